@@ -1,7 +1,38 @@
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
 #include <benchmark/benchmark.h>
 #include <spdlog/spdlog.h>
 #include <spdlog/sinks/null_sink.h>
 
+namespace {
+std::atomic<uint64_t> g_NumAllocations{0};
+}
+
+// Used for counting allocations in benchmarks.  operator new[]() and the
+// nothrow versions call this function.
+void* operator new(std::size_t size) {
+  g_NumAllocations.fetch_add(1, std::memory_order_relaxed);
+  if (auto* ptr = std::malloc(size == 0 ? 1 : size)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+  std::free(ptr);
+}
+
+uint64_t GetNumAllocations() {
+  return g_NumAllocations.load(std::memory_order_relaxed);
+}
+
 int main(int argc, char** argv) {
   spdlog::set_default_logger(spdlog::null_logger_st("null"));
   ::benchmark::Initialize(&argc, argv);
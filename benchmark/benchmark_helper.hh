@@ -0,0 +1,346 @@
+#pragma once
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <fmt/format.h>
+#include <tsduck/tsduck.h>
+
+#include "file.hh"
+#include "packet_sink.hh"
+#include "program_filter.hh"
+
+// Returns the number of calls to operator new() in this process.
+//
+// Defined in benchmark.cc.
+uint64_t GetNumAllocations();
+
+namespace {
+
+// Counts allocations in measured regions.  Call Resume() and Pause() where
+// benchmark::State::ResumeTiming() and PauseTiming() are called.
+class AllocationCounter final {
+ public:
+  AllocationCounter() {
+    Resume();
+  }
+
+  void Resume() {
+    start_ = GetNumAllocations();
+  }
+
+  void Pause() {
+    count_ += GetNumAllocations() - start_;
+  }
+
+  uint64_t count() const {
+    return count_;
+  }
+
+ private:
+  uint64_t start_ = 0;
+  uint64_t count_ = 0;
+};
+
+// Reports counters shared by component benchmarks: items/s, bytes/s and the
+// number of allocations per item.  An item is a packet for packet sinks.
+inline void SetCounters(benchmark::State& state, int64_t num_items,
+                        int64_t num_bytes, uint64_t num_allocations) {
+  state.SetItemsProcessed(num_items);
+  state.SetBytesProcessed(num_bytes);
+  state.counters["allocs/item"] = benchmark::Counter(
+      num_items > 0 ? static_cast<double>(num_allocations) / num_items : 0);
+}
+
+inline void SetPacketCounters(benchmark::State& state, int64_t num_packets,
+                              uint64_t num_allocations) {
+  SetCounters(state, num_packets, num_packets * ts::PKT_SIZE, num_allocations);
+}
+
+// Makes tables written in the XML format like TableSource in
+// test/test_helper.hh.  The PID of each table is specified with the
+// `test-pid` attribute.
+inline std::vector<std::unique_ptr<ts::BinaryTable>> MakeTables(
+    const std::string& xml) {
+  ts::DuckContext context;
+  ts::xml::Document doc(CERR);
+  doc.parse(ts::UString::FromUTF8(xml));
+
+  std::vector<std::unique_ptr<ts::BinaryTable>> tables;
+  const auto* root = doc.rootElement();
+  for (const auto* node = root->firstChildElement();
+       node != nullptr;
+       node = node->nextSiblingElement()) {
+    ts::PID pid;
+    node->getIntAttribute<ts::PID>(pid, u"test-pid", true, 0, 0x0000, 0x1FFF);
+
+    auto table = std::make_unique<ts::BinaryTable>();
+    table->fromXML(context, node);
+    table->setSourcePID(pid);
+    tables.push_back(std::move(table));
+  }
+  return tables;
+}
+
+// Makes packets of all sections in tables written in the XML format.
+inline std::vector<ts::TSPacket> MakeTablePackets(const std::string& xml) {
+  std::vector<ts::TSPacket> packets;
+  for (const auto& table : MakeTables(xml)) {
+    ts::CyclingPacketizer packetizer(table->sourcePID());
+    packetizer.addTable(*table);
+
+    ts::TSPacket packet;
+    do {
+      packetizer.getNextPacket(packet);
+      packets.push_back(packet);
+    } while (!packetizer.atCycleBoundary());
+  }
+  return packets;
+}
+
+// Makes a packet which has only PCR.
+inline ts::TSPacket MakePcrPacket(ts::PID pid, uint64_t pcr) {
+  ts::TSPacket packet = ts::NullPacket;
+  packet.setPID(pid);
+  packet.setPayloadSize(0);
+  packet.setPCR(pcr);
+  return packet;
+}
+
+// Makes a packet which has a payload filled with stuffing bytes.
+inline ts::TSPacket MakePesPacket(ts::PID pid) {
+  ts::TSPacket packet = ts::NullPacket;
+  packet.setPID(pid);
+  return packet;
+}
+
+// Renumbers continuity counters of packets so that the demux in each
+// component doesn't detect discontinuities.
+inline void FixContinuityCounters(std::vector<ts::TSPacket>* packets) {
+  std::map<ts::PID, uint8_t> counters;
+  for (auto& packet : *packets) {
+    auto& cc = counters[packet.getPID()];
+    packet.setCC(cc);
+    if (packet.hasPayload()) {
+      cc = (cc + 1) & 0x0F;
+    }
+  }
+}
+
+// Makes packets of a single service:
+//
+//   SID#0001 => PMT#0101
+//     PCR#0111
+//     PES/Video#0111
+//
+// followed by `num_pes_packets` packets for PID#0111.
+inline std::vector<ts::TSPacket> MakeServicePackets(size_t num_pes_packets) {
+  auto packets = MakeTablePackets(R"(
+    <?xml version="1.0" encoding="utf-8"?>
+    <tsduck>
+      <PAT version="1" current="true" transport_stream_id="0x1234"
+           test-pid="0x0000">
+        <service service_id="0x0001" program_map_PID="0x0101" />
+      </PAT>
+      <PMT version="1" current="true" service_id="0x0001" PCR_PID="0x0111"
+           test-pid="0x0101">
+        <component elementary_PID="0x0111" stream_type="0x02" />
+      </PMT>
+    </tsduck>
+  )");
+
+  for (size_t i = 0; i < num_pes_packets; ++i) {
+    packets.push_back(MakePesPacket(0x0111));
+  }
+  FixContinuityCounters(&packets);
+  return packets;
+}
+
+// An option of ProgramFilter used with packets made by
+// MakeProgramStartPackets() and MakeProgramStreamingPackets().
+const ProgramFilterOption kProgramFilterOption {
+  0x0001, 0x1001, 0x0901, 0, ts::Time(), {}, {}, 0, 0, false
+};
+
+// Makes packets which bring ProgramFilter to the streaming state like
+// ProgramFilterTest.WaitReady.
+inline std::vector<ts::TSPacket> MakeProgramStartPackets() {
+  auto packets = MakeTablePackets(R"(
+    <?xml version="1.0" encoding="utf-8"?>
+    <tsduck>
+      <PAT version="1" current="true" transport_stream_id="0x1234"
+           test-pid="0x0000">
+        <service service_id="0x0001" program_map_PID="0x0101" />
+      </PAT>
+      <PMT version="1" current="true" service_id="0x0001" PCR_PID="0x0901"
+           test-pid="0x0101">
+        <component elementary_PID="0x0301" stream_type="0x02" />
+        <component elementary_PID="0x0302" stream_type="0x0F" />
+      </PMT>
+      <EIT type="pf" version="1" current="true" actual="true"
+           service_id="0x0001" transport_stream_id="0x1234"
+           original_network_id="0x0001" last_table_id="0x4E"
+           test-pid="0x0012">
+        <event event_id="0x1001" start_time="1970-01-01 00:00:01"
+               duration="01:00:00" running_status="undefined" CA_mode="true" />
+      </EIT>
+    </tsduck>
+  )");
+  packets.push_back(MakePcrPacket(0x0901, 27000000));  // the start PCR
+  FixContinuityCounters(&packets);
+  return packets;
+}
+
+// Makes `num_packets` packets in the event following packets made by
+// MakeProgramStartPackets().  PAT and PMT are inserted every 100 packets and
+// PCR is inserted every 10 packets.
+inline std::vector<ts::TSPacket> MakeProgramStreamingPackets(
+    const std::vector<ts::TSPacket>& start_packets, size_t num_packets) {
+  std::vector<ts::TSPacket> packets;
+  for (size_t i = 0; i < num_packets; ++i) {
+    if (i % 100 == 0) {
+      packets.push_back(start_packets[0]);  // PAT
+      packets.push_back(start_packets[1]);  // PMT
+    } else if (i % 10 == 0) {
+      packets.push_back(MakePcrPacket(0x0901, 27000000 * 2));
+    } else if (i % 10 < 8) {
+      packets.push_back(MakePesPacket(0x0301));
+    } else {
+      packets.push_back(MakePesPacket(0x0302));
+    }
+  }
+  FixContinuityCounters(&packets);
+  return packets;
+}
+
+// Makes the payload of a short event descriptor as hex digits.  Strings are
+// encoded in ARIB STD-B24 and consist of level-1 kanji characters in the
+// default G0 set.
+inline std::string MakeShortEventPayloadHex(
+    size_t name_len, size_t text_len, size_t seed) {
+  auto make_string = [seed](size_t len) {
+    std::string hex;
+    for (size_t i = 0; i < len; ++i) {
+      auto row = 0x30 + (seed + i) % 0x1F;
+      auto cell = 0x21 + (seed * 7 + i) % 0x5E;
+      hex += fmt::format("{:02X}{:02X}", row, cell);
+    }
+    return hex;
+  };
+  return fmt::format(
+      "6A706E{:02X}{}{:02X}{}", name_len * 2, make_string(name_len),
+      text_len * 2, make_string(text_len));
+}
+
+// Makes an EIT schedule for SID#0001 in the XML format.
+//
+// Events start at 2021-01-01 00:00:00 and last 10 minutes.  So, each 3-hour
+// segment contains 18 events with short event descriptors.  `num_events` must
+// be less than 144 * 28.
+inline std::string MakeEitScheduleXml(size_t num_events) {
+  std::string events;
+  for (size_t i = 0; i < num_events; ++i) {
+    const auto min = i * 10;
+    events += fmt::format(
+        R"(<event event_id="{}" start_time="2021-01-{:02d} {:02d}:{:02d}:00")"
+        R"( duration="00:10:00" running_status="undefined" CA_mode="false">)"
+        R"(<generic_descriptor tag="0x4D">{}</generic_descriptor>)"
+        R"(</event>)",
+        i + 1, 1 + min / 1440, (min / 60) % 24, min % 60,
+        MakeShortEventPayloadHex(20, 80, i));
+  }
+  return fmt::format(R"(
+    <?xml version="1.0" encoding="utf-8"?>
+    <tsduck>
+      <EIT type="0" version="1" current="true" actual="true"
+           service_id="0x0001" transport_stream_id="0x0002"
+           original_network_id="0x0003" last_table_id="0x50"
+           test-pid="0x0012">
+        {}
+      </EIT>
+    </tsduck>
+  )", events);
+}
+
+// A sink which discards packets.
+class NullSink final : public PacketSink {
+ public:
+  NullSink() = default;
+  ~NullSink() override = default;
+
+  bool HandlePacket(const ts::TSPacket& packet) override {
+    count_ += packet.b[3] & 0x0F;  // prevent the call from being optimized out
+    return true;
+  }
+
+  size_t count() const {
+    return count_;
+  }
+
+ private:
+  size_t count_ = 0;
+};
+
+// A file created in a tmpfs in order to exclude the latency of the storage.
+//
+// The file is removed when the object is destroyed.
+class TmpfsFile final : public File {
+ public:
+  TmpfsFile() {
+    char path[] = "/dev/shm/mirakc-arib-benchmark-XXXXXX";
+    fd_ = mkstemp(path);
+    path_ = path;
+  }
+
+  ~TmpfsFile() override {
+    if (fd_ >= 0) {
+      close(fd_);
+      unlink(path_.c_str());
+    }
+  }
+
+  const std::string& path() const override {
+    return path_;
+  }
+
+  ssize_t Read(uint8_t* buf, size_t len) override {
+    return read(fd_, buf, len);
+  }
+
+  ssize_t Write(uint8_t* buf, size_t len) override {
+    return write(fd_, buf, len);
+  }
+
+  bool Sync() override {
+    return fsync(fd_) == 0;
+  }
+
+  bool Trunc(int64_t size) override {
+    return ftruncate(fd_, size) == 0;
+  }
+
+  int64_t Seek(int64_t offset, SeekMode mode) override {
+    switch (mode) {
+      case SeekMode::kSet:
+        return lseek(fd_, offset, SEEK_SET);
+      case SeekMode::kCur:
+        return lseek(fd_, offset, SEEK_CUR);
+      case SeekMode::kEnd:
+        return lseek(fd_, offset, SEEK_END);
+    }
+    return -1;
+  }
+
+ private:
+  std::string path_;
+  int fd_ = -1;
+};
+
+}  // namespace
@@ -0,0 +1,52 @@
+#include <memory>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "eit_collector.hh"
+#include "jsonl_sink.hh"
+
+#include "benchmark_helper.hh"
+
+namespace {
+
+constexpr size_t kNumEvents = 144;  // 24 hours
+
+// Collects a dense EIT schedule for a day.  A new collector is created for
+// each iteration because collected sections are skipped.
+//
+// The argument is the number of workers.
+void BM_EitCollector(benchmark::State& state) {
+  auto packets = MakeTablePackets(MakeEitScheduleXml(kNumEvents));
+  FixContinuityCounters(&packets);
+
+  EitCollectorOption option;
+  option.streaming = true;
+  option.num_workers = static_cast<size_t>(state.range(0));
+
+  std::unique_ptr<EitCollector> collector;
+  AllocationCounter allocs;
+  for (auto _ : state) {
+    state.PauseTiming();
+    allocs.Pause();
+    collector = std::make_unique<EitCollector>(option);
+    collector->Connect(std::make_unique<JsonlSink>());
+    allocs.Resume();
+    state.ResumeTiming();
+
+    collector->Start();
+    for (const auto& packet : packets) {
+      collector->HandlePacket(packet);
+    }
+    collector->End();  // waits for workers
+  }
+  allocs.Pause();
+
+  SetPacketCounters(
+      state, packets.size() * static_cast<int64_t>(state.iterations()),
+      allocs.count());
+}
+
+}  // namespace
+
+BENCHMARK(BM_EitCollector)->Arg(0)->Arg(4)->UseRealTime();
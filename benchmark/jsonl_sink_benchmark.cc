@@ -0,0 +1,54 @@
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+
+#include "jsonl_sink.hh"
+#include "tsduck_helper.hh"
+
+#include "benchmark_helper.hh"
+
+namespace {
+
+constexpr size_t kNumEvents = 144;  // 24 hours
+
+// Writes documents of EIT sections to STDOUT redirected to /dev/null.
+void BM_StdoutJsonlSink(benchmark::State& state) {
+  std::vector<rapidjson::Document> docs;
+  size_t num_bytes = 0;
+  for (const auto& table : MakeTables(MakeEitScheduleXml(kNumEvents))) {
+    for (size_t i = 0; i < table->sectionCount(); ++i) {
+      EitSection eit(*table->sectionAt(i));
+      docs.push_back(MakeJsonValue(eit));
+
+      rapidjson::StringBuffer buf;
+      rapidjson::Writer<rapidjson::StringBuffer> writer(buf);
+      docs.back().Accept(writer);
+      num_bytes += buf.GetSize() + 1;  // including a newline
+    }
+  }
+
+  std::ofstream null("/dev/null");
+  auto* rdbuf = std::cout.rdbuf(null.rdbuf());
+
+  StdoutJsonlSink sink;
+  AllocationCounter allocs;
+  for (auto _ : state) {
+    for (const auto& doc : docs) {
+      sink.HandleDocument(doc);
+    }
+  }
+  allocs.Pause();
+
+  std::cout.rdbuf(rdbuf);
+  const auto iterations = static_cast<int64_t>(state.iterations());
+  SetCounters(state, docs.size() * iterations, num_bytes * iterations,
+              allocs.count());
+}
+
+}  // namespace
+
+BENCHMARK(BM_StdoutJsonlSink);
@@ -0,0 +1,55 @@
+#include <cstdint>
+
+#include <benchmark/benchmark.h>
+#include <spdlog/spdlog.h>
+
+// Compiles this file like a build with MIRAKC_ARIB_LOG_LEVEL_FLOOR=debug so that
+// MIRAKC_ARIB_TRACE() is removed at compile time.
+#define MIRAKC_ARIB_LOG_LEVEL_FLOOR SPDLOG_LEVEL_DEBUG
+#include "logging.hh"
+
+namespace {
+
+// A trace message filtered out at runtime by the log level of the logger,
+// which is the cost of MIRAKC_ARIB_TRACE() in the default build.
+void BM_LogFilteredAtRuntime(benchmark::State& state) {
+  uint16_t pid = 0x0901;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(pid);
+    MIRAKC_ARIB_LOG(spdlog::level::trace,
+                    "PCR#{:04X} has no valid PCR...", pid);
+  }
+}
+
+// A trace message removed at compile time by MIRAKC_ARIB_LOG_LEVEL_FLOOR.
+void BM_LogRemovedAtCompileTime(benchmark::State& state) {
+  uint16_t pid = 0x0901;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(pid);
+    MIRAKC_ARIB_TRACE("PCR#{:04X} has no valid PCR...", pid);
+  }
+}
+
+void BM_Assert(benchmark::State& state) {
+  uint16_t pid = 0x0901;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(pid);
+    MIRAKC_ARIB_ASSERT(pid != 0x1FFF);
+  }
+}
+
+// Same as BM_Assert in the debug build.
+void BM_DebugAssert(benchmark::State& state) {
+  uint16_t pid = 0x0901;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(pid);
+    MIRAKC_ARIB_DASSERT(pid != 0x1FFF);
+  }
+}
+
+}  // namespace
+
+BENCHMARK(BM_LogFilteredAtRuntime);
+BENCHMARK(BM_LogRemovedAtCompileTime);
+BENCHMARK(BM_Assert);
+BENCHMARK(BM_DebugAssert);
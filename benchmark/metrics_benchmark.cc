@@ -0,0 +1,28 @@
+#include <benchmark/benchmark.h>
+
+#include "metrics.hh"
+
+namespace {
+
+// state.range(0): 0 = disabled, 1 = enabled
+void BM_MetricsCounter(benchmark::State& state) {
+  g_MetricsEnabled = state.range(0) != 0;
+  for (auto _ : state) {
+    MIRAKC_ARIB_METRICS_INC("benchmark.counter");
+  }
+  g_MetricsEnabled = false;
+}
+
+// state.range(0): 0 = disabled, 1 = enabled
+void BM_MetricsTimer(benchmark::State& state) {
+  g_MetricsEnabled = state.range(0) != 0;
+  for (auto _ : state) {
+    MIRAKC_ARIB_METRICS_TIMER("benchmark.timer");
+  }
+  g_MetricsEnabled = false;
+}
+
+}  // namespace
+
+BENCHMARK(BM_MetricsCounter)->Arg(0)->Arg(1);
+BENCHMARK(BM_MetricsTimer)->Arg(0)->Arg(1);
@@ -0,0 +1,90 @@
+#include <memory>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "jsonl_sink.hh"
+#include "pcr_synchronizer.hh"
+
+#include "benchmark_helper.hh"
+
+namespace {
+
+constexpr size_t kNumPesPackets = 10000;
+const PcrSynchronizerOption kOption {};
+
+// Makes packets of two services like PcrSynchronizerTest.  PCR packets come
+// after PES packets so that PcrSynchronizer processes all packets.
+std::vector<ts::TSPacket> MakePackets() {
+  auto packets = MakeTablePackets(R"(
+    <?xml version="1.0" encoding="utf-8"?>
+    <tsduck>
+      <PAT version="1" current="true" transport_stream_id="0x1234"
+           test-pid="0x0000">
+        <service service_id="0x0001" program_map_PID="0x0101" />
+        <service service_id="0x0002" program_map_PID="0x0102" />
+      </PAT>
+      <SDT version="1" current="true" actual="true" transport_stream_id="0x0003"
+           original_network_id="0x0002" test-pid="0x0011">
+        <service service_id="0x0001" EIT_schedule="false"
+                 EIT_present_following="true" CA_mode="false"
+                 running_status="undefined">
+          <service_descriptor service_type="0x01"
+                              service_provider_name="test"
+                              service_name="service-1" />
+        </service>
+        <service service_id="0x0002" EIT_schedule="false"
+                 EIT_present_following="true" CA_mode="false"
+                 running_status="undefined">
+          <service_descriptor service_type="0x01"
+                              service_provider_name="test"
+                              service_name="service-2" />
+        </service>
+      </SDT>
+      <PMT version="1" current="true" service_id="0x0001" PCR_PID="0x901"
+           test-pid="0x0101" />
+      <PMT version="1" current="true" service_id="0x0002" PCR_PID="0x902"
+           test-pid="0x0102" />
+      <TOT UTC_time="2019-01-02 03:04:05" test-pid="0x0014" />
+    </tsduck>
+  )");
+  for (size_t i = 0; i < kNumPesPackets; ++i) {
+    packets.push_back(MakePesPacket(i % 2 == 0 ? 0x0301 : 0x0302));
+  }
+  packets.push_back(MakePcrPacket(0x0901, 101));
+  packets.push_back(MakePcrPacket(0x0902, 201));
+  FixContinuityCounters(&packets);
+  return packets;
+}
+
+void BM_PcrSynchronizer(benchmark::State& state) {
+  const auto packets = MakePackets();
+
+  std::unique_ptr<PcrSynchronizer> sync;
+  AllocationCounter allocs;
+  for (auto _ : state) {
+    state.PauseTiming();
+    allocs.Pause();
+    sync = std::make_unique<PcrSynchronizer>(kOption);
+    sync->Connect(std::make_unique<JsonlSink>());
+    allocs.Resume();
+    state.ResumeTiming();
+
+    sync->Start();
+    for (const auto& packet : packets) {
+      if (!sync->HandlePacket(packet)) {
+        break;
+      }
+    }
+    sync->End();
+  }
+  allocs.Pause();
+
+  SetPacketCounters(
+      state, packets.size() * static_cast<int64_t>(state.iterations()),
+      allocs.count());
+}
+
+}  // namespace
+
+BENCHMARK(BM_PcrSynchronizer);
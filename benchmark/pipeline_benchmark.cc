@@ -0,0 +1,94 @@
+#include <memory>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "program_pipeline.hh"
+
+#include "benchmark_helper.hh"
+#include "stream_generator.hh"
+
+namespace {
+
+constexpr size_t kNumPackets = 10000;
+const ServiceFilterOption kServiceFilterOption { 0x0001 };
+
+// Feeds packets to the pipeline of `filter-program` made with
+// MakeProgramPipeline() like main.cc.
+template <typename Pipeline>
+void RunPipeline(benchmark::State& state, Pipeline& pipeline,
+                 const std::vector<ts::TSPacket>& start_packets,
+                 const std::vector<ts::TSPacket>& packets) {
+  pipeline.Start();
+  for (const auto& packet : start_packets) {
+    pipeline.HandlePacket(packet);
+  }
+
+  AllocationCounter allocs;
+  for (auto _ : state) {
+    for (const auto& packet : packets) {
+      pipeline.HandlePacket(packet);
+    }
+  }
+  allocs.Pause();
+
+  pipeline.End();
+  SetPacketCounters(
+      state, packets.size() * static_cast<int64_t>(state.iterations()),
+      allocs.count());
+}
+
+// The virtual chain used until the pipeline was composed statically.
+void BM_PipelineVirtual(benchmark::State& state) {
+  const auto start_packets = MakeProgramStartPackets();
+  const auto packets = MakeProgramStreamingPackets(start_packets, kNumPackets);
+  auto pipeline = MakeProgramPipeline<NullSink, ProgramFilter, ServiceFilter>(
+      kServiceFilterOption, kProgramFilterOption, std::make_unique<NullSink>());
+  RunPipeline(state, *pipeline, start_packets, packets);
+}
+
+// The static chain used in main.cc.
+void BM_PipelineStatic(benchmark::State& state) {
+  const auto start_packets = MakeProgramStartPackets();
+  const auto packets = MakeProgramStreamingPackets(start_packets, kNumPackets);
+  auto pipeline = MakeProgramPipeline(
+      kServiceFilterOption, kProgramFilterOption, std::make_unique<NullSink>());
+  RunPipeline(state, *pipeline, start_packets, packets);
+}
+
+// The static chain fed with a synthetic multiplex of three services at
+// `state.range(0)` Mbps.  90% of the bitrate is used for video streams.
+//
+// The first event of the first service starts at the beginning of the stream,
+// so ProgramFilter streams packets after it receives PMT and EIT p/f.
+void BM_PipelineMultiplex(benchmark::State& state) {
+  StreamGeneratorOption gen_option;
+  gen_option.mux_bitrate = static_cast<uint64_t>(state.range(0)) * 1000000;
+  gen_option.video_bitrate = gen_option.mux_bitrate * 9 / 10 / gen_option.num_services;
+  StreamGenerator generator(gen_option);
+
+  std::vector<ts::TSPacket> packets;
+  ts::TSPacket generated;
+  while (generator.Next(&generated)) {
+    packets.push_back(generated);
+  }
+
+  const ServiceFilterOption service_filter_option { StreamGenerator::kBaseSid };
+  ProgramFilterOption program_filter_option;
+  program_filter_option.sid = StreamGenerator::kBaseSid;
+  program_filter_option.eid = 1;
+  program_filter_option.clock_pid = 0x0100;  // the video PID of the service
+  program_filter_option.clock_pcr = 0;
+  program_filter_option.clock_time = ts::Time(2021, 1, 1, 0, 0, 0);
+
+  auto pipeline = MakeProgramPipeline(
+      service_filter_option, program_filter_option,
+      std::make_unique<NullSink>());
+  RunPipeline(state, *pipeline, {}, packets);
+}
+
+}  // namespace
+
+BENCHMARK(BM_PipelineVirtual);
+BENCHMARK(BM_PipelineStatic);
+BENCHMARK(BM_PipelineMultiplex)->Arg(30)->Arg(60);
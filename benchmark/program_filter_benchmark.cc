@@ -0,0 +1,41 @@
+#include <memory>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "program_filter.hh"
+
+#include "benchmark_helper.hh"
+
+namespace {
+
+constexpr size_t kNumPackets = 10000;
+
+void BM_ProgramFilter(benchmark::State& state) {
+  auto start_packets = MakeProgramStartPackets();
+  auto packets = MakeProgramStreamingPackets(start_packets, kNumPackets);
+
+  BasicProgramFilter<NullSink> filter(kProgramFilterOption);
+  filter.Connect(std::make_unique<NullSink>());
+  filter.Start();
+  for (const auto& packet : start_packets) {
+    filter.HandlePacket(packet);
+  }
+
+  AllocationCounter allocs;
+  for (auto _ : state) {
+    for (const auto& packet : packets) {
+      filter.HandlePacket(packet);
+    }
+  }
+  allocs.Pause();
+
+  filter.End();
+  SetPacketCounters(
+      state, packets.size() * static_cast<int64_t>(state.iterations()),
+      allocs.count());
+}
+
+}  // namespace
+
+BENCHMARK(BM_ProgramFilter);
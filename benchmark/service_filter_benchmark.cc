@@ -0,0 +1,80 @@
+#include <memory>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <fmt/format.h>
+
+#include "service_filter.hh"
+
+#include "benchmark_helper.hh"
+
+namespace {
+
+constexpr size_t kNumVersions = 32;
+constexpr size_t kNumPesPacketsPerVersion = 100;
+const ServiceFilterOption kOption { 0x0001 };
+
+// Makes packets in which PAT and PMT are updated every 100 PES packets.  A
+// quarter of PES packets belong to another service and are dropped.
+std::vector<ts::TSPacket> MakePsiChurnPackets() {
+  std::vector<ts::TSPacket> packets;
+  for (size_t version = 0; version < kNumVersions; ++version) {
+    auto tables = MakeTablePackets(fmt::format(R"(
+      <?xml version="1.0" encoding="utf-8"?>
+      <tsduck>
+        <PAT version="{0}" current="true" transport_stream_id="0x1234"
+             test-pid="0x0000">
+          <service service_id="0x0001" program_map_PID="0x0101" />
+          <service service_id="0x0002" program_map_PID="0x0102" />
+        </PAT>
+        <PMT version="{0}" current="true" service_id="0x0001" PCR_PID="0x0111"
+             test-pid="0x0101">
+          <component elementary_PID="0x0111" stream_type="0x02" />
+          <component elementary_PID="0x0112" stream_type="0x0F" />
+        </PMT>
+      </tsduck>
+    )", version));
+    packets.insert(packets.end(), tables.begin(), tables.end());
+
+    for (size_t i = 0; i < kNumPesPacketsPerVersion; ++i) {
+      switch (i % 4) {
+        case 0:
+          packets.push_back(MakePesPacket(0x0211));  // another service
+          break;
+        case 1:
+          packets.push_back(MakePesPacket(0x0112));
+          break;
+        default:
+          packets.push_back(MakePesPacket(0x0111));
+          break;
+      }
+    }
+  }
+  FixContinuityCounters(&packets);
+  return packets;
+}
+
+void BM_ServiceFilter(benchmark::State& state) {
+  const auto packets = MakePsiChurnPackets();
+
+  BasicServiceFilter<NullSink> filter(kOption);
+  filter.Connect(std::make_unique<NullSink>());
+  filter.Start();
+
+  AllocationCounter allocs;
+  for (auto _ : state) {
+    for (const auto& packet : packets) {
+      filter.HandlePacket(packet);
+    }
+  }
+  allocs.Pause();
+
+  filter.End();
+  SetPacketCounters(
+      state, packets.size() * static_cast<int64_t>(state.iterations()),
+      allocs.count());
+}
+
+}  // namespace
+
+BENCHMARK(BM_ServiceFilter);
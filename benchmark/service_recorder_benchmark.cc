@@ -0,0 +1,96 @@
+#include <memory>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "jsonl_sink.hh"
+#include "ring_file_sink.hh"
+#include "service_recorder.hh"
+
+#include "benchmark_helper.hh"
+
+namespace {
+
+constexpr size_t kNumPackets = 10000;
+constexpr size_t kChunkSize = RingFileSink::kBufferSize * 16;
+constexpr size_t kNumChunks = 4;
+const ServiceRecorderOption kOption { "", 3, kChunkSize, kNumChunks };
+
+// Makes packets which bring ServiceRecorder to the recording state like
+// ServiceRecorderTest.EventStart.
+std::vector<ts::TSPacket> MakeStartPackets() {
+  auto packets = MakeTablePackets(R"(
+    <?xml version="1.0" encoding="utf-8"?>
+    <tsduck>
+      <PAT version="1" current="true" transport_stream_id="0x0002"
+           test-pid="0x0000">
+        <service service_id="0x0003" program_map_PID="0x0101" />
+      </PAT>
+      <PMT version="1" current="true" service_id="0x0003" PCR_PID="0x901"
+           test-pid="0x0101">
+        <component elementary_PID="0x0301" stream_type="0x02" />
+      </PMT>
+      <TOT UTC_time="2021-01-01 00:00:00" test-pid="0x0014" />
+    </tsduck>
+  )");
+  packets.push_back(MakePcrPacket(0x0901, 0));
+  auto eit = MakeTablePackets(R"(
+    <?xml version="1.0" encoding="utf-8"?>
+    <tsduck>
+      <EIT type="pf" version="1" current="true" actual="true"
+           service_id="0x0003" transport_stream_id="0x0002"
+           original_network_id="0x0001" last_table_id="0x4E"
+           test-pid="0x0012">
+        <event event_id="5" start_time="2021-01-01 00:00:00"
+               duration="01:00:00" running_status="undefined" CA_mode="true" />
+      </EIT>
+    </tsduck>
+  )");
+  packets.insert(packets.end(), eit.begin(), eit.end());
+  packets.push_back(MakePesPacket(0x0301));
+  FixContinuityCounters(&packets);
+  return packets;
+}
+
+// Records a service into a ring buffer file in tmpfs.  PCR is inserted every
+// 10 packets.
+void BM_ServiceRecorder(benchmark::State& state) {
+  const auto start_packets = MakeStartPackets();
+
+  std::vector<ts::TSPacket> packets;
+  for (size_t i = 0; i < kNumPackets; ++i) {
+    if (i % 10 == 0) {
+      packets.push_back(MakePcrPacket(0x0901, i * 2700));  // 100us/packet
+    } else {
+      packets.push_back(MakePesPacket(0x0301));
+    }
+  }
+  FixContinuityCounters(&packets);
+
+  auto ring = std::make_unique<RingFileSink>(
+      std::make_unique<TmpfsFile>(), kChunkSize, kNumChunks);
+  BasicServiceRecorder<RingFileSink> recorder(kOption);
+  recorder.BasicServiceRecorder<RingFileSink>::Connect(std::move(ring));
+  recorder.JsonlSource::Connect(std::make_unique<JsonlSink>());
+  recorder.Start();
+  for (const auto& packet : start_packets) {
+    recorder.HandlePacket(packet);
+  }
+
+  AllocationCounter allocs;
+  for (auto _ : state) {
+    for (const auto& packet : packets) {
+      recorder.HandlePacket(packet);
+    }
+  }
+  allocs.Pause();
+
+  recorder.End();
+  SetPacketCounters(
+      state, packets.size() * static_cast<int64_t>(state.iterations()),
+      allocs.count());
+}
+
+}  // namespace
+
+BENCHMARK(BM_ServiceRecorder);
@@ -0,0 +1,73 @@
+#include <memory>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "start_seeker.hh"
+
+#include "benchmark_helper.hh"
+
+namespace {
+
+constexpr size_t kNumPackets = 10000;
+const StartSeekerOption kOption { 0x0001, 500, 0 };  // 500ms
+
+// Makes packets for 1 second.  StartSeeker keeps the first half and then
+// streams the rest.
+std::vector<ts::TSPacket> MakePackets() {
+  auto packets = MakeTablePackets(R"(
+    <?xml version="1.0" encoding="utf-8"?>
+    <tsduck>
+      <PAT version="1" current="true" transport_stream_id="0x1234"
+           test-pid="0x0000">
+        <service service_id="0x0001" program_map_PID="0x0101" />
+      </PAT>
+      <PMT version="1" current="true" service_id="0x0001" PCR_PID="0x0901"
+           test-pid="0x0101">
+        <component elementary_PID="0x0301" stream_type="0x02" />
+        <component elementary_PID="0x0302" stream_type="0x0F" />
+      </PMT>
+    </tsduck>
+  )");
+  for (size_t i = 0; i < kNumPackets; ++i) {
+    if (i % 10 == 0) {
+      packets.push_back(MakePcrPacket(0x0901, i * 2700));  // 100us/packet
+    } else if (i % 10 < 8) {
+      packets.push_back(MakePesPacket(0x0301));
+    } else {
+      packets.push_back(MakePesPacket(0x0302));
+    }
+  }
+  FixContinuityCounters(&packets);
+  return packets;
+}
+
+void BM_StartSeeker(benchmark::State& state) {
+  const auto packets = MakePackets();
+
+  std::unique_ptr<StartSeeker> seeker;
+  AllocationCounter allocs;
+  for (auto _ : state) {
+    state.PauseTiming();
+    allocs.Pause();
+    seeker = std::make_unique<StartSeeker>(kOption);
+    seeker->Connect(std::make_unique<NullSink>());
+    allocs.Resume();
+    state.ResumeTiming();
+
+    seeker->Start();
+    for (const auto& packet : packets) {
+      seeker->HandlePacket(packet);
+    }
+    seeker->End();
+  }
+  allocs.Pause();
+
+  SetPacketCounters(
+      state, packets.size() * static_cast<int64_t>(state.iterations()),
+      allocs.count());
+}
+
+}  // namespace
+
+BENCHMARK(BM_StartSeeker);
@@ -0,0 +1,93 @@
+// Measures phases performed from main() to the first packet processed.
+//
+// Some phases initialize process-wide state only once.  They are measured in
+// a single iteration, and this program is built as an executable separated
+// from mirakc-arib-benchmark so that other benchmarks never warm them up.
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <docopt/docopt.h>
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/null_sink.h>
+#include <tsduck/tsduck.h>
+
+#include "logging.hh"
+#include "logo_collector.hh"
+#include "usage.hh"
+
+namespace {
+
+void BM_Startup_Docopt(benchmark::State& state) {
+  const std::vector<std::string> argv { "track-airtime", "--sid=1", "--eid=2" };
+  for (auto _ : state) {
+    auto args = docopt::docopt(kUsage, argv, false, "");
+    benchmark::DoNotOptimize(args);
+  }
+}
+
+void BM_Startup_InitLogger(benchmark::State& state) {
+  auto default_logger = spdlog::default_logger();
+  size_t n = 0;
+  for (auto _ : state) {
+    auto name = fmt::format("startup-benchmark-{}", n++);
+    InitLogger(name);
+    state.PauseTiming();
+    spdlog::drop(name);
+    state.ResumeTiming();
+  }
+  spdlog::set_default_logger(default_logger);
+}
+
+// One-shot.
+void BM_Startup_EnableARIBMode(benchmark::State& state) {
+  for (auto _ : state) {
+    ts::DVBCharset::EnableARIBMode();
+  }
+}
+
+// One-shot.  Tables are registered to tsduck by static initializers before
+// main() is called, but the first table deserialized in a process still pays
+// for setting up the context and the registry lookup.
+void BM_Startup_FirstTable(benchmark::State& state) {
+  ts::BinaryTable table;
+  {
+    ts::DuckContext context;
+    ts::PAT pat(1, true, 0x0001);
+    pat.pmts[0x0001] = 0x0101;
+    pat.serialize(context, table);
+  }
+  for (auto _ : state) {
+    ts::DuckContext context;
+    ts::PAT pat(context, table);
+    benchmark::DoNotOptimize(pat);
+  }
+}
+
+void BM_Startup_LogoCollectorStart(benchmark::State& state) {
+  for (auto _ : state) {
+    LogoCollector collector;
+    collector.Start();
+    collector.End();
+  }
+}
+
+}  // namespace
+
+BENCHMARK(BM_Startup_Docopt);
+BENCHMARK(BM_Startup_InitLogger);
+BENCHMARK(BM_Startup_EnableARIBMode)->Iterations(1);
+BENCHMARK(BM_Startup_FirstTable)->Iterations(1);
+BENCHMARK(BM_Startup_LogoCollectorStart);
+
+int main(int argc, char** argv) {
+  spdlog::set_default_logger(spdlog::null_logger_st("null"));
+  ::benchmark::Initialize(&argc, argv);
+  if (::benchmark::ReportUnrecognizedArguments(argc, argv))
+    return 1;
+  ::benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
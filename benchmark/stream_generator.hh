@@ -0,0 +1,741 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <tsduck/tsduck.h>
+
+#include "base.hh"
+
+namespace {
+
+// Options of StreamGenerator.
+//
+// The default values make a stream like a terrestrial multiplex with three
+// HD services.  Increase `mux_bitrate` and `video_bitrate` in order to make a
+// stream like a BS/CS multiplex.
+struct StreamGeneratorOption final {
+  // The same seed always makes the same stream.
+  uint64_t seed = 0;
+  // 1..16 services.
+  size_t num_services = 3;
+  // The length of the stream in the stream time.
+  ts::MilliSecond duration = 10 * ts::MilliSecPerSec;
+  // The bitrate of the whole stream including null packets.  When the total
+  // bitrate of elementary streams and tables exceeds it, packets are delayed
+  // and the effective bitrate of each stream decreases.
+  uint64_t mux_bitrate = 32000000;
+  // The bitrate of each elementary stream.
+  uint64_t video_bitrate = 8000000;
+  uint64_t audio_bitrate = 256000;
+  // PCR is carried by video packets at this interval.
+  ts::MilliSecond pcr_interval = 40;
+  // The length of EIT schedule from the start of the day (up to 96 hours).
+  size_t schedule_hours = 24;
+  // Sends CDT containing a logo for each service.
+  bool logos = true;
+  // The probability that a continuity counter of a PES packet is skipped.
+  double discontinuity_rate = 0.0;
+  // Sends a packet having a broken sync byte at this interval.  Zero disables
+  // it.
+  ts::MilliSecond sync_loss_interval = 0;
+};
+
+// Makes a synthetic ARIB TS for benchmarks and load tests.
+//
+// The stream contains the following PIDs:
+//
+//   PAT#0000, CAT#0001, NIT#0010, SDT#0011, EIT#0012, TOT#0014, CDT#0029
+//   PMT#1000 + i
+//   Video#0100 + 0x10 * i (PCR)
+//   Audio#0101 + 0x10 * i
+//
+// where `i` is the index of a service whose SID is 0x0400 + i.  Names of
+// services and events are random Japanese strings encoded in ARIB STD-B24.
+//
+// Packets are scheduled on the stream time which advances by the duration of
+// a packet at `mux_bitrate`.  Each PID sends packets at its own interval, and
+// null packets fill the gaps.  Payloads of PES packets are pseudo random bytes
+// and can't be decoded.
+//
+// Only the stream time is used.  So, this class makes packets as fast as
+// possible.
+class StreamGenerator final {
+ public:
+  static constexpr uint16_t kNid = 0x7FE0;
+  static constexpr uint16_t kTsid = 0x7FE0;
+  static constexpr uint16_t kBaseSid = 0x0400;
+  static constexpr size_t kMaxServices = 16;
+  // 2021-01-01 00:00:00 UTC in seconds since the Unix epoch.
+  //
+  // Times in the stream are encoded from this value without the timezone
+  // offset.  So, TOT and EIT read 2021-01-01 00:00:00 as JST.
+  static constexpr int64_t kStartTime = 1609459200;
+
+  explicit StreamGenerator(const StreamGeneratorOption& option)
+      : option_(option),
+        rng_(option.seed) {
+    MakeServices();
+    MakeStreams();
+
+    packet_duration_ = static_cast<double>(ts::PKT_SIZE * 8) *
+        kPcrTicksPerSec / option_.mux_bitrate;
+    end_time_ = MilliSecToClock(option_.duration);
+    if (option_.sync_loss_interval > 0) {
+      sync_loss_interval_ = MilliSecToClock(option_.sync_loss_interval);
+      next_sync_loss_time_ = sync_loss_interval_;
+    }
+  }
+
+  ~StreamGenerator() = default;
+
+  // Makes the next packet.  Returns false at the end of the stream.
+  bool Next(ts::TSPacket* packet) {
+    if (now_ >= end_time_) {
+      return false;
+    }
+
+    if (sync_loss_interval_ > 0 && now_ >= next_sync_loss_time_) {
+      MakeBrokenPacket(packet);
+      next_sync_loss_time_ += sync_loss_interval_;
+    } else {
+      Stream* stream = nullptr;
+      for (auto& candidate : streams_) {
+        if (candidate->next_time() > now_) {
+          continue;
+        }
+        if (stream == nullptr || candidate->next_time() < stream->next_time()) {
+          stream = candidate.get();
+        }
+      }
+      if (stream != nullptr) {
+        stream->MakePacket(now_, packet);
+      } else {
+        *packet = ts::NullPacket;
+      }
+    }
+
+    now_ += packet_duration_;
+    return true;
+  }
+
+  // The number of packets made so far.
+  uint64_t num_packets() const {
+    return static_cast<uint64_t>(now_ / packet_duration_ + 0.5);
+  }
+
+ private:
+  using Bytes = std::vector<uint8_t>;
+
+  struct Event final {
+    uint16_t eid;
+    int64_t start_time;  // JST
+    int64_t duration;  // seconds
+    Bytes name;  // ARIB STD-B24
+    Bytes text;  // ARIB STD-B24
+  };
+
+  struct Service final {
+    uint16_t sid;
+    ts::PID pmt_pid;
+    ts::PID video_pid;
+    ts::PID audio_pid;
+    Bytes name;  // ARIB STD-B24
+    std::vector<Event> events;
+    Bytes logo;
+  };
+
+  // A PID which sends packets at a fixed interval.
+  class Stream {
+   public:
+    Stream(ts::PID pid, double interval) : pid_(pid), interval_(interval) {}
+    virtual ~Stream() = default;
+
+    double next_time() const {
+      return next_time_;
+    }
+
+    void MakePacket(double now, ts::TSPacket* packet) {
+      DoMakePacket(now, packet);
+      next_time_ += interval_;
+    }
+
+   protected:
+    virtual void DoMakePacket(double now, ts::TSPacket* packet) = 0;
+
+    void SetInterval(double interval) {
+      interval_ = interval;
+    }
+
+    void WriteHeader(bool pusi, bool adaptation_field, ts::TSPacket* packet) {
+      packet->b[0] = ts::SYNC_BYTE;
+      packet->b[1] = (pusi ? 0x40 : 0x00) | ((pid_ >> 8) & 0x1F);
+      packet->b[2] = pid_ & 0xFF;
+      packet->b[3] = (adaptation_field ? 0x30 : 0x10) | cc_;
+      cc_ = (cc_ + 1) & 0x0F;
+    }
+
+    void SkipContinuityCounter() {
+      cc_ = (cc_ + 1) & 0x0F;
+    }
+
+   private:
+    const ts::PID pid_;
+    double interval_;
+    double next_time_ = 0;
+    uint8_t cc_ = 0;
+  };
+
+  // Sends sections made by `maker` repeatedly.  The maker is called at the
+  // beginning of each cycle so that tables like TOT can change.  Packets of a
+  // cycle are spread over `cycle` evenly.
+  class SectionStream final : public Stream {
+   public:
+    using SectionMaker = std::function<std::vector<Bytes>(double now)>;
+
+    SectionStream(ts::PID pid, double cycle, SectionMaker maker)
+        : Stream(pid, cycle), cycle_(cycle), maker_(maker) {}
+    ~SectionStream() override = default;
+
+   protected:
+    void DoMakePacket(double now, ts::TSPacket* packet) override {
+      if (index_ >= sections_.size()) {
+        sections_ = maker_(now);
+        index_ = 0;
+        offset_ = 0;
+        size_t num_packets = 0;
+        for (const auto& section : sections_) {
+          num_packets += (section.size() + 1 + ts::PKT_SIZE - 5) / (ts::PKT_SIZE - 4);
+        }
+        SetInterval(cycle_ / num_packets);
+      }
+
+      const auto& section = sections_[index_];
+      const bool pusi = offset_ == 0;
+      WriteHeader(pusi, false, packet);
+      size_t pos = 4;
+      if (pusi) {
+        packet->b[pos++] = 0;  // pointer_field
+      }
+      const auto size = std::min(ts::PKT_SIZE - pos, section.size() - offset_);
+      std::memcpy(packet->b + pos, section.data() + offset_, size);
+      std::memset(packet->b + pos + size, 0xFF, ts::PKT_SIZE - pos - size);
+
+      offset_ += size;
+      if (offset_ == section.size()) {
+        ++index_;
+        offset_ = 0;
+      }
+    }
+
+   private:
+    const double cycle_;
+    SectionMaker maker_;
+    std::vector<Bytes> sections_;
+    size_t index_ = 0;
+    size_t offset_ = 0;
+  };
+
+  // Sends PES packets at `bitrate`.  A PES starts at every `frame` in the
+  // stream time.
+  class PesStream final : public Stream {
+   public:
+    PesStream(ts::PID pid, uint8_t stream_id, uint64_t bitrate, double frame,
+              double pcr_interval, double discontinuity_rate,
+              std::mt19937_64* rng, const Bytes* payload_pool)
+        : Stream(pid, static_cast<double>(ts::PKT_SIZE * 8) *
+                 kPcrTicksPerSec / bitrate),
+          stream_id_(stream_id),
+          frame_(frame),
+          pcr_interval_(pcr_interval),
+          discontinuity_rate_(discontinuity_rate),
+          rng_(rng),
+          payload_pool_(payload_pool) {}
+    ~PesStream() override = default;
+
+   protected:
+    void DoMakePacket(double now, ts::TSPacket* packet) override {
+      if (discontinuity_rate_ > 0 && dist_(*rng_) < discontinuity_rate_) {
+        SkipContinuityCounter();
+      }
+
+      const bool pcr = pcr_interval_ > 0 && now >= next_pcr_time_;
+      const bool pusi = now >= next_frame_time_;
+      WriteHeader(pusi, pcr, packet);
+      size_t pos = 4;
+
+      if (pcr) {
+        const auto value = static_cast<int64_t>(now) % kPcrUpperBound;
+        const auto base = value / kMaxPcrExt;
+        const auto ext = value % kMaxPcrExt;
+        packet->b[pos++] = 7;  // adaptation_field_length
+        packet->b[pos++] = 0x10;  // PCR_flag
+        packet->b[pos++] = static_cast<uint8_t>(base >> 25);
+        packet->b[pos++] = static_cast<uint8_t>(base >> 17);
+        packet->b[pos++] = static_cast<uint8_t>(base >> 9);
+        packet->b[pos++] = static_cast<uint8_t>(base >> 1);
+        packet->b[pos++] =
+            static_cast<uint8_t>(((base & 1) << 7) | 0x7E | (ext >> 8));
+        packet->b[pos++] = static_cast<uint8_t>(ext);
+        next_pcr_time_ += pcr_interval_;
+      }
+
+      if (pusi) {
+        // Presented 300ms later.
+        const auto pts = static_cast<uint64_t>(
+            (now + kPcrTicksPerSec * 3 / 10) / kMaxPcrExt) & 0x1FFFFFFFF;
+        packet->b[pos++] = 0x00;
+        packet->b[pos++] = 0x00;
+        packet->b[pos++] = 0x01;
+        packet->b[pos++] = stream_id_;
+        packet->b[pos++] = 0x00;  // PES_packet_length (unbounded)
+        packet->b[pos++] = 0x00;
+        packet->b[pos++] = 0x80;
+        packet->b[pos++] = 0x80;  // PTS only
+        packet->b[pos++] = 5;  // PES_header_data_length
+        packet->b[pos++] = static_cast<uint8_t>(0x21 | ((pts >> 29) & 0x0E));
+        packet->b[pos++] = static_cast<uint8_t>(pts >> 22);
+        packet->b[pos++] = static_cast<uint8_t>(((pts >> 14) & 0xFE) | 0x01);
+        packet->b[pos++] = static_cast<uint8_t>(pts >> 7);
+        packet->b[pos++] = static_cast<uint8_t>(((pts << 1) & 0xFE) | 0x01);
+        while (next_frame_time_ <= now) {
+          next_frame_time_ += frame_;
+        }
+      }
+
+      // Take bytes from a pool of random bytes rather than calling the RNG for
+      // each byte.  Making a stream must be much faster than processing it.
+      const auto size = ts::PKT_SIZE - pos;
+      if (pool_pos_ + size > payload_pool_->size()) {
+        pool_pos_ = (*rng_)() % (payload_pool_->size() - ts::PKT_SIZE);
+      }
+      std::memcpy(packet->b + pos, payload_pool_->data() + pool_pos_, size);
+      pool_pos_ += size;
+    }
+
+   private:
+    const uint8_t stream_id_;
+    const double frame_;
+    const double pcr_interval_;
+    const double discontinuity_rate_;
+    std::mt19937_64* rng_;
+    const Bytes* payload_pool_;
+    std::uniform_real_distribution<double> dist_;
+    double next_frame_time_ = 0;
+    double next_pcr_time_ = 0;
+    size_t pool_pos_ = 0;
+  };
+
+  static constexpr size_t kPayloadPoolSize = 64 * 1024;
+
+  static double MilliSecToClock(ts::MilliSecond ms) {
+    return static_cast<double>(ms) * kPcrTicksPerMs;
+  }
+
+  int64_t GetJstTime(double now) const {
+    return kStartTime + static_cast<int64_t>(now / kPcrTicksPerSec);
+  }
+
+  size_t RandomInt(size_t min, size_t max) {
+    return std::uniform_int_distribution<size_t>(min, max)(rng_);
+  }
+
+  // Makes a random string which consists of hiragana and level-1 kanji
+  // characters in the default G0 set of ARIB STD-B24.
+  Bytes MakeJapaneseString(size_t min_len, size_t max_len) {
+    Bytes str;
+    const auto len = RandomInt(min_len, max_len);
+    for (size_t i = 0; i < len; ++i) {
+      if (RandomInt(0, 9) < 7) {
+        str.push_back(0x24);  // hiragana
+        str.push_back(static_cast<uint8_t>(RandomInt(0x21, 0x73)));
+      } else {
+        str.push_back(static_cast<uint8_t>(RandomInt(0x30, 0x4E)));
+        str.push_back(static_cast<uint8_t>(RandomInt(0x21, 0x7E)));
+      }
+    }
+    return str;
+  }
+
+  void MakeServices() {
+    const auto num_services = std::min(option_.num_services, kMaxServices);
+    const auto schedule_end =
+        kStartTime + static_cast<int64_t>(std::min<size_t>(option_.schedule_hours, 96)) * 3600;
+
+    for (size_t i = 0; i < num_services; ++i) {
+      Service service;
+      service.sid = static_cast<uint16_t>(kBaseSid + i);
+      service.pmt_pid = static_cast<ts::PID>(0x1000 + i);
+      service.video_pid = static_cast<ts::PID>(0x0100 + 0x10 * i);
+      service.audio_pid = static_cast<ts::PID>(0x0101 + 0x10 * i);
+      service.name = MakeJapaneseString(4, 10);
+
+      uint16_t eid = 1;
+      for (auto time = kStartTime; time < schedule_end; ) {
+        Event event;
+        event.eid = eid++;
+        event.start_time = time;
+        event.duration = static_cast<int64_t>(RandomInt(1, 4)) * 15 * 60;
+        event.name = MakeJapaneseString(8, 20);
+        event.text = MakeJapaneseString(20, 80);
+        time += event.duration;
+        service.events.push_back(std::move(event));
+      }
+
+      if (option_.logos) {
+        // A PNG signature followed by random bytes.
+        static const uint8_t kPngSignature[] = {
+          0x89, 0x50, 0x4E, 0x47, 0x0D, 0x0A, 0x1A, 0x0A,
+        };
+        service.logo.assign(std::begin(kPngSignature), std::end(kPngSignature));
+        const auto size = RandomInt(200, 700);
+        for (size_t j = 0; j < size; ++j) {
+          service.logo.push_back(static_cast<uint8_t>(rng_()));
+        }
+      }
+
+      services_.push_back(std::move(service));
+    }
+
+    payload_pool_.resize(kPayloadPoolSize);
+    for (auto& byte : payload_pool_) {
+      byte = static_cast<uint8_t>(rng_());
+    }
+  }
+
+  void MakeStreams() {
+    AddSectionStream(ts::PID_PAT, 100, [this](double) {
+      return std::vector<Bytes> { MakePat() };
+    });
+    AddSectionStream(ts::PID_CAT, 1000, [this](double) {
+      return std::vector<Bytes> { MakeCat() };
+    });
+    AddSectionStream(ts::PID_NIT, 10000, [this](double) {
+      return std::vector<Bytes> { MakeNit() };
+    });
+    AddSectionStream(ts::PID_SDT, 2000, [this](double) {
+      return std::vector<Bytes> { MakeSdt() };
+    });
+    AddSectionStream(ts::PID_TOT, 5000, [this](double now) {
+      return std::vector<Bytes> { MakeTot(GetJstTime(now)) };
+    });
+    // EIT p/f and EIT schedule share the PID.  EIT p/f is inserted several
+    // times in a cycle of EIT schedule so that it's sent more often.
+    AddSectionStream(ts::PID_EIT, 10000, [this](double now) {
+      constexpr size_t kNumPfRepeats = 5;
+      const auto pf = MakeEitPf(GetJstTime(now));
+      const auto schedule = MakeEitSchedule();
+      std::vector<Bytes> sections;
+      for (size_t i = 0; i < kNumPfRepeats; ++i) {
+        sections.insert(sections.end(), pf.begin(), pf.end());
+        sections.insert(
+            sections.end(),
+            schedule.begin() + schedule.size() * i / kNumPfRepeats,
+            schedule.begin() + schedule.size() * (i + 1) / kNumPfRepeats);
+      }
+      return sections;
+    });
+    if (option_.logos) {
+      AddSectionStream(ts::PID_CDT, 10000, [this](double) {
+        return MakeCdt();
+      });
+    }
+
+    for (const auto& service : services_) {
+      AddSectionStream(service.pmt_pid, 100, [this, &service](double) {
+        return std::vector<Bytes> { MakePmt(service) };
+      });
+      streams_.push_back(std::make_unique<PesStream>(
+          service.video_pid, 0xE0, option_.video_bitrate,
+          kPcrTicksPerSec / 30.0, MilliSecToClock(option_.pcr_interval),
+          option_.discontinuity_rate, &rng_, &payload_pool_));
+      streams_.push_back(std::make_unique<PesStream>(
+          service.audio_pid, 0xC0, option_.audio_bitrate,
+          kPcrTicksPerSec * 1024.0 / 48000, 0,
+          option_.discontinuity_rate, &rng_, &payload_pool_));
+    }
+  }
+
+  void AddSectionStream(ts::PID pid, ts::MilliSecond cycle,
+                        SectionStream::SectionMaker maker) {
+    streams_.push_back(std::make_unique<SectionStream>(
+        pid, MilliSecToClock(cycle), maker));
+  }
+
+  static void PutUInt16(Bytes* bytes, uint16_t value) {
+    bytes->push_back(static_cast<uint8_t>(value >> 8));
+    bytes->push_back(static_cast<uint8_t>(value));
+  }
+
+  static uint8_t ToBcd(int64_t value) {
+    return static_cast<uint8_t>(((value / 10) << 4) | (value % 10));
+  }
+
+  // MJD + BCD encoded time.
+  static void PutTime(Bytes* bytes, int64_t time) {
+    PutUInt16(bytes, static_cast<uint16_t>(40587 + time / 86400));
+    PutDuration(bytes, time % 86400);
+  }
+
+  static void PutDuration(Bytes* bytes, int64_t duration) {
+    bytes->push_back(ToBcd(duration / 3600));
+    bytes->push_back(ToBcd((duration / 60) % 60));
+    bytes->push_back(ToBcd(duration % 60));
+  }
+
+  // Puts a descriptor loop length with 4 reserved bits followed by
+  // descriptors.
+  static void PutDescriptors(Bytes* bytes, const Bytes& descs) {
+    PutUInt16(bytes, static_cast<uint16_t>(0xF000 | descs.size()));
+    bytes->insert(bytes->end(), descs.begin(), descs.end());
+  }
+
+  static void PutCrc32(Bytes* section) {
+    const auto crc = ts::CRC32(section->data(), section->size()).value();
+    PutUInt16(section, static_cast<uint16_t>(crc >> 16));
+    PutUInt16(section, static_cast<uint16_t>(crc));
+  }
+
+  // `psi` is true for tables defined in ISO/IEC 13818-1 whose
+  // private_indicator is '0'.
+  static Bytes MakeLongSection(uint8_t tid, uint16_t tid_ext, uint8_t number,
+                               uint8_t last_number, const Bytes& body,
+                               bool psi = false) {
+    Bytes section;
+    const auto length = 5 + body.size() + 4;
+    section.push_back(tid);
+    PutUInt16(&section, static_cast<uint16_t>((psi ? 0xB000 : 0xF000) | length));
+    PutUInt16(&section, tid_ext);
+    section.push_back(0xC1 | (kVersion << 1));  // current_next_indicator
+    section.push_back(number);
+    section.push_back(last_number);
+    section.insert(section.end(), body.begin(), body.end());
+    PutCrc32(&section);
+    return section;
+  }
+
+  Bytes MakePat() const {
+    Bytes body;
+    PutUInt16(&body, 0);  // NIT
+    PutUInt16(&body, 0xE000 | ts::PID_NIT);
+    for (const auto& service : services_) {
+      PutUInt16(&body, service.sid);
+      PutUInt16(&body, 0xE000 | service.pmt_pid);
+    }
+    return MakeLongSection(ts::TID_PAT, kTsid, 0, 0, body, true);
+  }
+
+  Bytes MakeCat() const {
+    Bytes body {
+      ts::DID_CA, 4,
+      0x00, 0x05,  // CA_system_id
+      0xE0 | (kEmmPid >> 8), kEmmPid & 0xFF,
+    };
+    return MakeLongSection(ts::TID_CAT, 0xFFFF, 0, 0, body, true);
+  }
+
+  Bytes MakePmt(const Service& service) const {
+    Bytes body;
+    PutUInt16(&body, 0xE000 | service.video_pid);  // PCR_PID
+    PutDescriptors(&body, {});
+    body.push_back(ts::ST_MPEG2_VIDEO);
+    PutUInt16(&body, 0xE000 | service.video_pid);
+    PutDescriptors(&body, { ts::DID_STREAM_ID, 1, 0x00 });
+    body.push_back(ts::ST_AAC_AUDIO);
+    PutUInt16(&body, 0xE000 | service.audio_pid);
+    PutDescriptors(&body, { ts::DID_STREAM_ID, 1, 0x10 });
+    return MakeLongSection(ts::TID_PMT, service.sid, 0, 0, body, true);
+  }
+
+  Bytes MakeNit() const {
+    static const Bytes kNetworkName { 0x4E, 0x45, 0x54 };  // "NET"
+
+    Bytes network_descs { ts::DID_NETWORK_NAME,
+                          static_cast<uint8_t>(kNetworkName.size()) };
+    network_descs.insert(network_descs.end(), kNetworkName.begin(), kNetworkName.end());
+
+    Bytes service_list { ts::DID_SERVICE_LIST,
+                         static_cast<uint8_t>(3 * services_.size()) };
+    for (const auto& service : services_) {
+      PutUInt16(&service_list, service.sid);
+      service_list.push_back(0x01);  // digital TV service
+    }
+
+    Bytes ts_loop;
+    PutUInt16(&ts_loop, kTsid);
+    PutUInt16(&ts_loop, kNid);  // original_network_id
+    PutDescriptors(&ts_loop, service_list);
+
+    Bytes body;
+    PutDescriptors(&body, network_descs);
+    PutDescriptors(&body, ts_loop);  // transport_stream_loop_length
+    return MakeLongSection(ts::TID_NIT_ACT, kNid, 0, 0, body);
+  }
+
+  Bytes MakeSdt() const {
+    Bytes body;
+    PutUInt16(&body, kNid);  // original_network_id
+    body.push_back(0xFF);
+    for (const auto& service : services_) {
+      Bytes descs {
+        ts::DID_SERVICE, static_cast<uint8_t>(3 + service.name.size()),
+        0x01,  // digital TV service
+        0,  // service_provider_name_length
+        static_cast<uint8_t>(service.name.size()),
+      };
+      descs.insert(descs.end(), service.name.begin(), service.name.end());
+      if (option_.logos) {
+        const auto logo_id = static_cast<uint16_t>(service.sid - kBaseSid);
+        descs.push_back(ts::DID_ARIB_LOGO_TRANSMISSION);
+        descs.push_back(7);
+        descs.push_back(0x01);  // CDT transmission type 1
+        PutUInt16(&descs, 0xFE00 | logo_id);
+        PutUInt16(&descs, 0xF000 | kVersion);  // logo_version
+        PutUInt16(&descs, kDownloadDataId);
+      }
+
+      PutUInt16(&body, service.sid);
+      body.push_back(0xFF);  // EIT_schedule_flag and EIT_present_following_flag
+      // running_status = running, free_CA_mode = 0
+      PutUInt16(&body, static_cast<uint16_t>(0x8000 | descs.size()));
+      body.insert(body.end(), descs.begin(), descs.end());
+    }
+    return MakeLongSection(ts::TID_SDT_ACT, kTsid, 0, 0, body);
+  }
+
+  static Bytes MakeTot(int64_t time) {
+    Bytes body;
+    PutTime(&body, time);
+    PutDescriptors(&body, {});
+
+    Bytes section;
+    section.push_back(ts::TID_TOT);
+    PutUInt16(&section, static_cast<uint16_t>(0x7000 | (body.size() + 4)));
+    section.insert(section.end(), body.begin(), body.end());
+    PutCrc32(&section);
+    return section;
+  }
+
+  static void PutEvent(Bytes* bytes, const Event& event) {
+    Bytes desc { ts::DID_SHORT_EVENT,
+                 static_cast<uint8_t>(5 + event.name.size() + event.text.size()),
+                 0x6A, 0x70, 0x6E };  // "jpn"
+    desc.push_back(static_cast<uint8_t>(event.name.size()));
+    desc.insert(desc.end(), event.name.begin(), event.name.end());
+    desc.push_back(static_cast<uint8_t>(event.text.size()));
+    desc.insert(desc.end(), event.text.begin(), event.text.end());
+
+    PutUInt16(bytes, event.eid);
+    PutTime(bytes, event.start_time);
+    PutDuration(bytes, event.duration);
+    // running_status = undefined, free_CA_mode = 0
+    PutUInt16(bytes, static_cast<uint16_t>(desc.size()));
+    bytes->insert(bytes->end(), desc.begin(), desc.end());
+  }
+
+  static Bytes MakeEitBody(uint8_t segment_last_section_number,
+                           uint8_t last_table_id) {
+    Bytes body;
+    PutUInt16(&body, kTsid);
+    PutUInt16(&body, kNid);  // original_network_id
+    body.push_back(segment_last_section_number);
+    body.push_back(last_table_id);
+    return body;
+  }
+
+  std::vector<Bytes> MakeEitPf(int64_t time) const {
+    std::vector<Bytes> sections;
+    for (const auto& service : services_) {
+      for (uint8_t number = 0; number < 2; ++number) {
+        auto body = MakeEitBody(1, ts::TID_EIT_PF_ACT);
+        for (size_t i = 0; i < service.events.size(); ++i) {
+          const auto& event = service.events[i];
+          if (time < event.start_time + event.duration) {
+            if (i + number < service.events.size()) {
+              PutEvent(&body, service.events[i + number]);
+            }
+            break;
+          }
+        }
+        sections.push_back(MakeLongSection(
+            ts::TID_EIT_PF_ACT, service.sid, number, 1, body));
+      }
+    }
+    return sections;
+  }
+
+  // Each 3-hour segment is sent in a single section.
+  std::vector<Bytes> MakeEitSchedule() const {
+    constexpr int64_t kSegmentDuration = 3 * 3600;
+    const auto num_segments = std::max<size_t>(
+        1, (std::min<size_t>(option_.schedule_hours, 96) + 2) / 3);
+    const auto last_number = static_cast<uint8_t>((num_segments - 1) * 8);
+
+    std::vector<Bytes> sections;
+    for (const auto& service : services_) {
+      auto it = service.events.begin();
+      for (size_t segment = 0; segment < num_segments; ++segment) {
+        const auto number = static_cast<uint8_t>(segment * 8);
+        const auto end =
+            kStartTime + static_cast<int64_t>(segment + 1) * kSegmentDuration;
+        auto body = MakeEitBody(number, ts::TID_EIT_S_ACT_MIN);
+        for (; it != service.events.end() && it->start_time < end; ++it) {
+          PutEvent(&body, *it);
+        }
+        sections.push_back(MakeLongSection(
+            ts::TID_EIT_S_ACT_MIN, service.sid, number, last_number, body));
+      }
+    }
+    return sections;
+  }
+
+  // Each logo is sent in a single section.
+  std::vector<Bytes> MakeCdt() const {
+    std::vector<Bytes> sections;
+    const auto last_number = static_cast<uint8_t>(services_.size() - 1);
+    for (size_t i = 0; i < services_.size(); ++i) {
+      const auto& logo = services_[i].logo;
+      Bytes body;
+      PutUInt16(&body, kNid);  // original_network_id
+      body.push_back(0x01);  // data_type = logo
+      PutDescriptors(&body, {});
+      body.push_back(0x05);  // logo_type = HD large
+      PutUInt16(&body, static_cast<uint16_t>(0xFE00 | i));  // logo_id
+      PutUInt16(&body, 0xF000 | kVersion);  // logo_version
+      PutUInt16(&body, static_cast<uint16_t>(logo.size()));
+      body.insert(body.end(), logo.begin(), logo.end());
+      sections.push_back(MakeLongSection(
+          kTidCdt, kDownloadDataId, static_cast<uint8_t>(i), last_number, body));
+    }
+    return sections;
+  }
+
+  void MakeBrokenPacket(ts::TSPacket* packet) {
+    *packet = ts::NullPacket;
+    packet->b[0] = static_cast<uint8_t>(RandomInt(0x00, 0x46));
+  }
+
+  static constexpr uint8_t kTidCdt = 0xC8;
+  static constexpr uint8_t kVersion = 1;
+  static constexpr ts::PID kEmmPid = 0x0901;
+  static constexpr uint16_t kDownloadDataId = 0x0001;
+
+  const StreamGeneratorOption option_;
+  std::mt19937_64 rng_;
+  std::vector<Service> services_;
+  std::vector<std::unique_ptr<Stream>> streams_;
+  Bytes payload_pool_;
+  double packet_duration_ = 0;
+  double end_time_ = 0;
+  double now_ = 0;
+  double sync_loss_interval_ = 0;
+  double next_sync_loss_time_ = 0;
+
+  MIRAKC_ARIB_NON_COPYABLE(StreamGenerator);
+};
+
+}  // namespace
@@ -0,0 +1,132 @@
+// Writes a synthetic ARIB TS made by StreamGenerator to STDOUT.
+//
+//   $ mirakc-arib-stream-generator --duration=60000 --mux-bitrate=60000000 | \
+//       mirakc-arib collect-eits
+
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <docopt/docopt.h>
+#include <fmt/format.h>
+#include <tsduck/tsduck.h>
+
+#include "stream_generator.hh"
+
+namespace {
+
+const std::string kUsage = R"(
+Synthetic ARIB TS stream generator
+
+Usage:
+  mirakc-arib-stream-generator (-h | --help)
+  mirakc-arib-stream-generator [--seed=<seed>] [--services=<num>]
+    [--duration=<ms>] [--mux-bitrate=<bps>]
+    [--video-bitrate=<bps>] [--audio-bitrate=<bps>] [--pcr-interval=<ms>]
+    [--schedule-hours=<hours>] [--no-logos]
+    [--discontinuity-rate=<rate>] [--sync-loss-interval=<ms>]
+
+Options:
+  -h --help
+    Print help.
+
+  --seed=<seed>  [default: 0]
+    The seed of the random number generator.  The same seed and options always
+    make the same stream.
+
+  --services=<num>  [default: 3]
+    The number of services (1..16).
+
+  --duration=<ms>  [default: 10000]
+    The length of the stream in milliseconds.
+
+  --mux-bitrate=<bps>  [default: 32000000]
+    The bitrate of the whole stream including null packets.
+
+  --video-bitrate=<bps>  [default: 8000000]
+    The bitrate of the video stream of each service.
+
+  --audio-bitrate=<bps>  [default: 256000]
+    The bitrate of the audio stream of each service.
+
+  --pcr-interval=<ms>  [default: 40]
+    The interval of PCR carried by video packets.
+
+  --schedule-hours=<hours>  [default: 24]
+    The length of EIT schedule (up to 96 hours).
+
+  --no-logos
+    Don't send CDT.
+
+  --discontinuity-rate=<rate>  [default: 0]
+    The probability that a continuity counter of a PES packet is skipped.
+
+  --sync-loss-interval=<ms>  [default: 0]
+    Send a packet having a broken sync byte at this interval.  Zero disables
+    it.
+)";
+
+constexpr size_t kNumBufferedPackets = 1024;
+
+[[noreturn]] void Abort(const std::string& message) {
+  std::fprintf(stderr, "%s\n", message.c_str());
+  std::exit(EXIT_FAILURE);
+}
+
+uint64_t GetUInt(const std::map<std::string, docopt::value>& args,
+                 const std::string& name) {
+  auto value = args.at(name).asLong();
+  if (value < 0) {
+    Abort(fmt::format("{}: must be zero or a positive integer", name));
+  }
+  return static_cast<uint64_t>(value);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  auto args = docopt::docopt(kUsage, { argv + 1, argv + argc }, true, "");
+
+  StreamGeneratorOption option;
+  option.seed = GetUInt(args, "--seed");
+  option.num_services = GetUInt(args, "--services");
+  option.duration = static_cast<ts::MilliSecond>(GetUInt(args, "--duration"));
+  option.mux_bitrate = GetUInt(args, "--mux-bitrate");
+  option.video_bitrate = GetUInt(args, "--video-bitrate");
+  option.audio_bitrate = GetUInt(args, "--audio-bitrate");
+  option.pcr_interval = static_cast<ts::MilliSecond>(GetUInt(args, "--pcr-interval"));
+  option.schedule_hours = GetUInt(args, "--schedule-hours");
+  option.logos = !args.at("--no-logos").asBool();
+  option.discontinuity_rate = std::stod(args.at("--discontinuity-rate").asString());
+  option.sync_loss_interval =
+      static_cast<ts::MilliSecond>(GetUInt(args, "--sync-loss-interval"));
+
+  if (option.num_services < 1 || option.num_services > StreamGenerator::kMaxServices) {
+    Abort(fmt::format("--services: must be 1..{}", StreamGenerator::kMaxServices));
+  }
+  if (option.mux_bitrate == 0 || option.video_bitrate == 0 || option.audio_bitrate == 0) {
+    Abort("bitrates must be positive");
+  }
+  if (option.discontinuity_rate < 0.0 || option.discontinuity_rate > 1.0) {
+    Abort("--discontinuity-rate: must be 0..1");
+  }
+
+  StreamGenerator generator(option);
+  std::vector<ts::TSPacket> packets(kNumBufferedPackets);
+  for (;;) {
+    size_t n = 0;
+    while (n < packets.size() && generator.Next(&packets[n])) {
+      ++n;
+    }
+    if (n == 0) {
+      break;
+    }
+    if (std::fwrite(packets.data(), ts::PKT_SIZE, n, stdout) != n) {
+      return EXIT_FAILURE;  // broken pipe
+    }
+  }
+  std::fflush(stdout);
+  return EXIT_SUCCESS;
+}
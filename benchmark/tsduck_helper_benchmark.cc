@@ -0,0 +1,108 @@
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <rapidjson/document.h>
+
+#include "tsduck_helper.hh"
+
+#include "benchmark_helper.hh"
+
+namespace {
+
+constexpr size_t kNumEvents = 144;  // 24 hours
+
+// Keeps the tables which own the data referred from EitSection objects.
+struct EitSections {
+  std::vector<std::unique_ptr<ts::BinaryTable>> tables;
+  std::vector<EitSection> sections;
+};
+
+EitSections MakeEitSections() {
+  EitSections eits;
+  eits.tables = MakeTables(MakeEitScheduleXml(kNumEvents));
+  for (const auto& table : eits.tables) {
+    for (size_t i = 0; i < table->sectionCount(); ++i) {
+      eits.sections.emplace_back(*table->sectionAt(i));
+    }
+  }
+  return eits;
+}
+
+void BM_MakeEventsJsonValue(benchmark::State& state) {
+  const auto eits = MakeEitSections();
+
+  size_t num_events = 0;
+  size_t num_bytes = 0;
+  for (const auto& eit : eits.sections) {
+    rapidjson::Document doc;
+    num_events += MakeEventsJsonValue(eit, doc.GetAllocator()).Size();
+    num_bytes += eit.events_size;
+  }
+
+  AllocationCounter allocs;
+  for (auto _ : state) {
+    for (const auto& eit : eits.sections) {
+      rapidjson::Document doc;
+      auto events = MakeEventsJsonValue(eit, doc.GetAllocator());
+      benchmark::DoNotOptimize(events);
+    }
+  }
+  allocs.Pause();
+
+  const auto iterations = static_cast<int64_t>(state.iterations());
+  SetCounters(state, num_events * iterations, num_bytes * iterations,
+              allocs.count());
+}
+
+// Decodes the event name and the text in short event descriptors.
+void BM_DecodeAribString(benchmark::State& state) {
+  const auto eits = MakeEitSections();
+
+  std::vector<LibISDB::ARIBString> strs;
+  size_t num_bytes = 0;
+  for (const auto& eit : eits.sections) {
+    const auto* data = eit.events_data;
+    auto remain = eit.events_size;
+    for (;;) {
+      auto size = GetEitEventSize(data, remain);
+      if (size == 0) {
+        break;
+      }
+      LibISDB::DescriptorBlock desc_block;
+      desc_block.ParseBlock(data + EitSection::EIT_EVENT_FIXED_SIZE,
+                            size - EitSection::EIT_EVENT_FIXED_SIZE);
+      const auto* desc = desc_block.GetDescriptor<LibISDB::ShortEventDescriptor>();
+      if (desc != nullptr) {
+        LibISDB::ARIBString str;
+        if (desc->GetEventName(&str)) {
+          num_bytes += str.size();
+          strs.push_back(std::move(str));
+        }
+        if (desc->GetEventDescription(&str)) {
+          num_bytes += str.size();
+          strs.push_back(std::move(str));
+        }
+      }
+      data += size;
+      remain -= size;
+    }
+  }
+
+  AllocationCounter allocs;
+  for (auto _ : state) {
+    for (const auto& str : strs) {
+      auto utf8 = DecodeAribString(str);
+      benchmark::DoNotOptimize(utf8);
+    }
+  }
+  allocs.Pause();
+
+  const auto iterations = static_cast<int64_t>(state.iterations());
+  SetCounters(state, strs.size() * iterations, num_bytes * iterations,
+              allocs.count());
+}
+
+}  // namespace
+
+BENCHMARK(BM_MakeEventsJsonValue);
+BENCHMARK(BM_DecodeAribString);
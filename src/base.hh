@@ -93,13 +93,7 @@ class ClockBaseline final {
 
   int64_t TimeToPcr(const ts::Time& time) const {
     MIRAKC_ARIB_ASSERT(IsReady());
-    auto ms = time - time_;  // may be a negative value
-    auto pcr = pcr_ + ms * kPcrTicksPerMs;
-    while (pcr < 0) {
-      pcr += kPcrUpperBound;
-    }
-    MIRAKC_ARIB_ASSERT(pcr >= 0);
-    return pcr % kPcrUpperBound;
+    return ConvertTimeToPcr(time, time_, pcr_);
   }
 
   bool HasPid() const {
@@ -165,6 +159,12 @@ class Clock final {
     return ready_ && baseline_.IsReady();
   }
 
+  // The last PCR value.
+  int64_t pcr() const {
+    MIRAKC_ARIB_ASSERT(IsReady());
+    return last_pcr_;
+  }
+
   ts::Time Now() const {
     if (IsReady()) {
       auto last_pcr = last_pcr_;
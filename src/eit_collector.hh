@@ -1,8 +1,12 @@
 #pragma once
 
+#include <atomic>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <sstream>
+#include <string>
+#include <vector>
 
 #include <LibISDB/LibISDB.hpp>
 #include <LibISDB/EPG/EventInfo.hpp>
@@ -13,9 +17,14 @@
 #include <tsduck/tsduck.h>
 
 #include "base.hh"
+#include "eit_event_differ.hh"
+#include "eit_snapshot.hh"
 #include "jsonl_source.hh"
 #include "logging.hh"
+#include "metrics.hh"
+#include "ordered_worker_pool.hh"
 #include "packet_source.hh"
+#include "probes.hh"
 #include "tsduck_helper.hh"
 
 namespace {
@@ -25,6 +34,9 @@ struct EitCollectorOption final {
   SidSet xsids;
   ts::MilliSecond time_limit = 30 * ts::MilliSecPerSec;  // 30s
   bool streaming = false;
+  size_t num_workers = 0;  // 0 means that sections are encoded inline.
+  std::string state_file;
+  bool diff = false;
 };
 
 class TableProgress {
@@ -421,14 +433,47 @@ class CollectProgress {
   MIRAKC_ARIB_NON_COPYABLE(CollectProgress);
 };
 
+// State shared by EitCollector instances which collect EIT sections from
+// different TS streams in parallel.
+//
+// A section collected from a stream is skipped in other streams.  BS/CS
+// transponders carry EIT sections of all services in the same network, so most
+// of them are collected only from the first stream where they appear.
+//
+// The progress status depends on the current time.  So, streams must be
+// recorded at the same time.  A stream whose first TOT differs from the first
+// TOT of the other streams by more than kMaxTimeDifference is rejected.
+struct EitCollectorSharedState final {
+  static constexpr ts::MilliSecond kMaxTimeDifference = 5 * ts::MilliSecPerMin;
+
+  std::mutex mutex;
+  CollectProgress progress;  // guarded by mutex
+  EitSnapshot snapshot;  // guarded by mutex
+  EitEventDiffer differ;  // guarded by mutex
+  size_t num_unchanged = 0;  // guarded by mutex
+  size_t num_collectors = 0;  // guarded by mutex
+  size_t num_streams = 0;  // guarded by mutex
+  bool snapshot_loaded = false;  // guarded by mutex
+  bool has_reference_time = false;  // guarded by mutex
+  ts::Time reference_time;  // guarded by mutex, JST
+  std::atomic<bool> completed{false};
+};
+
 class EitCollector final : public PacketSink,
                            public JsonlSource,
                            public ts::SectionHandlerInterface,
                            public ts::TableHandlerInterface {
  public:
-  explicit EitCollector(const EitCollectorOption& option)
+  static constexpr size_t kMaxPendingJobsPerWorker = 16;
+
+  using Documents = std::vector<rapidjson::Document>;
+
+  explicit EitCollector(const EitCollectorOption& option,
+                        std::shared_ptr<EitCollectorSharedState> state =
+                            std::make_shared<EitCollectorSharedState>())
       : option_(option),
-        demux_(context_) {
+        demux_(context_),
+        state_(std::move(state)) {
     if (spdlog::default_logger()->should_log(spdlog::level::trace)) {
       EnableShowProgress();
     }
@@ -437,28 +482,58 @@ class EitCollector final : public PacketSink,
     demux_.setTableHandler(this);
     demux_.addPID(ts::PID_EIT);
     demux_.addPID(ts::PID_TOT);
+
+    if (option_.num_workers > 0) {
+      pool_ = std::make_unique<OrderedWorkerPool<Documents>>(
+          option_.num_workers, option_.num_workers * kMaxPendingJobsPerWorker);
+      MIRAKC_ARIB_INFO("Encode EIT sections with {} workers",
+                       option_.num_workers);
+    }
+
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    state_->num_collectors++;
+    state_->num_streams++;
   }
 
   ~EitCollector() override {}
 
   bool Start() override {
     start_time_ = ts::Time::CurrentUTC();
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    if (!option_.state_file.empty() && !state_->snapshot_loaded) {
+      state_->snapshot.Load(
+          option_.state_file, option_.diff ? &state_->differ : nullptr);
+      state_->snapshot_loaded = true;
+    }
     return true;
   }
 
   bool End() override {
+    FlushDocuments(true);
     auto elapse = ts::Time::CurrentUTC() - start_time_;
     auto min = elapse / ts::MilliSecPerMin;
     auto sec = (elapse - min * ts::MilliSecPerMin) / ts::MilliSecPerSec;
     auto ms = elapse % ts::MilliSecPerSec;
+    std::lock_guard<std::mutex> lock(state_->mutex);
     MIRAKC_ARIB_INFO(
-        "Collected {} services, {} sections, {}:{:02d}.{:03d} elapsed",
-        progress_.CountServices(), progress_.CountSections(), min, sec, ms);
+        "Collected {} services, {} sections ({} unchanged), {}:{:02d}.{:03d} elapsed",
+        state_->progress.CountServices(), state_->progress.CountSections(),
+        state_->num_unchanged, min, sec, ms);
+    // Save the snapshot when the last collector ends.
+    MIRAKC_ARIB_ASSERT(state_->num_collectors > 0);
+    state_->num_collectors--;
+    if (!option_.state_file.empty() && state_->num_collectors == 0) {
+      SaveSnapshot();
+    }
     return IsCompleted();
   }
 
   bool HandlePacket(const ts::TSPacket& packet) override {
     demux_.feedPacket(packet);
+    FlushDocuments(false);
+    if (rejected_) {
+      return false;
+    }
     if (IsCompleted()) {
       MIRAKC_ARIB_INFO("Completed");
       return false;
@@ -472,9 +547,14 @@ class EitCollector final : public PacketSink,
 
  private:
   void handleSection(ts::SectionDemux&, const ts::Section& section) override {
+    MIRAKC_ARIB_METRICS_INC("eit_collector.sections");
     if (!section.isValid()) {
+      MIRAKC_ARIB_METRICS_INC("eit_collector.invalid_sections");
       return;
     }
+    MIRAKC_ARIB_PROBE3(eit_collector_section,
+                       section.tableId(), section.tableIdExtension(),
+                       section.sectionNumber());
 
     const auto tid = section.tableId();
     if (tid < ts::TID_EIT_MIN || tid > ts::TID_EIT_MAX) {
@@ -503,19 +583,63 @@ class EitCollector final : public PacketSink,
           "Ignore SID#{:04X} according to the exclusion list", eit.sid);
       return;
     }
-    if (CheckCollected(eit)) {
+
+    if (rejected_) {
       return;
     }
 
-    MIRAKC_ARIB_INFO(
-        "EIT: onid({:04X}) tsid({:04X}) sid({:04X}) tid({:04X}/{:02X})"
-        " sec({:02X}:{:02X}/{:02X}) ver({:02d})",
-        eit.nid, eit.tsid, eit.sid, eit.tid, eit.last_table_id,
-        eit.section_number, eit.segment_last_section_number,
-        eit.last_section_number, eit.version);
+    {
+      std::lock_guard<std::mutex> lock(state_->mutex);
 
+      // Sections in a stream cannot be used for the progress status shared
+      // with other streams until the time of the stream is checked.
+      if (!has_timestamp_ && state_->num_streams > 1) {
+        return;
+      }
+
+      if (CheckCollected(eit)) {
+        return;
+      }
+
+      if (state_->snapshot.Contains(eit)) {
+        // The section has not been changed since the previous run.  Update
+        // only the progress status.
+        MIRAKC_ARIB_DEBUG(
+            "Unchanged EIT: onid({:04X}) tsid({:04X}) sid({:04X}) tid({:04X})"
+            " sec({:02X}) ver({:02d})",
+            eit.nid, eit.tsid, eit.sid, eit.tid, eit.section_number,
+            eit.version);
+        state_->num_unchanged++;
+        if (option_.diff) {
+          // Changes have been output in a previous run.  Keep the events for
+          // computing changes in later versions of the section.
+          state_->differ.Update(eit);
+        }
+        UpdateProgress(eit);
+        return;
+      }
+
+      MIRAKC_ARIB_INFO(
+          "EIT: onid({:04X}) tsid({:04X}) sid({:04X}) tid({:04X}/{:02X})"
+          " sec({:02X}:{:02X}/{:02X}) ver({:02d})",
+          eit.nid, eit.tsid, eit.sid, eit.tid, eit.last_table_id,
+          eit.section_number, eit.segment_last_section_number,
+          eit.last_section_number, eit.version);
+
+      if (option_.diff) {
+        // Output changes while holding the lock.  Otherwise, changes in the
+        // same section computed by collectors running on other threads may be
+        // output out of order.
+        auto changes = state_->differ.Update(eit);
+        UpdateProgress(eit);
+        FeedDocuments(MakeEventChangeDocuments(eit, changes));
+        return;
+      }
+      UpdateProgress(eit);
+    }
+
+    // Encode the section outside the lock.
     WriteEitSection(eit);
-    UpdateProgress(eit);
   }
 
   void handleTable(ts::SectionDemux&, const ts::BinaryTable& table) override {
@@ -557,9 +681,32 @@ class EitCollector final : public PacketSink,
   }
 
   inline void HandleTime(const ts::Time& time) {
-    timestamp_ = time;
+    if (rejected_) {
+      return;
+    }
+
+    std::lock_guard<std::mutex> lock(state_->mutex);
 
-    progress_.UpdateUnused(timestamp_);
+    if (!has_timestamp_) {
+      if (!state_->has_reference_time) {
+        state_->reference_time = time;
+        state_->has_reference_time = true;
+      }
+      auto diff = time - state_->reference_time;
+      if (diff < 0) {
+        diff = -diff;
+      }
+      if (diff > EitCollectorSharedState::kMaxTimeDifference) {
+        MIRAKC_ARIB_ERROR(
+            "TOT differs from other streams by {}s, reject the stream",
+            diff / ts::MilliSecPerSec);
+        rejected_ = true;
+        return;
+      }
+    }
+
+    timestamp_ = time;
+    state_->progress.UpdateUnused(timestamp_);
 
     if (!has_timestamp_) {
       last_updated_ = timestamp_;
@@ -567,27 +714,92 @@ class EitCollector final : public PacketSink,
     }
   }
 
+  // Must be called with state_->mutex locked.
   inline bool CheckCollected(const EitSection& eit) const {
-    return progress_.CheckCollected(eit);
+    return state_->progress.CheckCollected(eit);
   }
 
   void WriteEitSection(const EitSection& eit) {
-    FeedDocument(MakeJsonValue(eit));
+    if (!pool_) {
+      FeedDocuments(EncodeEitSection(eit));
+      return;
+    }
+
+    if (pool_->IsFull()) {
+      Documents docs;
+      pool_->Pop(&docs, true);
+      FeedDocuments(docs);
+    }
+
+    // `eit.events_data` points to a buffer owned by the demux.  Copy the data
+    // so that a worker can decode it after the buffer is reused.
+    std::vector<uint8_t> events(
+        eit.events_data, eit.events_data + eit.events_size);
+    pool_->Submit([eit, events = std::move(events)]() {
+      auto copy = eit;
+      copy.events_data = events.data();
+      return EncodeEitSection(copy);
+    });
+  }
+
+  static Documents EncodeEitSection(const EitSection& eit) {
+    Documents docs;
+    docs.push_back(MakeJsonValue(eit));
+    return docs;
   }
 
+  void FeedDocuments(const Documents& docs) {
+    for (const auto& doc : docs) {
+      FeedDocument(doc);
+    }
+  }
+
+  // Outputs encoded sections in the order of submission.
+  //
+  // Blocks until all pending sections have been encoded if `wait` is true.
+  void FlushDocuments(bool wait) {
+    if (!pool_) {
+      return;
+    }
+    Documents docs;
+    while (pool_->Pop(&docs, wait)) {
+      FeedDocuments(docs);
+    }
+  }
+
+  // Must be called with state_->mutex locked.
   void UpdateProgress(const EitSection& eit) {
     last_updated_ = timestamp_;
-    progress_.Update(eit);
+    state_->progress.Update(eit);
+    state_->completed = state_->progress.IsCompleted();
+    if (!option_.state_file.empty()) {
+      state_->snapshot.Update(eit);
+    }
     if (show_progress_) {
-      progress_.Show();
+      state_->progress.Show();
+    }
+  }
+
+  // Must be called with state_->mutex locked.
+  void SaveSnapshot() {
+    // A partial view is not saved.  Otherwise, sections which were not
+    // collected in this run would be dropped from the snapshot.
+    if (!state_->progress.IsCompleted()) {
+      MIRAKC_ARIB_WARN("Not completed, keep the previous snapshot in {}",
+                       option_.state_file);
+      return;
     }
+    auto* differ = option_.diff ? &state_->differ : nullptr;
+    state_->snapshot.Prune(differ);
+    state_->snapshot.Save(option_.state_file, differ);
   }
 
   inline bool IsCompleted() const {
     if (option_.streaming) {
       return false;
     }
-    return progress_.IsCompleted();
+    // Checked for each packet without locking the mutex.
+    return state_->completed;
   }
 
   inline bool CheckTimeout() const {
@@ -606,11 +818,13 @@ class EitCollector final : public PacketSink,
   ts::DuckContext context_;
   ts::SectionDemux demux_;
   bool has_timestamp_ = false;
+  bool rejected_ = false;  // the stream was recorded at a different time
   ts::Time timestamp_;  // JST
   ts::Time last_updated_;  // JST
-  CollectProgress progress_;
   bool show_progress_ = false;
   ts::Time start_time_;  // UTC
+  std::unique_ptr<OrderedWorkerPool<Documents>> pool_;
+  std::shared_ptr<EitCollectorSharedState> state_;
 
   MIRAKC_ARIB_NON_COPYABLE(EitCollector);
 };
@@ -0,0 +1,304 @@
+#pragma once
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <fmt/format.h>
+#include <rapidjson/document.h>
+
+#include "base.hh"
+#include "logging.hh"
+#include "tsduck_helper.hh"
+
+namespace {
+
+struct EitEventChange final {
+  enum class Type { kAdded, kChanged, kRemoved };
+
+  Type type;
+  uint16_t eid;
+  size_t offset;  // Offset of the event in EitSection::events_data.
+  size_t size;  // 0 for kRemoved.
+};
+
+// Keeps a compact event table for each service and computes event-level
+// changes in EIT sections.
+//
+// Events are compared by the hash of their raw bytes in the section.  An event
+// moved to another section without any change is not reported.
+//
+// Basic tables (0x50-0x57, 0x60-0x67) and extended tables (0x58-0x5F,
+// 0x68-0x6F) carry the same event IDs with different descriptors.  So, they
+// have separate event tables.  Otherwise, an event would flip between the
+// basic and extended payloads on every cycle.
+class EitEventDiffer final {
+ public:
+  EitEventDiffer() = default;
+  ~EitEventDiffer() = default;
+
+  std::vector<EitEventChange> Update(
+      uint64_t triple, uint8_t tid, uint8_t section_number,
+      const uint8_t* events_data, size_t events_size) {
+    std::vector<EitEventChange> changes;
+
+    const auto slot = static_cast<uint16_t>(tid << 8 | section_number);
+    auto& events = services_[MakeGroupKey(triple, tid)];
+
+    std::vector<uint16_t> eids;
+    const auto* data = events_data;
+    auto remain = events_size;
+    for (;;) {
+      auto size = GetEitEventSize(data, remain);
+      if (size == 0) {
+        break;
+      }
+      const auto eid = ts::GetUInt16(data);
+      const auto hash = ComputeHash(data, size);
+      const auto offset = static_cast<size_t>(data - events_data);
+      eids.push_back(eid);
+
+      auto it = events.find(eid);
+      if (it == events.end()) {
+        events.emplace(eid, Entry { hash, slot });
+        changes.push_back({ EitEventChange::Type::kAdded, eid, offset, size });
+      } else if (it->second.hash != hash) {
+        it->second = { hash, slot };
+        changes.push_back({ EitEventChange::Type::kChanged, eid, offset, size });
+      } else {
+        it->second.slot = slot;  // may be moved from another section
+      }
+
+      data += size;
+      remain -= size;
+    }
+
+    // Events which were included in the previous version of the section but
+    // have not been moved to other sections are removed.
+    auto& prev_eids = sections_[triple | slot];
+    for (auto eid : prev_eids) {
+      if (std::find(eids.begin(), eids.end(), eid) != eids.end()) {
+        continue;
+      }
+      auto it = events.find(eid);
+      if (it == events.end() || it->second.slot != slot) {
+        continue;
+      }
+      events.erase(it);
+      changes.push_back({ EitEventChange::Type::kRemoved, eid, 0, 0 });
+    }
+    prev_eids = std::move(eids);
+
+    return changes;
+  }
+
+  std::vector<EitEventChange> Update(const EitSection& eit) {
+    return Update(eit.service_triple(), static_cast<uint8_t>(eit.tid),
+                  eit.section_number, eit.events_data, eit.events_size);
+  }
+
+  // Removes events in a section without reporting changes.
+  void RemoveSection(uint64_t triple, uint8_t tid, uint8_t section_number) {
+    const auto slot = static_cast<uint16_t>(tid << 8 | section_number);
+    auto it = sections_.find(triple | slot);
+    if (it == sections_.end()) {
+      return;
+    }
+    const auto group_key = MakeGroupKey(triple, tid);
+    auto& events = services_[group_key];
+    for (auto eid : it->second) {
+      auto event = events.find(eid);
+      if (event != events.end() && event->second.slot == slot) {
+        events.erase(event);
+      }
+    }
+    if (events.empty()) {
+      services_.erase(group_key);
+    }
+    sections_.erase(it);
+  }
+
+  size_t CountEvents() const {
+    size_t n = 0;
+    for (const auto& pair : services_) {
+      n += pair.second.size();
+    }
+    return n;
+  }
+
+  // Encodes the event table for a state file.
+  //
+  // Events in each section are encoded into a string of `<eid><hash>` in hex
+  // so that changes can be computed against the previous run.
+  rapidjson::Value ToJson(
+      rapidjson::Document::AllocatorType& allocator) const {
+    rapidjson::Value sections(rapidjson::kArrayType);
+    for (const auto& pair : sections_) {
+      const auto triple = pair.first & ~kSlotMask;
+      const auto slot = static_cast<uint16_t>(pair.first & kSlotMask);
+      auto service = services_.find(
+          MakeGroupKey(triple, static_cast<uint8_t>(slot >> 8)));
+      if (service == services_.end()) {
+        continue;
+      }
+      const auto& events = service->second;
+      std::string str;
+      for (auto eid : pair.second) {
+        auto it = events.find(eid);
+        if (it == events.end() || it->second.slot != slot) {
+          continue;  // moved to another section
+        }
+        str += fmt::format("{:04X}{:016X}", eid, it->second.hash);
+      }
+      rapidjson::Value value(str, allocator);
+      rapidjson::Value section(rapidjson::kObjectType);
+      section.AddMember("key", pair.first, allocator);
+      section.AddMember("events", value, allocator);
+      sections.PushBack(section, allocator);
+    }
+    return sections;
+  }
+
+  // The current event table is kept if `json` is broken.
+  bool FromJson(const rapidjson::Value& json) {
+    if (!json.IsArray()) {
+      return false;
+    }
+
+    decltype(services_) services;
+    decltype(sections_) sections;
+    for (const auto& section : json.GetArray()) {
+      if (!section.IsObject() ||
+          !section.HasMember("key") || !section["key"].IsUint64() ||
+          !section.HasMember("events") || !section["events"].IsString() ||
+          section["events"].GetStringLength() % kEventStringSize != 0) {
+        return false;
+      }
+      const auto key = section["key"].GetUint64();
+      const auto triple = key & ~kSlotMask;
+      const auto slot = static_cast<uint16_t>(key & kSlotMask);
+      const std::string str = section["events"].GetString();
+      auto& events =
+          services[MakeGroupKey(triple, static_cast<uint8_t>(slot >> 8))];
+      auto& eids = sections[key];
+      for (size_t i = 0; i < str.size(); i += kEventStringSize) {
+        uint16_t eid;
+        uint64_t hash;
+        if (!DecodeHex(str.substr(i, 4), &eid) ||
+            !DecodeHex(str.substr(i + 4, 16), &hash)) {
+          return false;
+        }
+        events[eid] = Entry { hash, slot };
+        eids.push_back(eid);
+      }
+    }
+
+    services_ = std::move(services);
+    sections_ = std::move(sections);
+    return true;
+  }
+
+ private:
+  static constexpr uint64_t kSlotMask = 0xFFFF;
+  static constexpr uint8_t kExtendedTableMask = 0x08;
+
+  // The lower 16 bits of the service triple are always zero.
+  static uint64_t MakeGroupKey(uint64_t triple, uint8_t tid) {
+    return (tid & kExtendedTableMask) != 0 ? triple | 1 : triple;
+  }
+  static constexpr size_t kEventStringSize = 4 + 16;
+
+  template <typename T>
+  static bool DecodeHex(const std::string& str, T* value) {
+    T v = 0;
+    for (auto c : str) {
+      v <<= 4;
+      if (c >= '0' && c <= '9') {
+        v |= static_cast<T>(c - '0');
+      } else if (c >= 'A' && c <= 'F') {
+        v |= static_cast<T>(c - 'A' + 10);
+      } else {
+        return false;
+      }
+    }
+    *value = v;
+    return true;
+  }
+
+  struct Entry {
+    uint64_t hash;
+    uint16_t slot;  // table_id << 8 | section_number
+  };
+
+  // 64-bit FNV-1a
+  static uint64_t ComputeHash(const uint8_t* data, size_t size) {
+    uint64_t hash = 0xCBF29CE484222325;
+    for (size_t i = 0; i < size; ++i) {
+      hash ^= data[i];
+      hash *= 0x100000001B3;
+    }
+    return hash;
+  }
+
+  // (service triple | extended) -> event id -> entry
+  std::unordered_map<uint64_t, std::unordered_map<uint16_t, Entry>> services_;
+  // (service triple | slot) -> event ids
+  std::unordered_map<uint64_t, std::vector<uint16_t>> sections_;
+
+  MIRAKC_ARIB_NON_COPYABLE(EitEventDiffer);
+};
+
+// Makes documents of event-level changes in an EIT section.
+//
+//   {"type": "event-added", "data": {<service triple>, <tid>, "event": {...}}}
+//   {"type": "event-changed", "data": {<service triple>, <tid>, "event": {...}}}
+//   {"type": "event-removed", "data": {<service triple>, <tid>, "eventId": 1}}
+std::vector<rapidjson::Document> MakeEventChangeDocuments(
+    const EitSection& eit, const std::vector<EitEventChange>& changes) {
+  std::vector<rapidjson::Document> docs;
+  docs.reserve(changes.size());
+
+  for (const auto& change : changes) {
+    rapidjson::Document doc(rapidjson::kObjectType);
+    auto& allocator = doc.GetAllocator();
+
+    rapidjson::Value data(rapidjson::kObjectType);
+    data.AddMember("originalNetworkId", eit.nid, allocator);
+    data.AddMember("transportStreamId", eit.tsid, allocator);
+    data.AddMember("serviceId", eit.sid, allocator);
+    data.AddMember("tableId", eit.tid, allocator);
+
+    switch (change.type) {
+      case EitEventChange::Type::kAdded:
+      case EitEventChange::Type::kChanged: {
+        auto event = MakeEventJsonValue(
+            eit.events_data + change.offset, change.size, allocator);
+        data.AddMember("event", event, allocator);
+        break;
+      }
+      case EitEventChange::Type::kRemoved:
+        data.AddMember("eventId", change.eid, allocator);
+        break;
+    }
+
+    switch (change.type) {
+      case EitEventChange::Type::kAdded:
+        doc.AddMember("type", "event-added", allocator);
+        break;
+      case EitEventChange::Type::kChanged:
+        doc.AddMember("type", "event-changed", allocator);
+        break;
+      case EitEventChange::Type::kRemoved:
+        doc.AddMember("type", "event-removed", allocator);
+        break;
+    }
+    doc.AddMember("data", data, allocator);
+
+    docs.push_back(std::move(doc));
+  }
+
+  return docs;
+}
+
+}  // namespace
@@ -0,0 +1,274 @@
+#pragma once
+
+#include <array>
+#include <bitset>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <string>
+
+#include <fmt/format.h>
+#include <rapidjson/document.h>
+#include <rapidjson/istreamwrapper.h>
+#include <rapidjson/ostreamwrapper.h>
+#include <rapidjson/writer.h>
+
+#include "base.hh"
+#include "eit_event_differ.hh"
+#include "logging.hh"
+#include "tsduck_helper.hh"
+
+namespace {
+
+// Version numbers of EIT sections collected in a previous run.
+//
+// Unlike TableProgress, version numbers are stored for each section number so
+// that a changed section can be detected exactly.
+//
+// The event table of EitEventDiffer can be stored together.  It's needed for
+// computing event-level changes in sections changed since the previous run.
+//
+// Sections not seen in the current run are dropped by Prune() before saving.
+// This removes sections of services which no longer exist and sections out of
+// the schedule window.
+class EitSnapshot final {
+ public:
+  static constexpr int kFormatVersion = 1;
+
+  EitSnapshot() = default;
+  ~EitSnapshot() = default;
+
+  bool Contains(uint64_t triple, uint8_t tid, uint8_t section_number,
+                uint8_t version) const {
+    auto it = tables_.find(MakeKey(triple, tid));
+    if (it == tables_.end()) {
+      return false;
+    }
+    return it->second[section_number] == version;
+  }
+
+  bool Contains(const EitSection& eit) const {
+    return Contains(eit.service_triple(), static_cast<uint8_t>(eit.tid),
+                    eit.section_number, eit.version);
+  }
+
+  void Update(uint64_t triple, uint8_t tid, uint8_t section_number,
+              uint8_t version) {
+    auto key = MakeKey(triple, tid);
+    auto it = tables_.find(key);
+    if (it == tables_.end()) {
+      Versions versions;
+      versions.fill(kNoVersion);
+      it = tables_.emplace(key, versions).first;
+    }
+    it->second[section_number] = version;
+    seen_[key].set(section_number);
+  }
+
+  void Update(const EitSection& eit) {
+    Update(eit.service_triple(), static_cast<uint8_t>(eit.tid),
+           eit.section_number, eit.version);
+  }
+
+  size_t CountTables() const {
+    return tables_.size();
+  }
+
+  // Removes sections which have not been updated since the snapshot was
+  // loaded.  Events in the removed sections are also removed from `differ`
+  // if it's specified.
+  void Prune(EitEventDiffer* differ = nullptr) {
+    size_t num_sections = 0;
+    for (auto it = tables_.begin(); it != tables_.end();) {
+      const auto triple = it->first & ~kTableIdMask;
+      const auto tid = static_cast<uint8_t>(it->first & kTableIdMask);
+      const auto& seen = seen_[it->first];
+      auto& versions = it->second;
+      for (size_t i = 0; i < kNumSections; ++i) {
+        if (versions[i] == kNoVersion || seen.test(i)) {
+          continue;
+        }
+        versions[i] = kNoVersion;
+        if (differ != nullptr) {
+          differ->RemoveSection(triple, tid, static_cast<uint8_t>(i));
+        }
+        num_sections++;
+      }
+      if (seen.none()) {
+        it = tables_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    seen_.clear();
+    MIRAKC_ARIB_INFO("Pruned {} sections from the snapshot", num_sections);
+  }
+
+  // When `differ` is specified, the snapshot is loaded only if the file also
+  // contains the event table.  Otherwise, unchanged sections would be skipped
+  // without the events needed for computing changes in the other sections.
+  bool Load(const std::string& path, EitEventDiffer* differ = nullptr) {
+    std::ifstream ifs(path);
+    if (!ifs) {
+      MIRAKC_ARIB_INFO("No snapshot in {}", path);
+      return false;
+    }
+
+    rapidjson::IStreamWrapper stream(ifs);
+    rapidjson::Document doc;
+    doc.ParseStream(stream);
+    if (doc.HasParseError() || !doc.IsObject()) {
+      MIRAKC_ARIB_WARN("Broken snapshot in {}, ignored", path);
+      return false;
+    }
+
+    if (!doc.HasMember("version") || !doc["version"].IsInt() ||
+        doc["version"].GetInt() != kFormatVersion) {
+      MIRAKC_ARIB_WARN("Unsupported snapshot format in {}, ignored", path);
+      return false;
+    }
+
+    if (!doc.HasMember("tables") || !doc["tables"].IsArray()) {
+      MIRAKC_ARIB_WARN("Broken snapshot in {}, ignored", path);
+      return false;
+    }
+
+    std::map<uint64_t, Versions> tables;
+    for (const auto& table : doc["tables"].GetArray()) {
+      if (!table.IsObject() ||
+          !table.HasMember("key") || !table["key"].IsUint64() ||
+          !table.HasMember("versions") || !table["versions"].IsString() ||
+          table["versions"].GetStringLength() != kNumSections * 2) {
+        MIRAKC_ARIB_WARN("Broken snapshot in {}, ignored", path);
+        return false;
+      }
+      Versions versions;
+      if (!DecodeVersions(table["versions"].GetString(), &versions)) {
+        MIRAKC_ARIB_WARN("Broken snapshot in {}, ignored", path);
+        return false;
+      }
+      tables.emplace(table["key"].GetUint64(), versions);
+    }
+
+    if (differ != nullptr) {
+      if (!doc.HasMember("events")) {
+        MIRAKC_ARIB_WARN("No event table in {}, ignored", path);
+        return false;
+      }
+      if (!differ->FromJson(doc["events"])) {
+        MIRAKC_ARIB_WARN("Broken snapshot in {}, ignored", path);
+        return false;
+      }
+    }
+
+    tables_ = std::move(tables);
+    seen_.clear();
+    MIRAKC_ARIB_INFO("Loaded {} tables from {}", tables_.size(), path);
+    return true;
+  }
+
+  bool Save(const std::string& path,
+            const EitEventDiffer* differ = nullptr) const {
+    rapidjson::Document doc(rapidjson::kObjectType);
+    auto& allocator = doc.GetAllocator();
+
+    rapidjson::Value tables(rapidjson::kArrayType);
+    for (const auto& pair : tables_) {
+      rapidjson::Value versions(EncodeVersions(pair.second), allocator);
+      rapidjson::Value table(rapidjson::kObjectType);
+      table.AddMember("key", pair.first, allocator);
+      table.AddMember("versions", versions, allocator);
+      tables.PushBack(table, allocator);
+    }
+
+    doc.AddMember("version", kFormatVersion, allocator);
+    doc.AddMember("tables", tables, allocator);
+    if (differ != nullptr) {
+      doc.AddMember("events", differ->ToJson(allocator), allocator);
+    }
+
+    // Write into a temporary file and rename it in order to keep the previous
+    // snapshot when the program is killed while writing.
+    auto tmp_path = path + ".tmp";
+    {
+      std::ofstream ofs(tmp_path, std::ios::trunc);
+      if (!ofs) {
+        MIRAKC_ARIB_ERROR("Failed to open {}", tmp_path);
+        return false;
+      }
+      rapidjson::OStreamWrapper stream(ofs);
+      rapidjson::Writer<rapidjson::OStreamWrapper> writer(stream);
+      doc.Accept(writer);
+      ofs.flush();
+      if (!ofs) {
+        MIRAKC_ARIB_ERROR("Failed to write to {}", tmp_path);
+        return false;
+      }
+    }
+    if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+      MIRAKC_ARIB_ERROR("Failed to rename {} to {}: {} ({})",
+                        tmp_path, path, std::strerror(errno), errno);
+      return false;
+    }
+
+    MIRAKC_ARIB_INFO("Saved {} tables to {}", tables_.size(), path);
+    return true;
+  }
+
+ private:
+  static constexpr size_t kNumSections = 256;
+  static constexpr uint8_t kNoVersion = 0xFF;
+  static constexpr uint64_t kTableIdMask = 0xFF;
+
+  using Versions = std::array<uint8_t, kNumSections>;
+
+  static uint64_t MakeKey(uint64_t triple, uint8_t tid) {
+    // The lower 16 bits of the service triple are always zero.
+    return triple | tid;
+  }
+
+  static std::string EncodeVersions(const Versions& versions) {
+    std::string str;
+    str.reserve(kNumSections * 2);
+    for (auto version : versions) {
+      str += fmt::format("{:02X}", version);
+    }
+    return str;
+  }
+
+  static bool DecodeVersions(const char* str, Versions* versions) {
+    for (size_t i = 0; i < kNumSections; ++i) {
+      auto hi = DecodeHexDigit(str[i * 2]);
+      auto lo = DecodeHexDigit(str[i * 2 + 1]);
+      if (hi < 0 || lo < 0) {
+        return false;
+      }
+      (*versions)[i] = static_cast<uint8_t>(hi << 4 | lo);
+    }
+    return true;
+  }
+
+  static int DecodeHexDigit(char c) {
+    if (c >= '0' && c <= '9') {
+      return c - '0';
+    }
+    if (c >= 'A' && c <= 'F') {
+      return c - 'A' + 10;
+    }
+    if (c >= 'a' && c <= 'f') {
+      return c - 'a' + 10;
+    }
+    return -1;
+  }
+
+  // (service triple | table_id) -> versions
+  std::map<uint64_t, Versions> tables_;
+  // (service triple | table_id) -> sections updated in the current run
+  std::map<uint64_t, std::bitset<kNumSections>> seen_;
+
+  MIRAKC_ARIB_NON_COPYABLE(EitSnapshot);
+};
+
+}  // namespace
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include <tsduck/tsduck.h>
+
+#include "base.hh"
+#include "logging.hh"
+#include "packet_sink.hh"
+
+namespace {
+
+// Forwards each packet to multiple downstream stages.
+//
+// The same packet object is passed to all downstream stages without copying
+// it.  When a downstream stage returns false from HandlePacket(), packets are
+// no longer forwarded to it and the other stages keep going.  HandlePacket()
+// of this class returns false when all downstream stages have stopped.
+//
+// End() is called on each downstream stage as soon as it stops so that its
+// output is flushed and closed without waiting for the other stages.  End() of
+// this class calls it on the remaining stages.
+template <typename Sink>
+class BasicFanoutSink final : public PacketSink {
+ public:
+  BasicFanoutSink() = default;
+  ~BasicFanoutSink() override {}
+
+  void Connect(std::unique_ptr<Sink>&& sink) {
+    outputs_.push_back({std::move(sink), true});
+    num_active_++;
+  }
+
+  bool Start() override {
+    if (outputs_.empty()) {
+      MIRAKC_ARIB_ERROR("fanout: No sink has been connected");
+      return false;
+    }
+
+    for (auto& output : outputs_) {
+      if (!output.sink->Start()) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool End() override {
+    bool success = end_result_;
+    for (auto& output : outputs_) {
+      if (!output.active) {
+        continue;  // already ended
+      }
+      if (!output.sink->End()) {
+        success = false;
+      }
+    }
+    return success;
+  }
+
+  bool HandlePacket(const ts::TSPacket& packet) override {
+    for (size_t i = 0; i < outputs_.size(); ++i) {
+      auto& output = outputs_[i];
+      if (!output.active) {
+        continue;
+      }
+      if (!output.sink->HandlePacket(packet)) {
+        MIRAKC_ARIB_DEBUG("fanout: Sink#{} stopped", i);
+        output.active = false;
+        num_active_--;
+        if (!output.sink->End()) {
+          end_result_ = false;
+        }
+      }
+    }
+    return num_active_ > 0;
+  }
+
+ private:
+  struct Output {
+    std::unique_ptr<Sink> sink;
+    bool active;
+  };
+
+  std::vector<Output> outputs_;
+  size_t num_active_ = 0;
+  bool end_result_ = true;
+
+  MIRAKC_ARIB_NON_COPYABLE(BasicFanoutSink);
+};
+
+using FanoutSink = BasicFanoutSink<PacketSink>;
+
+}  // namespace
@@ -1,11 +1,16 @@
 #pragma once
 
 #include <iostream>
+#include <memory>
+#include <mutex>
 
 #include <rapidjson/document.h>
 #include <rapidjson/ostreamwrapper.h>
 #include <rapidjson/writer.h>
 
+#include "metrics.hh"
+#include "probes.hh"
+
 namespace {
 
 class JsonlSink {
@@ -15,6 +20,32 @@ class JsonlSink {
   virtual bool HandleDocument(const rapidjson::Document&) { return true; }
 };
 
+// Counts characters written to a rapidjson output stream.
+template <typename Stream>
+class CountingOStream final {
+ public:
+  using Ch = typename Stream::Ch;
+
+  explicit CountingOStream(Stream& stream) : stream_(stream) {}
+
+  void Put(Ch c) {
+    stream_.Put(c);
+    ++count_;
+  }
+
+  void Flush() {
+    stream_.Flush();
+  }
+
+  size_t count() const {
+    return count_;
+  }
+
+ private:
+  Stream& stream_;
+  size_t count_ = 0;
+};
+
 class StdoutJsonlSink final : public JsonlSink {
  public:
   StdoutJsonlSink() = default;
@@ -22,11 +53,49 @@ class StdoutJsonlSink final : public JsonlSink {
 
   bool HandleDocument(const rapidjson::Document& doc) override {
     rapidjson::OStreamWrapper stream(std::cout);
-    rapidjson::Writer<rapidjson::OStreamWrapper> writer(stream);
+    CountingOStream<rapidjson::OStreamWrapper> counting_stream(stream);
+    rapidjson::Writer<CountingOStream<rapidjson::OStreamWrapper>> writer(counting_stream);
     doc.Accept(writer);
     std::cout << std::endl;
+    MIRAKC_ARIB_METRICS_INC("jsonl_sink.documents");
+    MIRAKC_ARIB_METRICS_ADD("jsonl_sink.bytes", counting_stream.count() + 1);
+    MIRAKC_ARIB_PROBE1(jsonl_sink_document, counting_stream.count() + 1);
     return true;
   }
 };
 
+// Serializes documents fed from multiple sources running on different threads
+// into a single sink.
+//
+// Each source has to be connected to its own instance made by Clone().
+class SharedJsonlSink final : public JsonlSink {
+ public:
+  explicit SharedJsonlSink(std::unique_ptr<JsonlSink>&& sink)
+      : shared_(std::make_shared<Shared>()) {
+    shared_->sink = std::move(sink);
+  }
+
+  ~SharedJsonlSink() override = default;
+
+  std::unique_ptr<SharedJsonlSink> Clone() const {
+    return std::unique_ptr<SharedJsonlSink>(new SharedJsonlSink(shared_));
+  }
+
+  bool HandleDocument(const rapidjson::Document& doc) override {
+    std::lock_guard<std::mutex> lock(shared_->mutex);
+    return shared_->sink->HandleDocument(doc);
+  }
+
+ private:
+  struct Shared {
+    std::mutex mutex;
+    std::unique_ptr<JsonlSink> sink;  // guarded by mutex
+  };
+
+  explicit SharedJsonlSink(const std::shared_ptr<Shared>& shared)
+      : shared_(shared) {}
+
+  std::shared_ptr<Shared> shared_;
+};
+
 }  // namespace
@@ -9,7 +9,8 @@
 namespace {
 
 inline void InitLogger(const std::string& name) {
-  auto logger = spdlog::stderr_color_st(name);
+  // Some sub-commands output log messages from multiple threads.
+  auto logger = spdlog::stderr_color_mt(name);
   if (std::getenv("MIRAKC_ARIB_LOG_NO_TIMESTAMP") != nullptr) {
     logger->set_pattern("%^%L%$ %n %v");
   } else {
@@ -26,6 +27,14 @@ inline void InitLogger(const std::string& name) {
 #define MIRAKC_ARIB_SOURCE_LOC (spdlog::source_loc {})
 #endif
 
+// Log messages at levels lower than MIRAKC_ARIB_LOG_LEVEL_FLOOR are removed at
+// compile time.  The value is one of SPDLOG_LEVEL_*.  Messages at the removed
+// levels cost nothing even in hot paths, but can no longer be enabled by the
+// MIRAKC_ARIB_LOG environment variable.
+#if !defined(MIRAKC_ARIB_LOG_LEVEL_FLOOR)
+#define MIRAKC_ARIB_LOG_LEVEL_FLOOR SPDLOG_LEVEL_TRACE
+#endif
+
 #define MIRAKC_ARIB_LOG(...) spdlog::log(MIRAKC_ARIB_SOURCE_LOC, __VA_ARGS__)
 #define MIRAKC_ARIB_TRACE(...) MIRAKC_ARIB_LOG(spdlog::level::trace, __VA_ARGS__)
 #define MIRAKC_ARIB_DEBUG(...) MIRAKC_ARIB_LOG(spdlog::level::debug, __VA_ARGS__)
@@ -33,8 +42,28 @@ inline void InitLogger(const std::string& name) {
 #define MIRAKC_ARIB_WARN(...) MIRAKC_ARIB_LOG(spdlog::level::warn, __VA_ARGS__)
 #define MIRAKC_ARIB_ERROR(...) MIRAKC_ARIB_LOG(spdlog::level::err, __VA_ARGS__)
 
-// In the future, the following macros might be disabled in the release build if
-// that improves the performance significantly.
+#if MIRAKC_ARIB_LOG_LEVEL_FLOOR > SPDLOG_LEVEL_TRACE
+#undef MIRAKC_ARIB_TRACE
+#define MIRAKC_ARIB_TRACE(...) ((void)0)
+#endif
+#if MIRAKC_ARIB_LOG_LEVEL_FLOOR > SPDLOG_LEVEL_DEBUG
+#undef MIRAKC_ARIB_DEBUG
+#define MIRAKC_ARIB_DEBUG(...) ((void)0)
+#endif
+#if MIRAKC_ARIB_LOG_LEVEL_FLOOR > SPDLOG_LEVEL_INFO
+#undef MIRAKC_ARIB_INFO
+#define MIRAKC_ARIB_INFO(...) ((void)0)
+#endif
+#if MIRAKC_ARIB_LOG_LEVEL_FLOOR > SPDLOG_LEVEL_WARN
+#undef MIRAKC_ARIB_WARN
+#define MIRAKC_ARIB_WARN(...) ((void)0)
+#endif
+#if MIRAKC_ARIB_LOG_LEVEL_FLOOR > SPDLOG_LEVEL_ERROR
+#undef MIRAKC_ARIB_ERROR
+#define MIRAKC_ARIB_ERROR(...) ((void)0)
+#endif
+
+// Assertions are always enabled regardless of MIRAKC_ARIB_LOG_LEVEL_FLOOR.
 
 #define MIRAKC_ARIB_ASSERT(cond) \
   ((cond) ? (void)0 : \
@@ -49,6 +78,16 @@ inline void InitLogger(const std::string& name) {
 #define MIRAKC_ARIB_NEVER_REACH(...) \
   (MIRAKC_ARIB_LOG(spdlog::level::critical, __VA_ARGS__), std::abort())
 
+// Assertions checked for each packet.  These are enabled only in the debug
+// build (NDEBUG is not defined).
+#if defined(NDEBUG)
+#define MIRAKC_ARIB_DASSERT(cond) ((void)0)
+#define MIRAKC_ARIB_DASSERT_MSG(cond, ...) ((void)0)
+#else
+#define MIRAKC_ARIB_DASSERT(cond) MIRAKC_ARIB_ASSERT(cond)
+#define MIRAKC_ARIB_DASSERT_MSG(cond, ...) MIRAKC_ARIB_ASSERT_MSG(cond, __VA_ARGS__)
+#endif
+
 #if defined(MIRAKC_ARIB_DISABLE_LOGGING)
 #undef MIRAKC_ARIB_LOG
 #undef MIRAKC_ARIB_TRACE
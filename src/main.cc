@@ -1,11 +1,22 @@
+#include <algorithm>
 #include <cerrno>
+#include <climits>
 #include <cstddef>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <map>
 #include <memory>
 #include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
+#include <fcntl.h>
+#include <signal.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 
 #include <docopt/docopt.h>
@@ -16,21 +27,30 @@
 #include "airtime_tracker.hh"
 #include "base.hh"
 #include "eit_collector.hh"
+#include "fanout_sink.hh"
 #include "file.hh"
 #include "jsonl_sink.hh"
 #include "logging.hh"
 #include "logo_collector.hh"
+#include "metrics.hh"
+#include "msgpack.hh"
 #include "packet_sink.hh"
 #include "packet_source.hh"
+#include "pcr_index.hh"
 #include "pcr_synchronizer.hh"
 #include "program_filter.hh"
 #include "program_metadata_filter.hh"
+#include "program_pipeline.hh"
+#include "psi_state.hh"
 #include "ring_file_sink.hh"
 #include "service_filter.hh"
 #include "service_recorder.hh"
 #include "service_scanner.hh"
+#include "session_server.hh"
 #include "start_seeker.hh"
+#include "threaded_sink.hh"
 #include "pes_printer.hh"
+#include "usage.hh"
 
 namespace {
 
@@ -44,56 +64,6 @@ static const std::string kVersion = R"(mirakc-arib {}
 * mirakc/tsduck-arib {}
 * DBCTRADO/LibISDB {})";
 
-static const std::string kUsage = R"(
-Tools to process ARIB TS streams.
-
-Usage:
-  mirakc-arib (-h | --help)
-    [(scan-services | sync-clocks | collect-eits | collect-logos |
-      filter-service | filter-program | filter-program-metadata |
-      record-service | track-airtime | seek-start | print-pes)]
-  mirakc-arib --version
-  mirakc-arib scan-services [--sids=<sid>...] [--xsids=<sid>...] [<file>]
-  mirakc-arib sync-clocks [--sids=<sid>...] [--xsids=<sid>...] [<file>]
-  mirakc-arib collect-eits [--sids=<sid>...] [--xsids=<sid>...]
-                           [--time-limit=<ms>] [--streaming]
-                           [--use-unicode-symbol] [<file>]
-  mirakc-arib collect-logos [<file>]
-  mirakc-arib filter-service --sid=<sid> [<file>]
-  mirakc-arib filter-program --sid=<sid> --eid=<eid>
-    --clock-pid=<pid> --clock-pcr=<pcr> --clock-time=<unix-time-ms>
-    [--audio-tags=<tag>...] [--video-tags=<tag>...]
-    [--start-margin=<ms>] [--end-margin=<ms>] [--pre-streaming] [<file>]
-  mirakc-arib filter-program-metadata [--sid=<sid>] [<file>]
-  mirakc-arib record-service --sid=<sid> --file=<file>
-    --chunk-size=<bytes> --num-chunks=<num> [--start-pos=<pos>] [<file>]
-  mirakc-arib track-airtime --sid=<sid> --eid=<eid> [<file>]
-  mirakc-arib seek-start --sid=<sid>
-    [--max-duration=<ms>] [--max-packets=<num>] [<file>]
-  mirakc-arib print-pes [<file>]
-
-Description:
-  `mirakc-arib <sub-command> -h` shows help for each sub-command.
-
-Logging:
-  mirakc-arib doesn't output any log message by default.  The MIRAKC_ARIB_LOG
-  environment variable is used for changing the logging level.
-
-  The following command outputs info-level log messages to STDERR:
-
-    $ recdvb 26 - - 2>/dev/null | \
-        MIRAKC_ARIB_LOG=info mirakc-arib scan-services >/dev/null
-    [2019-08-11 22:58:31.989] [scan-services] [info] Read packets from STDIN...
-    [2019-08-11 22:58:31.990] [scan-services] [info] Feed packets...
-    [2019-08-11 22:58:34.840] [scan-services] [info] PAT ready
-    [2019-08-11 22:58:35.574] [scan-services] [info] SDT ready
-    [2019-08-11 22:58:35.709] [scan-services] [info] NIT ready
-    [2019-08-11 22:58:35.709] [scan-services] [info] Ready to collect services
-
-  mirakc-arib uses spdlog for logging.  See the document of spdlog for details
-  about log levels.
-)";
-
 static const std::string kScanServices = "scan-services";
 
 static const std::string kScanServicesHelp = R"(
@@ -215,8 +185,9 @@ Collect EIT sections
 
 Usage:
   mirakc-arib collect-eits [--sids=<sid>...] [--xsids=<sid>...]
-                           [--time-limit=<ms>] [--streaming]
-                           [--use-unicode-symbol] [<file>]
+                           [--time-limit=<ms>] [--streaming] [--jobs=<num>]
+                           [--state-file=<file>] [--diff]
+                           [--use-unicode-symbol] [<file>...]
 
 Options:
   -h --help
@@ -242,6 +213,42 @@ Options:
     status will be updated in order to drop EIT sections which have already been
     collected.
 
+  --jobs=<num>  [default: 0]
+    The number of worker threads used for decoding and encoding EIT sections.
+
+    Sections are decoded and encoded on the main thread if 0 is specified.
+    Otherwise, the main thread only demuxes sections and updates the progress
+    status.  The output order is the same regardless of this option.
+
+    In the diff mode, changes are encoded on the thread demuxing sections so
+    that changes in the same section are output in order even when multiple
+    files are specified.
+
+  --state-file=<file>
+    Path to a file used for keeping version numbers of collected sections
+    between runs.
+
+    Version numbers are loaded from the file at startup if it exists, and saved
+    to the file before exit.  Sections which have not been changed since the
+    previous run are not output, but they are taken into account for checking
+    the progress status.  So, the application must keep data of sections which
+    were output in previous runs.
+
+    The file is saved only when the collection completes.  Sections which
+    were not seen in the run are removed from the file.
+
+  --diff
+    Output event-level changes instead of EIT sections.
+
+    An in-memory event table is kept for each service, and only events added,
+    changed or removed are output when a new version of a section comes.  See
+    the description below about the format of each message.
+
+    When `--state-file` is also specified, the event table is saved to the file
+    together with version numbers so that changes in sections changed since the
+    previous run are computed correctly.  A file saved without `--diff` is
+    ignored.
+
 Obsoleted Options:
   --use-unicode-symbol
     Use the `MIRAKC_ARIB_KEEP_UNICODE_SYMBOLS` environment variable instead of
@@ -251,6 +258,17 @@ Arguments:
   <file>
     Path to a TS file.
 
+    Multiple files can be specified.  In this case, each file is processed on
+    its own thread, and results are merged into a single output.  A section
+    collected from a file is not output again even if it's contained in other
+    files.  The program stops when all sections have been collected from the
+    files, or when every file has reached its end or the time limit.
+
+    The files must be recorded at the same time because the progress status
+    depends on the current time.  A file whose first TOT differs from the
+    first TOT of the other files by more than 5 minutes is ignored.  Sections
+    before the first TOT in each file are also ignored.
+
 Description:
   `collect-eits` collects EIT sections from a TS stream.  Results will be output
   to STDOUT in the following JSONL format:
@@ -304,6 +322,48 @@ Description:
       ]
     }}
 
+  The following messages are output in the diff mode:
+
+    {{
+      "type": "event-added",
+      "data": {{
+        "originalNetworkId": 32736,
+        "transportStreamId": 32736,
+        "serviceId": 1024,
+        "tableId": 80,
+        "event": {{ ... }}
+      }}
+    }}
+
+    {{
+      "type": "event-changed",
+      "data": {{
+        "originalNetworkId": 32736,
+        "transportStreamId": 32736,
+        "serviceId": 1024,
+        "tableId": 80,
+        "event": {{ ... }}
+      }}
+    }}
+
+    {{
+      "type": "event-removed",
+      "data": {{
+        "originalNetworkId": 32736,
+        "transportStreamId": 32736,
+        "serviceId": 1024,
+        "tableId": 80,
+        "eventId": 12250
+      }}
+    }}
+
+  where `event` is the same structure as an element of `events` described above.
+
+  Events in basic tables (0x50-0x57, 0x60-0x67) and extended tables
+  (0x58-0x5F, 0x68-0x6F) are tracked separately because they carry different
+  descriptors for the same event.  `tableId` tells which table the change
+  comes from.
+
 Environment Variables:
   MIRAKC_ARIB_KEEP_UNICODE_SYMBOLS
     Set `1` if you like to keep Unicode symbols like enclosed ideographic
@@ -438,7 +498,8 @@ Usage:
   mirakc-arib filter-program --sid=<sid> --eid=<eid>
     --clock-pid=<pid> --clock-pcr=<pcr> --clock-time=<unix-time-ms>
     [--audio-tags=<tag>...] [--video-tags=<tag>...]
-    [--start-margin=<ms>] [--end-margin=<ms>] [--pre-streaming] [<file>]
+    [--start-margin=<ms>] [--end-margin=<ms>] [--pre-streaming] [--threaded]
+    [--keyframe-start] [--index=<file>] [--program=<spec>...] [<file>]
 
 Options:
   -h --help
@@ -482,6 +543,43 @@ Options:
   --pre-streaming
     Output PAT packets before start.
 
+  --threaded
+    Run the service filter, the program filter and the output on different
+    threads connected by bounded queues.
+
+    This may improve the throughput on a multi-core machine, but increases the
+    latency of each packet slightly.
+
+  --keyframe-start
+    Start streaming from the last random access point of the video stream
+    before the start time, instead of a packet in the middle of a GOP.
+
+    Packets since the last random access point are kept in a buffer limited to
+    about 2 seconds at 24 Mbps.  Streaming starts at the start time if no
+    random access point is found within the limit.
+
+  --index=<file>
+    Path to a PCR index of <file> made by `index`.  <file> is read from a
+    position close to the start of the TV program.
+
+    The index is rebuilt and saved to the path if it doesn't exist or it was
+    made for another file.
+
+    When `--program` is specified, <file> is read from a position close to the
+    start of the earliest TV program.
+
+  --program=<spec>
+    An additional TV program to be extracted in the same pass.  SPEC is in the
+    following format:
+
+      <eid>:<fd>[:<start-margin>[:<end-margin>]]
+
+    Packets of the TV program are written to the file descriptor <fd> which
+    must be opened by the parent process.  <fd> is closed as soon as the TV
+    program ends.  <start-margin> and <end-margin> default to 0.  The other
+    options such as `--audio-tags` are shared with the TV program specified
+    with `--eid`.
+
 Arguments:
   <file>
     Path to a TS file.
@@ -504,6 +602,17 @@ Description:
   `filter-program` resynchronize the clock automatically.  In this case, actual
   start and end times may be delayed about 5 seconds due to the clock
   synchronization.
+
+  Consecutive TV programs on the same service can be extracted in a single pass
+  with `--program` like below:
+
+    mirakc-arib filter-program --sid=1 --eid=1 ... --program=2:3 \
+      3>program2.m2ts >program1.m2ts
+
+  The service filter, the demux and the clock are shared by all TV programs.
+  Packets in overlapping ranges are written to each output.  When the reader of
+  an output closes it, only that output stops.  `filter-program` stops when all
+  TV programs have ended.
 )";
 
 static const std::string kFilterProgramMetadata = "filter-program-metadata";
@@ -552,7 +661,8 @@ Record a service stream into a ring buffer file
 
 Usage:
   mirakc-arib record-service --sid=<sid> --file=<file>
-    --chunk-size=<bytes> --num-chunks=<num> [--start-pos=<pos>] [<file>]
+    --chunk-size=<bytes> --num-chunks=<num> [--start-pos=<pos>] [--threaded]
+    [<file>]
 
 Options:
   -h --help
@@ -575,6 +685,13 @@ Options:
     A file position to start recoring.
     The value must be a multiple of the chunk size.
 
+  --threaded
+    Run the service filter and the recorder on different threads connected by
+    a bounded queue.
+
+    This may improve the throughput on a multi-core machine, but increases the
+    latency of each packet slightly.
+
 Arguments:
   <file>
     Path to a TS file.
@@ -720,7 +837,7 @@ Seek the start position of a TV program
 
 Usage:
   mirakc-arib seek-start --sid=<sid>
-    [--max-duration=<ms>] [--max-packets=<num>] [<file>]
+    [--max-duration=<ms>] [--max-packets=<num>] [--keyframe-start] [<file>]
 
 Options:
   -h --help
@@ -735,6 +852,10 @@ Options:
   --max-packets=<num>
     The maximum number of packets used for detecting a stream transion point.
 
+  --keyframe-start
+    Drop PES packets until the first random access point of the video stream
+    after the stream transition point.  PSI/SI packets are not dropped.
+
 Arguments:
   <file>
     Path to a TS file.
@@ -743,9 +864,16 @@ Description:
   `seek-start` checks the leading packets in the TS stream and start streaming
   from the start position of a TV program.
 
-  Currently, `seek-start` checks only the change of the number of audio streams
-  for detecting a stream transition point.  This is not a perfect solution, but
-  works well in most cases.
+  `seek-start` detects a stream transition point by the following signals:
+
+    * A change of the number of audio streams in PMT
+    * A change of component tags in PMT
+    * A discontinuity indicator in the video or the first audio stream
+    * A change of the format in MPEG-2 sequence headers or H.264 SPSs
+    * A change of the profile, the sampling rate or the channel configuration
+      in ADTS headers of the first audio stream
+
+  This is not a perfect solution, but works well in most cases.
 
   When a stream transition is detected, `seek-start` start streaming from a PSUI
   packet of a PAT just before the transition point.  Otherwise, `seek-start`
@@ -818,6 +946,95 @@ Examples:
     ...
 )";
 
+static const std::string kIndex = "index";
+
+static const std::string kIndexHelp = R"(
+Make a PCR index of a TS file
+
+Usage:
+  mirakc-arib index [--sid=<sid>] [--interval=<bytes>] [--output=<file>]
+    <file>
+
+Options:
+  -h --help
+    Print help.
+
+  --sid=<sid>
+    Service ID.  The first service in PAT is used if not specified.
+
+  --interval=<bytes>  [default: 4194304]
+    Interval of file offsets between records.
+
+  --output=<file>
+    Path to the index file.  <file>.index is used if not specified.
+
+Arguments:
+  <file>
+    Path to a TS file.
+
+Description:
+  `index` scans a TS file and makes a sparse index mapping PCR values of a
+  service to file offsets.  Only PAT, PMT, EIT p/f Actual, TOT and packets
+  having PCR of the service are processed.
+
+  The index file consists of a 32-byte header and 32-byte records.  Each
+  record holds the following values taken from the first PCR packet after
+  every <bytes>:
+
+    * The file offset of the packet
+    * The PCR value
+    * UNIX time (ms) computed from TOT and the PCR value
+    * Event IDs of the present and following events in EIT p/f Actual
+    * Versions of PAT and PMT
+
+  Values are stored in the native byte order so that the index file can be
+  used by memory-mapping it.
+
+  `filter-program --index=<file>` uses the index for seeking <file>.
+)";
+
+static const std::string kServe = "serve";
+
+static const std::string kServeHelp = R"(
+Run sub-commands in sessions requested through a Unix domain socket
+
+Usage:
+  mirakc-arib serve --socket=<path>
+
+Options:
+  -h --help
+    Print help.
+
+  --socket=<path>
+    Path to a Unix domain socket to listen on.  An existing file at the path
+    is removed.
+
+Description:
+  `serve` runs as a long-running server process and executes sub-commands
+  requested by clients.  This eliminates the process startup cost of each
+  invocation, which is significant when mirakc-arib is invoked very often
+  with short inputs.
+
+  The server forks a process for each session.  So, sessions are isolated
+  from each other, and the initialization performed at startup is shared
+  with sessions.
+
+  Protocol:
+    1. A client connects to the socket with SOCK_SEQPACKET.
+    2. The client sends a single message containing the arguments of the
+       sub-command, each terminated by NUL (e.g. "print-pes\0").  The file
+       descriptors used as STDIN, STDOUT and STDERR of the session must be
+       attached to the message as SCM_RIGHTS ancillary data.
+    3. The server sends the exit status of the session as a 32-bit big
+       endian integer when the session ends.  The exit status of a session
+       killed by a signal is 128 + the signal number.
+
+  Environment variables such as MIRAKC_ARIB_LOG are NOT sent from clients.
+  Sessions use values specified to the server process.
+
+  The `serve` sub-command cannot be requested in a session.
+)";
+
 class PosixFile final : public File {
  public:
   enum class Mode { kWrite };
@@ -934,6 +1151,91 @@ class PosixFile final : public File {
   bool stdio_ = false;
 };
 
+// A read-only memory-mapped file.
+class MappedFile final {
+ public:
+  MappedFile(const std::string& path)
+      : path_(path) {
+    auto fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      MIRAKC_ARIB_DEBUG("Failed to open {}: {} ({})", path, std::strerror(errno), errno);
+      return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+      MIRAKC_ARIB_ERROR("Failed to stat {}: {} ({})", path, std::strerror(errno), errno);
+      close(fd);
+      return;
+    }
+    if (st.st_size > 0) {
+      auto* addr = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ,
+                        MAP_PRIVATE, fd, 0);
+      if (addr != MAP_FAILED) {
+        data_ = static_cast<const uint8_t*>(addr);
+        size_ = static_cast<size_t>(st.st_size);
+      } else {
+        MIRAKC_ARIB_ERROR("Failed to map {}: {} ({})", path, std::strerror(errno), errno);
+      }
+    }
+    // The mapping is still valid after the file descriptor is closed.
+    close(fd);
+  }
+
+  ~MappedFile() {
+    if (data_ != nullptr) {
+      munmap(const_cast<uint8_t*>(data_), size_);
+    }
+  }
+
+  const std::string& path() const {
+    return path_;
+  }
+
+  const uint8_t* data() const {
+    return data_;
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+ private:
+  std::string path_;
+  const uint8_t* data_ = nullptr;
+  size_t size_ = 0;
+
+  MIRAKC_ARIB_NON_COPYABLE(MappedFile);
+};
+
+enum class OutputFormat {
+  kJsonl,
+  kMsgpack,
+};
+
+static OutputFormat g_OutputFormat = OutputFormat::kJsonl;
+
+void LoadOutputFormat() {
+  auto format = std::getenv("MIRAKC_ARIB_OUTPUT_FORMAT");
+  if (format == nullptr || std::string(format) == "jsonl") {
+    g_OutputFormat = OutputFormat::kJsonl;
+  } else if (std::string(format) == "msgpack") {
+    g_OutputFormat = OutputFormat::kMsgpack;
+  } else {
+    MIRAKC_ARIB_ERROR("MIRAKC_ARIB_OUTPUT_FORMAT: unsupported format: {}", format);
+    std::abort();
+  }
+}
+
+std::unique_ptr<JsonlSink> MakeJsonlSink() {
+  switch (g_OutputFormat) {
+    case OutputFormat::kJsonl:
+      return std::make_unique<StdoutJsonlSink>();
+    case OutputFormat::kMsgpack:
+      return std::make_unique<MsgpackJsonlSink>();
+  }
+  MIRAKC_ARIB_NEVER_REACH("unknown output format");
+}
+
 void Init(const Args& args) {
   if (args.at(kScanServices).asBool()) {
     InitLogger(kScanServices);
@@ -957,19 +1259,309 @@ void Init(const Args& args) {
     InitLogger(kSeekStart);
   } else if (args.at(kPrintPes).asBool()) {
     InitLogger(kPrintPes);
+  } else if (args.at(kIndex).asBool()) {
+    InitLogger(kIndex);
+  } else if (args.at(kServe).asBool()) {
+    InitLogger(kServe);
   }
 
-  ts::DVBCharset::EnableARIBMode();
+  LoadOutputFormat();
+
+  // Only `scan-services` decodes strings with tsduck.  Other sub-commands
+  // don't need to pay for the initialization of the ARIB charset tables.
+  // `serve` enables it in advance for sessions forked from it.
+  if (args.at(kScanServices).asBool() || args.at(kServe).asBool()) {
+    ts::DVBCharset::EnableARIBMode();
+  }
 }
 
-std::unique_ptr<PacketSource> MakePacketSource(const Args& args) {
+std::vector<std::string> GetInputFiles(const Args& args) {
   static const std::string kFile = "<file>";
 
-  std::string path = args.at(kFile).isString() ? args.at(kFile).asString() : "";
+  // `<file>` is a string list in all sub-commands because `collect-eits`
+  // accepts multiple files.
+  const auto& file = args.at(kFile);
+  if (file.isStringList()) {
+    return file.asStringList();
+  }
+  if (file.isString()) {
+    return { file.asString() };
+  }
+  return {};
+}
+
+std::unique_ptr<PacketSource> MakePacketSource(const std::string& path) {
   std::unique_ptr<File> file = std::make_unique<PosixFile>(path);
   return std::make_unique<FileSource>(std::move(file));
 }
 
+std::unique_ptr<PacketSource> MakePacketSource(const Args& args) {
+  auto files = GetInputFiles(args);
+  return MakePacketSource(files.empty() ? "" : files[0]);
+}
+
+bool GetFileSize(const std::string& path, uint64_t* size) {
+  struct stat st;
+  if (stat(path.c_str(), &st) < 0) {
+    return false;
+  }
+  *size = static_cast<uint64_t>(st.st_size);
+  return true;
+}
+
+// `mapped` must outlive `index`.
+bool LoadPcrIndex(const MappedFile& mapped, uint16_t sid, uint64_t file_size,
+                  PcrIndex* index) {
+  if (mapped.data() == nullptr) {
+    return false;  // not found
+  }
+  if (!index->Map(mapped.data(), mapped.size(), mapped.path())) {
+    return false;
+  }
+  if (!index->IsValidFor(sid, file_size)) {
+    MIRAKC_ARIB_INFO("{} is outdated", mapped.path());
+    return false;
+  }
+  return true;
+}
+
+bool BuildPcrIndex(const std::string& path, const PcrIndexerOption& option,
+                   uint64_t file_size, PcrIndex* index) {
+  MIRAKC_ARIB_INFO("Building the PCR index of {}...", path);
+  FileSource src(std::make_unique<PosixFile>(path));
+  auto indexer = std::make_unique<PcrIndexer>(option, &src);
+  auto* indexer_ptr = indexer.get();
+  src.Connect(std::move(indexer));
+  if (!src.FeedPackets()) {
+    return false;
+  }
+  *index = std::move(indexer_ptr->index());
+  index->SetFileSize(file_size);
+  return true;
+}
+
+// Writes the index into a temporary file and renames it like
+// EitSnapshot::Save().  Another process may have mapped the previous index,
+// and truncating it causes SIGBUS in that process.  A partially written index
+// is never left at the path even if the program is killed while writing.
+//
+// The temporary file name contains the PID because processes using the same
+// index may save it at the same time.
+bool SavePcrIndex(const std::string& path, const PcrIndex& index) {
+  auto tmp_path = fmt::format("{}.{}.tmp", path, getpid());
+  {
+    PosixFile file(tmp_path, PosixFile::Mode::kWrite);
+    if (!file.Trunc(0) || !index.Save(&file) || !file.Sync()) {
+      MIRAKC_ARIB_ERROR("Failed to save the PCR index into {}", tmp_path);
+      unlink(tmp_path.c_str());
+      return false;
+    }
+  }
+  if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+    MIRAKC_ARIB_ERROR("Failed to rename {} to {}: {} ({})",
+                      tmp_path, path, std::strerror(errno), errno);
+    unlink(tmp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+// An additional TV program specified with `filter-program --program`.
+struct ProgramSpec {
+  uint16_t eid = 0;
+  int fd = -1;
+  ts::MilliSecond start_margin = 0;
+  ts::MilliSecond end_margin = 0;
+};
+
+// Parses `<eid>:<fd>[:<start-margin>[:<end-margin>]]`.
+//
+// Like LoadComponentTags(), the program aborts if conditions are not met.
+void LoadProgramSpecs(const Args& args, std::vector<ProgramSpec>* specs) {
+  static const std::string kProgram = "--program";
+
+  if (!args.at(kProgram)) {
+    return;
+  }
+
+  for (const auto& str : args.at(kProgram).asStringList()) {
+    std::vector<std::string> fields;
+    size_t begin = 0;
+    while (true) {
+      auto end = str.find(':', begin);
+      fields.push_back(str.substr(begin, end - begin));
+      if (end == std::string::npos) {
+        break;
+      }
+      begin = end + 1;
+    }
+    if (fields.size() < 2 || fields.size() > 4) {
+      MIRAKC_ARIB_ERROR(
+          "{}: must be <eid>:<fd>[:<start-margin>[:<end-margin>]]: {}",
+          kProgram, str);
+      std::abort();
+    }
+
+    std::vector<long long> values;
+    for (size_t i = 0; i < fields.size(); ++i) {
+      const auto& field = fields[i];
+      // The EID can be specified in hex like `--eid`.
+      // std::stoll() is not used because it throws an exception.
+      char* end = nullptr;
+      errno = 0;
+      auto val = std::strtoll(field.c_str(), &end, i == 0 ? 0 : 10);
+      if (field.empty() || errno != 0 || *end != '\0') {
+        MIRAKC_ARIB_ERROR(
+            "{}: must be numbers separated by ':': {}", kProgram, str);
+        std::abort();
+      }
+      values.push_back(val);
+    }
+
+    ProgramSpec spec;
+    if (values[0] < 0 || values[0] > 0xFFFF) {
+      MIRAKC_ARIB_ERROR(
+          "{}: EID must be in the range of 0..0xFFFF: {}", kProgram, str);
+      std::abort();
+    }
+    spec.eid = static_cast<uint16_t>(values[0]);
+    // STDIN, STDOUT and STDERR are used for the input, the output of the TV
+    // program specified with `--eid` and logs respectively.
+    if (values[1] <= STDERR_FILENO || values[1] > INT_MAX) {
+      MIRAKC_ARIB_ERROR(
+          "{}: FD must be larger than {}: {}", kProgram, STDERR_FILENO, str);
+      std::abort();
+    }
+    spec.fd = static_cast<int>(values[1]);
+    if (fcntl(spec.fd, F_GETFD) < 0) {
+      MIRAKC_ARIB_ERROR("{}: FD#{} is not open: {}", kProgram, spec.fd, str);
+      std::abort();
+    }
+    for (const auto& other : *specs) {
+      if (other.fd == spec.fd) {
+        MIRAKC_ARIB_ERROR(
+            "{}: FD#{} is used more than once", kProgram, spec.fd);
+        std::abort();
+      }
+    }
+    if (values.size() > 2) {
+      spec.start_margin = static_cast<ts::MilliSecond>(values[2]);
+    }
+    if (values.size() > 3) {
+      spec.end_margin = static_cast<ts::MilliSecond>(values[3]);
+    }
+    specs->push_back(spec);
+  }
+}
+
+// Returns a packet source which starts reading packets from a position close to
+// the start of the TV program specified with `filter-program`.
+//
+// When additional TV programs are specified with `--program`, the position is
+// close to the start of the earliest one.
+std::unique_ptr<PacketSource> MakeIndexedPacketSource(const Args& args) {
+  static const std::string kSid = "--sid";
+  static const std::string kEid = "--eid";
+  static const std::string kStartMargin = "--start-margin";
+  static const std::string kIndexOption = "--index";
+
+  auto files = GetInputFiles(args);
+  if (files.empty()) {
+    MIRAKC_ARIB_ERROR("--index: <file> must be specified");
+    return nullptr;
+  }
+  const auto& path = files[0];
+
+  uint64_t file_size;
+  if (!GetFileSize(path, &file_size)) {
+    MIRAKC_ARIB_ERROR("Failed to get the size of {}: {} ({})",
+                      path, std::strerror(errno), errno);
+    return nullptr;
+  }
+
+  auto sid = static_cast<uint16_t>(args.at(kSid).asLong());
+  auto eid = static_cast<uint16_t>(args.at(kEid).asLong());
+  ts::MilliSecond start_margin = 0;
+  if (args.at(kStartMargin)) {
+    start_margin = static_cast<ts::MilliSecond>(args.at(kStartMargin).asInt64());
+  }
+
+  const auto& index_path = args.at(kIndexOption).asString();
+  auto mapped = std::make_unique<MappedFile>(index_path);
+  PcrIndex index;
+  if (!LoadPcrIndex(*mapped, sid, file_size, &index)) {
+    // Unmap the file before replacing it.
+    index = PcrIndex();
+    mapped.reset();
+    PcrIndexerOption option;
+    option.sid = sid;
+    if (!BuildPcrIndex(path, option, file_size, &index)) {
+      MIRAKC_ARIB_ERROR("Failed to build the PCR index of {}", path);
+      return nullptr;
+    }
+    SavePcrIndex(index_path, index);
+  }
+
+  auto pos = index.FindProgramStartPos(eid, start_margin);
+  std::vector<ProgramSpec> specs;
+  LoadProgramSpecs(args, &specs);
+  for (const auto& spec : specs) {
+    // 0 is returned if the TV program is not found in the index.
+    pos = std::min(pos, index.FindProgramStartPos(spec.eid, spec.start_margin));
+  }
+  auto src = std::make_unique<FileSource>(std::make_unique<PosixFile>(path));
+  if (pos != 0 && !src->Seek(pos)) {
+    return nullptr;
+  }
+  return src;
+}
+
+void LoadOption(const Args& args, PcrIndexerOption* opt) {
+  static const std::string kSid = "--sid";
+  static const std::string kInterval = "--interval";
+
+  if (args.at(kSid)) {
+    opt->sid = static_cast<uint16_t>(args.at(kSid).asLong());
+  }
+  if (args.at(kInterval)) {
+    auto interval = args.at(kInterval).asInt64();
+    if (interval <= 0) {
+      MIRAKC_ARIB_ERROR("{}: must be a positive number: {}", kInterval, interval);
+      std::abort();
+    }
+    opt->interval = static_cast<uint64_t>(interval);
+  }
+  MIRAKC_ARIB_INFO("Options: sid={:04X} interval={}", opt->sid, opt->interval);
+}
+
+// Makes a PCR index of a TS file and saves it.
+int MakeIndex(const Args& args) {
+  static const std::string kOutput = "--output";
+
+  PcrIndexerOption option;
+  LoadOption(args, &option);
+
+  const auto& path = GetInputFiles(args)[0];
+  auto index_path = args.at(kOutput) ? args.at(kOutput).asString() : path + ".index";
+
+  uint64_t file_size;
+  if (!GetFileSize(path, &file_size)) {
+    MIRAKC_ARIB_ERROR("Failed to get the size of {}: {} ({})",
+                      path, std::strerror(errno), errno);
+    return EXIT_FAILURE;
+  }
+
+  PcrIndex index;
+  if (!BuildPcrIndex(path, option, file_size, &index)) {
+    MIRAKC_ARIB_ERROR("Failed to build the PCR index of {}", path);
+    return EXIT_FAILURE;
+  }
+  if (!SavePcrIndex(index_path, index)) {
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
 ts::Time ConvertUnixTimeToJstTime(ts::MilliSecond unix_time_ms) {
   return ts::Time::UnixEpoch + unix_time_ms + kJstTzOffset;
 }
@@ -1038,6 +1630,9 @@ void LoadComponentTags(const Args& args, const std::string& name,
 void LoadOption(const Args& args, EitCollectorOption* opt) {
   static const std::string kTimeLimit = "--time-limit";
   static const std::string kStreaming = "--streaming";
+  static const std::string kJobs = "--jobs";
+  static const std::string kStateFile = "--state-file";
+  static const std::string kDiff = "--diff";
   static const std::string kUseUnicodeSymbol = "--use-unicode-symbol";
 
   LoadSidSet(args, "--sids", &opt->sids);
@@ -1047,12 +1642,27 @@ void LoadOption(const Args& args, EitCollectorOption* opt) {
         static_cast<ts::MilliSecond>(args.at(kTimeLimit).asInt64());
   }
   opt->streaming = args.at(kStreaming).asBool();
+  if (args.at(kJobs)) {
+    auto jobs = args.at(kJobs).asLong();
+    if (jobs < 0) {
+      MIRAKC_ARIB_ERROR("jobs must be zero or a positive integer");
+      std::abort();
+    }
+    opt->num_workers = static_cast<size_t>(jobs);
+  }
+  if (args.at(kStateFile)) {
+    opt->state_file = args.at(kStateFile).asString();
+  }
+  opt->diff = args.at(kDiff).asBool();
   auto use_unicode_symbol = args.at(kUseUnicodeSymbol).asBool();
   if (use_unicode_symbol) {
     g_KeepUnicodeSymbols = true;
   }
-  MIRAKC_ARIB_INFO("Options: time-limit={}, streaming={} use-unicode-symbol={}",
-                   opt->time_limit, opt->streaming, use_unicode_symbol);
+  MIRAKC_ARIB_INFO(
+      "Options: time-limit={}, streaming={} jobs={} state-file={} diff={}"
+      " use-unicode-symbol={}",
+      opt->time_limit, opt->streaming, opt->num_workers, opt->state_file,
+      opt->diff, use_unicode_symbol);
 }
 
 void LoadOption(const Args& args, ServiceFilterOption* opt) {
@@ -1077,6 +1687,7 @@ void LoadOption(const Args& args, ProgramFilterOption* opt) {
   static const std::string kStartMargin = "--start-margin";
   static const std::string kEndMargin = "--end-margin";
   static const std::string kPreStreaming = "--pre-streaming";
+  static const std::string kKeyframeStart = "--keyframe-start";
 
   opt->sid = static_cast<uint16_t>(args.at(kSid).asLong());
   opt->eid = static_cast<uint16_t>(args.at(kEid).asLong());
@@ -1095,11 +1706,12 @@ void LoadOption(const Args& args, ProgramFilterOption* opt) {
         static_cast<ts::MilliSecond>(args.at(kEndMargin).asInt64());
   }
   opt->pre_streaming = args.at(kPreStreaming).asBool();
+  opt->keyframe_start = args.at(kKeyframeStart).asBool();
   MIRAKC_ARIB_INFO(
       "ProgramFilterOptions: sid={:04X} eid={:04X} clock=({:04X}, {:011X}, {})"
-      " margin=({}, {}) pre-streaming={}",
+      " margin=({}, {}) pre-streaming={} keyframe-start={}",
       opt->sid, opt->eid, opt->clock_pid, opt->clock_pcr, opt->clock_time,
-      opt->start_margin, opt->end_margin, opt->pre_streaming);
+      opt->start_margin, opt->end_margin, opt->pre_streaming, opt->keyframe_start);
 }
 
 void LoadOption(const Args& args, ProgramMetadataFilterOption* opt) {
@@ -1172,6 +1784,7 @@ void LoadOption(const Args& args, StartSeekerOption* opt) {
   static const std::string kSid = "--sid";
   static const std::string kMaxDuration = "--max-duration";
   static const std::string kMaxPackets = "--max-packets";
+  static const std::string kKeyframeStart = "--keyframe-start";
 
   opt->sid = static_cast<uint16_t>(args.at(kSid).asLong());
   if (args.at(kMaxDuration)) {
@@ -1185,17 +1798,86 @@ void LoadOption(const Args& args, StartSeekerOption* opt) {
     fmt::print(kSeekStartHelp);
     exit(EXIT_FAILURE);
   }
-  MIRAKC_ARIB_INFO("Options: sid={:04X} max-duration={} max-packets={}",
-                   opt->sid, opt->max_duration, opt->max_packets);
+  opt->keyframe_start = args.at(kKeyframeStart).asBool();
+  MIRAKC_ARIB_INFO(
+      "Options: sid={:04X} max-duration={} max-packets={} keyframe-start={}",
+      opt->sid, opt->max_duration, opt->max_packets, opt->keyframe_start);
+}
+
+// Makes a pipeline extracting multiple TV programs in a single pass like below:
+//
+//   ServiceFilter --> Fanout -+-> ProgramFilter --> FdSink (STDOUT)
+//                             +-> ProgramFilter --> FdSink (FD in --program)
+//                             ...
+//
+// Each packet is passed to all program filters without copying it.
+std::unique_ptr<PacketSink> MakeMultiProgramFilter(
+    const ServiceFilterOption& service_filter_option,
+    const ProgramFilterOption& program_filter_option,
+    const std::vector<ProgramSpec>& specs, bool threaded) {
+  // A reader of an output may close its pipe before the TV program ends.
+  // Ignore SIGPIPE so that write() fails with EPIPE and FanoutSink stops only
+  // that output instead of the whole process being killed.
+  signal(SIGPIPE, SIG_IGN);
+
+  std::vector<std::pair<ProgramFilterOption, int>> programs;
+  programs.emplace_back(program_filter_option, FdSink::kStdoutFd);
+  for (const auto& spec : specs) {
+    auto option = program_filter_option;
+    option.eid = spec.eid;
+    option.start_margin = spec.start_margin;
+    option.end_margin = spec.end_margin;
+    MIRAKC_ARIB_INFO(
+        "Program: eid={:04X} fd={} margin=({}, {})",
+        option.eid, spec.fd, option.start_margin, option.end_margin);
+    programs.emplace_back(option, spec.fd);
+  }
+
+  if (threaded) {
+    MIRAKC_ARIB_INFO("Run stages on different threads");
+    // Each program filter has its own PsiState because PsiState is not
+    // thread-safe.
+    using Output = BasicThreadedSink<FdSink>;
+    using Program = BasicThreadedSink<BasicProgramFilter<Output>>;
+    using Fanout = BasicFanoutSink<Program>;
+    using Service = BasicServiceFilter<Fanout>;
+    auto fanout = std::make_unique<Fanout>();
+    for (const auto& [option, fd] : programs) {
+      auto program_filter = std::make_unique<BasicProgramFilter<Output>>(option);
+      program_filter->Connect(
+          std::make_unique<Output>(std::make_unique<FdSink>(fd)));
+      fanout->Connect(std::make_unique<Program>(std::move(program_filter)));
+    }
+    auto service_filter = std::make_unique<Service>(service_filter_option);
+    service_filter->Connect(std::move(fanout));
+    return service_filter;
+  }
+
+  // All stages share tables parsed once.
+  auto psi = std::make_shared<PsiState>(service_filter_option.sid);
+  using Program = BasicProgramFilter<FdSink>;
+  using Fanout = BasicFanoutSink<Program>;
+  using Service = BasicServiceFilter<Fanout>;
+  auto fanout = std::make_unique<Fanout>();
+  for (const auto& [option, fd] : programs) {
+    auto program_filter = std::make_unique<Program>(option, psi);
+    program_filter->Connect(std::make_unique<FdSink>(fd));
+    fanout->Connect(std::move(program_filter));
+  }
+  auto service_filter = std::make_unique<Service>(service_filter_option, psi);
+  service_filter->Connect(std::move(fanout));
+  return service_filter;
 }
 
 std::unique_ptr<PacketSink> MakePacketSink(const Args& args) {
+  static const std::string kThreaded = "--threaded";
+
   if (args.at(kScanServices).asBool()) {
     ServiceScannerOption option;
     LoadSidSet(args, "--sids", &option.sids);
     LoadSidSet(args, "--xsids", &option.xsids);
     auto scanner = std::make_unique<ServiceScanner>(option);
-    scanner->Connect(std::move(std::make_unique<StdoutJsonlSink>()));
+    scanner->Connect(MakeJsonlSink());
     return scanner;
   }
   if (args.at(kSyncClocks).asBool()) {
@@ -1203,44 +1885,62 @@ std::unique_ptr<PacketSink> MakePacketSink(const Args& args) {
     LoadSidSet(args, "--sids", &option.sids);
     LoadSidSet(args, "--xsids", &option.xsids);
     auto sync = std::make_unique<PcrSynchronizer>(option);
-    sync->Connect(std::move(std::make_unique<StdoutJsonlSink>()));
+    sync->Connect(MakeJsonlSink());
     return sync;
   }
   if (args.at(kCollectEits).asBool()) {
     EitCollectorOption option;
     LoadOption(args, &option);
     auto collector = std::make_unique<EitCollector>(option);
-    collector->Connect(std::move(std::make_unique<StdoutJsonlSink>()));
+    collector->Connect(MakeJsonlSink());
     return collector;
   }
   if (args.at(kCollectLogos).asBool()) {
     auto collector = std::make_unique<LogoCollector>();
-    collector->Connect(std::move(std::make_unique<StdoutJsonlSink>()));
+    collector->Connect(MakeJsonlSink());
     return collector;
   }
   if (args.at(kFilterService).asBool()) {
     ServiceFilterOption option;
     LoadOption(args, &option);
-    auto filter = std::make_unique<ServiceFilter>(option);
+    auto filter = std::make_unique<BasicServiceFilter<StdoutSink>>(option);
     filter->Connect(std::make_unique<StdoutSink>());
     return filter;
   }
   if (args.at(kFilterProgram).asBool()) {
     ProgramFilterOption program_filter_option;
     LoadOption(args, &program_filter_option);
-    auto program_filter = std::make_unique<ProgramFilter>(program_filter_option);
-    program_filter->Connect(std::make_unique<StdoutSink>());
     ServiceFilterOption service_filter_option;
     LoadOption(args, &service_filter_option);
-    auto service_filter = std::make_unique<ServiceFilter>(service_filter_option);
-    service_filter->Connect(std::move(program_filter));
-    return service_filter;
+    std::vector<ProgramSpec> specs;
+    LoadProgramSpecs(args, &specs);
+    if (!specs.empty()) {
+      return MakeMultiProgramFilter(
+          service_filter_option, program_filter_option, specs,
+          args.at(kThreaded).asBool());
+    }
+    if (args.at(kThreaded).asBool()) {
+      MIRAKC_ARIB_INFO("Run stages on different threads");
+      using Output = BasicThreadedSink<StdoutSink>;
+      using Program = BasicThreadedSink<BasicProgramFilter<Output>>;
+      using Service = BasicServiceFilter<Program>;
+      auto program_filter =
+          std::make_unique<BasicProgramFilter<Output>>(program_filter_option);
+      program_filter->Connect(
+          std::make_unique<Output>(std::make_unique<StdoutSink>()));
+      auto service_filter = std::make_unique<Service>(service_filter_option);
+      service_filter->Connect(std::make_unique<Program>(std::move(program_filter)));
+      return service_filter;
+    }
+    return MakeProgramPipeline(
+        service_filter_option, program_filter_option,
+        std::make_unique<StdoutSink>());
   }
   if (args.at(kFilterProgramMetadata).asBool()) {
     ProgramMetadataFilterOption option;
     LoadOption(args, &option);
     auto filter = std::make_unique<ProgramMetadataFilter>(option);
-    filter->Connect(std::move(std::make_unique<StdoutJsonlSink>()));
+    filter->Connect(MakeJsonlSink());
     return filter;
   }
   if (args.at(kRecordService).asBool()) {
@@ -1249,12 +1949,29 @@ std::unique_ptr<PacketSink> MakePacketSink(const Args& args) {
     auto file = std::make_unique<PosixFile>(recorder_option.file, PosixFile::Mode::kWrite);
     auto sink = std::make_unique<RingFileSink>(
         std::move(file), recorder_option.chunk_size, recorder_option.num_chunks);
-    auto recorder = std::make_unique<ServiceRecorder>(recorder_option);
-    recorder->ServiceRecorder::Connect(std::move(sink));
-    recorder->JsonlSource::Connect(std::move(std::make_unique<StdoutJsonlSink>()));
+    // The recorder and the ring file sink have to run on the same thread
+    // because the recorder is called back from the sink.
+    using Recorder = BasicServiceRecorder<RingFileSink>;
     ServiceFilterOption filter_option;
     LoadOption(args, &filter_option);
-    auto filter = std::make_unique<ServiceFilter>(filter_option);
+    if (args.at(kThreaded).asBool()) {
+      MIRAKC_ARIB_INFO("Run stages on different threads");
+      auto recorder = std::make_unique<Recorder>(recorder_option);
+      recorder->Recorder::Connect(std::move(sink));
+      recorder->JsonlSource::Connect(MakeJsonlSink());
+      using Service = BasicServiceFilter<BasicThreadedSink<Recorder>>;
+      auto filter = std::make_unique<Service>(filter_option);
+      filter->Connect(
+          std::make_unique<BasicThreadedSink<Recorder>>(std::move(recorder)));
+      return filter;
+    }
+    // Stages running on the same thread share tables parsed once.
+    auto psi = std::make_shared<PsiState>(filter_option.sid);
+    auto recorder = std::make_unique<Recorder>(recorder_option, psi);
+    recorder->Recorder::Connect(std::move(sink));
+    recorder->JsonlSource::Connect(MakeJsonlSink());
+    using Service = BasicServiceFilter<Recorder>;
+    auto filter = std::make_unique<Service>(filter_option, psi);
     filter->Connect(std::move(recorder));
     return filter;
   }
@@ -1262,7 +1979,7 @@ std::unique_ptr<PacketSink> MakePacketSink(const Args& args) {
     AirtimeTrackerOption option;
     LoadOption(args, &option);
     auto tracker = std::make_unique<AirtimeTracker>(option);
-    tracker->Connect(std::move(std::make_unique<StdoutJsonlSink>()));
+    tracker->Connect(MakeJsonlSink());
     return tracker;
   }
   if (args.at(kSeekStart).asBool()) {
@@ -1278,6 +1995,43 @@ std::unique_ptr<PacketSink> MakePacketSink(const Args& args) {
   return std::unique_ptr<PacketSink>();
 }
 
+// Collects EIT sections from multiple files in parallel.
+bool CollectEits(const Args& args, const std::vector<std::string>& files) {
+  EitCollectorOption option;
+  LoadOption(args, &option);
+
+  auto state = std::make_shared<EitCollectorSharedState>();
+  SharedJsonlSink sink(MakeJsonlSink());
+
+  std::vector<std::unique_ptr<PacketSource>> srcs;
+  for (const auto& file : files) {
+    auto collector = std::make_unique<EitCollector>(option, state);
+    collector->Connect(sink.Clone());
+    auto src = MakePacketSource(file);
+    src->Connect(std::move(collector));
+    srcs.push_back(std::move(src));
+  }
+
+  MIRAKC_ARIB_INFO("Collect EIT sections from {} files in parallel",
+                   files.size());
+
+  // Use `char` instead of `bool` so that each thread writes its own byte.
+  std::vector<char> results(srcs.size(), false);
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < srcs.size(); ++i) {
+    threads.emplace_back([&srcs, &results, i] {
+      results[i] = srcs[i]->FeedPackets();
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  // A collector which has reached the end of its file before the completion
+  // returns false.
+  return std::find(results.begin(), results.end(), true) != results.end();
+}
+
 void ShowHelp(const Args& args) {
   if (args.at(kScanServices).asBool()) {
     fmt::print(kScanServicesHelp);
@@ -1301,21 +2055,33 @@ void ShowHelp(const Args& args) {
     fmt::print(kSeekStartHelp);
   } else if (args.at(kPrintPes).asBool()) {
     fmt::print(kPrintPesHelp);
+  } else if (args.at(kIndex).asBool()) {
+    fmt::print(kIndexHelp);
+  } else if (args.at(kServe).asBool()) {
+    fmt::print(kServeHelp);
   } else {
     fmt::print(kUsage);
   }
 }
 
-}  // namespace
+static bool g_InSession = false;
 
-int main(int argc, char* argv[]) {
-  spdlog::cfg::load_env_levels("MIRAKC_ARIB_LOG");
+int Run(const std::vector<std::string>& argv);
 
-  auto keep_unicode_symbols = std::getenv("MIRAKC_ARIB_KEEP_UNICODE_SYMBOLS");
-  if (keep_unicode_symbols != nullptr && std::string(keep_unicode_symbols) == "1") {
-    g_KeepUnicodeSymbols = true;
+int Serve(const Args& args) {
+  SessionServer server(args.at("--socket").asString(),
+                       [](const std::vector<std::string>& argv) {
+                         g_InSession = true;
+                         return Run(argv);
+                       });
+  if (!server.Listen()) {
+    return EXIT_FAILURE;
   }
+  server.Serve();
+  return EXIT_FAILURE;
+}
 
+int Run(const std::vector<std::string>& argv) {
   auto version = fmt::format(kVersion,
                              MIRAKC_ARIB_VERSION,
                              MIRAKC_ARIB_DOCOPT_VERSION,
@@ -1327,19 +2093,66 @@ int main(int argc, char* argv[]) {
                              MIRAKC_ARIB_TSDUCK_ARIB_VERSION,
                              MIRAKC_ARIB_LIBISDB_VERSION);
 
-  auto args =
-      docopt::docopt(kUsage, { argv + 1, argv + argc }, false, version);
+  auto args = docopt::docopt(kUsage, argv, false, version);
 
   if (args.at("-h").asBool() || args.at("--help").asBool()) {
     ShowHelp(args);
     return EXIT_SUCCESS;
   }
 
+  // Checked before Init() which registers the logger again.
+  if (g_InSession && args.at(kServe).asBool()) {
+    MIRAKC_ARIB_ERROR("serve: cannot be requested in a session");
+    return EXIT_FAILURE;
+  }
+
   Init(args);
 
-  auto src = MakePacketSource(args);
+  if (args.at(kServe).asBool()) {
+    // The reporter is started in each session instead.  A reporter thread in
+    // this process might hold the lock of the registry when a session is
+    // forked, and the session would deadlock on the first use of metrics.
+    return Serve(args);
+  }
+
+  StartMetricsReporter();
+
+  if (args.at(kCollectEits).asBool()) {
+    auto files = GetInputFiles(args);
+    if (files.size() > 1) {
+      auto success = CollectEits(args, files);
+      return success ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+  }
+
+  if (args.at(kIndex).asBool()) {
+    return MakeIndex(args);
+  }
+
+  std::unique_ptr<PacketSource> src;
+  if (args.at(kFilterProgram).asBool() && args.at("--index")) {
+    src = MakeIndexedPacketSource(args);
+    if (!src) {
+      return EXIT_FAILURE;
+    }
+  } else {
+    src = MakePacketSource(args);
+  }
   src->Connect(MakePacketSink(args));
   auto success = src->FeedPackets();
 
   return success ? EXIT_SUCCESS : EXIT_FAILURE;
 }
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  spdlog::cfg::load_env_levels("MIRAKC_ARIB_LOG");
+
+  auto keep_unicode_symbols = std::getenv("MIRAKC_ARIB_KEEP_UNICODE_SYMBOLS");
+  if (keep_unicode_symbols != nullptr && std::string(keep_unicode_symbols) == "1") {
+    g_KeepUnicodeSymbols = true;
+  }
+
+  return Run({ argv + 1, argv + argc });
+}
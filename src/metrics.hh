@@ -0,0 +1,393 @@
+#pragma once
+
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+
+#include "base.hh"
+#include "logging.hh"
+
+namespace {
+
+// Metrics are collected only when this flag is set.  The flag must be set
+// before pipelines start.  See StartMetricsReporter().
+static bool g_MetricsEnabled = false;
+
+class MetricsCounter final {
+ public:
+  MetricsCounter() = default;
+  ~MetricsCounter() = default;
+
+  void Add(uint64_t n) {
+    value_.fetch_add(n, std::memory_order_relaxed);
+  }
+
+  uint64_t value() const {
+    return value_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  std::atomic<uint64_t> value_{0};
+
+  MIRAKC_ARIB_NON_COPYABLE(MetricsCounter);
+};
+
+// Records values into log-linear buckets like HdrHistogram.  Each range
+// between powers of two is split into 8 sub-buckets.  So, the relative error
+// of percentiles is less than 12.5%.
+class MetricsHistogram final {
+ public:
+  static constexpr int kSubBucketBits = 3;
+  static constexpr size_t kNumSubBuckets = 1 << kSubBucketBits;
+  static constexpr size_t kNumBuckets = (64 - kSubBucketBits + 1) * kNumSubBuckets;
+
+  MetricsHistogram() = default;
+  ~MetricsHistogram() = default;
+
+  void Record(uint64_t value) {
+    buckets_[GetBucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(value, std::memory_order_relaxed);
+    auto max = max_.load(std::memory_order_relaxed);
+    while (value > max &&
+           !max_.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+      continue;
+    }
+  }
+
+  uint64_t count() const {
+    return count_.load(std::memory_order_relaxed);
+  }
+
+  uint64_t sum() const {
+    return sum_.load(std::memory_order_relaxed);
+  }
+
+  uint64_t max() const {
+    return max_.load(std::memory_order_relaxed);
+  }
+
+  // Returns the upper bound of the bucket containing the value at
+  // `percentile` (0..100).  Returns 0 if no value has been recorded.
+  uint64_t GetPercentile(double percentile) const {
+    const auto count = this->count();
+    if (count == 0) {
+      return 0;
+    }
+    auto target = static_cast<uint64_t>(count * percentile / 100.0 + 0.5);
+    if (target == 0) {
+      target = 1;
+    }
+    uint64_t accum = 0;
+    for (size_t i = 0; i < kNumBuckets; ++i) {
+      accum += buckets_[i].load(std::memory_order_relaxed);
+      if (accum >= target) {
+        return std::min(GetBucketUpperBound(i), max());
+      }
+    }
+    return max();
+  }
+
+  static size_t GetBucketIndex(uint64_t value) {
+    if (value < kNumSubBuckets) {
+      return static_cast<size_t>(value);
+    }
+    const int msb = 63 - __builtin_clzll(value);
+    const auto sub = (value >> (msb - kSubBucketBits)) & (kNumSubBuckets - 1);
+    return (msb - kSubBucketBits + 1) * kNumSubBuckets + static_cast<size_t>(sub);
+  }
+
+  static uint64_t GetBucketUpperBound(size_t index) {
+    if (index < kNumSubBuckets) {
+      return index;
+    }
+    const auto shift = index / kNumSubBuckets - 1;
+    const auto lower = static_cast<uint64_t>(kNumSubBuckets + index % kNumSubBuckets) << shift;
+    return lower + ((static_cast<uint64_t>(1) << shift) - 1);
+  }
+
+ private:
+  std::atomic<uint64_t> buckets_[kNumBuckets] = {};
+  std::atomic<uint64_t> count_{0};
+  std::atomic<uint64_t> sum_{0};
+  std::atomic<uint64_t> max_{0};
+
+  MIRAKC_ARIB_NON_COPYABLE(MetricsHistogram);
+};
+
+// Metrics are registered on the first use and never removed.  So, pointers
+// returned from the registry can be cached.
+class MetricsRegistry final {
+ public:
+  static MetricsRegistry& GetInstance() {
+    // Never destroyed because the reporter thread may access it at exit.
+    static auto* registry = new MetricsRegistry();
+    return *registry;
+  }
+
+  MetricsCounter* GetCounter(const std::string& name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& counter = counters_[name];
+    if (!counter) {
+      counter = std::make_unique<MetricsCounter>();
+    }
+    return counter.get();
+  }
+
+  MetricsHistogram* GetHistogram(const std::string& name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& histogram = histograms_[name];
+    if (!histogram) {
+      histogram = std::make_unique<MetricsHistogram>();
+    }
+    return histogram.get();
+  }
+
+  // Returns a snapshot in a single-line JSON like below:
+  //
+  //   {"counters":{"<name>":<value>,...},
+  //    "histograms":{"<name>":{"count":..,"sum":..,"max":..,"p50":..,
+  //                            "p90":..,"p99":..,"p999":..},...}}
+  std::string ToJson() const {
+    rapidjson::StringBuffer buf;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(buf);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    writer.StartObject();
+    writer.Key("counters");
+    writer.StartObject();
+    for (const auto& [name, counter] : counters_) {
+      writer.Key(name.c_str());
+      writer.Uint64(counter->value());
+    }
+    writer.EndObject();
+    writer.Key("histograms");
+    writer.StartObject();
+    for (const auto& [name, histogram] : histograms_) {
+      writer.Key(name.c_str());
+      writer.StartObject();
+      writer.Key("count");
+      writer.Uint64(histogram->count());
+      writer.Key("sum");
+      writer.Uint64(histogram->sum());
+      writer.Key("max");
+      writer.Uint64(histogram->max());
+      writer.Key("p50");
+      writer.Uint64(histogram->GetPercentile(50.0));
+      writer.Key("p90");
+      writer.Uint64(histogram->GetPercentile(90.0));
+      writer.Key("p99");
+      writer.Uint64(histogram->GetPercentile(99.0));
+      writer.Key("p999");
+      writer.Uint64(histogram->GetPercentile(99.9));
+      writer.EndObject();
+    }
+    writer.EndObject();
+    writer.EndObject();
+    return std::string(buf.GetString(), buf.GetSize());
+  }
+
+ private:
+  MetricsRegistry() = default;
+  ~MetricsRegistry() = default;
+
+  mutable std::mutex mutex_;
+  std::map<std::string, std::unique_ptr<MetricsCounter>> counters_;  // guarded by mutex_
+  std::map<std::string, std::unique_ptr<MetricsHistogram>> histograms_;  // guarded by mutex_
+
+  MIRAKC_ARIB_NON_COPYABLE(MetricsRegistry);
+};
+
+// Records the elapsed time of a scope in nanoseconds.
+class MetricsTimer final {
+ public:
+  explicit MetricsTimer(MetricsHistogram* histogram) : histogram_(histogram) {
+    if (histogram_ != nullptr) {
+      start_ = std::chrono::steady_clock::now();
+    }
+  }
+
+  ~MetricsTimer() {
+    if (histogram_ != nullptr) {
+      auto elapsed = std::chrono::steady_clock::now() - start_;
+      histogram_->Record(static_cast<uint64_t>(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+    }
+  }
+
+ private:
+  MetricsHistogram* histogram_;
+  std::chrono::steady_clock::time_point start_;
+
+  MIRAKC_ARIB_NON_COPYABLE(MetricsTimer);
+};
+
+inline void WriteMetrics(int fd) {
+  auto json = MetricsRegistry::GetInstance().ToJson();
+  json.push_back('\n');
+  size_t nwritten = 0;
+  while (nwritten < json.size()) {
+    auto result = write(fd, json.data() + nwritten, json.size() - nwritten);
+    if (result < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return;
+    }
+    nwritten += result;
+  }
+}
+
+// Enables metrics if the MIRAKC_ARIB_METRICS environment variable is 1, and
+// starts a thread writing metrics in JSON:
+//
+//   * to STDERR when SIGUSR1 is received
+//   * to the file descriptor specified with MIRAKC_ARIB_METRICS_FD at intervals
+//     specified with MIRAKC_ARIB_METRICS_INTERVAL in milliseconds (1000 by
+//     default)
+//
+// This function must be called before other threads are created.  SIGUSR1 is
+// blocked in the calling thread so that threads created after that never
+// receive it.
+//
+// The thread is started again in a process forked from the process calling
+// this function.  The `serve` sub-command doesn't call this function before
+// forking sessions so that a session never inherits the lock of the registry
+// held by the reporter thread.
+inline void StartMetricsReporter() {
+  static pid_t started_pid = 0;
+
+  auto enabled = std::getenv("MIRAKC_ARIB_METRICS");
+  if (enabled == nullptr || std::string(enabled) != "1") {
+    return;
+  }
+  if (started_pid == getpid()) {
+    return;
+  }
+  started_pid = getpid();
+  g_MetricsEnabled = true;
+
+  int fd = -1;
+  if (auto str = std::getenv("MIRAKC_ARIB_METRICS_FD"); str != nullptr) {
+    fd = std::atoi(str);
+  }
+  long interval = 1000;  // ms
+  if (auto str = std::getenv("MIRAKC_ARIB_METRICS_INTERVAL"); str != nullptr) {
+    interval = std::atol(str);
+  }
+  if (interval <= 0) {
+    MIRAKC_ARIB_ERROR("MIRAKC_ARIB_METRICS_INTERVAL must be a positive integer");
+    std::abort();
+  }
+
+  sigset_t set;
+  sigemptyset(&set);
+  sigaddset(&set, SIGUSR1);
+  pthread_sigmask(SIG_BLOCK, &set, nullptr);
+
+  std::thread([set, fd, interval] {
+    for (;;) {
+      int sig;
+      if (fd >= 0) {
+        struct timespec timeout;
+        timeout.tv_sec = interval / 1000;
+        timeout.tv_nsec = (interval % 1000) * 1000000;
+        sig = sigtimedwait(&set, nullptr, &timeout);
+        if (sig < 0 && errno == EAGAIN) {
+          WriteMetrics(fd);
+          continue;
+        }
+      } else {
+        sig = sigwaitinfo(&set, nullptr);
+      }
+      if (sig == SIGUSR1) {
+        WriteMetrics(STDERR_FILENO);
+      }
+    }
+  }).detach();
+
+  MIRAKC_ARIB_INFO("Metrics enabled");
+}
+
+}  // namespace
+
+#define MIRAKC_ARIB_METRICS_CONCAT_(a, b) a##b
+#define MIRAKC_ARIB_METRICS_CONCAT(a, b) MIRAKC_ARIB_METRICS_CONCAT_(a, b)
+
+// `name` must be a string literal.  Metrics are registered on the first use
+// after they are enabled, and each use site caches the pointer in a static
+// variable.  So, these macros cost only a branch when metrics are disabled.
+#define MIRAKC_ARIB_METRICS_ADD(name, n) \
+  do { \
+    if (g_MetricsEnabled) { \
+      static auto* const metrics_counter_ = \
+          MetricsRegistry::GetInstance().GetCounter(name); \
+      metrics_counter_->Add(n); \
+    } \
+  } while (0)
+
+#define MIRAKC_ARIB_METRICS_INC(name) MIRAKC_ARIB_METRICS_ADD(name, 1)
+
+#define MIRAKC_ARIB_METRICS_RECORD(name, value) \
+  do { \
+    if (g_MetricsEnabled) { \
+      static auto* const metrics_histogram_ = \
+          MetricsRegistry::GetInstance().GetHistogram(name); \
+      metrics_histogram_->Record(value); \
+    } \
+  } while (0)
+
+// Records the elapsed time from here to the end of the scope.
+#define MIRAKC_ARIB_METRICS_TIMER(name) \
+  MetricsTimer MIRAKC_ARIB_METRICS_CONCAT(metrics_timer_, __LINE__)( \
+      g_MetricsEnabled ? \
+      [] { \
+        static auto* const histogram = \
+            MetricsRegistry::GetInstance().GetHistogram(name); \
+        return histogram; \
+      }() : nullptr)
+
+// Same as MIRAKC_ARIB_METRICS_TIMER, but records only one of every `interval`
+// executions on each thread.  Use this on per-packet paths where reading the
+// clock twice for every packet would add measurable overhead.
+#define MIRAKC_ARIB_METRICS_SAMPLED_TIMER(name, interval) \
+  static thread_local uint32_t \
+      MIRAKC_ARIB_METRICS_CONCAT(metrics_timer_samples_, __LINE__) = 0; \
+  MetricsTimer MIRAKC_ARIB_METRICS_CONCAT(metrics_timer_, __LINE__)( \
+      g_MetricsEnabled && \
+      ++MIRAKC_ARIB_METRICS_CONCAT(metrics_timer_samples_, __LINE__) % \
+          (interval) == 0 ? \
+      [] { \
+        static auto* const histogram = \
+            MetricsRegistry::GetInstance().GetHistogram(name); \
+        return histogram; \
+      }() : nullptr)
+
+#if defined(MIRAKC_ARIB_DISABLE_METRICS)
+#undef MIRAKC_ARIB_METRICS_ADD
+#undef MIRAKC_ARIB_METRICS_INC
+#undef MIRAKC_ARIB_METRICS_RECORD
+#undef MIRAKC_ARIB_METRICS_TIMER
+#undef MIRAKC_ARIB_METRICS_SAMPLED_TIMER
+#define MIRAKC_ARIB_METRICS_ADD(name, n) ((void)0)
+#define MIRAKC_ARIB_METRICS_INC(name) ((void)0)
+#define MIRAKC_ARIB_METRICS_RECORD(name, value) ((void)0)
+#define MIRAKC_ARIB_METRICS_TIMER(name) ((void)0)
+#define MIRAKC_ARIB_METRICS_SAMPLED_TIMER(name, interval) ((void)0)
+#endif  // defined(MIRAKC_ARIB_DISABLE_METRICS)
@@ -0,0 +1,464 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <rapidjson/document.h>
+
+#include "base.hh"
+#include "jsonl_sink.hh"
+#include "logging.hh"
+#include "metrics.hh"
+#include "probes.hh"
+
+namespace {
+
+// A binary alternative of JSONL.
+//
+// The stream starts with a header consisting of the magic bytes and a schema
+// version number.  Each document follows the header as a frame consisting of
+// the size of the MessagePack data in the 32-bit big endian format and the
+// MessagePack data itself:
+//
+//   +------+---------+--------+-----------+--------+-----------+-----
+//   | MKAB | version | size#0 | msgpack#0 | size#1 | msgpack#1 | ...
+//   +------+---------+--------+-----------+--------+-----------+-----
+//     4B     1B        4B       size#0B     4B       size#1B
+//
+// Property names and values are the same as the JSONL format.
+constexpr char kMsgpackMagic[4] = { 'M', 'K', 'A', 'B' };
+constexpr uint8_t kMsgpackSchemaVersion = 1;
+constexpr size_t kMsgpackHeaderSize = sizeof(kMsgpackMagic) + 1;
+constexpr size_t kMsgpackFrameHeaderSize = 4;
+
+class MsgpackWriter final {
+ public:
+  MsgpackWriter() = default;
+  ~MsgpackWriter() = default;
+
+  const std::string& data() const {
+    return buf_;
+  }
+
+  void Clear() {
+    buf_.clear();
+  }
+
+  void Write(const rapidjson::Value& value) {
+    switch (value.GetType()) {
+      case rapidjson::kNullType:
+        PutUInt8(0xC0);
+        break;
+      case rapidjson::kFalseType:
+        PutUInt8(0xC2);
+        break;
+      case rapidjson::kTrueType:
+        PutUInt8(0xC3);
+        break;
+      case rapidjson::kObjectType:
+        WriteMapHeader(value.MemberCount());
+        for (const auto& member : value.GetObject()) {
+          WriteString(member.name.GetString(), member.name.GetStringLength());
+          Write(member.value);
+        }
+        break;
+      case rapidjson::kArrayType:
+        WriteArrayHeader(value.Size());
+        for (const auto& elem : value.GetArray()) {
+          Write(elem);
+        }
+        break;
+      case rapidjson::kStringType:
+        WriteString(value.GetString(), value.GetStringLength());
+        break;
+      case rapidjson::kNumberType:
+        if (value.IsDouble()) {
+          WriteDouble(value.GetDouble());
+        } else if (value.IsUint64()) {
+          WriteUint(value.GetUint64());
+        } else {
+          WriteInt(value.GetInt64());
+        }
+        break;
+    }
+  }
+
+ private:
+  void WriteUint(uint64_t v) {
+    if (v < 0x80) {
+      PutUInt8(static_cast<uint8_t>(v));  // positive fixint
+    } else if (v <= 0xFF) {
+      PutUInt8(0xCC);
+      PutUInt8(static_cast<uint8_t>(v));
+    } else if (v <= 0xFFFF) {
+      PutUInt8(0xCD);
+      PutBigEndian(v, 2);
+    } else if (v <= 0xFFFFFFFF) {
+      PutUInt8(0xCE);
+      PutBigEndian(v, 4);
+    } else {
+      PutUInt8(0xCF);
+      PutBigEndian(v, 8);
+    }
+  }
+
+  void WriteInt(int64_t v) {
+    if (v >= 0) {
+      WriteUint(static_cast<uint64_t>(v));
+    } else if (v >= -32) {
+      PutUInt8(static_cast<uint8_t>(v));  // negative fixint
+    } else if (v >= INT8_MIN) {
+      PutUInt8(0xD0);
+      PutBigEndian(static_cast<uint64_t>(v), 1);
+    } else if (v >= INT16_MIN) {
+      PutUInt8(0xD1);
+      PutBigEndian(static_cast<uint64_t>(v), 2);
+    } else if (v >= INT32_MIN) {
+      PutUInt8(0xD2);
+      PutBigEndian(static_cast<uint64_t>(v), 4);
+    } else {
+      PutUInt8(0xD3);
+      PutBigEndian(static_cast<uint64_t>(v), 8);
+    }
+  }
+
+  void WriteDouble(double v) {
+    uint64_t bits;
+    static_assert(sizeof(bits) == sizeof(v));
+    std::memcpy(&bits, &v, sizeof(bits));
+    PutUInt8(0xCB);
+    PutBigEndian(bits, 8);
+  }
+
+  void WriteString(const char* str, size_t len) {
+    if (len < 32) {
+      PutUInt8(static_cast<uint8_t>(0xA0 | len));
+    } else if (len <= 0xFF) {
+      PutUInt8(0xD9);
+      PutUInt8(static_cast<uint8_t>(len));
+    } else if (len <= 0xFFFF) {
+      PutUInt8(0xDA);
+      PutBigEndian(len, 2);
+    } else {
+      PutUInt8(0xDB);
+      PutBigEndian(len, 4);
+    }
+    buf_.append(str, len);
+  }
+
+  void WriteArrayHeader(size_t n) {
+    if (n < 16) {
+      PutUInt8(static_cast<uint8_t>(0x90 | n));
+    } else if (n <= 0xFFFF) {
+      PutUInt8(0xDC);
+      PutBigEndian(n, 2);
+    } else {
+      PutUInt8(0xDD);
+      PutBigEndian(n, 4);
+    }
+  }
+
+  void WriteMapHeader(size_t n) {
+    if (n < 16) {
+      PutUInt8(static_cast<uint8_t>(0x80 | n));
+    } else if (n <= 0xFFFF) {
+      PutUInt8(0xDE);
+      PutBigEndian(n, 2);
+    } else {
+      PutUInt8(0xDF);
+      PutBigEndian(n, 4);
+    }
+  }
+
+  inline void PutUInt8(uint8_t v) {
+    buf_.push_back(static_cast<char>(v));
+  }
+
+  inline void PutBigEndian(uint64_t v, size_t nbytes) {
+    for (size_t i = nbytes; i > 0; --i) {
+      PutUInt8(static_cast<uint8_t>(v >> ((i - 1) * 8)));
+    }
+  }
+
+  std::string buf_;
+
+  MIRAKC_ARIB_NON_COPYABLE(MsgpackWriter);
+};
+
+// Decodes MessagePack data written by MsgpackWriter.
+//
+// Only types used in MsgpackWriter are supported.
+class MsgpackReader final {
+ public:
+  MsgpackReader(const uint8_t* data, size_t size)
+      : data_(data), size_(size) {}
+
+  ~MsgpackReader() = default;
+
+  bool Read(rapidjson::Document* doc) {
+    pos_ = 0;
+    if (!ReadValue(doc, doc->GetAllocator(), 0)) {
+      return false;
+    }
+    return pos_ == size_;  // no trailing bytes
+  }
+
+ private:
+  static constexpr int kMaxDepth = 64;
+
+  bool ReadValue(rapidjson::Value* value,
+                 rapidjson::Document::AllocatorType& allocator, int depth) {
+    if (depth > kMaxDepth) {
+      return false;
+    }
+
+    uint8_t type;
+    if (!GetUInt8(&type)) {
+      return false;
+    }
+
+    if (type < 0x80) {
+      value->SetUint(type);  // positive fixint
+      return true;
+    }
+    if (type >= 0xE0) {
+      value->SetInt(static_cast<int8_t>(type));  // negative fixint
+      return true;
+    }
+    if ((type & 0xF0) == 0x80) {
+      return ReadMap(value, type & 0x0F, allocator, depth);
+    }
+    if ((type & 0xF0) == 0x90) {
+      return ReadArray(value, type & 0x0F, allocator, depth);
+    }
+    if ((type & 0xE0) == 0xA0) {
+      return ReadString(value, type & 0x1F, allocator);
+    }
+
+    uint64_t v;
+    switch (type) {
+      case 0xC0:
+        value->SetNull();
+        return true;
+      case 0xC2:
+        value->SetBool(false);
+        return true;
+      case 0xC3:
+        value->SetBool(true);
+        return true;
+      case 0xCB: {
+        if (!GetBigEndian(8, &v)) {
+          return false;
+        }
+        double d;
+        std::memcpy(&d, &v, sizeof(d));
+        value->SetDouble(d);
+        return true;
+      }
+      case 0xCC:
+      case 0xCD:
+      case 0xCE:
+      case 0xCF:
+        if (!GetBigEndian(1 << (type - 0xCC), &v)) {
+          return false;
+        }
+        value->SetUint64(v);
+        return true;
+      case 0xD0:
+      case 0xD1:
+      case 0xD2:
+      case 0xD3: {
+        auto nbytes = 1 << (type - 0xD0);
+        if (!GetBigEndian(nbytes, &v)) {
+          return false;
+        }
+        // Sign extension.
+        auto shift = 64 - nbytes * 8;
+        value->SetInt64(static_cast<int64_t>(v << shift) >> shift);
+        return true;
+      }
+      case 0xD9:
+      case 0xDA:
+      case 0xDB:
+        if (!GetBigEndian(1 << (type - 0xD9), &v)) {
+          return false;
+        }
+        return ReadString(value, v, allocator);
+      case 0xDC:
+      case 0xDD:
+        if (!GetBigEndian(2 << (type - 0xDC), &v)) {
+          return false;
+        }
+        return ReadArray(value, v, allocator, depth);
+      case 0xDE:
+      case 0xDF:
+        if (!GetBigEndian(2 << (type - 0xDE), &v)) {
+          return false;
+        }
+        return ReadMap(value, v, allocator, depth);
+      default:
+        return false;
+    }
+  }
+
+  bool ReadString(rapidjson::Value* value, uint64_t len,
+                  rapidjson::Document::AllocatorType& allocator) {
+    if (len > size_ - pos_) {
+      return false;
+    }
+    value->SetString(reinterpret_cast<const char*>(data_ + pos_),
+                     static_cast<rapidjson::SizeType>(len), allocator);
+    pos_ += len;
+    return true;
+  }
+
+  bool ReadArray(rapidjson::Value* value, uint64_t n,
+                 rapidjson::Document::AllocatorType& allocator, int depth) {
+    if (n > size_ - pos_) {  // each element needs at least 1 byte
+      return false;
+    }
+    value->SetArray();
+    for (uint64_t i = 0; i < n; ++i) {
+      rapidjson::Value elem;
+      if (!ReadValue(&elem, allocator, depth + 1)) {
+        return false;
+      }
+      value->PushBack(elem, allocator);
+    }
+    return true;
+  }
+
+  bool ReadMap(rapidjson::Value* value, uint64_t n,
+               rapidjson::Document::AllocatorType& allocator, int depth) {
+    if (n > (size_ - pos_) / 2) {  // each pair needs at least 2 bytes
+      return false;
+    }
+    value->SetObject();
+    for (uint64_t i = 0; i < n; ++i) {
+      rapidjson::Value name;
+      if (!ReadValue(&name, allocator, depth + 1) || !name.IsString()) {
+        return false;
+      }
+      rapidjson::Value member;
+      if (!ReadValue(&member, allocator, depth + 1)) {
+        return false;
+      }
+      value->AddMember(name, member, allocator);
+    }
+    return true;
+  }
+
+  inline bool GetUInt8(uint8_t* v) {
+    if (pos_ >= size_) {
+      return false;
+    }
+    *v = data_[pos_++];
+    return true;
+  }
+
+  inline bool GetBigEndian(size_t nbytes, uint64_t* v) {
+    if (nbytes > size_ - pos_) {
+      return false;
+    }
+    *v = 0;
+    for (size_t i = 0; i < nbytes; ++i) {
+      *v = (*v << 8) | data_[pos_++];
+    }
+    return true;
+  }
+
+  const uint8_t* data_;
+  size_t size_;
+  size_t pos_ = 0;
+
+  MIRAKC_ARIB_NON_COPYABLE(MsgpackReader);
+};
+
+// Reads the stream header and frames written by MsgpackJsonlSink.
+class MsgpackStreamReader final {
+ public:
+  explicit MsgpackStreamReader(std::istream& is) : is_(is) {}
+  ~MsgpackStreamReader() = default;
+
+  bool ReadHeader(uint8_t* version) {
+    char header[kMsgpackHeaderSize];
+    if (!is_.read(header, sizeof(header))) {
+      return false;
+    }
+    if (std::memcmp(header, kMsgpackMagic, sizeof(kMsgpackMagic)) != 0) {
+      return false;
+    }
+    *version = static_cast<uint8_t>(header[sizeof(kMsgpackMagic)]);
+    return true;
+  }
+
+  // Returns false at the end of the stream or if the frame is broken.
+  bool ReadFrame(rapidjson::Document* doc) {
+    uint8_t size_bytes[kMsgpackFrameHeaderSize];
+    if (!is_.read(reinterpret_cast<char*>(size_bytes), sizeof(size_bytes))) {
+      return false;
+    }
+    size_t size = 0;
+    for (auto b : size_bytes) {
+      size = (size << 8) | b;
+    }
+    buf_.resize(size);
+    if (!is_.read(reinterpret_cast<char*>(buf_.data()), size)) {
+      return false;
+    }
+    MsgpackReader reader(buf_.data(), buf_.size());
+    return reader.Read(doc);
+  }
+
+ private:
+  std::istream& is_;
+  std::vector<uint8_t> buf_;
+
+  MIRAKC_ARIB_NON_COPYABLE(MsgpackStreamReader);
+};
+
+class MsgpackJsonlSink final : public JsonlSink {
+ public:
+  explicit MsgpackJsonlSink(std::ostream& os = std::cout) : os_(os) {}
+  ~MsgpackJsonlSink() override = default;
+
+  bool HandleDocument(const rapidjson::Document& doc) override {
+    size_t nbytes = 0;
+    if (!header_written_) {
+      os_.write(kMsgpackMagic, sizeof(kMsgpackMagic));
+      os_.put(static_cast<char>(kMsgpackSchemaVersion));
+      header_written_ = true;
+      nbytes += sizeof(kMsgpackMagic) + 1;
+    }
+
+    writer_.Clear();
+    writer_.Write(doc);
+    const auto& data = writer_.data();
+    MIRAKC_ARIB_ASSERT(data.size() <= UINT32_MAX);
+
+    char size_bytes[kMsgpackFrameHeaderSize];
+    for (size_t i = 0; i < kMsgpackFrameHeaderSize; ++i) {
+      size_bytes[i] = static_cast<char>(data.size() >> ((3 - i) * 8));
+    }
+    os_.write(size_bytes, sizeof(size_bytes));
+    os_.write(data.data(), data.size());
+    // Flush each frame like StdoutJsonlSink.
+    os_.flush();
+    // The same metrics as StdoutJsonlSink.
+    nbytes += sizeof(size_bytes) + data.size();
+    MIRAKC_ARIB_METRICS_INC("jsonl_sink.documents");
+    MIRAKC_ARIB_METRICS_ADD("jsonl_sink.bytes", nbytes);
+    MIRAKC_ARIB_PROBE1(jsonl_sink_document, nbytes);
+    return static_cast<bool>(os_);
+  }
+
+ private:
+  std::ostream& os_;
+  MsgpackWriter writer_;
+  bool header_written_ = false;
+};
+
+}  // namespace
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "base.hh"
+#include "logging.hh"
+
+namespace {
+
+// A pool of worker threads which run jobs in parallel and return their results
+// in the submission order.
+//
+// Submit() and Pop() must be called from a single thread.  Jobs must not touch
+// any state shared with the submitter thread.
+template <typename T>
+class OrderedWorkerPool final {
+ public:
+  using Job = std::function<T()>;
+
+  OrderedWorkerPool(size_t num_workers, size_t max_pending_jobs)
+      : max_pending_jobs_(max_pending_jobs) {
+    MIRAKC_ARIB_ASSERT(num_workers > 0);
+    MIRAKC_ARIB_ASSERT(max_pending_jobs > 0);
+    workers_.reserve(num_workers);
+    for (size_t i = 0; i < num_workers; ++i) {
+      workers_.emplace_back([this] { RunWorker(); });
+    }
+  }
+
+  ~OrderedWorkerPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopped_ = true;
+    }
+    job_cv_.notify_all();
+    for (auto& worker : workers_) {
+      worker.join();
+    }
+  }
+
+  size_t num_workers() const {
+    return workers_.size();
+  }
+
+  // Returns true if the caller has to pop at least one result before submitting
+  // the next job.
+  bool IsFull() const {
+    return slots_.size() >= max_pending_jobs_;
+  }
+
+  bool IsEmpty() const {
+    return slots_.empty();
+  }
+
+  void Submit(Job&& job) {
+    MIRAKC_ARIB_ASSERT(!IsFull());
+    auto slot = std::make_shared<Slot>();
+    slot->job = std::move(job);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      jobs_.push_back(slot);
+    }
+    slots_.push_back(std::move(slot));
+    job_cv_.notify_one();
+  }
+
+  // Takes the result of the oldest job.
+  //
+  // Returns false if there is no job, or if `wait` is false and the oldest job
+  // has not been done yet.
+  bool Pop(T* result, bool wait) {
+    if (slots_.empty()) {
+      return false;
+    }
+    auto& slot = slots_.front();
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (wait) {
+        done_cv_.wait(lock, [&slot] { return slot->result.has_value(); });
+      } else if (!slot->result.has_value()) {
+        return false;
+      }
+    }
+    *result = std::move(*slot->result);
+    slots_.pop_front();
+    return true;
+  }
+
+ private:
+  struct Slot {
+    Job job;
+    std::optional<T> result;
+  };
+
+  void RunWorker() {
+    for (;;) {
+      std::shared_ptr<Slot> slot;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        job_cv_.wait(lock, [this] { return stopped_ || !jobs_.empty(); });
+        if (jobs_.empty()) {
+          return;  // stopped
+        }
+        slot = std::move(jobs_.front());
+        jobs_.pop_front();
+      }
+      auto result = slot->job();
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        slot->job = nullptr;
+        slot->result.emplace(std::move(result));
+      }
+      done_cv_.notify_one();
+    }
+  }
+
+  const size_t max_pending_jobs_;
+  std::vector<std::thread> workers_;
+  std::deque<std::shared_ptr<Slot>> slots_;  // accessed only by the submitter
+  std::mutex mutex_;
+  std::condition_variable job_cv_;
+  std::condition_variable done_cv_;
+  std::deque<std::shared_ptr<Slot>> jobs_;  // guarded by mutex_
+  bool stopped_ = false;  // guarded by mutex_
+
+  MIRAKC_ARIB_NON_COPYABLE(OrderedWorkerPool);
+};
+
+}  // namespace
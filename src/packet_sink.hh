@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cerrno>
+#include <cstddef>
 #include <cstring>
 
 #include <tsduck/tsduck.h>
@@ -10,6 +11,14 @@
 
 namespace {
 
+// The interface of a stage in a packet pipeline.
+//
+// A stage forwarding packets to a downstream stage takes the type of the
+// downstream stage as a template parameter like BasicServiceFilter<Sink>.  When
+// a final class such as StdoutSink is specified, the compiler can devirtualize
+// and inline calls to HandlePacket() in the per-packet path.  Each stage also
+// provides an alias such as ServiceFilter which takes any PacketSink, for use
+// in tests with mocks.
 class PacketSink {
  public:
   PacketSink() = default;
@@ -18,6 +27,17 @@ class PacketSink {
   virtual bool End() { return true; }
   virtual bool HandlePacket(const ts::TSPacket& packet) = 0;
 
+  // Handles packets buffered in a stage at once.  Stops at the first packet
+  // which fails.
+  virtual bool HandlePackets(const ts::TSPacket* packets, size_t num_packets) {
+    for (size_t i = 0; i < num_packets; ++i) {
+      if (!HandlePacket(packets[i])) {
+        return false;
+      }
+    }
+    return true;
+  }
+
  private:
   MIRAKC_ARIB_NON_COPYABLE(PacketSink);
 };
@@ -45,13 +65,26 @@ class PacketRingSink : public PacketSink {
   MIRAKC_ARIB_NON_COPYABLE(PacketRingSink);
 };
 
-class StdoutSink final : public PacketSink {
+// Writes packets to a file descriptor.
+//
+// The file descriptor is not closed by this class.
+class FdSink final : public PacketSink {
  public:
-  StdoutSink() = default;
-  ~StdoutSink() override {}
+  static constexpr int kStdoutFd = 1;
 
+  explicit FdSink(int fd = kStdoutFd) : fd_(fd) {}
+  ~FdSink() override {}
+
+  // Closes the FD unless it's STDOUT so that the reader gets EOF before the
+  // process exits.
   bool End() override {
-    return Flush();
+    auto success = Flush();
+    if (fd_ != kStdoutFd && close(fd_) < 0) {
+      MIRAKC_ARIB_ERROR("Failed to close FD#{}: {} ({})",
+                        fd_, std::strerror(errno), errno);
+      success = false;
+    }
+    return success;
   }
 
   bool HandlePacket(const ts::TSPacket& packet) override {
@@ -78,34 +111,58 @@ class StdoutSink final : public PacketSink {
     return true;
   }
 
- private:
-  static constexpr int kStdoutFd = 1;
+  bool HandlePackets(const ts::TSPacket* packets, size_t num_packets) override {
+    static_assert(sizeof(ts::TSPacket) == ts::PKT_SIZE);
+    auto size = num_packets * ts::PKT_SIZE;
+    if (pos_ + size < kBufferSize) {
+      std::memcpy(buf_ + pos_, packets, size);
+      pos_ += size;
+      return true;
+    }
 
+    // Write the packets directly instead of copying them into the buffer.
+    if (!Flush()) {
+      return false;
+    }
+    return Write(reinterpret_cast<const uint8_t*>(packets), size);
+  }
+
+ private:
   // 4 pages for the write buffer.
   // 16 pages for pipe in Linux by default.
   // See https://man7.org/linux/man-pages/man7/pipe.7.html
   static constexpr size_t kBufferSize = 4096 * 4;
 
   bool Flush() {
+    if (!Write(buf_, pos_)) {
+      return false;
+    }
+    pos_ = 0;
+    return true;
+  }
+
+  bool Write(const uint8_t* data, size_t size) {
     size_t nwritten = 0;
-    while (nwritten < pos_) {
-      auto res = write(kStdoutFd, buf_ + nwritten, pos_ - nwritten);
+    while (nwritten < size) {
+      auto res = write(fd_, data + nwritten, size - nwritten);
       if (res < 0) {
-        MIRAKC_ARIB_ERROR(
-            "Failed to write packets: {} ({})", std::strerror(errno), errno);
+        MIRAKC_ARIB_ERROR("Failed to write packets to FD#{}: {} ({})",
+                          fd_, std::strerror(errno), errno);
         return false;
       }
       nwritten += res;
     }
-    MIRAKC_ARIB_ASSERT(nwritten == pos_);
-    pos_ = 0;
+    MIRAKC_ARIB_ASSERT(nwritten == size);
     return true;
   }
 
+  const int fd_;
   uint8_t buf_[kBufferSize];
   size_t pos_ = 0;
 
-  MIRAKC_ARIB_NON_COPYABLE(StdoutSink);
+  MIRAKC_ARIB_NON_COPYABLE(FdSink);
 };
 
+using StdoutSink = FdSink;
+
 }  // namespace
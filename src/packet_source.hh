@@ -10,12 +10,17 @@
 #include "base.hh"
 #include "file.hh"
 #include "logging.hh"
+#include "metrics.hh"
 #include "packet_sink.hh"
+#include "probes.hh"
 
 namespace {
 
 class PacketSource {
  public:
+  // Records the time of one of this number of packets.
+  static constexpr uint32_t kMetricsSampleInterval = 64;
+
   PacketSource() = default;
   virtual ~PacketSource() = default;
 
@@ -31,6 +36,11 @@ class PacketSource {
     }
     ts::TSPacket packet;
     while (GetNextPacket(&packet)) {
+      MIRAKC_ARIB_METRICS_INC("source.packets");
+      // Time spent in all downstream stages.  Sampled so that reading the
+      // clock doesn't inflate the time being measured.
+      MIRAKC_ARIB_METRICS_SAMPLED_TIMER(
+          "source.handle_packet_ns", kMetricsSampleInterval);
       if (!sink_->HandlePacket(packet)) {
         break;
       }
@@ -70,6 +80,25 @@ class FileSource final : public PacketSource {
   explicit FileSource(std::unique_ptr<File>&& file) : file_(std::move(file)) {}
   ~FileSource() override {}
 
+  // Moves the read position to `pos`.  Packets are resynced if `pos` is not
+  // the start of a packet.
+  bool Seek(uint64_t pos) {
+    if (file_->Seek(static_cast<int64_t>(pos), SeekMode::kSet) < 0) {
+      return false;
+    }
+    MIRAKC_ARIB_INFO("Seeked to {}", pos);
+    eof_ = false;
+    pos_ = 0;
+    end_ = 0;
+    buf_offset_ = pos;
+    return true;
+  }
+
+  // The file offset of the last packet read.
+  uint64_t packet_pos() const {
+    return packet_pos_;
+  }
+
  private:
   bool GetNextPacket(ts::TSPacket* packet) override {
     if (!FillBuffer(ts::PKT_SIZE)) {
@@ -85,17 +114,18 @@ class FileSource final : public PacketSource {
     }
 
     std::memcpy(packet->b, &buf_[pos_], ts::PKT_SIZE);
+    packet_pos_ = buf_offset_ + pos_;
     pos_ += ts::PKT_SIZE;
 
-    MIRAKC_ARIB_ASSERT(packet->hasValidSync());
+    MIRAKC_ARIB_DASSERT(packet->hasValidSync());
     return true;
   }
 
   inline bool FillBuffer(size_t min_bytes) {
-    MIRAKC_ARIB_ASSERT(min_bytes <= kMaxResyncBytes);
-    MIRAKC_ARIB_ASSERT(!eof_);
-    MIRAKC_ARIB_ASSERT(pos_ <= end_);
-    MIRAKC_ARIB_ASSERT(end_ <= kBufferSize);
+    MIRAKC_ARIB_DASSERT(min_bytes <= kMaxResyncBytes);
+    MIRAKC_ARIB_DASSERT(!eof_);
+    MIRAKC_ARIB_DASSERT(pos_ <= end_);
+    MIRAKC_ARIB_DASSERT(end_ <= kBufferSize);
 
     auto avail_bytes = available_bytes();
     if (avail_bytes >= min_bytes) {
@@ -103,6 +133,7 @@ class FileSource final : public PacketSource {
     }
 
     std::memmove(&buf_[0], &buf_[pos_], avail_bytes);
+    buf_offset_ += pos_;
     pos_ = 0;
     end_ = avail_bytes;
 
@@ -115,6 +146,8 @@ class FileSource final : public PacketSource {
         return false;
       }
       end_ += nread;
+      MIRAKC_ARIB_PROBE1(file_source_read, nread);
+      MIRAKC_ARIB_METRICS_ADD("file_source.read_bytes", nread);
     } while (end_ < min_bytes);
 
     return true;
@@ -122,6 +155,8 @@ class FileSource final : public PacketSource {
 
   inline bool Resync() {
     MIRAKC_ARIB_WARN("Resync...");
+    MIRAKC_ARIB_METRICS_INC("file_source.resyncs");
+    MIRAKC_ARIB_PROBE(file_source_resync_start);
 
     if (!FillBuffer(kMaxResyncBytes)) {
       return false;
@@ -137,12 +172,15 @@ class FileSource final : public PacketSource {
       }
       if (ValidateResync()) {
         MIRAKC_ARIB_WARN("Resynced, {} bytes dropped", pos_ - resync_start);
+        MIRAKC_ARIB_METRICS_ADD("file_source.dropped_bytes", pos_ - resync_start);
+        MIRAKC_ARIB_PROBE2(file_source_resync_done, 1, pos_ - resync_start);
         return true;
       }
       pos_++;
     }
 
     MIRAKC_ARIB_ERROR("Resync failed");
+    MIRAKC_ARIB_PROBE2(file_source_resync_done, 0, pos_ - resync_start);
     return false;
   }
 
@@ -165,6 +203,8 @@ class FileSource final : public PacketSource {
   uint8_t buf_[kBufferSize];
   size_t pos_ = 0;
   size_t end_ = 0;
+  uint64_t buf_offset_ = 0;  // the file offset of buf_[0]
+  uint64_t packet_pos_ = 0;
 
   MIRAKC_ARIB_NON_COPYABLE(FileSource);
 };
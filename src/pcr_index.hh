@@ -0,0 +1,634 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <tsduck/tsduck.h>
+
+#include "base.hh"
+#include "file.hh"
+#include "logging.hh"
+#include "packet_sink.hh"
+#include "packet_source.hh"
+#include "tsduck_helper.hh"
+
+#define MIRAKC_ARIB_PCR_INDEX_TRACE(...) \
+  MIRAKC_ARIB_TRACE("pcr-index: " __VA_ARGS__)
+#define MIRAKC_ARIB_PCR_INDEX_DEBUG(...) \
+  MIRAKC_ARIB_DEBUG("pcr-index: " __VA_ARGS__)
+#define MIRAKC_ARIB_PCR_INDEX_INFO(...) \
+  MIRAKC_ARIB_INFO("pcr-index: " __VA_ARGS__)
+#define MIRAKC_ARIB_PCR_INDEX_WARN(...) \
+  MIRAKC_ARIB_WARN("pcr-index: " __VA_ARGS__)
+#define MIRAKC_ARIB_PCR_INDEX_ERROR(...) \
+  MIRAKC_ARIB_ERROR("pcr-index: " __VA_ARGS__)
+
+namespace {
+
+// A PCR index is a sparse list of records sampled from PCR packets of a
+// service at a fixed interval of file offsets.  It's used for seeking a TS
+// file without reading packets from the beginning.
+//
+// The header and records are written in the native byte order without any
+// padding.
+
+struct PcrIndexHeader final {
+  char magic[8];
+  uint32_t version;
+  uint16_t sid;
+  uint16_t pcr_pid;
+  uint64_t interval;
+  uint64_t file_size;  // the size of the TS file when the index was built
+};
+
+static_assert(sizeof(PcrIndexHeader) == 32);
+
+struct PcrIndexRecord final {
+  static constexpr uint8_t kHasTime = 0x01;
+  static constexpr uint8_t kHasEid = 0x02;
+  static constexpr uint8_t kHasNextEid = 0x04;
+  static constexpr uint8_t kHasPatVersion = 0x08;
+  static constexpr uint8_t kHasPmtVersion = 0x10;
+
+  uint64_t pos;  // the file offset of the PCR packet
+  int64_t pcr;
+  int64_t time;  // Unix time (ms) computed from TOT and PCR
+  uint16_t eid;  // the present event in EIT p/f
+  uint16_t next_eid;  // the following event in EIT p/f
+  uint8_t pat_version;
+  uint8_t pmt_version;
+  uint8_t flags;
+  uint8_t reserved;
+
+  bool HasTime() const {
+    return (flags & kHasTime) != 0;
+  }
+
+  // Returns true if the event is listed in EIT p/f at this point.
+  bool IncludesEvent(uint16_t event_id) const {
+    if ((flags & kHasEid) != 0 && eid == event_id) {
+      return true;
+    }
+    if ((flags & kHasNextEid) != 0 && next_eid == event_id) {
+      return true;
+    }
+    return false;
+  }
+};
+
+static_assert(sizeof(PcrIndexRecord) == 32);
+
+// A read-only view of records.
+class PcrIndexRecords final {
+ public:
+  PcrIndexRecords(const PcrIndexRecord* data, size_t size)
+      : data_(data), size_(size) {}
+
+  const PcrIndexRecord* data() const {
+    return data_;
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  bool empty() const {
+    return size_ == 0;
+  }
+
+  const PcrIndexRecord* begin() const {
+    return data_;
+  }
+
+  const PcrIndexRecord* end() const {
+    return data_ + size_;
+  }
+
+  const PcrIndexRecord& operator[](size_t i) const {
+    return data_[i];
+  }
+
+  const PcrIndexRecord& back() const {
+    return data_[size_ - 1];
+  }
+
+ private:
+  const PcrIndexRecord* data_;
+  size_t size_;
+};
+
+class PcrIndex final {
+ public:
+  static constexpr char kMagic[8] = { 'M', 'K', 'A', 'R', 'I', 'B', 'I', 'X' };
+  static constexpr uint32_t kVersion = 1;
+
+  PcrIndex() {
+    std::memset(&header_, 0, sizeof(header_));
+    std::memcpy(header_.magic, kMagic, sizeof(kMagic));
+    header_.version = kVersion;
+  }
+
+  ~PcrIndex() = default;
+
+  PcrIndex(PcrIndex&&) = default;
+  PcrIndex& operator=(PcrIndex&&) = default;
+
+  const PcrIndexHeader& header() const {
+    return header_;
+  }
+
+  PcrIndexRecords records() const {
+    if (mapped_records_ != nullptr) {
+      return PcrIndexRecords(mapped_records_, num_mapped_records_);
+    }
+    return PcrIndexRecords(records_.data(), records_.size());
+  }
+
+  void SetService(uint16_t sid, ts::PID pcr_pid) {
+    header_.sid = sid;
+    header_.pcr_pid = pcr_pid;
+  }
+
+  void SetInterval(uint64_t interval) {
+    header_.interval = interval;
+  }
+
+  void SetFileSize(uint64_t file_size) {
+    header_.file_size = file_size;
+  }
+
+  void AddRecord(const PcrIndexRecord& record) {
+    MIRAKC_ARIB_ASSERT(mapped_records_ == nullptr);
+    records_.push_back(record);
+  }
+
+  // Returns true if the index was built from a TS file having the same size
+  // for the service.  Zero `sid` matches with any service.
+  bool IsValidFor(uint16_t sid, uint64_t file_size) const {
+    if (sid != 0 && header_.sid != sid) {
+      return false;
+    }
+    return header_.file_size == file_size;
+  }
+
+  bool Load(File* file) {
+    PcrIndexHeader header;
+    if (!ReadBytes(file, reinterpret_cast<uint8_t*>(&header), sizeof(header))) {
+      MIRAKC_ARIB_PCR_INDEX_ERROR("Failed to read the header from {}", file->path());
+      return false;
+    }
+    if (!CheckHeader(header, file->path())) {
+      return false;
+    }
+
+    std::vector<PcrIndexRecord> records;
+    PcrIndexRecord record;
+    while (ReadBytes(file, reinterpret_cast<uint8_t*>(&record), sizeof(record))) {
+      records.push_back(record);
+    }
+
+    header_ = header;
+    records_ = std::move(records);
+    mapped_records_ = nullptr;
+    num_mapped_records_ = 0;
+    MIRAKC_ARIB_PCR_INDEX_INFO(
+        "Loaded {} records for SID#{:04X} from {}",
+        records_.size(), header_.sid, file->path());
+    return true;
+  }
+
+  // Uses records in a memory-mapped index file without copying them.
+  //
+  // `data` must be aligned to 8 bytes, and must outlive this object.
+  bool Map(const uint8_t* data, size_t size, const std::string& path) {
+    MIRAKC_ARIB_ASSERT(reinterpret_cast<uintptr_t>(data) % alignof(PcrIndexRecord) == 0);
+    if (size < sizeof(PcrIndexHeader)) {
+      MIRAKC_ARIB_PCR_INDEX_ERROR("{}: too small", path);
+      return false;
+    }
+    PcrIndexHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    if (!CheckHeader(header, path)) {
+      return false;
+    }
+
+    // A partially written record at the end is ignored like Load().
+    header_ = header;
+    records_.clear();
+    mapped_records_ =
+        reinterpret_cast<const PcrIndexRecord*>(data + sizeof(PcrIndexHeader));
+    num_mapped_records_ = (size - sizeof(PcrIndexHeader)) / sizeof(PcrIndexRecord);
+    MIRAKC_ARIB_PCR_INDEX_INFO(
+        "Mapped {} records for SID#{:04X} from {}",
+        num_mapped_records_, header_.sid, path);
+    return true;
+  }
+
+  bool Save(File* file) const {
+    if (!WriteBytes(file, reinterpret_cast<const uint8_t*>(&header_), sizeof(header_))) {
+      return false;
+    }
+    auto records = this->records();
+    if (!WriteBytes(file, reinterpret_cast<const uint8_t*>(records.data()),
+                    records.size() * sizeof(PcrIndexRecord))) {
+      return false;
+    }
+    MIRAKC_ARIB_PCR_INDEX_INFO(
+        "Saved {} records for SID#{:04X} into {}",
+        records.size(), header_.sid, file->path());
+    return true;
+  }
+
+  // Returns the file offset of the last record at or before `time` (Unix time
+  // in ms).  Returns 0 if there is no such record.
+  uint64_t FindPos(int64_t time) const {
+    auto records = this->records();
+    auto it = std::upper_bound(records.begin(), records.end(), time,
+                               [](int64_t time, const PcrIndexRecord& record) {
+                                 return time < GetTime(record);
+                               });
+    if (it == records.begin()) {
+      return 0;
+    }
+    return (it - 1)->pos;
+  }
+
+  // Returns a file offset from which ProgramFilter can extract the event.
+  //
+  // ProgramFilter stops if the event is not listed in EIT p/f before the
+  // event starts.  So, the file offset is chosen from records which list the
+  // event.  Returns 0 if there is no such record.
+  uint64_t FindProgramStartPos(uint16_t eid, ts::MilliSecond start_margin) const {
+    auto records = this->records();
+    auto begin = records.begin();
+    auto end = std::find_if(records.begin(), records.end(),
+                            [eid](const PcrIndexRecord& record) {
+                              return (record.flags & PcrIndexRecord::kHasEid) != 0
+                                  && record.eid == eid;
+                            });
+
+    if (end == records.end()) {
+      // The event hasn't started until the end of the file.
+      auto it = std::find_if(records.begin(), records.end(),
+                             [eid](const PcrIndexRecord& record) {
+                               return record.IncludesEvent(eid);
+                             });
+      if (it == records.end()) {
+        MIRAKC_ARIB_PCR_INDEX_WARN("Event#{:04X} not found", eid);
+        return 0;
+      }
+      return it->pos;
+    }
+
+    if (end == records.begin()) {
+      MIRAKC_ARIB_PCR_INDEX_DEBUG("Event#{:04X} started before the first record", eid);
+      return 0;
+    }
+
+    // The event starts between `*(end - 1)` and `*end`.  Records listing the
+    // event as the following event continue until `*(end - 1)`.
+    auto it = end;
+    while (it != records.begin() && (it - 1)->IncludesEvent(eid)) {
+      --it;
+    }
+    begin = it;
+    if (begin == end) {
+      MIRAKC_ARIB_PCR_INDEX_WARN(
+          "Event#{:04X} is not listed before it starts, read from the beginning", eid);
+      return 0;
+    }
+
+    // No TOT has been received before the event starts.  The start margin
+    // cannot be applied, so read from the first record listing the event.
+    if (!(end - 1)->HasTime()) {
+      MIRAKC_ARIB_PCR_INDEX_DEBUG(
+          "Event#{:04X}: no time before the event starts, read from {}",
+          eid, begin->pos);
+      return begin->pos;
+    }
+
+    // Choose the last record before the start time of the event minus the
+    // start margin.  The start time is approximated by the time of the last
+    // record before the event starts.
+    auto start_time = GetTime(*(end - 1)) - start_margin;
+    it = std::upper_bound(begin, end, start_time,
+                          [](int64_t time, const PcrIndexRecord& record) {
+                            return time < GetTime(record);
+                          });
+    if (it != begin) {
+      --it;
+    }
+    MIRAKC_ARIB_PCR_INDEX_INFO(
+        "Event#{:04X}: start reading from {} (PCR#{:011X})", eid, it->pos, it->pcr);
+    return it->pos;
+  }
+
+ private:
+  static bool CheckHeader(const PcrIndexHeader& header, const std::string& path) {
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0) {
+      MIRAKC_ARIB_PCR_INDEX_ERROR("{}: not a PCR index", path);
+      return false;
+    }
+    if (header.version != kVersion) {
+      MIRAKC_ARIB_PCR_INDEX_ERROR("{}: unsupported version {}", path, header.version);
+      return false;
+    }
+    return true;
+  }
+
+  static int64_t GetTime(const PcrIndexRecord& record) {
+    // Records without time appear only before the first TOT.
+    return record.HasTime() ? record.time : std::numeric_limits<int64_t>::min();
+  }
+
+  static bool ReadBytes(File* file, uint8_t* buf, size_t size) {
+    size_t nread = 0;
+    while (nread < size) {
+      auto n = file->Read(buf + nread, size - nread);
+      if (n <= 0) {
+        return false;
+      }
+      nread += static_cast<size_t>(n);
+    }
+    return true;
+  }
+
+  static bool WriteBytes(File* file, const uint8_t* buf, size_t size) {
+    size_t nwritten = 0;
+    while (nwritten < size) {
+      auto n = file->Write(const_cast<uint8_t*>(buf) + nwritten, size - nwritten);
+      if (n <= 0) {
+        return false;
+      }
+      nwritten += static_cast<size_t>(n);
+    }
+    return true;
+  }
+
+  PcrIndexHeader header_;
+  std::vector<PcrIndexRecord> records_;
+  const PcrIndexRecord* mapped_records_ = nullptr;
+  size_t num_mapped_records_ = 0;
+
+  MIRAKC_ARIB_NON_COPYABLE(PcrIndex);
+};
+
+struct PcrIndexerOption final {
+  uint16_t sid = 0;  // the first service in PAT if 0
+  uint64_t interval = 4 * 1024 * 1024;  // bytes
+};
+
+// Builds a PCR index from packets.
+//
+// File offsets of packets are obtained from `src` if specified.  Otherwise,
+// they're computed from the number of packets.
+class PcrIndexer final : public PacketSink,
+                         public ts::TableHandlerInterface {
+ public:
+  PcrIndexer(const PcrIndexerOption& option, const FileSource* src = nullptr)
+      : option_(option),
+        src_(src),
+        demux_(context_) {
+    demux_.setTableHandler(this);
+    demux_.addPID(ts::PID_PAT);
+    MIRAKC_ARIB_PCR_INDEX_DEBUG("Demux += PAT");
+    demux_.addPID(ts::PID_EIT);
+    MIRAKC_ARIB_PCR_INDEX_DEBUG("Demux += EIT");
+    demux_.addPID(ts::PID_TOT);
+    MIRAKC_ARIB_PCR_INDEX_DEBUG("Demux += TDT/TOT");
+    index_.SetInterval(option_.interval);
+  }
+
+  ~PcrIndexer() override = default;
+
+  PcrIndex& index() {
+    return index_;
+  }
+
+  bool End() override {
+    MIRAKC_ARIB_PCR_INDEX_INFO(
+        "Built {} records from {} packets", index_.records().size(), num_packets_);
+    return true;
+  }
+
+  bool HandlePacket(const ts::TSPacket& packet) override {
+    auto pos = src_ != nullptr ? src_->packet_pos() : num_packets_ * ts::PKT_SIZE;
+    num_packets_++;
+
+    auto pid = packet.getPID();
+    if (pid == pcr_pid_ && packet.hasPCR()) {
+      auto pcr = packet.getPCR();
+      if (pcr != ts::INVALID_PCR) {
+        HandlePcr(pos, static_cast<int64_t>(pcr));
+      }
+    }
+
+    // PES packets are never fed to the demux.
+    if (pid == ts::PID_PAT || pid == ts::PID_EIT || pid == ts::PID_TOT ||
+        pid == pmt_pid_) {
+      demux_.feedPacket(packet);
+    }
+    return true;
+  }
+
+ private:
+  void handleTable(ts::SectionDemux&, const ts::BinaryTable& table) override {
+    switch (table.tableId()) {
+      case ts::TID_PAT:
+        HandlePat(table);
+        break;
+      case ts::TID_PMT:
+        HandlePmt(table);
+        break;
+      case ts::TID_EIT_PF_ACT:
+        HandleEit(table);
+        break;
+      case ts::TID_TOT:
+        HandleTot(table);
+        break;
+      default:
+        break;
+    }
+  }
+
+  void HandlePat(const ts::BinaryTable& table) {
+    ts::PAT pat(context_, table);
+    if (!pat.isValid()) {
+      MIRAKC_ARIB_PCR_INDEX_WARN("Broken PAT, skip");
+      return;
+    }
+
+    if (sid_ == 0) {
+      if (option_.sid != 0) {
+        sid_ = option_.sid;
+      } else if (!pat.pmts.empty()) {
+        sid_ = pat.pmts.begin()->first;
+      }
+    }
+
+    auto it = pat.pmts.find(sid_);
+    if (it == pat.pmts.end()) {
+      MIRAKC_ARIB_PCR_INDEX_WARN("SID#{:04X} not found in PAT", sid_);
+      return;
+    }
+
+    pat_version_ = pat.version;
+    has_pat_version_ = true;
+
+    if (pmt_pid_ != it->second) {
+      if (pmt_pid_ != ts::PID_NULL) {
+        demux_.removePID(pmt_pid_);
+        MIRAKC_ARIB_PCR_INDEX_DEBUG("Demux -= PMT#{:04X}", pmt_pid_);
+      }
+      pmt_pid_ = it->second;
+      demux_.addPID(pmt_pid_);
+      MIRAKC_ARIB_PCR_INDEX_DEBUG("Demux += PMT#{:04X}", pmt_pid_);
+    }
+  }
+
+  void HandlePmt(const ts::BinaryTable& table) {
+    ts::PMT pmt(context_, table);
+    if (!pmt.isValid()) {
+      MIRAKC_ARIB_PCR_INDEX_WARN("Broken PMT, skip");
+      return;
+    }
+    if (pmt.service_id != sid_) {
+      return;
+    }
+
+    pmt_version_ = pmt.version;
+    has_pmt_version_ = true;
+
+    if (pcr_pid_ != pmt.pcr_pid) {
+      MIRAKC_ARIB_PCR_INDEX_DEBUG("PCR#{:04X}", pmt.pcr_pid);
+      pcr_pid_ = pmt.pcr_pid;
+      has_time_ = false;
+      index_.SetService(sid_, pcr_pid_);
+    }
+  }
+
+  void HandleEit(const ts::BinaryTable& table) {
+    ts::EIT eit(context_, table);
+    if (!eit.isValid()) {
+      MIRAKC_ARIB_PCR_INDEX_WARN("Broken EIT, skip");
+      return;
+    }
+    if (eit.service_id != sid_) {
+      return;
+    }
+
+    // The present and following events are carried in the sections #0 and #1
+    // respectively.  `eit.events` cannot be used for distinguishing them
+    // because each section may be empty.
+    has_eid_ = false;
+    has_next_eid_ = false;
+    for (size_t i = 0; i < table.sectionCount(); ++i) {
+      const auto& section = table.sectionAt(i);
+      if (section->payloadSize() <
+          EitSection::EIT_PAYLOAD_FIXED_SIZE + EitSection::EIT_EVENT_FIXED_SIZE) {
+        continue;  // no event
+      }
+      EitSection eit_section(*section);
+      auto eid = ts::GetUInt16(eit_section.events_data);
+      switch (eit_section.section_number) {
+        case 0:
+          eid_ = eid;
+          has_eid_ = true;
+          break;
+        case 1:
+          next_eid_ = eid;
+          has_next_eid_ = true;
+          break;
+        default:
+          break;
+      }
+    }
+  }
+
+  void HandleTot(const ts::BinaryTable& table) {
+    ts::TOT tot(context_, table);
+    if (!tot.isValid()) {
+      MIRAKC_ARIB_PCR_INDEX_WARN("Broken TOT, skip");
+      return;
+    }
+    // Synchronized with the next PCR.
+    tot_time_ = tot.utc_time;  // JST in ARIB
+    tot_pending_ = true;
+  }
+
+  void HandlePcr(uint64_t pos, int64_t pcr) {
+    if (tot_pending_) {
+      time_ = tot_time_;
+      time_pcr_ = pcr;
+      has_time_ = true;
+      tot_pending_ = false;
+    }
+
+    if (pos < next_pos_) {
+      return;
+    }
+    next_pos_ = pos - pos % option_.interval + option_.interval;
+
+    PcrIndexRecord record;
+    std::memset(&record, 0, sizeof(record));
+    record.pos = pos;
+    record.pcr = pcr;
+    if (has_time_) {
+      // The PCR always goes forward from `time_pcr_` until the next TOT.
+      auto delta = (pcr - time_pcr_ + kPcrUpperBound) % kPcrUpperBound;
+      auto jst = time_ + delta / kPcrTicksPerMs;
+      record.time = (jst - kJstTzOffset) - ts::Time::UnixEpoch;
+      record.flags |= PcrIndexRecord::kHasTime;
+    }
+    if (has_eid_) {
+      record.eid = eid_;
+      record.flags |= PcrIndexRecord::kHasEid;
+    }
+    if (has_next_eid_) {
+      record.next_eid = next_eid_;
+      record.flags |= PcrIndexRecord::kHasNextEid;
+    }
+    if (has_pat_version_) {
+      record.pat_version = pat_version_;
+      record.flags |= PcrIndexRecord::kHasPatVersion;
+    }
+    if (has_pmt_version_) {
+      record.pmt_version = pmt_version_;
+      record.flags |= PcrIndexRecord::kHasPmtVersion;
+    }
+    index_.AddRecord(record);
+    MIRAKC_ARIB_PCR_INDEX_TRACE("Record: pos={} pcr={:011X}", pos, pcr);
+  }
+
+  const PcrIndexerOption option_;
+  const FileSource* src_;
+  ts::DuckContext context_;
+  ts::SectionDemux demux_;
+  PcrIndex index_;
+  uint64_t num_packets_ = 0;
+  uint64_t next_pos_ = 0;
+  uint16_t sid_ = 0;
+  ts::PID pmt_pid_ = ts::PID_NULL;
+  ts::PID pcr_pid_ = ts::PID_NULL;
+  int64_t time_pcr_ = 0;
+  ts::Time time_;  // JST
+  ts::Time tot_time_;  // JST
+  uint16_t eid_ = 0;
+  uint16_t next_eid_ = 0;
+  uint8_t pat_version_ = 0;
+  uint8_t pmt_version_ = 0;
+  bool tot_pending_ = false;
+  bool has_time_ = false;
+  bool has_eid_ = false;
+  bool has_next_eid_ = false;
+  bool has_pat_version_ = false;
+  bool has_pmt_version_ = false;
+
+  MIRAKC_ARIB_NON_COPYABLE(PcrIndexer);
+};
+
+}  // namespace
@@ -0,0 +1,35 @@
+#pragma once
+
+// USDT (SystemTap-style) static probes.
+//
+// A probe compiles to a single NOP instruction and an ELF note when
+// MIRAKC_ARIB_ENABLE_PROBES is defined.  Tools like bpftrace replace the NOP
+// with a breakpoint only while they attach to the probe:
+//
+//   $ bpftrace -e 'usdt:/usr/local/bin/mirakc-arib:mirakc_arib:file_source_read
+//       { @bytes = hist(arg0); }'
+//
+// Arguments must be integers or pointers, and should be cheap to evaluate
+// because they're evaluated even when no tool attaches to the probe.
+//
+// Probes are no-ops when MIRAKC_ARIB_ENABLE_PROBES is not defined.  The CMake
+// build defines it when <sys/sdt.h> is available.  See README.md for the list
+// of probes.
+
+#if defined(MIRAKC_ARIB_ENABLE_PROBES)
+#include <sys/sdt.h>
+
+#define MIRAKC_ARIB_PROBE(name) \
+  DTRACE_PROBE(mirakc_arib, name)
+#define MIRAKC_ARIB_PROBE1(name, a1) \
+  DTRACE_PROBE1(mirakc_arib, name, a1)
+#define MIRAKC_ARIB_PROBE2(name, a1, a2) \
+  DTRACE_PROBE2(mirakc_arib, name, a1, a2)
+#define MIRAKC_ARIB_PROBE3(name, a1, a2, a3) \
+  DTRACE_PROBE3(mirakc_arib, name, a1, a2, a3)
+#else
+#define MIRAKC_ARIB_PROBE(name) ((void)0)
+#define MIRAKC_ARIB_PROBE1(name, a1) ((void)0)
+#define MIRAKC_ARIB_PROBE2(name, a1, a2) ((void)0)
+#define MIRAKC_ARIB_PROBE3(name, a1, a2, a3) ((void)0)
+#endif  // defined(MIRAKC_ARIB_ENABLE_PROBES)
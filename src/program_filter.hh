@@ -8,8 +8,10 @@
 
 #include "base.hh"
 #include "logging.hh"
+#include "metrics.hh"
 #include "packet_sink.hh"
 #include "packet_source.hh"
+#include "psi_state.hh"
 #include "tsduck_helper.hh"
 
 #define MIRAKC_ARIB_PROGRAM_FILTER_TRACE(...) \
@@ -36,14 +38,23 @@ struct ProgramFilterOption final {
   ts::MilliSecond start_margin = 0;  // ms
   ts::MilliSecond end_margin = 0;  // ms
   bool pre_streaming = false;  // disabled
+  bool keyframe_start = false;  // disabled
 };
 
-class ProgramFilter final : public PacketSink,
-                            public ts::TableHandlerInterface {
+// `Sink` is the type of the downstream stage.
+//
+// Tables are received from `psi` shared with the upstream stage which feeds
+// packets to it.  ProgramFilter feeds packets to its own PsiState if `psi` is
+// not specified.
+template <typename Sink>
+class BasicProgramFilter final : public PacketSink,
+                                 public PsiObserver {
  public:
-  explicit ProgramFilter(const ProgramFilterOption& option)
+  explicit BasicProgramFilter(const ProgramFilterOption& option,
+                              std::shared_ptr<PsiState> psi = nullptr)
       : option_(option),
-        demux_(context_) {
+        psi_(psi ? psi : std::make_shared<PsiState>(option.sid)),
+        feeds_psi_(!psi) {
     clock_pid_ = option_.clock_pid;
     clock_pcr_ = option_.clock_pcr;
     clock_time_ = option_.clock_time;
@@ -54,16 +65,20 @@ class ProgramFilter final : public PacketSink,
     MIRAKC_ARIB_PROGRAM_FILTER_DEBUG("Video tags: {}", fmt::join(option_.video_tags, ", "));
     MIRAKC_ARIB_PROGRAM_FILTER_DEBUG("Audio tags: {}", fmt::join(option_.audio_tags, ", "));
 
-    demux_.setTableHandler(this);
-    demux_.addPID(ts::PID_PAT);
-    demux_.addPID(ts::PID_EIT);
-    demux_.addPID(ts::PID_TOT);
-    MIRAKC_ARIB_PROGRAM_FILTER_DEBUG("Demux += PAT EIT TDT/TOT");
+    MIRAKC_ARIB_ASSERT(psi_->sid() == option_.sid);
+    psi_->Subscribe(this, kPsiPmt | kPsiEit | kPsiTime);
+    MIRAKC_ARIB_PROGRAM_FILTER_DEBUG("Subscribe PMT EIT TDT/TOT");
+
+    if (option_.keyframe_start) {
+      lookback_packets_.reserve(kMaxLookbackPackets);
+    }
   }
 
-  virtual ~ProgramFilter() override {}
+  virtual ~BasicProgramFilter() override {
+    psi_->Unsubscribe(this);
+  }
 
-  void Connect(std::unique_ptr<PacketSink>&& sink) {
+  void Connect(std::unique_ptr<Sink>&& sink) {
     sink_ = std::move(sink);
   }
 
@@ -92,7 +107,10 @@ class ProgramFilter final : public PacketSink,
       return false;
     }
 
-    demux_.feedPacket(packet);
+    MIRAKC_ARIB_METRICS_INC("program_filter.packets");
+    if (feeds_psi_) {
+      psi_->FeedPacket(packet);
+    }
 
     switch (state_) {
       case kWaitReady:
@@ -126,6 +144,8 @@ class ProgramFilter final : public PacketSink,
         last_pat_packets_.clear();
       }
       last_pat_packets_.push_back(packet);
+    } else if (option_.keyframe_start) {
+      UpdateLookback(packet);
     } else {
       // Drop other packets.
     }
@@ -181,19 +201,72 @@ class ProgramFilter final : public PacketSink,
     }
 
     // Send PMT packets.
-    ts::TSPacket pmt_packet;
+    MIRAKC_ARIB_ASSERT(pmt_packet_index_ == 0);
     do {
-      pmt_packetizer_.getNextPacket(pmt_packet);
-      MIRAKC_ARIB_ASSERT(pmt_packet.getPID() == pmt_pid_);
-      if (!sink_->HandlePacket(pmt_packet)) {
+      if (!SendPmtPacket()) {
         return false;
       }
-    } while (!pmt_packetizer_.atCycleBoundary());
+    } while (pmt_packet_index_ != 0);
 
     state_ = kStreaming;
+
+    if (lookback_ready_) {
+      // `packet` is the last packet in `lookback_packets_`.
+      MIRAKC_ARIB_PROGRAM_FILTER_INFO(
+          "Start from the last keyframe, {} packets before", lookback_packets_.size() - 1);
+      return SendLookbackPackets();
+    }
+
     return sink_->HandlePacket(packet);
   }
 
+  // Keeps packets since the last random access point of the video stream.
+  void UpdateLookback(const ts::TSPacket& packet) {
+    auto pid = packet.getPID();
+
+    if (pid == pmt_pid_) {
+      // PMT packets are sent from `pmt_packets_`.
+      return;
+    }
+
+    if (pid == keyframe_pid_ && IsRandomAccessPoint(packet, keyframe_stream_type_)) {
+      MIRAKC_ARIB_PROGRAM_FILTER_TRACE("Keyframe in PES#{:04X}", pid);
+      lookback_packets_.clear();
+      lookback_ready_ = true;
+    }
+
+    if (!lookback_ready_) {
+      return;
+    }
+
+    if (lookback_packets_.size() == kMaxLookbackPackets) {
+      MIRAKC_ARIB_PROGRAM_FILTER_DEBUG("Too long GOP, wait for the next keyframe");
+      lookback_packets_.clear();
+      lookback_ready_ = false;
+      return;
+    }
+
+    lookback_packets_.push_back(packet);
+  }
+
+  bool SendLookbackPackets() {
+    bool ok = true;
+    for (const auto& packet : lookback_packets_) {
+      if (CheckPesBlackListForDrop(packet.getPID())) {
+        continue;
+      }
+      ok = sink_->HandlePacket(packet);
+      if (!ok) {
+        break;
+      }
+    }
+    // Release the memory.
+    lookback_packets_.clear();
+    lookback_packets_.shrink_to_fit();
+    lookback_ready_ = false;
+    return ok;
+  }
+
   bool DoStreaming(const ts::TSPacket& packet) {
     if (stop_) {
       MIRAKC_ARIB_PROGRAM_FILTER_INFO("Done");
@@ -228,10 +301,7 @@ class ProgramFilter final : public PacketSink,
     }
 
     if (pid == pmt_pid_) {
-      ts::TSPacket pmt_packet;
-      pmt_packetizer_.getNextPacket(pmt_packet);
-      MIRAKC_ARIB_ASSERT(pmt_packet.getPID() == pmt_pid_);
-      return sink_->HandlePacket(pmt_packet);
+      return SendPmtPacket();
     }
 
     if (CheckPesBlackListForDrop(pid)) {
@@ -241,94 +311,29 @@ class ProgramFilter final : public PacketSink,
     return sink_->HandlePacket(packet);
   }
 
-  bool CheckPesBlackListForDrop(ts::PID pid) const {
-    if (pes_black_list_.find(pid) != pes_black_list_.end()) {
-      return true;
-    }
-    return false;
-  }
-
-  void handleTable(ts::SectionDemux&, const ts::BinaryTable& table) override {
-    switch (table.tableId()) {
-      case ts::TID_PAT:
-        HandlePat(table);
-        break;
-      case ts::TID_PMT:
-        HandlePmt(table);
-        break;
-      case ts::TID_EIT_PF_ACT:
-        HandleEit(table);
-        break;
-      case ts::TID_TDT:
-        HandleTdt(table);
-        break;
-      case ts::TID_TOT:
-        HandleTot(table);
-        break;
-      default:
-        break;
-    }
+  // Sends the next packet of the modified PMT.  Cached packets are sent
+  // cyclically with the continuity counter patched.
+  bool SendPmtPacket() {
+    MIRAKC_ARIB_ASSERT(!pmt_packets_.empty());
+    auto& pmt_packet = pmt_packets_[pmt_packet_index_];
+    MIRAKC_ARIB_DASSERT(pmt_packet.getPID() == pmt_pid_);
+    pmt_packet.setCC(pmt_cc_);
+    pmt_cc_ = (pmt_cc_ + 1) & 0x0F;
+    pmt_packet_index_ = (pmt_packet_index_ + 1) % pmt_packets_.size();
+    return sink_->HandlePacket(pmt_packet);
   }
 
-  void HandlePat(const ts::BinaryTable& table) {
-    // Ignore a strange PAT delivered with PID#0012 around midnight at least on
-    // BS-NTV and BS11 channels.
-    //
-    // This PAT has no PID of NIT and its ts_id is 0 like below:
-    //
-    //   * PAT, TID 0 (0x00), PID 18 (0x0012)
-    //     Short section, total size: 179 bytes
-    //     - Section 0:
-    //       TS id:       0 (0x0000)
-    //       Program: 19796 (0x4D54)  PID: 2672 (0x0A70)
-    //       Program: 28192 (0x6E20)  PID: 6205 (0x183D)
-    //       ...
-    //
-    if (table.sourcePID() != ts::PID_PAT) {
-      MIRAKC_ARIB_PROGRAM_FILTER_WARN(
-          "PAT delivered with PID#{:04X}, skip", table.sourcePID());
-      return;
-    }
-
-    ts::PAT pat(context_, table);
-
-    if (!pat.isValid()) {
-      MIRAKC_ARIB_PROGRAM_FILTER_WARN("Broken PAT, skip");
-      return;
-    }
-
-    if (pat.ts_id == 0) {
-      MIRAKC_ARIB_PROGRAM_FILTER_WARN("PAT for TSID#0000, skip");
-      return;
-    }
-
-    // The following condition is ensured by ServiceFilter.
-    MIRAKC_ARIB_ASSERT(pat.pmts.find(option_.sid) != pat.pmts.end());
-
-    auto new_pmt_pid = pat.pmts[option_.sid];
-
-    if (pmt_pid_ != ts::PID_NULL) {
-      MIRAKC_ARIB_PROGRAM_FILTER_DEBUG("Demux -= PMT#{:04X}", pmt_pid_);
-      demux_.removePID(pmt_pid_);
-      pmt_pid_ = ts::PID_NULL;
-    }
-
-    pmt_pid_ = new_pmt_pid;
-    demux_.addPID(pmt_pid_);
-    MIRAKC_ARIB_PROGRAM_FILTER_DEBUG("Demux += PMT#{:04X}", pmt_pid_);
+  bool CheckPesBlackListForDrop(ts::PID pid) const {
+    return pes_black_list_.test(pid);
   }
 
-  void HandlePmt(const ts::BinaryTable& table) {
-    ts::PMT pmt(context_, table);
+  void OnPmt(const ts::PMT& original_pmt, ts::PID pmt_pid) override {
+    // Streams in the black list will be removed from the copy.
+    ts::PMT pmt(original_pmt);
 
-    if (!pmt.isValid()) {
-      MIRAKC_ARIB_PROGRAM_FILTER_WARN("Broken PMT, skip");
-      return;
-    }
-
-    if (pmt.service_id != option_.sid) {
-      MIRAKC_ARIB_PROGRAM_FILTER_WARN("PMT.SID#{} unmatched, skip", pmt.service_id);
-      return;
+    if (pmt_pid_ != pmt_pid) {
+      MIRAKC_ARIB_PROGRAM_FILTER_DEBUG("PMT#{:04X}", pmt_pid);
+      pmt_pid_ = pmt_pid;
     }
 
     pcr_pid_ = pmt.pcr_pid;
@@ -345,23 +350,26 @@ class ProgramFilter final : public PacketSink,
       clock_time_ready_ = false;
     }
 
-    pes_black_list_.clear();
+    pes_black_list_.reset();
     MIRAKC_ARIB_PROGRAM_FILTER_DEBUG("Clear PES black list");
 
+    ts::PID keyframe_pid = ts::PID_NULL;
+    uint8_t keyframe_stream_type = 0;
+
     for (auto it = pmt.streams.begin(); it != pmt.streams.end(); ++it) {
       auto pid = it->first;
       const auto& stream = it->second;
       if (stream.isVideo() && !option_.video_tags.empty()) {
         uint8_t tag;
         if (!stream.getComponentTag(tag)) {
-          pes_black_list_.insert(pid);
+          pes_black_list_.set(pid);
           MIRAKC_ARIB_PROGRAM_FILTER_DEBUG("PES black list += PES/Video#{:04X} (no tag)", pid);
           continue;
         }
         const auto& tag_it = std::find(
             std::begin(option_.video_tags), std::end(option_.video_tags), tag);
         if (tag_it == std::end(option_.video_tags)) {
-          pes_black_list_.insert(pid);
+          pes_black_list_.set(pid);
           MIRAKC_ARIB_PROGRAM_FILTER_DEBUG(
               "PES black list += PES/Video#{:04X} (tag:{})", pid, tag);
           continue;
@@ -369,35 +377,63 @@ class ProgramFilter final : public PacketSink,
       } else if (stream.isAudio() && !option_.audio_tags.empty()) {
         uint8_t tag;
         if (!stream.getComponentTag(tag)) {
-          pes_black_list_.insert(pid);
+          pes_black_list_.set(pid);
           MIRAKC_ARIB_PROGRAM_FILTER_DEBUG("PES black list += PES/Audio#{:04X} (no tag)", pid);
           continue;
         }
         const auto& tag_it = std::find(
             std::begin(option_.audio_tags), std::end(option_.audio_tags), tag);
         if (tag_it == std::end(option_.audio_tags)) {
-          pes_black_list_.insert(pid);
+          pes_black_list_.set(pid);
           MIRAKC_ARIB_PROGRAM_FILTER_DEBUG(
               "PES black list += PES/Audio#{:04X} (tag:{})", pid, tag);
           continue;
         }
       }
+      // Use the first video stream which is not dropped.
+      if (stream.isVideo() && keyframe_pid == ts::PID_NULL) {
+        keyframe_pid = pid;
+        keyframe_stream_type = stream.stream_type;
+      }
+    }
+
+    if (keyframe_pid_ != keyframe_pid) {
+      MIRAKC_ARIB_PROGRAM_FILTER_DEBUG(
+          "Keyframes in PES/Video#{:04X} (stream type: {:02X})",
+          keyframe_pid, keyframe_stream_type);
+      keyframe_pid_ = keyframe_pid;
+      keyframe_stream_type_ = keyframe_stream_type;
+      lookback_packets_.clear();
+      lookback_ready_ = false;
+    }
+
+    // PsiState delivers the PMT again whenever it receives the PAT even if the
+    // PMT has not been changed.  The modified PMT depends only on the original
+    // PMT, so the cached packets are reused while the key is unchanged.
+    auto pmt_crc32 = psi_->pmt_crc32();
+    if (!pmt_packets_.empty() && pmt_pid == pmt_packets_pid_ &&
+        pmt.version == pmt_packets_version_ && pmt_crc32 == pmt_packets_crc32_) {
+      MIRAKC_ARIB_PROGRAM_FILTER_TRACE("PMT#{:04X} unchanged, reuse cached packets", pmt_pid);
+      return;
     }
+    pmt_packets_pid_ = pmt_pid;
+    pmt_packets_version_ = pmt.version;
+    pmt_packets_crc32_ = pmt_crc32;
 
-    if (pes_black_list_.empty()) {
+    if (pes_black_list_.none()) {
       // Forward PMT packets without modification.
     } else {
       // Remove streams included in the PES black list.
       auto it = pmt.streams.begin();
       while (it != pmt.streams.end()) {
-        if (pes_black_list_.find(it->first) != pes_black_list_.end()) {
+        if (pes_black_list_.test(it->first)) {
           it = pmt.streams.erase(it);
         } else {
           ++it;
         }
       }
 
-      MIRAKC_ARIB_PROGRAM_FILTER_DEBUG("Modified PMT#{:04X}", table.sourcePID());
+      MIRAKC_ARIB_PROGRAM_FILTER_DEBUG("Modified PMT#{:04X}", pmt_pid_);
       for (auto it = pmt.streams.begin(); it != pmt.streams.end(); ++it) {
         auto pid = it->first;
         const auto& stream = it->second;
@@ -416,22 +452,25 @@ class ProgramFilter final : public PacketSink,
         }
       }
     }
-    pmt_packetizer_.removeAll();
-    pmt_packetizer_.setPID(table.sourcePID());
-    pmt_packetizer_.addTable(context_, pmt);
-  }
 
-  void HandleEit(const ts::BinaryTable& table) {
-    ts::EIT eit(context_, table);
+    // The modified PMT is packetized only when the PMT is changed.  Sections
+    // are never packed into a packet of the next cycle so that the cached
+    // packets can be sent cyclically.
+    ts::CyclingPacketizer packetizer(pmt_pid_, ts::CyclingPacketizer::ALWAYS);
+    packetizer.addTable(context_, pmt);
+    pmt_packets_.clear();
+    do {
+      ts::TSPacket pmt_packet;
+      packetizer.getNextPacket(pmt_packet);
+      pmt_packets_.push_back(pmt_packet);
+    } while (!packetizer.atCycleBoundary());
+    pmt_packet_index_ = 0;
+    MIRAKC_ARIB_PROGRAM_FILTER_DEBUG(
+        "Cached {} packets of PMT#{:04X}", pmt_packets_.size(), pmt_pid_);
+  }
 
-    if (!eit.isValid()) {
-      MIRAKC_ARIB_PROGRAM_FILTER_WARN("Broken EIT, skip");
-      return;
-    }
-
-    if (eit.service_id != option_.sid) {
-      return;
-    }
+  void OnEit(const std::shared_ptr<ts::EIT>& eit_ptr) override {
+    const auto& eit = *eit_ptr;
 
     if (eit.events.size() == 0) {
       MIRAKC_ARIB_PROGRAM_FILTER_ERROR("No event in EIT, stop");
@@ -476,34 +515,12 @@ class ProgramFilter final : public PacketSink,
     return;
   }
 
-  void HandleTdt(const ts::BinaryTable& table) {
-    ts::TDT tdt(context_, table);
-
-    if (!tdt.isValid()) {
-      MIRAKC_ARIB_PROGRAM_FILTER_WARN("Broken TDT, skip");
-      return;
-    }
-
+  void OnTime(const ts::Time& time) override {
     if (clock_time_ready_) {
       return;
     }
 
-    UpdateClockTime(tdt.utc_time);  // JST in ARIB
-  }
-
-  void HandleTot(const ts::BinaryTable& table) {
-    ts::TOT tot(context_, table);
-
-    if (!tot.isValid()) {
-      MIRAKC_ARIB_PROGRAM_FILTER_WARN("Broken TOT, skip");
-      return;
-    }
-
-    if (clock_time_ready_) {
-      return;
-    }
-
-    UpdateClockTime(tot.utc_time);  // JST in ARIB
+    UpdateClockTime(time);
   }
 
   void UpdateEventTime(const ts::EIT::Event& event) {
@@ -555,36 +572,33 @@ class ProgramFilter final : public PacketSink,
     MIRAKC_ARIB_ASSERT(event_time_ready_);
     MIRAKC_ARIB_ASSERT(clock_pcr_ready_);
     MIRAKC_ARIB_ASSERT(clock_time_ready_);
+    MIRAKC_ARIB_ASSERT(IsValidPcr(clock_pcr_));
 
-    start_pcr_ = ConvertTimeToPcr(event_start_time_);
-    end_pcr_ = ConvertTimeToPcr(event_end_time_);
+    start_pcr_ = ConvertTimeToPcr(event_start_time_, clock_time_, clock_pcr_);
+    end_pcr_ = ConvertTimeToPcr(event_end_time_, clock_time_, clock_pcr_);
     MIRAKC_ARIB_PROGRAM_FILTER_INFO(
         "Updated PCR range: {:011X} ({}) .. {:011X} ({})",
         start_pcr_, event_start_time_, end_pcr_, event_end_time_);
   }
 
-  int64_t ConvertTimeToPcr(const ts::Time& time) {
-    MIRAKC_ARIB_ASSERT(clock_pcr_ready_);
-    MIRAKC_ARIB_ASSERT(clock_time_ready_);
-    MIRAKC_ARIB_ASSERT(IsValidPcr(clock_pcr_));
-
-    auto ms = time - clock_time_;  // may be a negative value
-    auto pcr = clock_pcr_ + ms * kPcrTicksPerMs;
-    while (pcr < 0) {
-      pcr += kPcrUpperBound;
-    }
-    MIRAKC_ARIB_ASSERT(pcr >= 0);
-    return pcr % kPcrUpperBound;
-  }
-
   const ProgramFilterOption option_;
   ts::DuckContext context_;
-  ts::SectionDemux demux_;
-  std::unique_ptr<PacketSink> sink_;
+  std::shared_ptr<PsiState> psi_;
+  const bool feeds_psi_;
+  std::unique_ptr<Sink> sink_;
   State state_ = kWaitReady;
   ts::TSPacketVector last_pat_packets_;
-  std::unordered_set<ts::PID> pes_black_list_;
-  ts::CyclingPacketizer pmt_packetizer_;
+  ts::TSPacketVector lookback_packets_;
+  ts::PID keyframe_pid_ = ts::PID_NULL;
+  uint8_t keyframe_stream_type_ = 0;
+  ts::PIDSet pes_black_list_;
+  ts::TSPacketVector pmt_packets_;
+  size_t pmt_packet_index_ = 0;
+  uint8_t pmt_cc_ = 0;
+  // The key of `pmt_packets_`.
+  ts::PID pmt_packets_pid_ = ts::PID_NULL;
+  uint8_t pmt_packets_version_ = 0;
+  uint32_t pmt_packets_crc32_ = 0;
   ts::PID clock_pid_ = ts::PID_NULL;
   int64_t clock_pcr_ = 0;
   ts::Time clock_time_;
@@ -598,9 +612,15 @@ class ProgramFilter final : public PacketSink,
   bool event_time_ready_ = false;
   bool clock_pcr_ready_ = false;
   bool clock_time_ready_ = false;
+  bool lookback_ready_ = false;
   bool stop_ = false;
 
-  MIRAKC_ARIB_NON_COPYABLE(ProgramFilter);
+  // 2 seconds at 24 Mbps.
+  static constexpr size_t kMaxLookbackPackets = 32 * 1024;
+
+  MIRAKC_ARIB_NON_COPYABLE(BasicProgramFilter);
 };
 
+using ProgramFilter = BasicProgramFilter<PacketSink>;
+
 }  // namespace
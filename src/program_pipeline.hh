@@ -0,0 +1,35 @@
+#pragma once
+
+#include <memory>
+
+#include "program_filter.hh"
+#include "psi_state.hh"
+#include "service_filter.hh"
+
+namespace {
+
+// Makes the pipeline of `filter-program` like below:
+//
+//   ServiceFilter --> ProgramFilter --> Sink
+//
+// The stages run on the same thread and share tables parsed once.
+//
+// The stages are composed statically by default.  Benchmarks specify
+// ServiceFilter and ProgramFilter as `Service` and `Program` in order to make
+// a chain of virtual calls.
+template <typename Sink,
+          typename Program = BasicProgramFilter<Sink>,
+          typename Service = BasicServiceFilter<Program>>
+std::unique_ptr<Service> MakeProgramPipeline(
+    const ServiceFilterOption& service_filter_option,
+    const ProgramFilterOption& program_filter_option,
+    std::unique_ptr<Sink>&& sink) {
+  auto psi = std::make_shared<PsiState>(service_filter_option.sid);
+  auto program_filter = std::make_unique<Program>(program_filter_option, psi);
+  program_filter->Connect(std::move(sink));
+  auto service_filter = std::make_unique<Service>(service_filter_option, psi);
+  service_filter->Connect(std::move(program_filter));
+  return service_filter;
+}
+
+}  // namespace
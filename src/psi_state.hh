@@ -0,0 +1,348 @@
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <optional>
+#include <unordered_set>
+#include <vector>
+
+#include <tsduck/tsduck.h>
+
+#include "base.hh"
+#include "logging.hh"
+#include "metrics.hh"
+
+#define MIRAKC_ARIB_PSI_STATE_TRACE(...) \
+  MIRAKC_ARIB_TRACE("psi-state: " __VA_ARGS__)
+#define MIRAKC_ARIB_PSI_STATE_DEBUG(...) \
+  MIRAKC_ARIB_DEBUG("psi-state: " __VA_ARGS__)
+#define MIRAKC_ARIB_PSI_STATE_INFO(...) \
+  MIRAKC_ARIB_INFO("psi-state: " __VA_ARGS__)
+#define MIRAKC_ARIB_PSI_STATE_WARN(...) \
+  MIRAKC_ARIB_WARN("psi-state: " __VA_ARGS__)
+#define MIRAKC_ARIB_PSI_STATE_ERROR(...) \
+  MIRAKC_ARIB_ERROR("psi-state: " __VA_ARGS__)
+
+namespace {
+
+// Tables which a PsiObserver subscribes to.
+enum PsiTable : uint32_t {
+  kPsiPat = 1 << 0,
+  kPsiCat = 1 << 1,
+  kPsiPmt = 1 << 2,  // PMT of the service
+  kPsiEit = 1 << 3,  // EIT p/f actual of the service
+  kPsiTime = 1 << 4,  // TDT/TOT
+};
+
+class PsiObserver {
+ public:
+  PsiObserver() = default;
+  virtual ~PsiObserver() = default;
+  virtual void OnPat(const ts::PAT&) {}
+  virtual void OnCat(const ts::CAT&) {}
+  virtual void OnPmt(const ts::PMT&, ts::PID) {}
+  // The EIT object is shared with other observers and must not be modified.
+  virtual void OnEit(const std::shared_ptr<ts::EIT>&) {}
+  virtual void OnTime(const ts::Time&) {}  // JST
+
+ private:
+  MIRAKC_ARIB_NON_COPYABLE(PsiObserver);
+};
+
+// PSI/SI tables of a service parsed once for all stages in a pipeline.
+//
+// Stages chained in a pipeline used to have their own demux and parse the
+// same PAT, PMT, EIT and TDT/TOT tables again and again.  Instead, stages
+// subscribe to the tables with PsiObserver and receive parsed tables from a
+// single PsiState shared between them.  Only the first stage in the pipeline
+// feeds packets to the PsiState so that each packet is demuxed only once.
+//
+// Tables are delivered before the packet completing them reaches any
+// downstream stage.  This is the same order as a demux owned by each stage.
+//
+// PsiState is not thread-safe.  Stages running on different threads must not
+// share it.
+class PsiState final : public ts::TableHandlerInterface {
+ public:
+  explicit PsiState(uint16_t sid)
+      : sid_(sid),
+        demux_(context_) {
+    demux_.setTableHandler(this);
+    demux_.addPID(ts::PID_PAT);
+    MIRAKC_ARIB_PSI_STATE_DEBUG("Demux += PAT");
+  }
+
+  ~PsiState() override {}
+
+  uint16_t sid() const {
+    return sid_;
+  }
+
+  // `tables` is a bit set of PsiTable.
+  void Subscribe(PsiObserver* observer, uint32_t tables) {
+    MIRAKC_ARIB_ASSERT(observer != nullptr);
+    observers_.push_back({observer, tables});
+
+    auto added = tables & ~tables_;
+    tables_ |= tables;
+    if (added & kPsiCat) {
+      demux_.addPID(ts::PID_CAT);
+      MIRAKC_ARIB_PSI_STATE_DEBUG("Demux += CAT");
+    }
+    if (added & kPsiEit) {
+      demux_.addPID(ts::PID_EIT);
+      MIRAKC_ARIB_PSI_STATE_DEBUG("Demux += EIT");
+    }
+    if (added & kPsiTime) {
+      demux_.addPID(ts::PID_TOT);
+      MIRAKC_ARIB_PSI_STATE_DEBUG("Demux += TDT/TOT");
+    }
+  }
+
+  // PIDs demuxed for the observer are kept until the PsiState is destroyed.
+  void Unsubscribe(PsiObserver* observer) {
+    observers_.erase(
+        std::remove_if(observers_.begin(), observers_.end(),
+                       [observer](const Subscription& sub) {
+                         return sub.observer == observer;
+                       }),
+        observers_.end());
+  }
+
+  void FeedPacket(const ts::TSPacket& packet) {
+    demux_.feedPacket(packet);
+  }
+
+  // Snapshots of the latest tables.
+
+  ts::PID pmt_pid() const {
+    return pmt_pid_;
+  }
+
+  // nullptr until the PMT of the service is received.
+  const std::shared_ptr<ts::PMT>& pmt() const {
+    return pmt_;
+  }
+
+  // CRC32 of the PMT section.  Stages can use it together with the version for
+  // detecting a PMT delivered again without any change.
+  uint32_t pmt_crc32() const {
+    return pmt_crc32_;
+  }
+
+  // nullptr until the EIT p/f of the service is received.
+  const std::shared_ptr<ts::EIT>& eit() const {
+    return eit_;
+  }
+
+  const std::unordered_set<ts::PID>& emm_pids() const {
+    return emm_pids_;
+  }
+
+  const std::optional<ts::Time>& time() const {
+    return time_;
+  }
+
+ private:
+  struct Subscription {
+    PsiObserver* observer;
+    uint32_t tables;
+  };
+
+  void handleTable(ts::SectionDemux&, const ts::BinaryTable& table) override {
+    MIRAKC_ARIB_METRICS_INC("psi_state.tables");
+    switch (table.tableId()) {
+      case ts::TID_PAT:
+        HandlePat(table);
+        break;
+      case ts::TID_CAT:
+        HandleCat(table);
+        break;
+      case ts::TID_PMT:
+        HandlePmt(table);
+        break;
+      case ts::TID_EIT_PF_ACT:
+        HandleEit(table);
+        break;
+      case ts::TID_TDT:
+        HandleTdt(table);
+        break;
+      case ts::TID_TOT:
+        HandleTot(table);
+        break;
+      default:
+        break;
+    }
+  }
+
+  void HandlePat(const ts::BinaryTable& table) {
+    // Ignore a strange PAT delivered with PID#0012 around midnight at least on
+    // BS-NTV and BS11 channels.
+    //
+    // This PAT has no PID of NIT and its ts_id is 0 like below:
+    //
+    //   * PAT, TID 0 (0x00), PID 18 (0x0012)
+    //     Short section, total size: 179 bytes
+    //     - Section 0:
+    //       TS id:       0 (0x0000)
+    //       Program: 19796 (0x4D54)  PID: 2672 (0x0A70)
+    //       Program: 28192 (0x6E20)  PID: 6205 (0x183D)
+    //       ...
+    //
+    if (table.sourcePID() != ts::PID_PAT) {
+      MIRAKC_ARIB_PSI_STATE_WARN(
+          "PAT delivered with PID#{:04X}, skip", table.sourcePID());
+      return;
+    }
+
+    ts::PAT pat(context_, table);
+
+    if (!pat.isValid()) {
+      MIRAKC_ARIB_PSI_STATE_WARN("Broken PAT, skip");
+      return;
+    }
+
+    if (pat.ts_id == 0) {
+      MIRAKC_ARIB_PSI_STATE_WARN("PAT for TSID#0000, skip");
+      return;
+    }
+
+    // The PMT is demuxed again even if its PID is unchanged.  A PMT with the
+    // same version will be delivered again.
+    auto it = pat.pmts.find(sid_);
+    if (it != pat.pmts.end()) {
+      if (pmt_pid_ != ts::PID_NULL) {
+        MIRAKC_ARIB_PSI_STATE_DEBUG("Demux -= PMT#{:04X}", pmt_pid_);
+        demux_.removePID(pmt_pid_);
+      }
+      pmt_pid_ = it->second;
+      demux_.addPID(pmt_pid_);
+      MIRAKC_ARIB_PSI_STATE_DEBUG("Demux += PMT#{:04X}", pmt_pid_);
+    }
+
+    for (const auto& sub : observers_) {
+      if (sub.tables & kPsiPat) {
+        sub.observer->OnPat(pat);
+      }
+    }
+  }
+
+  void HandleCat(const ts::BinaryTable& table) {
+    ts::CAT cat(context_, table);
+
+    if (!cat.isValid()) {
+      MIRAKC_ARIB_PSI_STATE_WARN("Broken CAT, skip");
+      return;
+    }
+
+    emm_pids_.clear();
+    auto i = cat.descs.search(ts::DID_CA);
+    while (i < cat.descs.size()) {
+      ts::CADescriptor desc(context_, *cat.descs[i]);
+      emm_pids_.insert(desc.ca_pid);
+      i = cat.descs.search(ts::DID_CA, i + 1);
+    }
+
+    for (const auto& sub : observers_) {
+      if (sub.tables & kPsiCat) {
+        sub.observer->OnCat(cat);
+      }
+    }
+  }
+
+  void HandlePmt(const ts::BinaryTable& table) {
+    auto pmt = std::make_shared<ts::PMT>(context_, table);
+
+    if (!pmt->isValid()) {
+      MIRAKC_ARIB_PSI_STATE_WARN("Broken PMT, skip");
+      return;
+    }
+
+    if (pmt->service_id != sid_) {
+      MIRAKC_ARIB_PSI_STATE_WARN("PMT.SID#{} unmatched, skip", pmt->service_id);
+      return;
+    }
+
+    pmt_ = std::move(pmt);
+    // The PMT of a service consists of a single section.
+    const auto& section = table.sectionAt(0);
+    pmt_crc32_ = ts::GetUInt32(section->content() + section->size() - 4);
+
+    for (const auto& sub : observers_) {
+      if (sub.tables & kPsiPmt) {
+        sub.observer->OnPmt(*pmt_, table.sourcePID());
+      }
+    }
+  }
+
+  void HandleEit(const ts::BinaryTable& table) {
+    auto eit = std::make_shared<ts::EIT>(context_, table);
+
+    if (!eit->isValid()) {
+      MIRAKC_ARIB_PSI_STATE_WARN("Broken EIT, skip");
+      return;
+    }
+
+    if (eit->service_id != sid_) {
+      MIRAKC_ARIB_PSI_STATE_TRACE(
+          "SID#{:04X} not matched with {:04X}, skip", eit->service_id, sid_);
+      return;
+    }
+
+    eit_ = std::move(eit);
+
+    for (const auto& sub : observers_) {
+      if (sub.tables & kPsiEit) {
+        sub.observer->OnEit(eit_);
+      }
+    }
+  }
+
+  void HandleTdt(const ts::BinaryTable& table) {
+    ts::TDT tdt(context_, table);
+
+    if (!tdt.isValid()) {
+      MIRAKC_ARIB_PSI_STATE_WARN("Broken TDT, skip");
+      return;
+    }
+
+    UpdateTime(tdt.utc_time);  // JST in ARIB
+  }
+
+  void HandleTot(const ts::BinaryTable& table) {
+    ts::TOT tot(context_, table);
+
+    if (!tot.isValid()) {
+      MIRAKC_ARIB_PSI_STATE_WARN("Broken TOT, skip");
+      return;
+    }
+
+    UpdateTime(tot.utc_time);  // JST in ARIB
+  }
+
+  void UpdateTime(const ts::Time& time) {
+    time_ = time;
+
+    for (const auto& sub : observers_) {
+      if (sub.tables & kPsiTime) {
+        sub.observer->OnTime(time);
+      }
+    }
+  }
+
+  const uint16_t sid_;
+  ts::DuckContext context_;
+  ts::SectionDemux demux_;
+  std::vector<Subscription> observers_;
+  uint32_t tables_ = 0;
+  ts::PID pmt_pid_ = ts::PID_NULL;
+  std::shared_ptr<ts::PMT> pmt_;
+  uint32_t pmt_crc32_ = 0;
+  std::shared_ptr<ts::EIT> eit_;
+  std::unordered_set<ts::PID> emm_pids_;
+  std::optional<ts::Time> time_;
+
+  MIRAKC_ARIB_NON_COPYABLE(PsiState);
+};
+
+}  // namespace
@@ -9,7 +9,9 @@
 #include "base.hh"
 #include "file.hh"
 #include "logging.hh"
+#include "metrics.hh"
 #include "packet_sink.hh"
+#include "probes.hh"
 
 namespace {
 
@@ -58,7 +60,7 @@ class RingFileSink final : public PacketRingSink {
         }
       }
     } while (nwritten < ts::PKT_SIZE);
-    MIRAKC_ARIB_ASSERT(nwritten == ts::PKT_SIZE);
+    MIRAKC_ARIB_DASSERT(nwritten == ts::PKT_SIZE);
 
     return true;
   }
@@ -102,9 +104,9 @@ class RingFileSink final : public PacketRingSink {
     auto fill_bytes = std::min(size, free_bytes());
     std::memcpy(buf_ + buf_pos_, data, fill_bytes);
     buf_pos_ += fill_bytes;
-    MIRAKC_ARIB_ASSERT(buf_pos_ <= kBufferSize);
+    MIRAKC_ARIB_DASSERT(buf_pos_ <= kBufferSize);
     ring_pos_ += fill_bytes;
-    MIRAKC_ARIB_ASSERT(ring_pos_ <= ring_size_);
+    MIRAKC_ARIB_DASSERT(ring_pos_ <= ring_size_);
     return fill_bytes;
   }
 
@@ -119,11 +121,18 @@ class RingFileSink final : public PacketRingSink {
 
     while (nwritten < kBufferSize) {
       MIRAKC_ARIB_TRACE("{}: Write the buffer", file_->path());
-      auto result = file_->Write(buf_ + nwritten, kBufferSize - nwritten);
+      ssize_t result;
+      {
+        MIRAKC_ARIB_METRICS_TIMER("ring_file_sink.write_ns");
+        MIRAKC_ARIB_PROBE1(ring_file_sink_write_start, kBufferSize - nwritten);
+        result = file_->Write(buf_ + nwritten, kBufferSize - nwritten);
+        MIRAKC_ARIB_PROBE1(ring_file_sink_write_done, result);
+      }
       if (result <= 0) {
         return false;
       }
       nwritten += result;
+      MIRAKC_ARIB_METRICS_ADD("ring_file_sink.written_bytes", result);
     }
     MIRAKC_ARIB_ASSERT(nwritten == kBufferSize);
 
@@ -136,7 +145,14 @@ class RingFileSink final : public PacketRingSink {
       MIRAKC_ARIB_ASSERT(ring_pos_ != 0);
       MIRAKC_ARIB_ASSERT(ring_pos_ % chunk_size_ == 0);
       MIRAKC_ARIB_DEBUG("{}: Reached the chunk boundary {}, sync", file_->path(), ring_pos_);
-      if (!file_->Sync()) {
+      bool synced;
+      {
+        MIRAKC_ARIB_METRICS_TIMER("ring_file_sink.sync_ns");
+        MIRAKC_ARIB_PROBE1(ring_file_sink_sync_start, ring_pos_);
+        synced = file_->Sync();
+        MIRAKC_ARIB_PROBE1(ring_file_sink_sync_done, synced);
+      }
+      if (!synced) {
         return false;
       }
       chunk_pos_ = 0;
@@ -9,8 +9,11 @@
 
 #include "base.hh"
 #include "logging.hh"
+#include "metrics.hh"
 #include "packet_sink.hh"
 #include "packet_source.hh"
+#include "probes.hh"
+#include "psi_state.hh"
 #include "tsduck_helper.hh"
 
 #define MIRAKC_ARIB_SERVICE_FILTER_TRACE(...) \
@@ -31,27 +34,35 @@ struct ServiceFilterOption final {
   std::optional<ts::Time> time_limit = std::nullopt;  // JST
 };
 
-class ServiceFilter final : public PacketSink,
-                            public ts::TableHandlerInterface {
+// `Sink` is the type of the downstream stage.  See the comment on PacketSink
+// for details.
+//
+// ServiceFilter is always the first stage in a pipeline, so it feeds packets
+// to `psi` which may be shared with downstream stages.
+template <typename Sink>
+class BasicServiceFilter final : public PacketSink,
+                                 public PsiObserver {
  public:
-  explicit ServiceFilter(const ServiceFilterOption& option)
+  explicit BasicServiceFilter(const ServiceFilterOption& option,
+                              std::shared_ptr<PsiState> psi = nullptr)
       : option_(option),
-        demux_(context_),
+        psi_(psi ? std::move(psi) : std::make_shared<PsiState>(option.sid)),
         pat_packetizer_(ts::PID_PAT, ts::CyclingPacketizer::ALWAYS) {
-    demux_.setTableHandler(this);
-    demux_.addPID(ts::PID_PAT);
-    MIRAKC_ARIB_SERVICE_FILTER_DEBUG("Demux PAT");
-    demux_.addPID(ts::PID_CAT);
-    MIRAKC_ARIB_SERVICE_FILTER_DEBUG("Demux CAT for detecting EMM PIDs");
+    MIRAKC_ARIB_ASSERT(psi_->sid() == option_.sid);
+    uint32_t tables = kPsiPat | kPsiCat | kPsiPmt;
+    MIRAKC_ARIB_SERVICE_FILTER_DEBUG("Subscribe PAT CAT PMT");
     if (option_.time_limit.has_value()) {
-      demux_.addPID(ts::PID_TOT);
-      MIRAKC_ARIB_SERVICE_FILTER_DEBUG("Demux TDT/TOT for checking the time limit");
+      tables |= kPsiTime;
+      MIRAKC_ARIB_SERVICE_FILTER_DEBUG("Subscribe TDT/TOT for checking the time limit");
     }
+    psi_->Subscribe(this, tables);
   }
 
-  virtual ~ServiceFilter() override {}
+  virtual ~BasicServiceFilter() override {
+    psi_->Unsubscribe(this);
+  }
 
-  void Connect(std::unique_ptr<PacketSink>&& sink) {
+  void Connect(std::unique_ptr<Sink>&& sink) {
     sink_ = std::move(sink);
   }
 
@@ -80,7 +91,8 @@ class ServiceFilter final : public PacketSink,
       return false;
     }
 
-    demux_.feedPacket(packet);
+    MIRAKC_ARIB_METRICS_INC("service_filter.packets");
+    psi_->FeedPacket(packet);
 
     if (done_) {
       return false;
@@ -89,6 +101,7 @@ class ServiceFilter final : public PacketSink,
     auto pid = packet.getPID();
 
     if (CheckFilterForDrop(pid)) {
+      MIRAKC_ARIB_METRICS_INC("service_filter.dropped_packets");
       return true;
     }
 
@@ -100,7 +113,7 @@ class ServiceFilter final : public PacketSink,
       return sink_->HandlePacket(pat_packet);
     }
 
-    MIRAKC_ARIB_ASSERT(pid != ts::PID_NULL);
+    MIRAKC_ARIB_DASSERT(pid != ts::PID_NULL);
     return sink_->HandlePacket(packet);
   }
 
@@ -118,53 +131,18 @@ class ServiceFilter final : public PacketSink,
     return true;
   }
 
-  void handleTable(ts::SectionDemux&, const ts::BinaryTable& table) override {
-    switch (table.tableId()) {
-      case ts::TID_PAT:
-        HandlePat(table);
-        break;
-      case ts::TID_CAT:
-        HandleCat(table);
-        break;
-      case ts::TID_PMT:
-        HandlePmt(table);
-        break;
-      case ts::TID_TDT:
-        HandleTdt(table);
-        break;
-      case ts::TID_TOT:
-        HandleTot(table);
-        break;
-      default:
-        break;
-    }
-  }
-
-  void HandlePat(const ts::BinaryTable& table) {
-    if (table.sourcePID() != ts::PID_PAT) {
-      MIRAKC_ARIB_SERVICE_FILTER_WARN(
-          "PAT delivered with PID#{:04X}, skip", table.sourcePID());
-      return;
-    }
-
-    ts::PAT pat(context_, table);
-
-    if (!pat.isValid()) {
-      MIRAKC_ARIB_SERVICE_FILTER_WARN("Broken PAT, skip");
-      return;
-    }
+  void OnPat(const ts::PAT& original_pat) override {
+    MIRAKC_ARIB_PROBE2(service_filter_pat, original_pat.ts_id, original_pat.version);
 
-    if (pat.ts_id == 0) {
-      MIRAKC_ARIB_SERVICE_FILTER_WARN("PAT for TSID#0000, skip");
-      return;
-    }
-
-    if (pat.pmts.find(option_.sid) == pat.pmts.end()) {
+    if (original_pat.pmts.find(option_.sid) == original_pat.pmts.end()) {
       MIRAKC_ARIB_SERVICE_FILTER_ERROR("SID#{:04X} not found in PAT", option_.sid);
       done_ = true;
       return;
     }
 
+    // Other services will be removed from the copy.
+    ts::PAT pat(original_pat);
+
     psi_filter_.clear();
     MIRAKC_ARIB_SERVICE_FILTER_DEBUG("Clear PSI/SI filter");
 
@@ -173,8 +151,6 @@ class ServiceFilter final : public PacketSink,
     if (pmt_pid_ != ts::PID_NULL) {
       MIRAKC_ARIB_SERVICE_FILTER_INFO(
           "PID of PMT has been changed: {:04X} -> {:04X}", pmt_pid_, new_pmt_pid);
-      demux_.removePID(pmt_pid_);
-      MIRAKC_ARIB_SERVICE_FILTER_DEBUG("Stop to demux PMT#{:04X}", pmt_pid_);
       pmt_pid_ = ts::PID_NULL;
 
       // content_filter_ is not cleared at this point.  This will be cleared
@@ -182,8 +158,6 @@ class ServiceFilter final : public PacketSink,
     }
 
     pmt_pid_ = new_pmt_pid;
-    demux_.addPID(pmt_pid_);
-    MIRAKC_ARIB_SERVICE_FILTER_DEBUG("Demux PMT#{:04X}", pmt_pid_);
 
     // Remove other services from PAT.
     for (auto it = pat.pmts.begin(); it != pat.pmts.end(); ) {
@@ -215,38 +189,18 @@ class ServiceFilter final : public PacketSink,
         pmt_pid_);
   }
 
-  void HandleCat(const ts::BinaryTable& table) {
-    ts::CAT cat(context_, table);
-
-    if (!cat.isValid()) {
-      MIRAKC_ARIB_SERVICE_FILTER_WARN("Broken CAT, skip");
-      return;
-    }
-
+  void OnCat(const ts::CAT&) override {
     emm_filter_.clear();
     MIRAKC_ARIB_SERVICE_FILTER_DEBUG("Clear EMM filter");
 
-    auto i = cat.descs.search(ts::DID_CA);
-    while (i < cat.descs.size()) {
-      ts::CADescriptor desc(context_, *cat.descs[i]);
-      emm_filter_.insert(desc.ca_pid);
-      MIRAKC_ARIB_SERVICE_FILTER_DEBUG("EMM filter += EMM#{:04X}", desc.ca_pid);
-      i = cat.descs.search(ts::DID_CA, i + 1);
+    for (auto pid : psi_->emm_pids()) {
+      emm_filter_.insert(pid);
+      MIRAKC_ARIB_SERVICE_FILTER_DEBUG("EMM filter += EMM#{:04X}", pid);
     }
   }
 
-  void HandlePmt(const ts::BinaryTable& table) {
-    ts::PMT pmt(context_, table);
-
-    if (!pmt.isValid()) {
-      MIRAKC_ARIB_SERVICE_FILTER_WARN("Broken PMT, skip");
-      return;
-    }
-
-    if (pmt.service_id != option_.sid) {
-      MIRAKC_ARIB_SERVICE_FILTER_WARN("PMT.SID#{} unmatched, skip", pmt.service_id);
-      return;
-    }
+  void OnPmt(const ts::PMT& pmt, ts::PID) override {
+    MIRAKC_ARIB_PROBE2(service_filter_pmt, pmt.service_id, pmt.version);
 
     content_filter_.clear();
     MIRAKC_ARIB_SERVICE_FILTER_DEBUG("Clear content filter");
@@ -284,29 +238,7 @@ class ServiceFilter final : public PacketSink,
     }
   }
 
-  void HandleTdt(const ts::BinaryTable& table) {
-    ts::TDT tdt(context_, table);
-
-    if (!tdt.isValid()) {
-      MIRAKC_ARIB_SERVICE_FILTER_WARN("Broken TDT, skip");
-      return;
-    }
-
-    CheckTimeLimit(tdt.utc_time);  // JST in ARIB
-  }
-
-  void HandleTot(const ts::BinaryTable& table) {
-    ts::TOT tot(context_, table);
-
-    if (!tot.isValid()) {
-      MIRAKC_ARIB_SERVICE_FILTER_WARN("Broken TOT, skip");
-      return;
-    }
-
-    CheckTimeLimit(tot.utc_time);  // JST in ARIB
-  }
-
-  void CheckTimeLimit(const ts::Time& jst_time) {
+  void OnTime(const ts::Time& jst_time) override {
     if (jst_time < option_.time_limit.value()) {
       return;
     }
@@ -317,16 +249,19 @@ class ServiceFilter final : public PacketSink,
 
   const ServiceFilterOption option_;
   ts::DuckContext context_;
-  ts::SectionDemux demux_;
+  std::shared_ptr<PsiState> psi_;
   ts::CyclingPacketizer pat_packetizer_;
-  std::unique_ptr<PacketSink> sink_;
+  std::unique_ptr<Sink> sink_;
   std::unordered_set<ts::PID> psi_filter_;
   std::unordered_set<ts::PID> content_filter_;
   std::unordered_set<ts::PID> emm_filter_;
   ts::PID pmt_pid_ = ts::PID_NULL;
   bool done_ = false;
 
-  MIRAKC_ARIB_NON_COPYABLE(ServiceFilter);
+  MIRAKC_ARIB_NON_COPYABLE(BasicServiceFilter);
 };
 
+// Used with arbitrary PacketSink implementations including mocks.
+using ServiceFilter = BasicServiceFilter<PacketSink>;
+
 }  // namespace
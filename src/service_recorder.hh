@@ -10,7 +10,10 @@
 #include "base.hh"
 #include "jsonl_source.hh"
 #include "logging.hh"
+#include "metrics.hh"
 #include "packet_sink.hh"
+#include "probes.hh"
+#include "psi_state.hh"
 #include "tsduck_helper.hh"
 
 #define MIRAKC_ARIB_SERVICE_RECORDER_TRACE(...) \
@@ -34,26 +37,32 @@ struct ServiceRecorderOption final {
   uint64_t start_pos = 0;
 };
 
-class ServiceRecorder final : public PacketSink,
-                              public JsonlSource,
-                              public PacketRingObserver,
-                              public ts::TableHandlerInterface {
+// `Sink` is the type of the ring buffer which must implement PacketRingSink.
+//
+// Tables are received from `psi` shared with the upstream stage which feeds
+// packets to it.  ServiceRecorder feeds packets to its own PsiState if `psi`
+// is not specified.
+template <typename Sink>
+class BasicServiceRecorder final : public PacketSink,
+                                   public JsonlSource,
+                                   public PacketRingObserver,
+                                   public PsiObserver {
  public:
-  explicit ServiceRecorder(const ServiceRecorderOption& option)
+  explicit BasicServiceRecorder(const ServiceRecorderOption& option,
+                                std::shared_ptr<PsiState> psi = nullptr)
       : option_(option),
-        demux_(context_) {
-    demux_.setTableHandler(this);
-    demux_.addPID(ts::PID_PAT);
-    MIRAKC_ARIB_SERVICE_RECORDER_DEBUG("Demux PAT");
-    demux_.addPID(ts::PID_EIT);
-    MIRAKC_ARIB_SERVICE_RECORDER_DEBUG("Demux EIT");
-    demux_.addPID(ts::PID_TOT);
-    MIRAKC_ARIB_SERVICE_RECORDER_DEBUG("Demux TDT/TOT");
+        psi_(psi ? psi : std::make_shared<PsiState>(option.sid)),
+        feeds_psi_(!psi) {
+    MIRAKC_ARIB_ASSERT(psi_->sid() == option_.sid);
+    psi_->Subscribe(this, kPsiPmt | kPsiEit | kPsiTime);
+    MIRAKC_ARIB_SERVICE_RECORDER_DEBUG("Subscribe PMT EIT TDT/TOT");
   }
 
-  ~ServiceRecorder() override = default;
+  ~BasicServiceRecorder() override {
+    psi_->Unsubscribe(this);
+  }
 
-  void Connect(std::unique_ptr<PacketRingSink>&& sink) {
+  void Connect(std::unique_ptr<Sink>&& sink) {
     sink_ = std::move(sink);
     sink_->SetObserver(this);
   }
@@ -95,11 +104,20 @@ class ServiceRecorder final : public PacketSink,
     if (clock_.HasPid() && clock_.pid() == pid && packet.hasPCR()) {
       auto pcr = packet.getPCR();
       if (pcr != ts::INVALID_PCR) {
+        auto was_ready = clock_.IsReady();
         clock_.UpdatePcr(pcr);
+        if (!was_ready || !clock_.IsReady()) {
+          // The clock has been synchronized or invalidated.
+          event_check_needed_ = true;
+        } else if (end_pcr_ready_ && ComparePcr(pcr, end_pcr_) >= 0) {  // pcr >= end_pcr_
+          event_check_needed_ = true;
+        }
       }
     }
 
-    demux_.feedPacket(packet);
+    if (feeds_psi_) {
+      psi_->FeedPacket(packet);
+    }
 
     switch (state_) {
       case State::kPreparing:
@@ -112,6 +130,7 @@ class ServiceRecorder final : public PacketSink,
   }
 
   void OnEndOfChunk(uint64_t pos) override {
+    MIRAKC_ARIB_PROBE1(service_recorder_end_of_chunk, pos);
     auto now = clock_.Now();
     if (pos == sink_->ring_size()) {
       pos = 0;
@@ -130,76 +149,7 @@ class ServiceRecorder final : public PacketSink,
     kDone,
   };
 
-  void handleTable(ts::SectionDemux&, const ts::BinaryTable& table) override {
-    switch (table.tableId()) {
-      case ts::TID_PAT:
-        HandlePat(table);
-        break;
-      case ts::TID_PMT:
-        HandlePmt(table);
-        break;
-      case ts::TID_EIT_PF_ACT:
-        HandleEit(table);
-        break;
-      case ts::TID_TDT:
-        HandleTdt(table);
-        break;
-      case ts::TID_TOT:
-        HandleTot(table);
-        break;
-      default:
-        break;
-    }
-  }
-
-  void HandlePat(const ts::BinaryTable& table) {
-    // See comments in ProgramFiler::HandlePat().
-    if (table.sourcePID() != ts::PID_PAT) {
-      MIRAKC_ARIB_SERVICE_RECORDER_WARN("PAT delivered with PID#{:04X}, skip", table.sourcePID());
-      return;
-    }
-
-    ts::PAT pat(context_, table);
-
-    if (!pat.isValid()) {
-      MIRAKC_ARIB_SERVICE_RECORDER_WARN("Broken PAT, skip");
-      return;
-    }
-
-    if (pat.ts_id == 0) {
-      MIRAKC_ARIB_SERVICE_RECORDER_WARN("PAT for TSID#0000, skip");
-      return;
-    }
-
-    // The following condition is ensured by ServiceFilter.
-    MIRAKC_ARIB_ASSERT(pat.pmts.find(option_.sid) != pat.pmts.end());
-
-    auto new_pmt_pid = pat.pmts[option_.sid];
-
-    if (pmt_pid_ != ts::PID_NULL) {
-      MIRAKC_ARIB_SERVICE_RECORDER_DEBUG("Demux -= PMT#{:04X}", pmt_pid_);
-      demux_.removePID(pmt_pid_);
-      pmt_pid_ = ts::PID_NULL;
-    }
-
-    pmt_pid_ = new_pmt_pid;
-    demux_.addPID(pmt_pid_);
-    MIRAKC_ARIB_SERVICE_RECORDER_DEBUG("Demux += PMT#{:04X}", pmt_pid_);
-  }
-
-  void HandlePmt(const ts::BinaryTable& table) {
-    ts::PMT pmt(context_, table);
-
-    if (!pmt.isValid()) {
-      MIRAKC_ARIB_SERVICE_RECORDER_WARN("Broken PMT, skip");
-      return;
-    }
-
-    if (pmt.service_id != option_.sid) {
-      MIRAKC_ARIB_SERVICE_RECORDER_WARN("PMT.SID#{} not matched, skip", pmt.service_id);
-      return;
-    }
-
+  void OnPmt(const ts::PMT& pmt, ts::PID) override {
     auto pcr_pid = pmt.pcr_pid;
     if (!clock_.HasPid()) {
       MIRAKC_ARIB_SERVICE_RECORDER_DEBUG("PCR#{:04X}", pcr_pid);
@@ -211,19 +161,7 @@ class ServiceRecorder final : public PacketSink,
     }
   }
 
-  void HandleEit(const ts::BinaryTable& table) {
-    std::shared_ptr<ts::EIT> eit(new ts::EIT(context_, table));
-
-    if (!eit->isValid()) {
-      MIRAKC_ARIB_SERVICE_RECORDER_WARN("Broken EIT, skip");
-      return;
-    }
-
-    if (eit->service_id != option_.sid) {
-      MIRAKC_ARIB_TRACE("SID#{:04X} not matched with {:04X}, skip", eit->service_id, option_.sid);
-      return;
-    }
-
+  void OnEit(const std::shared_ptr<ts::EIT>& eit) override {
     auto num_events = eit->events.size();
     if (num_events == 0) {
       MIRAKC_ARIB_SERVICE_RECORDER_WARN("No event in EIT, skip");
@@ -243,25 +181,13 @@ class ServiceRecorder final : public PacketSink,
 
     // For keeping the locality of side effects, we don't update eit_ here.  It will be updated
     // in the implementation of the state machine.
-    new_eit_ = std::move(eit);
+    new_eit_ = eit;
+    event_check_needed_ = true;
   }
 
-  void HandleTdt(const ts::BinaryTable& table) {
-    ts::TDT tdt(context_, table);
-    if (!tdt.isValid()) {
-      MIRAKC_ARIB_SERVICE_RECORDER_WARN("Broken TDT, skip");
-      return;
-    }
-    clock_.UpdateTime(tdt.utc_time);  // JST in ARIB
-  }
-
-  void HandleTot(const ts::BinaryTable& table) {
-    ts::TOT tot(context_, table);
-    if (!tot.isValid()) {
-      MIRAKC_ARIB_SERVICE_RECORDER_WARN("Broken TOT, skip");
-      return;
-    }
-    clock_.UpdateTime(tot.utc_time);  // JST in ARIB
+  void OnTime(const ts::Time& time) override {
+    clock_.UpdateTime(time);
+    event_check_needed_ = true;
   }
 
   bool OnPreparing(const ts::TSPacket& packet) {
@@ -297,49 +223,72 @@ class ServiceRecorder final : public PacketSink,
   }
 
   bool OnRecording(const ts::TSPacket& packet) {
-    auto now = clock_.Now();
+    // The event state changes only when the EIT or the clock is updated, or
+    // PCR reaches `end_pcr_`.  Other packets are sent to the sink without any
+    // check.  The clock computes the current time from the local time while
+    // it's not ready, so the event state has to be checked for each packet in
+    // that case.
+    if (event_check_needed_ || !clock_.IsReady()) {
+      event_check_needed_ = false;
+      CheckEvent();
+    }
+    return sink_->HandlePacket(packet);
+  }
 
-    // Copy the safe pointers on the stack in order to hold EIT objects.
-    auto eit = eit_;
-    auto new_eit = new_eit_;
-    auto event_changed = false;
+  void CheckEvent() {
     if (new_eit_) {
-      if (GetEvent(eit_).event_id != GetEvent(new_eit_).event_id) {
-        event_changed = true;
-      } else {
-        // Same EID, but event data might change.
-        eit = new_eit;
-      }
+      // Hold the previous EIT object until messages are sent.
+      auto eit = std::move(eit_);
       eit_ = std::move(new_eit_);
+      if (GetEvent(eit).event_id != GetEvent(eit_).event_id) {
+        OnEventChanged(eit);
+        // Update `end_pcr_` for the new event with the next packet.
+        event_check_needed_ = true;
+        return;
+      }
+      // Same EID, but event data might change.
     }
 
-    if (event_started_) {
-      if (event_changed) {
-        MIRAKC_ARIB_SERVICE_RECORDER_WARN(
-            "Event#{:04X} has started before Event#{:04X} ends",
-            GetEvent(new_eit).event_id, GetEvent(eit).event_id);
-        UpdateEventBoundary(now, sink_->pos());
-        SendEventEndMessage(eit);
-        SendEventStartMessage(new_eit);
-      } else {
-        if (IsUnspecifiedEventEndTime(GetEvent(eit))) {
-          // Continue recording as the current program until the event changes.
-        } else {
-          auto end_time = GetEventEndTime(GetEvent(eit));
-          if (now >= end_time) {
-            UpdateEventBoundary(end_time, sink_->pos());
-            SendEventEndMessage(eit);
-            event_started_ = false;  // wait for new event
-          }
-        }
+    end_pcr_ready_ = false;
+
+    if (!event_started_) {
+      return;  // wait for new event
+    }
+
+    if (IsUnspecifiedEventEndTime(GetEvent(eit_))) {
+      // Continue recording as the current program until the event changes.
+      return;
+    }
+
+    auto end_time = GetEventEndTime(GetEvent(eit_));
+    if (clock_.IsReady()) {
+      // Computed in the same way as ProgramFilter.
+      end_pcr_ = clock_.TimeToPcr(end_time);
+      if (ComparePcr(clock_.pcr(), end_pcr_) < 0) {  // pcr < end_pcr_
+        end_pcr_ready_ = true;
+        return;
       }
+    } else if (clock_.Now() < end_time) {
+      return;
+    }
+
+    UpdateEventBoundary(end_time, sink_->pos());
+    SendEventEndMessage(eit_);
+    event_started_ = false;  // wait for new event
+  }
+
+  void OnEventChanged(const std::shared_ptr<ts::EIT>& prev_eit) {
+    if (event_started_) {
+      MIRAKC_ARIB_SERVICE_RECORDER_WARN(
+          "Event#{:04X} has started before Event#{:04X} ends",
+          GetEvent(eit_).event_id, GetEvent(prev_eit).event_id);
+      UpdateEventBoundary(clock_.Now(), sink_->pos());
+      SendEventEndMessage(prev_eit);
+      SendEventStartMessage(eit_);
     } else {
-      if (event_changed) {
-        SendEventStartMessage(new_eit);
-        event_started_ = true;
-      }
+      SendEventStartMessage(eit_);
+      event_started_ = true;
     }
-    return sink_->HandlePacket(packet);
   }
 
   void UpdateEventBoundary(const ts::Time& time, uint64_t pos) {
@@ -466,19 +415,23 @@ class ServiceRecorder final : public PacketSink,
   }
 
   const ServiceRecorderOption option_;
-  ts::DuckContext context_;
-  ts::SectionDemux demux_;
-  std::unique_ptr<PacketRingSink> sink_;
+  std::shared_ptr<PsiState> psi_;
+  const bool feeds_psi_;
+  std::unique_ptr<Sink> sink_;
   Clock clock_;
   ts::Time event_boundary_time_;
   uint64_t event_boundary_pos_;
   std::shared_ptr<ts::EIT> eit_;
   std::shared_ptr<ts::EIT> new_eit_;
-  ts::PID pmt_pid_ = ts::PID_NULL;
   State state_ = State::kPreparing;
   bool event_started_ = false;
+  bool event_check_needed_ = true;
+  int64_t end_pcr_ = 0;
+  bool end_pcr_ready_ = false;
 
-  MIRAKC_ARIB_NON_COPYABLE(ServiceRecorder);
+  MIRAKC_ARIB_NON_COPYABLE(BasicServiceRecorder);
 };
 
+using ServiceRecorder = BasicServiceRecorder<PacketRingSink>;
+
 }  // namespace
@@ -0,0 +1,364 @@
+#pragma once
+
+#include <arpa/inet.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "base.hh"
+#include "logging.hh"
+
+#define MIRAKC_ARIB_SESSION_SERVER_TRACE(...) \
+  MIRAKC_ARIB_TRACE("session-server: " __VA_ARGS__)
+#define MIRAKC_ARIB_SESSION_SERVER_DEBUG(...) \
+  MIRAKC_ARIB_DEBUG("session-server: " __VA_ARGS__)
+#define MIRAKC_ARIB_SESSION_SERVER_INFO(...) \
+  MIRAKC_ARIB_INFO("session-server: " __VA_ARGS__)
+#define MIRAKC_ARIB_SESSION_SERVER_WARN(...) \
+  MIRAKC_ARIB_WARN("session-server: " __VA_ARGS__)
+#define MIRAKC_ARIB_SESSION_SERVER_ERROR(...) \
+  MIRAKC_ARIB_ERROR("session-server: " __VA_ARGS__)
+
+namespace {
+
+// Protocol:
+//
+//   1. A client connects to the server with a SOCK_SEQPACKET socket.
+//   2. The client sends a request in a single message.  The payload is a list of
+//      NUL-terminated arguments like "track-airtime\0--sid=1\0--eid=2\0", and
+//      file descriptors for STDIN, STDOUT and STDERR of the session are attached
+//      as SCM_RIGHTS ancillary data.
+//   3. The server runs the session in a child process and sends the exit status
+//      as a 32-bit big endian integer when the session ends.  The exit status of
+//      a session killed by a signal is 128 + the signal number.
+//   4. The server closes the connection.
+constexpr size_t kSessionMaxRequestSize = 64 * 1024;
+constexpr int kSessionNumFds = 3;
+
+// Runs a session with arguments and returns the exit status.
+using SessionRunner = std::function<int(const std::vector<std::string>&)>;
+
+class SessionServer final {
+ public:
+  SessionServer(const std::string& path, SessionRunner runner)
+      : path_(path), runner_(runner) {}
+
+  ~SessionServer() {
+    if (sock_ >= 0) {
+      close(sock_);
+      unlink(path_.c_str());
+      signal(SIGCHLD, prev_sigchld_handler_);
+    }
+  }
+
+  bool Listen() {
+    struct sockaddr_un addr;
+    if (path_.size() >= sizeof(addr.sun_path)) {
+      MIRAKC_ARIB_SESSION_SERVER_ERROR("Too long socket path: {}", path_);
+      return false;
+    }
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    std::strcpy(addr.sun_path, path_.c_str());
+
+    // Remove a stale socket file left by a previous server.  Other types of
+    // files are never removed so that a mistyped path doesn't destroy data.
+    struct stat st;
+    if (lstat(path_.c_str(), &st) == 0) {
+      if (!S_ISSOCK(st.st_mode)) {
+        MIRAKC_ARIB_SESSION_SERVER_ERROR("Not a socket: {}", path_);
+        return false;
+      }
+      unlink(path_.c_str());
+    } else if (errno != ENOENT) {
+      MIRAKC_ARIB_SESSION_SERVER_ERROR(
+          "Failed to stat {}: {} ({})", path_, std::strerror(errno), errno);
+      return false;
+    }
+
+    auto sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (sock < 0) {
+      MIRAKC_ARIB_SESSION_SERVER_ERROR(
+          "Failed to create a socket: {} ({})", std::strerror(errno), errno);
+      return false;
+    }
+
+    if (bind(sock, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0) {
+      MIRAKC_ARIB_SESSION_SERVER_ERROR(
+          "Failed to bind to {}: {} ({})", path_, std::strerror(errno), errno);
+      close(sock);
+      return false;
+    }
+
+    if (listen(sock, SOMAXCONN) < 0) {
+      MIRAKC_ARIB_SESSION_SERVER_ERROR(
+          "Failed to listen on {}: {} ({})", path_, std::strerror(errno), errno);
+      close(sock);
+      unlink(path_.c_str());
+      return false;
+    }
+
+    // Supervisor processes are reaped automatically.
+    prev_sigchld_handler_ = signal(SIGCHLD, SIG_IGN);
+
+    sock_ = sock;
+    MIRAKC_ARIB_SESSION_SERVER_INFO("Listening on {}...", path_);
+    return true;
+  }
+
+  // Serves sessions until an unrecoverable error occurs.
+  void Serve() {
+    while (ServeOne()) {
+      continue;
+    }
+  }
+
+  // Accepts a connection and starts a session for it.
+  //
+  // Returns false if an unrecoverable error occurs.  Errors regarding a request
+  // are logged and ignored.
+  bool ServeOne() {
+    MIRAKC_ARIB_ASSERT(sock_ >= 0);
+
+    auto conn = accept4(sock_, nullptr, nullptr, SOCK_CLOEXEC);
+    if (conn < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        return true;
+      }
+      MIRAKC_ARIB_SESSION_SERVER_ERROR(
+          "Failed to accept: {} ({})", std::strerror(errno), errno);
+      return false;
+    }
+
+    std::vector<std::string> args;
+    int fds[kSessionNumFds];
+    if (!ReceiveRequest(conn, &args, fds)) {
+      close(conn);
+      return true;
+    }
+
+    MIRAKC_ARIB_SESSION_SERVER_INFO("Start session: {}", fmt::join(args, " "));
+
+    auto pid = fork();
+    if (pid < 0) {
+      MIRAKC_ARIB_SESSION_SERVER_ERROR(
+          "Failed to fork: {} ({})", std::strerror(errno), errno);
+    } else if (pid == 0) {
+      RunSupervisor(conn, args, fds);  // never returns
+    }
+
+    CloseFds(fds);
+    close(conn);
+    return true;
+  }
+
+ private:
+  // Receives a request message.  `fds` are valid only when this function
+  // returns true.
+  static bool ReceiveRequest(int conn, std::vector<std::string>* args,
+                             int fds[kSessionNumFds]) {
+    std::vector<char> buf(kSessionMaxRequestSize);
+    struct iovec iov;
+    iov.iov_base = buf.data();
+    iov.iov_len = buf.size();
+
+    union {
+      char buf[CMSG_SPACE(sizeof(int) * kSessionNumFds)];
+      struct cmsghdr align;
+    } control;
+    std::memset(&control, 0, sizeof(control));
+
+    struct msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    auto nread = recvmsg(conn, &msg, MSG_CMSG_CLOEXEC);
+    if (nread < 0) {
+      MIRAKC_ARIB_SESSION_SERVER_ERROR(
+          "Failed to receive a request: {} ({})", std::strerror(errno), errno);
+      return false;
+    }
+
+    // Take received file descriptors first so that they are closed in any case.
+    size_t num_fds = 0;
+    for (auto* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr;
+         cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+      if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+        continue;
+      }
+      num_fds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+      std::memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * num_fds);
+      break;
+    }
+
+    if (num_fds != kSessionNumFds || (msg.msg_flags & MSG_CTRUNC) != 0) {
+      MIRAKC_ARIB_SESSION_SERVER_ERROR(
+          "Broken request: {} file descriptors must be attached", kSessionNumFds);
+      for (size_t i = 0; i < num_fds; ++i) {
+        close(fds[i]);
+      }
+      return false;
+    }
+
+    if ((msg.msg_flags & MSG_TRUNC) != 0 || nread == 0 || buf[nread - 1] != '\0') {
+      MIRAKC_ARIB_SESSION_SERVER_ERROR("Broken request: invalid arguments");
+      CloseFds(fds);
+      return false;
+    }
+
+    args->clear();
+    for (ssize_t i = 0; i < nread; ) {
+      std::string arg(&buf[i]);
+      i += arg.size() + 1;
+      args->push_back(std::move(arg));
+    }
+    return true;
+  }
+
+  [[noreturn]] void RunSupervisor(int conn, const std::vector<std::string>& args,
+                                  int fds[kSessionNumFds]) {
+    close(sock_);
+    // waitpid() doesn't work if SIGCHLD is ignored.
+    signal(SIGCHLD, SIG_DFL);
+
+    auto pid = fork();
+    if (pid < 0) {
+      MIRAKC_ARIB_SESSION_SERVER_ERROR(
+          "Failed to fork: {} ({})", std::strerror(errno), errno);
+      _exit(EXIT_FAILURE);
+    }
+
+    if (pid == 0) {
+      close(conn);
+      for (int i = 0; i < kSessionNumFds; ++i) {
+        if (dup2(fds[i], i) < 0) {
+          _exit(EXIT_FAILURE);
+        }
+      }
+      CloseFds(fds);
+      // Use std::exit() in order to flush buffered outputs.
+      std::exit(runner_(args));
+    }
+
+    CloseFds(fds);
+
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0) {
+      if (errno != EINTR) {
+        _exit(EXIT_FAILURE);
+      }
+    }
+
+    uint32_t code = EXIT_FAILURE;
+    if (WIFEXITED(status)) {
+      code = WEXITSTATUS(status);
+    } else if (WIFSIGNALED(status)) {
+      code = 128 + WTERMSIG(status);
+    }
+    MIRAKC_ARIB_SESSION_SERVER_INFO("End session with exit status {}", code);
+
+    code = htonl(code);
+    send(conn, &code, sizeof(code), MSG_NOSIGNAL);
+    close(conn);
+    _exit(EXIT_SUCCESS);
+  }
+
+  static void CloseFds(int fds[kSessionNumFds]) {
+    for (int i = 0; i < kSessionNumFds; ++i) {
+      if (fds[i] >= kSessionNumFds) {  // keep STDIN, STDOUT and STDERR
+        close(fds[i]);
+      }
+    }
+  }
+
+  const std::string path_;
+  SessionRunner runner_;
+  int sock_ = -1;
+  sighandler_t prev_sigchld_handler_ = SIG_DFL;
+
+  MIRAKC_ARIB_NON_COPYABLE(SessionServer);
+};
+
+// Runs a session on a server and returns its exit status, or -1 on failure.
+//
+// This function is used in tests, and also shows how to implement a client.
+inline int RunRemoteSession(const std::string& path,
+                            const std::vector<std::string>& args,
+                            const int fds[kSessionNumFds]) {
+  struct sockaddr_un addr;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    return -1;
+  }
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  std::strcpy(addr.sun_path, path.c_str());
+
+  auto sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (sock < 0) {
+    return -1;
+  }
+  if (connect(sock, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0) {
+    close(sock);
+    return -1;
+  }
+
+  std::string payload;
+  for (const auto& arg : args) {
+    payload.append(arg);
+    payload.push_back('\0');
+  }
+
+  struct iovec iov;
+  iov.iov_base = payload.data();
+  iov.iov_len = payload.size();
+
+  union {
+    char buf[CMSG_SPACE(sizeof(int) * kSessionNumFds)];
+    struct cmsghdr align;
+  } control;
+  std::memset(&control, 0, sizeof(control));
+
+  struct msghdr msg;
+  std::memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+
+  auto* cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int) * kSessionNumFds);
+  std::memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * kSessionNumFds);
+
+  if (sendmsg(sock, &msg, MSG_NOSIGNAL) < 0) {
+    close(sock);
+    return -1;
+  }
+
+  uint32_t code;
+  auto nread = recv(sock, &code, sizeof(code), MSG_WAITALL);
+  close(sock);
+  if (nread != sizeof(code)) {
+    return -1;
+  }
+  return static_cast<int>(ntohl(code));
+}
+
+}  // namespace
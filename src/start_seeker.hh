@@ -1,8 +1,10 @@
 #pragma once
 
+#include <algorithm>
 #include <memory>
 #include <string>
 #include <unordered_set>
+#include <vector>
 
 #include <tsduck/tsduck.h>
 
@@ -18,6 +20,7 @@ struct StartSeekerOption final {
   uint16_t sid = 0;
   ts::MilliSecond max_duration = 0;
   uint32_t max_packets = 0;
+  bool keyframe_start = false;  // disabled
 };
 
 class StartSeeker final : public PacketSink,
@@ -29,6 +32,7 @@ class StartSeeker final : public PacketSink,
     demux_.setTableHandler(this);
     demux_.addPID(ts::PID_PAT);
     MIRAKC_ARIB_DEBUG("Demux += PAT");
+    blocks_.reserve(EstimateNumBlocks(option_));
   }
 
   virtual ~StartSeeker() override {}
@@ -53,7 +57,7 @@ class StartSeeker final : public PacketSink,
       return false;
     }
 
-    (void)SendPackets();  // ignore the error
+    (void)SendPackets(transition_index_ > 0 ? SeekPat() : 0);  // ignore the error
 
     return sink_->End();
   }
@@ -84,26 +88,29 @@ class StartSeeker final : public PacketSink,
   bool Seek(const ts::TSPacket& packet) {
     auto pid = packet.getPID();
 
-    packets_.push_back(packet);
+    BufferPacket(packet);
 
     if (transition_index_ > 0) {
-      MIRAKC_ARIB_INFO("Found transition point, start streaming");
-      SendPackets(SeekPat());
-      state_ = kStreaming;
-      return true;
+      if (!option_.keyframe_start || keyframe_index_ > 0) {
+        MIRAKC_ARIB_INFO("Found transition point, start streaming");
+        SendPackets(SeekPat());
+        state_ = kStreaming;
+        return true;
+      }
+      // Wait for a keyframe after the transition point.
     }
 
     if (option_.max_packets != 0) {
-      if (option_.max_packets == packets_.size()) {
+      if (option_.max_packets == num_packets_) {
         MIRAKC_ARIB_INFO(
             "The number of packets reached the limit, start streaming");
-        SendPackets();
+        SendPackets(transition_index_ > 0 ? SeekPat() : 0);
         state_ = kStreaming;
         return true;
       }
-      MIRAKC_ARIB_ASSERT(packets_.size() < option_.max_packets);
+      MIRAKC_ARIB_ASSERT(num_packets_ < option_.max_packets);
     } else {
-      // no limit on packets_.size()
+      // no limit on num_packets_
     }
 
     if (pcr_pid_ == ts::PID_NULL || pcr_pid_ != pid) {
@@ -133,17 +140,123 @@ class StartSeeker final : public PacketSink,
     }
 
     MIRAKC_ARIB_INFO("The duration reached the limit, start streaming");
-    SendPackets();
+    SendPackets(transition_index_ > 0 ? SeekPat() : 0);
     state_ = kStreaming;
     return true;
   }
 
+  // Returns the number of blocks for packets buffered until the limit.
+  static size_t EstimateNumBlocks(const StartSeekerOption& option) {
+    // 24 Mbps is enough for a HD service in BS.
+    static constexpr uint64_t kMaxBitrate = 24 * 1000 * 1000;
+    // Capacity of the block list reserved in advance.  The list grows beyond
+    // this if needed.
+    static constexpr size_t kMaxReservedBlocks = 1024;
+
+    uint64_t num_packets = option.max_packets;
+    if (num_packets == 0) {
+      num_packets = static_cast<uint64_t>(option.max_duration) * kMaxBitrate /
+          8 / 1000 / ts::PKT_SIZE;
+    }
+    auto num_blocks = (num_packets + kBlockSize - 1) / kBlockSize;
+    return static_cast<size_t>(
+        std::min(num_blocks, static_cast<uint64_t>(kMaxReservedBlocks)));
+  }
+
+  // Packets are stored in fixed-size blocks so that buffered packets are never
+  // moved when the buffer grows.
+  void BufferPacket(const ts::TSPacket& packet) {
+    auto block = num_packets_ / kBlockSize;
+    if (block == blocks_.size()) {
+      blocks_.emplace_back(new ts::TSPacket[kBlockSize]);
+    }
+    blocks_[block][num_packets_ % kBlockSize] = packet;
+    if (packet.getPID() == ts::PID_PAT && packet.getPUSI()) {
+      pat_indexes_.push_back(num_packets_);
+    }
+    if (transition_index_ == 0 && num_packets_ > 0) {
+      DetectPesTransition(packet);
+    }
+    if (option_.keyframe_start && transition_index_ > 0 && keyframe_index_ == 0 &&
+        packet.getPID() == video_pid_ &&
+        IsRandomAccessPoint(packet, video_stream_type_)) {
+      MIRAKC_ARIB_DEBUG("Found keyframe at {}", num_packets_);
+      keyframe_index_ = num_packets_;
+    }
+    num_packets_++;
+  }
+
+  // Checks signals in the PES layer which appear at a program boundary.  This
+  // is done while buffering each packet because the packet is hot in the cache
+  // at that point.  Only headers at the beginning of a PES packet are checked.
+  void DetectPesTransition(const ts::TSPacket& packet) {
+    auto pid = packet.getPID();
+    if (pid == ts::PID_NULL) {
+      return;
+    }
+
+    if (pid == video_pid_) {
+      if (HasDiscontinuityIndicator(packet)) {
+        MIRAKC_ARIB_DEBUG(
+            "Discontinuity in PES#{:04X} at {}", pid, num_packets_);
+        SetTransition(num_packets_);
+        return;
+      }
+      uint32_t format;
+      if (GetVideoFormat(packet, video_stream_type_, &format)) {
+        if (has_video_format_ && video_format_ != format) {
+          MIRAKC_ARIB_DEBUG(
+              "Video format changed from {:08X} to {:08X} at {}",
+              video_format_, format, num_packets_);
+          SetTransition(num_packets_);
+        }
+        video_format_ = format;
+        has_video_format_ = true;
+      }
+      return;
+    }
+
+    if (pid == audio_pid_) {
+      if (HasDiscontinuityIndicator(packet)) {
+        MIRAKC_ARIB_DEBUG(
+            "Discontinuity in PES#{:04X} at {}", pid, num_packets_);
+        SetTransition(num_packets_);
+        return;
+      }
+      uint32_t format;
+      if (GetAdtsFormat(packet, &format)) {
+        if (has_audio_format_ && audio_format_ != format) {
+          MIRAKC_ARIB_DEBUG(
+              "Audio format changed from {:03X} to {:03X} at {}",
+              audio_format_, format, num_packets_);
+          SetTransition(num_packets_);
+        }
+        audio_format_ = format;
+        has_audio_format_ = true;
+      }
+      return;
+    }
+  }
+
+  void SetTransition(size_t index) {
+    MIRAKC_ARIB_ASSERT(index > 0);
+    transition_index_ = index;
+    MIRAKC_ARIB_DEBUG("Found transition at {}", transition_index_);
+    if (pmt_pid_ != ts::PID_NULL) {
+      MIRAKC_ARIB_DEBUG("Demux -= PMT#{:04X}", pmt_pid_);
+      demux_.removePID(pmt_pid_);
+      pmt_pid_ = ts::PID_NULL;
+    }
+    MIRAKC_ARIB_DEBUG("Demux -= PAT");
+    demux_.removePID(ts::PID_PAT);
+  }
+
   size_t SeekPat() const {
     MIRAKC_ARIB_ASSERT(transition_index_ != 0);
-    for (auto i = transition_index_ - 1; i != 0; --i) {
-      const auto& packet = packets_[i];
-      if (packet.getPID() == ts::PID_PAT && packet.getPUSI()) {
-        return i;
+    // The transition point is close to the last PAT.
+    for (auto it = pat_indexes_.rbegin(); it != pat_indexes_.rend(); ++it) {
+      if (*it < transition_index_) {
+        return *it;
       }
     }
     return 0;
@@ -151,13 +264,34 @@ class StartSeeker final : public PacketSink,
 
   bool SendPackets(size_t index = 0) {
     bool ok = true;
-    for (auto i = index; i < packets_.size(); ++i) {
-      ok = sink_->HandlePacket(packets_[i]);
+    // Drop PES packets before the keyframe.
+    for (; index < keyframe_index_; ++index) {
+      const auto& packet = blocks_[index / kBlockSize][index % kBlockSize];
+      if (pes_pids_.find(packet.getPID()) != pes_pids_.end()) {
+        continue;
+      }
+      ok = sink_->HandlePacket(packet);
       if (!ok) {
         break;
       }
     }
-    packets_.clear();
+    while (ok && index < num_packets_) {
+      auto block = index / kBlockSize;
+      auto offset = index % kBlockSize;
+      auto n = std::min(kBlockSize - offset, num_packets_ - index);
+      ok = sink_->HandlePackets(&blocks_[block][offset], n);
+      if (!ok) {
+        break;
+      }
+      index += n;
+    }
+    // Release the memory.  Packets are never buffered after this.
+    blocks_.clear();
+    blocks_.shrink_to_fit();
+    pat_indexes_.clear();
+    pat_indexes_.shrink_to_fit();
+    num_packets_ = 0;
+    keyframe_index_ = 0;
     return ok;
   }
 
@@ -229,29 +363,57 @@ class StartSeeker final : public PacketSink,
     pcr_pid_ = pmt.pcr_pid;
     MIRAKC_ARIB_DEBUG("PCR#{:04X}", pcr_pid_);
 
-    // Currently, we check only the number of audio streams.
+    // A transition is detected by the number of audio streams or a change of
+    // the component tags.
     size_t num_audio_streams = 0;
+    std::vector<uint8_t> component_tags;
+    pes_pids_.clear();
+    auto video_pid = ts::PID_NULL;
+    auto audio_pid = ts::PID_NULL;
     for (const auto& [pid, stream] : pmt.streams) {
       if (stream.isAudio()) {
         num_audio_streams++;
+        if (audio_pid == ts::PID_NULL) {
+          audio_pid = pid;
+        }
+      }
+      if (stream.isVideo() && video_pid == ts::PID_NULL) {
+        video_pid = pid;
+        video_stream_type_ = stream.stream_type;
+      }
+      uint8_t tag;
+      if (stream.getComponentTag(tag)) {
+        component_tags.push_back(tag);
       }
+      pes_pids_.insert(pid);
+    }
+    std::sort(component_tags.begin(), component_tags.end());
+
+    if (video_pid != video_pid_) {
+      video_pid_ = video_pid;
+      has_video_format_ = false;
+    }
+    if (audio_pid != audio_pid_) {
+      audio_pid_ = audio_pid;
+      has_audio_format_ = false;
     }
 
     bool changed = false;
     if (num_audio_streams_ > 0 && num_audio_streams_ != num_audio_streams) {
+      MIRAKC_ARIB_DEBUG("The number of audio streams is changed");
+      changed = true;
+    }
+    if (pmt_ready_ && component_tags_ != component_tags) {
+      MIRAKC_ARIB_DEBUG("The component tags are changed");
       changed = true;
     }
     num_audio_streams_ = num_audio_streams;
+    component_tags_ = std::move(component_tags);
+    pmt_ready_ = true;
     MIRAKC_ARIB_DEBUG("Found {} audio streams", num_audio_streams);
 
     if (changed) {
-      transition_index_ = table.getFirstTSPacketIndex();
-      MIRAKC_ARIB_DEBUG(
-          "The number of audio streams is changed at {}", transition_index_);
-      MIRAKC_ARIB_DEBUG("Demux -= PAT PMT#{:04X}", pmt_pid_);
-      demux_.removePID(pmt_pid_);
-      demux_.removePID(ts::PID_PAT);
-      pmt_pid_ = ts::PID_NULL;
+      SetTransition(table.getFirstTSPacketIndex());
     }
   }
 
@@ -260,13 +422,29 @@ class StartSeeker final : public PacketSink,
   ts::SectionDemux demux_;
   std::unique_ptr<PacketSink> sink_;
   State state_ = kSeek;
-  ts::TSPacketVector packets_;
+  std::vector<std::unique_ptr<ts::TSPacket[]>> blocks_;
+  std::vector<size_t> pat_indexes_;  // indexes of PAT packets with PUSI
+  size_t num_packets_ = 0;
+  std::unordered_set<ts::PID> pes_pids_;
+  ts::PID video_pid_ = ts::PID_NULL;
+  uint8_t video_stream_type_ = 0;
+  size_t keyframe_index_ = 0;
+  ts::PID audio_pid_ = ts::PID_NULL;  // the first audio stream
+  uint32_t video_format_ = 0;
+  bool has_video_format_ = false;
+  uint32_t audio_format_ = 0;
+  bool has_audio_format_ = false;
+  std::vector<uint8_t> component_tags_;  // sorted
+  bool pmt_ready_ = false;
   ts::PID pmt_pid_ = ts::PID_NULL;
   ts::PID pcr_pid_ = ts::PID_NULL;
   size_t num_audio_streams_ = 0;
   int64_t end_pcr_ = -1;
   size_t transition_index_ = 0;
 
+  // 4096 packets (752 KiB) in each block.
+  static constexpr size_t kBlockSize = 4096;
+
   MIRAKC_ARIB_NON_COPYABLE(StartSeeker);
 };
 
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <tsduck/tsduck.h>
+
+#include "base.hh"
+#include "logging.hh"
+#include "metrics.hh"
+#include "packet_sink.hh"
+
+namespace {
+
+// Runs a downstream stage on its own thread.
+//
+// Packets are passed to the thread in batches through a bounded queue.  All
+// methods of the downstream stage are called on that thread in the following
+// order: Start(), HandlePacket() in the order of arrival, and End().
+//
+// When the downstream stage returns false from HandlePacket(), the remaining
+// packets are discarded and HandlePacket() of this class returns false.
+// Because packets are queued, the upstream stage notices that a few batches
+// later than the synchronous pipeline.
+//
+// The latency of each packet increases up to the time for filling a batch.
+template <typename Sink>
+class BasicThreadedSink final : public PacketSink {
+ public:
+  static constexpr size_t kBatchSize = 256;  // packets
+  static constexpr size_t kMaxBatches = 16;
+
+  explicit BasicThreadedSink(std::unique_ptr<Sink>&& sink)
+      : sink_(std::move(sink)) {
+    batch_.reserve(kBatchSize);
+  }
+
+  ~BasicThreadedSink() override {
+    if (thread_.joinable()) {
+      // End() has not been called.
+      canceled_ = true;
+      Close();
+      thread_.join();
+    }
+  }
+
+  bool Start() override {
+    MIRAKC_ARIB_ASSERT(!thread_.joinable());
+    thread_ = std::thread([this] { Run(); });
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this] { return started_; });
+    return start_result_;
+  }
+
+  bool End() override {
+    MIRAKC_ARIB_ASSERT(thread_.joinable());
+    if (!batch_.empty()) {
+      Push();
+    }
+    Close();
+    thread_.join();
+    return end_result_;
+  }
+
+  bool HandlePacket(const ts::TSPacket& packet) override {
+    if (canceled_) {
+      return false;
+    }
+    batch_.push_back(packet);
+    if (batch_.size() >= kBatchSize) {
+      Push();
+    }
+    return true;
+  }
+
+ private:
+  using Batch = std::vector<ts::TSPacket>;
+
+  void Push() {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this] { return queue_.size() < kMaxBatches; });
+      queue_.push_back(std::move(batch_));
+    }
+    cv_.notify_all();
+    batch_ = Batch();
+    batch_.reserve(kBatchSize);
+  }
+
+  void Close() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      closed_ = true;
+    }
+    cv_.notify_all();
+  }
+
+  void Run() {
+    auto start_result = sink_->Start();
+    if (!start_result) {
+      canceled_ = true;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      started_ = true;
+      start_result_ = start_result;
+    }
+    cv_.notify_all();
+
+    for (;;) {
+      Batch batch;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return !queue_.empty() || closed_; });
+        if (queue_.empty()) {
+          break;  // closed
+        }
+        batch = std::move(queue_.front());
+        queue_.pop_front();
+      }
+      cv_.notify_all();
+
+      if (canceled_) {
+        continue;  // discard
+      }
+      MIRAKC_ARIB_METRICS_INC("threaded_sink.batches");
+      // Time spent in the downstream stage.
+      MIRAKC_ARIB_METRICS_TIMER("threaded_sink.handle_batch_ns");
+      for (const auto& packet : batch) {
+        if (!sink_->HandlePacket(packet)) {
+          canceled_ = true;
+          break;
+        }
+      }
+    }
+
+    // End() is not called if Start() failed like PacketSource::FeedPackets().
+    end_result_ = start_result ? sink_->End() : false;
+  }
+
+  std::unique_ptr<Sink> sink_;
+  std::thread thread_;
+  Batch batch_;  // accessed only by the upstream thread
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<Batch> queue_;  // guarded by mutex_
+  bool closed_ = false;  // guarded by mutex_
+  bool started_ = false;  // guarded by mutex_
+  bool start_result_ = false;  // guarded by mutex_
+  bool end_result_ = false;  // written before the thread is joined
+  std::atomic<bool> canceled_{false};
+
+  MIRAKC_ARIB_NON_COPYABLE(BasicThreadedSink);
+};
+
+using ThreadedSink = BasicThreadedSink<PacketSink>;
+
+}  // namespace
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <string>
 
 #include <LibISDB/LibISDB.hpp>
@@ -59,18 +60,226 @@ std::string FormatPcr(int64_t pcr) {
 
 // Compares two PCR values taking into account the PCR wrap around.
 //
-// Assumed that the real interval time between the PCR values is less than half
-// of kPcrUpperBound.
+// Returns the signed interval from `rhs` to `lhs` in either direction of the
+// wrap around.  Assumed that the real interval time between the PCR values is
+// less than half of kPcrUpperBound.
 inline int64_t ComparePcr(int64_t lhs, int64_t rhs) {
   MIRAKC_ARIB_ASSERT(IsValidPcr(lhs));
   MIRAKC_ARIB_ASSERT(IsValidPcr(rhs));
 
-  auto a = lhs - rhs;
-  auto b = lhs - (kPcrUpperBound + rhs);
-  if (std::abs(a) < std::abs(b)) {
-    return a;
+  auto delta = (lhs - rhs) % kPcrUpperBound;
+  if (delta < 0) {
+    delta += kPcrUpperBound;
   }
-  return b;
+  if (delta >= kPcrUpperBound / 2) {
+    delta -= kPcrUpperBound;
+  }
+  return delta;
+}
+
+// Converts a time into a PCR value by using a pair of a PCR value and a time
+// which were obtained at the same moment.
+//
+// The result is compared with PCR values in a stream by using ComparePcr().
+inline int64_t ConvertTimeToPcr(
+    const ts::Time& time, const ts::Time& base_time, int64_t base_pcr) {
+  auto ms = time - base_time;  // may be a negative value
+  auto pcr = base_pcr + ms * kPcrTicksPerMs;
+  while (pcr < 0) {
+    pcr += kPcrUpperBound;
+  }
+  MIRAKC_ARIB_ASSERT(pcr >= 0);
+  return pcr % kPcrUpperBound;
+}
+
+// Helpers for inspecting packets without parsing PES packets.
+//
+// These look into a single packet.  They don't check the CC and don't
+// reassemble PES packets.
+
+inline bool HasAdaptationFieldFlag(const ts::TSPacket& packet, uint8_t flag) {
+  const auto* b = packet.b;
+  return (b[3] & 0x20) != 0 && b[4] > 0 && (b[5] & flag) != 0;
+}
+
+inline bool HasDiscontinuityIndicator(const ts::TSPacket& packet) {
+  return HasAdaptationFieldFlag(packet, 0x80);
+}
+
+inline bool HasRandomAccessIndicator(const ts::TSPacket& packet) {
+  return HasAdaptationFieldFlag(packet, 0x40);
+}
+
+// Returns the offset of elementary stream data in a packet which starts a PES
+// packet.  Returns 0 if the packet doesn't start a PES packet.
+inline size_t GetEsOffset(const ts::TSPacket& packet) {
+  const auto* b = packet.b;
+  if ((b[1] & 0x40) == 0 || (b[3] & 0x10) == 0) {  // no PUSI or no payload
+    return 0;
+  }
+  size_t pos = 4;
+  if ((b[3] & 0x20) != 0) {  // adaptation field
+    pos += 1 + static_cast<size_t>(b[4]);
+  }
+  if (pos + 9 > ts::PKT_SIZE ||
+      b[pos] != 0x00 || b[pos + 1] != 0x00 || b[pos + 2] != 0x01) {
+    return 0;
+  }
+  pos += 9 + static_cast<size_t>(b[pos + 8]);  // PES_header_data_length
+  return pos < ts::PKT_SIZE ? pos : 0;
+}
+
+// Returns the offset of the start code prefix (00 00 01) of the first start
+// code at or after `pos` which `pred(code)` accepts, or 0 if not found.
+//
+// `pred` returns 1 for accepting, -1 for giving up and 0 for skipping.
+template <typename Pred>
+inline size_t FindStartCode(const ts::TSPacket& packet, size_t pos, Pred pred) {
+  const auto* b = packet.b;
+  for (; pos + 4 <= ts::PKT_SIZE; ++pos) {
+    if (b[pos] != 0x00 || b[pos + 1] != 0x00 || b[pos + 2] != 0x01) {
+      continue;
+    }
+    auto result = pred(b[pos + 3]);
+    if (result > 0) {
+      return pos;
+    }
+    if (result < 0) {
+      return 0;
+    }
+  }
+  return 0;
+}
+
+// Returns true if a packet of a video stream starts a random access point.
+//
+// The random_access_indicator in the adaptation field is checked first.  Then,
+// the first start code after the PES header is checked if the packet starts a
+// PES packet:
+//
+//   * MPEG-2 Video: sequence header
+//   * H.264: IDR picture or SPS
+//   * HEVC: IRAP picture or VPS
+//
+// Start codes are searched only in the packet.  In broadcast streams, the
+// sequence header (or SPS/VPS) of an I-picture is usually placed at the
+// beginning of the PES packet.
+inline bool IsRandomAccessPoint(const ts::TSPacket& packet, uint8_t stream_type) {
+  if (HasRandomAccessIndicator(packet)) {
+    return true;
+  }
+
+  auto pos = GetEsOffset(packet);
+  if (pos == 0) {
+    return false;
+  }
+
+  switch (stream_type) {
+    case ts::ST_MPEG2_VIDEO:
+      return FindStartCode(packet, pos, [](uint8_t code) {
+        if (code == 0xB3) {  // sequence_header_code
+          return 1;
+        }
+        if (code == 0x00) {  // picture_start_code
+          return -1;
+        }
+        return 0;
+      }) != 0;
+    case ts::ST_AVC_VIDEO:
+      return FindStartCode(packet, pos, [](uint8_t code) {
+        const auto nal_unit_type = code & 0x1F;
+        if (nal_unit_type == 5 || nal_unit_type == 7) {  // IDR, SPS
+          return 1;
+        }
+        if (nal_unit_type == 1) {  // non-IDR picture
+          return -1;
+        }
+        return 0;
+      }) != 0;
+    case ts::ST_HEVC_VIDEO:
+      return FindStartCode(packet, pos, [](uint8_t code) {
+        const auto nal_unit_type = (code >> 1) & 0x3F;
+        if ((nal_unit_type >= 16 && nal_unit_type <= 21) ||  // IRAP
+            nal_unit_type == 32) {  // VPS
+          return 1;
+        }
+        if (nal_unit_type <= 9) {  // non-IRAP picture
+          return -1;
+        }
+        return 0;
+      }) != 0;
+    default:
+      return false;
+  }
+}
+
+// Gets a value representing the format of a video stream from a packet which
+// starts a PES packet including a sequence header (or SPS).
+//
+//   * MPEG-2 Video: horizontal_size, vertical_size, aspect_ratio_information
+//     and frame_rate_code in the sequence header
+//   * H.264: profile_idc and level_idc in the SPS
+//
+// Returns false if the packet doesn't include the sequence header (or SPS).
+inline bool GetVideoFormat(
+    const ts::TSPacket& packet, uint8_t stream_type, uint32_t* format) {
+  auto pos = GetEsOffset(packet);
+  if (pos == 0) {
+    return false;
+  }
+
+  const auto* b = packet.b;
+  switch (stream_type) {
+    case ts::ST_MPEG2_VIDEO:
+      pos = FindStartCode(packet, pos, [](uint8_t code) {
+        return code == 0xB3 ? 1 : (code == 0x00 ? -1 : 0);
+      });
+      if (pos == 0 || pos + 8 > ts::PKT_SIZE) {
+        return false;
+      }
+      *format = (static_cast<uint32_t>(b[pos + 4]) << 24) |
+          (static_cast<uint32_t>(b[pos + 5]) << 16) |
+          (static_cast<uint32_t>(b[pos + 6]) << 8) |
+          static_cast<uint32_t>(b[pos + 7]);
+      return true;
+    case ts::ST_AVC_VIDEO:
+      pos = FindStartCode(packet, pos, [](uint8_t code) {
+        const auto nal_unit_type = code & 0x1F;
+        return nal_unit_type == 7 ? 1 : (nal_unit_type == 1 || nal_unit_type == 5 ? -1 : 0);
+      });
+      if (pos == 0 || pos + 7 > ts::PKT_SIZE) {
+        return false;
+      }
+      *format = (static_cast<uint32_t>(b[pos + 4]) << 8) |  // profile_idc
+          static_cast<uint32_t>(b[pos + 6]);  // level_idc
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Gets a value representing the format of an AAC stream from the ADTS header
+// at the beginning of a PES packet.
+//
+// The value consists of profile, sampling_frequency_index and
+// channel_configuration.  Returns false if the packet doesn't start a PES
+// packet or the ADTS header is not found.
+inline bool GetAdtsFormat(const ts::TSPacket& packet, uint32_t* format) {
+  auto pos = GetEsOffset(packet);
+  if (pos == 0 || pos + 4 > ts::PKT_SIZE) {
+    return false;
+  }
+
+  const auto* b = packet.b;
+  if (b[pos] != 0xFF || (b[pos + 1] & 0xF0) != 0xF0) {  // syncword
+    return false;
+  }
+  const uint32_t profile = b[pos + 2] >> 6;
+  const uint32_t sampling_frequency_index = (b[pos + 2] >> 2) & 0x0F;
+  const uint32_t channel_configuration =
+      ((b[pos + 2] & 0x01) << 2) | (b[pos + 3] >> 6);
+  *format = (profile << 8) | (sampling_frequency_index << 4) | channel_configuration;
+  return true;
 }
 
 struct EitSection {
@@ -153,10 +362,15 @@ inline LibISDB::ARIBStringDecoder::DecodeFlag GetAribStringDecodeFlag() {
   return flags;
 }
 
+// The decoder is created when it's used for the first time on each thread.
+inline LibISDB::ARIBStringDecoder& GetAribStringDecoder() {
+  thread_local LibISDB::ARIBStringDecoder decoder;
+  return decoder;
+}
+
 inline LibISDB::String DecodeAribString(const LibISDB::ARIBString& str) {
-  LibISDB::ARIBStringDecoder decoder;
   LibISDB::String utf8;
-  decoder.Decode(str, &utf8, GetAribStringDecodeFlag());
+  GetAribStringDecoder().Decode(str, &utf8, GetAribStringDecodeFlag());
   return std::move(utf8);
 }
 
@@ -335,11 +549,10 @@ rapidjson::Value MakeExtendedEventJsonValue(
 rapidjson::Value MakeExtendedEventJsonValue(
     const LibISDB::DescriptorBlock& desc_block,
     rapidjson::Document::AllocatorType& allocator) {
-  LibISDB::ARIBStringDecoder decoder;
   auto flags = GetAribStringDecodeFlag();
   LibISDB::EventInfo::ExtendedTextInfoList ext_list;
   if (!LibISDB::GetEventExtendedTextList(
-          &desc_block, decoder, flags, &ext_list)) {
+          &desc_block, GetAribStringDecoder(), flags, &ext_list)) {
     return rapidjson::Value();
   }
 
@@ -422,94 +635,113 @@ rapidjson::Value MakeJsonValue(
   return value;
 }
 
-template <typename Allocator>
-rapidjson::Value MakeEventsJsonValue(const EitSection& eit, Allocator& allocator) {
-  const auto* data = eit.events_data;
-  auto remain = eit.events_size;
-
-  rapidjson::Value events(rapidjson::kArrayType);
-
-  while (remain >= EitSection::EIT_EVENT_FIXED_SIZE) {
-    const auto eid = ts::GetUInt16(data);
-
-    ts::Time start_time;
-    ts::DecodeMJD(data + 2, 5, start_time);
-    start_time -= kJstTzOffset;  // JST -> UTC
-    const auto start_time_unix = start_time - ts::Time::UnixEpoch;
+// Returns the size of an event in the event loop of an EIT section.
+//
+// Returns 0 if the remaining data is too short.
+inline size_t GetEitEventSize(const uint8_t* data, size_t remain) {
+  if (remain < EitSection::EIT_EVENT_FIXED_SIZE) {
+    return 0;
+  }
+  size_t info_length = ts::GetUInt16(data + 10) & 0x0FFF;
+  return EitSection::EIT_EVENT_FIXED_SIZE +
+      std::min(info_length, remain - EitSection::EIT_EVENT_FIXED_SIZE);
+}
 
-    const auto hour = ts::DecodeBCD(data[7]);
-    const auto min = ts::DecodeBCD(data[8]);
-    const auto sec = ts::DecodeBCD(data[9]);
-    const ts::MilliSecond duration =
-        hour * ts::MilliSecPerHour + min * ts::MilliSecPerMin +
-        sec * ts::MilliSecPerSec;
+// Makes a JSON value from an event in the event loop of an EIT section.
+//
+// `size` must be a value returned from GetEitEventSize().
+template <typename Allocator>
+rapidjson::Value MakeEventJsonValue(
+    const uint8_t* data, size_t size, Allocator& allocator) {
+  const auto eid = ts::GetUInt16(data);
 
-    const uint8_t running_status = (data[10] >> 5) & 0x07;
+  ts::Time start_time;
+  ts::DecodeMJD(data + 2, 5, start_time);
+  start_time -= kJstTzOffset;  // JST -> UTC
+  const auto start_time_unix = start_time - ts::Time::UnixEpoch;
 
-    const bool ca_controlled = (data[10] >> 4) & 0x01;
+  const auto hour = ts::DecodeBCD(data[7]);
+  const auto min = ts::DecodeBCD(data[8]);
+  const auto sec = ts::DecodeBCD(data[9]);
+  const ts::MilliSecond duration =
+      hour * ts::MilliSecPerHour + min * ts::MilliSecPerMin +
+      sec * ts::MilliSecPerSec;
 
-    size_t info_length = ts::GetUInt16(data + 10) & 0x0FFF;
-    data += EitSection::EIT_EVENT_FIXED_SIZE;
-    remain -= EitSection::EIT_EVENT_FIXED_SIZE;
+  const bool ca_controlled = (data[10] >> 4) & 0x01;
 
-    LibISDB::DescriptorBlock desc_block;
-    desc_block.ParseBlock(data, info_length);
+  LibISDB::DescriptorBlock desc_block;
+  desc_block.ParseBlock(data + EitSection::EIT_EVENT_FIXED_SIZE,
+                        size - EitSection::EIT_EVENT_FIXED_SIZE);
 
-    rapidjson::Value descriptors(rapidjson::kArrayType);
+  rapidjson::Value descriptors(rapidjson::kArrayType);
 
-    for (int i = 0; i < desc_block.GetDescriptorCount(); ++i) {
-      const auto* dp = desc_block.GetDescriptorByIndex(i);
-      if (!dp->IsValid()) {
-        continue;
+  for (int i = 0; i < desc_block.GetDescriptorCount(); ++i) {
+    const auto* dp = desc_block.GetDescriptorByIndex(i);
+    if (!dp->IsValid()) {
+      continue;
+    }
+    switch (dp->GetTag()) {
+      case LibISDB::ShortEventDescriptor::TAG: {
+        const auto* desc = static_cast<const LibISDB::ShortEventDescriptor*>(dp);
+        auto json = MakeJsonValue(desc, allocator);
+        descriptors.PushBack(json, allocator);
+        break;
       }
-      switch (dp->GetTag()) {
-        case LibISDB::ShortEventDescriptor::TAG: {
-          const auto* desc = static_cast<const LibISDB::ShortEventDescriptor*>(dp);
-          auto json = MakeJsonValue(desc, allocator);
-          descriptors.PushBack(json, allocator);
-          break;
-        }
-        case LibISDB::ComponentDescriptor::TAG: {
-          const auto* desc = static_cast<const LibISDB::ComponentDescriptor*>(dp);
-          auto json = MakeJsonValue(desc, allocator);
-          descriptors.PushBack(json, allocator);
-          break;
-        }
-        case LibISDB::ContentDescriptor::TAG: {
-          const auto* desc = static_cast<const LibISDB::ContentDescriptor*>(dp);
-          auto json = MakeJsonValue(desc, allocator);
-          descriptors.PushBack(json, allocator);
-          break;
-        }
-        case LibISDB::AudioComponentDescriptor::TAG: {
-          const auto* desc = static_cast<const LibISDB::AudioComponentDescriptor*>(dp);
-          auto json = MakeJsonValue(desc, allocator);
-          descriptors.PushBack(json, allocator);
-          break;
-        }
-        default:
-          break;
+      case LibISDB::ComponentDescriptor::TAG: {
+        const auto* desc = static_cast<const LibISDB::ComponentDescriptor*>(dp);
+        auto json = MakeJsonValue(desc, allocator);
+        descriptors.PushBack(json, allocator);
+        break;
       }
-    }
-
-    {
-      auto json = MakeExtendedEventJsonValue(desc_block, allocator);
-      if (!json.IsNull()) {
+      case LibISDB::ContentDescriptor::TAG: {
+        const auto* desc = static_cast<const LibISDB::ContentDescriptor*>(dp);
+        auto json = MakeJsonValue(desc, allocator);
         descriptors.PushBack(json, allocator);
+        break;
       }
+      case LibISDB::AudioComponentDescriptor::TAG: {
+        const auto* desc = static_cast<const LibISDB::AudioComponentDescriptor*>(dp);
+        auto json = MakeJsonValue(desc, allocator);
+        descriptors.PushBack(json, allocator);
+        break;
+      }
+      default:
+        break;
     }
+  }
 
-    rapidjson::Value event(rapidjson::kObjectType);
-    event.AddMember("eventId", eid, allocator);
-    event.AddMember("startTime", start_time_unix, allocator);
-    event.AddMember("duration", duration, allocator);
-    event.AddMember("scrambled", ca_controlled, allocator);
-    event.AddMember("descriptors", descriptors, allocator);
+  {
+    auto json = MakeExtendedEventJsonValue(desc_block, allocator);
+    if (!json.IsNull()) {
+      descriptors.PushBack(json, allocator);
+    }
+  }
 
-    events.PushBack(event, allocator);
+  rapidjson::Value event(rapidjson::kObjectType);
+  event.AddMember("eventId", eid, allocator);
+  event.AddMember("startTime", start_time_unix, allocator);
+  event.AddMember("duration", duration, allocator);
+  event.AddMember("scrambled", ca_controlled, allocator);
+  event.AddMember("descriptors", descriptors, allocator);
+  return event;
+}
+
+template <typename Allocator>
+rapidjson::Value MakeEventsJsonValue(const EitSection& eit, Allocator& allocator) {
+  const auto* data = eit.events_data;
+  auto remain = eit.events_size;
 
-    data += info_length;
-    remain -= info_length;
+  rapidjson::Value events(rapidjson::kArrayType);
+
+  for (;;) {
+    auto size = GetEitEventSize(data, remain);
+    if (size == 0) {
+      break;
+    }
+    auto event = MakeEventJsonValue(data, size, allocator);
+    events.PushBack(event, allocator);
+    data += size;
+    remain -= size;
   }
 
   return events;
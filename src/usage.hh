@@ -0,0 +1,81 @@
+#pragma once
+
+#include <string>
+
+namespace {
+
+// Shared with benchmark/startup_benchmark.cc so that the benchmark measures
+// the same docopt grammar as the executable.
+const std::string kUsage = R"(
+Tools to process ARIB TS streams.
+
+Usage:
+  mirakc-arib (-h | --help)
+    [(scan-services | sync-clocks | collect-eits | collect-logos |
+      filter-service | filter-program | filter-program-metadata |
+      record-service | track-airtime | seek-start | print-pes | index |
+      serve)]
+  mirakc-arib --version
+  mirakc-arib scan-services [--sids=<sid>...] [--xsids=<sid>...] [<file>]
+  mirakc-arib sync-clocks [--sids=<sid>...] [--xsids=<sid>...] [<file>]
+  mirakc-arib collect-eits [--sids=<sid>...] [--xsids=<sid>...]
+                           [--time-limit=<ms>] [--streaming] [--jobs=<num>]
+                           [--state-file=<file>] [--diff]
+                           [--use-unicode-symbol] [<file>...]
+  mirakc-arib collect-logos [<file>]
+  mirakc-arib filter-service --sid=<sid> [<file>]
+  mirakc-arib filter-program --sid=<sid> --eid=<eid>
+    --clock-pid=<pid> --clock-pcr=<pcr> --clock-time=<unix-time-ms>
+    [--audio-tags=<tag>...] [--video-tags=<tag>...]
+    [--start-margin=<ms>] [--end-margin=<ms>] [--pre-streaming] [--threaded]
+    [--keyframe-start] [--index=<file>] [--program=<spec>...] [<file>]
+  mirakc-arib filter-program-metadata [--sid=<sid>] [<file>]
+  mirakc-arib record-service --sid=<sid> --file=<file>
+    --chunk-size=<bytes> --num-chunks=<num> [--start-pos=<pos>] [--threaded]
+    [<file>]
+  mirakc-arib track-airtime --sid=<sid> --eid=<eid> [<file>]
+  mirakc-arib seek-start --sid=<sid>
+    [--max-duration=<ms>] [--max-packets=<num>] [--keyframe-start] [<file>]
+  mirakc-arib print-pes [<file>]
+  mirakc-arib index [--sid=<sid>] [--interval=<bytes>] [--output=<file>]
+    <file>
+  mirakc-arib serve --socket=<path>
+
+Description:
+  `mirakc-arib <sub-command> -h` shows help for each sub-command.
+
+Logging:
+  mirakc-arib doesn't output any log message by default.  The MIRAKC_ARIB_LOG
+  environment variable is used for changing the logging level.
+
+  The following command outputs info-level log messages to STDERR:
+
+    $ recdvb 26 - - 2>/dev/null | \
+        MIRAKC_ARIB_LOG=info mirakc-arib scan-services >/dev/null
+    [2019-08-11 22:58:31.989] [scan-services] [info] Read packets from STDIN...
+    [2019-08-11 22:58:31.990] [scan-services] [info] Feed packets...
+    [2019-08-11 22:58:34.840] [scan-services] [info] PAT ready
+    [2019-08-11 22:58:35.574] [scan-services] [info] SDT ready
+    [2019-08-11 22:58:35.709] [scan-services] [info] NIT ready
+    [2019-08-11 22:58:35.709] [scan-services] [info] Ready to collect services
+
+  mirakc-arib uses spdlog for logging.  See the document of spdlog for details
+  about log levels.
+
+Output Format:
+  Sub-commands which output JSON messages write them in the JSONL format by
+  default.  The MIRAKC_ARIB_OUTPUT_FORMAT environment variable is used for
+  changing the output format:
+
+    jsonl (default)
+      Each message is written as a JSON text followed by a newline.
+
+    msgpack
+      The output starts with a header consisting of the magic bytes `MKAB`
+      and a 1-byte schema version (currently 1).  Each message follows it as
+      a frame consisting of the size of the data in the 32-bit big endian
+      format and the message encoded in MessagePack.  Property names and
+      values are the same as the JSONL format.
+)";
+
+}  // namespace
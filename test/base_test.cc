@@ -42,3 +42,60 @@ TEST(ClockTest, Invalidate) {
   EXPECT_TRUE(clock.IsReady());
   EXPECT_EQ(ts::Time(), clock.Now());
 }
+
+TEST(ClockTest, TimeToPcr) {
+  ClockBaseline baseline;
+  baseline.SetPid(0x100);
+  baseline.SetPcr(kPcrUpperBound - kPcrTicksPerMs);
+  baseline.SetTime(ts::Time());
+
+  Clock clock(baseline);
+  clock.UpdatePcr(kPcrUpperBound - kPcrTicksPerMs);
+  EXPECT_EQ(kPcrUpperBound - kPcrTicksPerMs, clock.pcr());
+
+  auto end_pcr = clock.TimeToPcr(ts::Time() + 2);
+  EXPECT_EQ(kPcrTicksPerMs, end_pcr);
+  EXPECT_LT(ComparePcr(clock.pcr(), end_pcr), 0);
+
+  clock.UpdatePcr(kPcrTicksPerMs - 1);
+  EXPECT_LT(ComparePcr(clock.pcr(), end_pcr), 0);
+  EXPECT_LT(clock.Now(), ts::Time() + 2);
+
+  clock.UpdatePcr(kPcrTicksPerMs);
+  EXPECT_GE(ComparePcr(clock.pcr(), end_pcr), 0);
+  EXPECT_GE(clock.Now(), ts::Time() + 2);
+}
+
+TEST(ClockTest, TimeToPcrBeforeWrapAround) {
+  ClockBaseline baseline;
+  baseline.SetPid(0x100);
+  baseline.SetPcr(kPcrUpperBound - 2 * kPcrTicksPerMs);
+  baseline.SetTime(ts::Time());
+
+  Clock clock(baseline);
+  clock.UpdatePcr(kPcrUpperBound - 2 * kPcrTicksPerMs);
+
+  // The end PCR is just before the wrap around.
+  auto end_pcr = clock.TimeToPcr(ts::Time() + 1);
+  EXPECT_EQ(kPcrUpperBound - kPcrTicksPerMs, end_pcr);
+  EXPECT_LT(ComparePcr(clock.pcr(), end_pcr), 0);
+
+  clock.UpdatePcr(end_pcr - 1);
+  EXPECT_LT(ComparePcr(clock.pcr(), end_pcr), 0);
+  EXPECT_LT(clock.Now(), ts::Time() + 1);
+
+  // The current PCR has wrapped around.
+  clock.UpdatePcr(0);
+  EXPECT_EQ(kPcrTicksPerMs, ComparePcr(clock.pcr(), end_pcr));
+  EXPECT_GE(clock.Now(), ts::Time() + 1);
+}
+
+TEST(ClockTest, ComparePcr) {
+  EXPECT_EQ(0, ComparePcr(0, 0));
+  EXPECT_EQ(1, ComparePcr(1, 0));
+  EXPECT_EQ(-1, ComparePcr(0, 1));
+  EXPECT_EQ(1, ComparePcr(0, kMaxPcr));
+  EXPECT_EQ(-1, ComparePcr(kMaxPcr, 0));
+  EXPECT_EQ(27001000, ComparePcr(1000, kPcrUpperBound - 27000000));
+  EXPECT_EQ(-27001000, ComparePcr(kPcrUpperBound - 27000000, 1000));
+}
@@ -3,6 +3,7 @@
 set -u
 
 MIRAKC_ARIB="$1"
+STREAM_GENERATOR="${2:-}"
 
 export MIRAKC_ARIB_LOG=none
 
@@ -19,12 +20,24 @@ assert() {
   fi
 }
 
+# Checks that a command outputs Japanese strings decoded from ARIB STD-B24.
+assert_arib_strings() {
+  cmd="$1"
+  # The first two bytes of hiragana characters encoded in UTF-8.
+  if sh -c "$cmd 2>/dev/null" | LC_ALL=C grep -q "$(printf '\343[\201\202]')"; then
+    echo "PASS: $cmd"
+  else
+    echo "FAIL: $cmd: no ARIB string decoded"
+    exit 1
+  fi
+}
+
 for opt in '-h' '--help'
 do
   assert 0 "$MIRAKC_ARIB $opt"
   for cmd in 'scan-services' 'sync-clocks' 'collect-eits' 'collect-logos' \
              'filter-service' 'filter-program' 'record-service' 'track-airtime' \
-             'seek-start' 'print-pes'
+             'seek-start' 'print-pes' 'index' 'serve'
   do
     assert 0 "$MIRAKC_ARIB $cmd $opt"
   done
@@ -41,6 +54,14 @@ assert 1 "$MIRAKC_ARIB sync-clocks --sids=1 --sids=0xFFFF --xsids=1 --xsids=0xFF
 assert 1 "$MIRAKC_ARIB collect-eits"
 assert 1 "$MIRAKC_ARIB collect-eits --sids=1 --sids=0xFFFF --xsids=1 --xsids=0xFFFF --time-limit=0x7FFFFFFFFFFFFFFF --streaming"
 assert 134 "$MIRAKC_ARIB collect-eits --time-limit=0xFFFFFFFFFFFFFFFF"
+assert 1 "$MIRAKC_ARIB collect-eits --jobs=4"
+assert 134 "$MIRAKC_ARIB collect-eits --jobs=-1"
+assert 1 "$MIRAKC_ARIB collect-eits --state-file=state.json"
+assert 1 "$MIRAKC_ARIB collect-eits --diff"
+assert 1 "$MIRAKC_ARIB collect-eits /dev/null /dev/null"
+assert 1 "MIRAKC_ARIB_OUTPUT_FORMAT=jsonl $MIRAKC_ARIB collect-eits"
+assert 1 "MIRAKC_ARIB_OUTPUT_FORMAT=msgpack $MIRAKC_ARIB collect-eits"
+assert 134 "MIRAKC_ARIB_OUTPUT_FORMAT=cbor $MIRAKC_ARIB collect-eits"
 
 assert 0 "$MIRAKC_ARIB filter-service --sid=1"
 assert 0 "$MIRAKC_ARIB filter-service --sid=0xFFFF"
@@ -49,11 +70,51 @@ assert 0 "$MIRAKC_ARIB filter-program --sid=1 --eid=1 --clock-pid=1 --clock-pcr=
 assert 0 "$MIRAKC_ARIB filter-program --sid=0xFFFF --eid=0xFFFF --clock-pid=0xFFFF --clock-pcr=0x7FFFFFFFFFFFFFFF --clock-time=-9223372036854775808 --start-margin=1 --end-margin=1 --pre-streaming"
 assert 134 "$MIRAKC_ARIB filter-program --sid=1 --eid=1 --clock-pid=1 --clock-pcr=0xFFFFFFFFFFFFFFFFF --clock-time=1"
 assert 134 "$MIRAKC_ARIB filter-program --sid=1 --eid=1 --clock-pid=1 --clock-pcr=1 --clock-time=-9223372036854775809"
+assert 0 "$MIRAKC_ARIB filter-program --sid=1 --eid=1 --clock-pid=1 --clock-pcr=1 --clock-time=1 --threaded"
+assert 0 "$MIRAKC_ARIB filter-program --sid=1 --eid=1 --clock-pid=1 --clock-pcr=1 --clock-time=1 --keyframe-start"
 assert 0 "$MIRAKC_ARIB filter-program --sid=1 --eid=1 --clock-pid=1 --clock-pcr=1 --clock-time=1 --audio-tags=0 --audio-tags=255 --video-tags=0 --video-tags=255"
 assert 134 "$MIRAKC_ARIB filter-program --sid=1 --eid=1 --clock-pid=1 --clock-pcr=1 --clock-time=1 --audio-tags='-1'"
 assert 134 "$MIRAKC_ARIB filter-program --sid=1 --eid=1 --clock-pid=1 --clock-pcr=1 --clock-time=1 --audio-tags=256"
 assert 134 "$MIRAKC_ARIB filter-program --sid=1 --eid=1 --clock-pid=1 --clock-pcr=1 --clock-time=1 --video-tags='-1'"
 assert 134 "$MIRAKC_ARIB filter-program --sid=1 --eid=1 --clock-pid=1 --clock-pcr=1 --clock-time=1 --video-tags=256"
+assert 1 "$MIRAKC_ARIB filter-program --sid=1 --eid=1 --clock-pid=1 --clock-pcr=1 --clock-time=1 --index=file.index"
+assert 0 "$MIRAKC_ARIB filter-program --sid=1 --eid=1 --clock-pid=1 --clock-pcr=1 --clock-time=1 --program=2:3 --program=0xFFFF:4:1:1 3>/dev/null 4>/dev/null"
+assert 0 "$MIRAKC_ARIB filter-program --sid=1 --eid=1 --clock-pid=1 --clock-pcr=1 --clock-time=1 --program=2:3 --threaded 3>/dev/null"
+assert 134 "$MIRAKC_ARIB filter-program --sid=1 --eid=1 --clock-pid=1 --clock-pcr=1 --clock-time=1 --program=2"
+assert 134 "$MIRAKC_ARIB filter-program --sid=1 --eid=1 --clock-pid=1 --clock-pcr=1 --clock-time=1 --program=2:1"
+assert 134 "$MIRAKC_ARIB filter-program --sid=1 --eid=1 --clock-pid=1 --clock-pcr=1 --clock-time=1 --program=2:3:x 3>/dev/null"
+assert 134 "$MIRAKC_ARIB filter-program --sid=1 --eid=1 --clock-pid=1 --clock-pcr=1 --clock-time=1 --program=x:3 3>/dev/null"
+assert 134 "$MIRAKC_ARIB filter-program --sid=1 --eid=1 --clock-pid=1 --clock-pcr=1 --clock-time=1 --program=2:99999999999999999999 3>/dev/null"
+assert 134 "$MIRAKC_ARIB filter-program --sid=1 --eid=1 --clock-pid=1 --clock-pcr=1 --clock-time=1 --program=0x10000:3 3>/dev/null"
+assert 134 "$MIRAKC_ARIB filter-program --sid=1 --eid=1 --clock-pid=1 --clock-pcr=1 --clock-time=1 --program=2:3 --program=3:3 3>/dev/null"
+assert 134 "$MIRAKC_ARIB filter-program --sid=1 --eid=1 --clock-pid=1 --clock-pcr=1 --clock-time=1 --program=2:9"
+
+# The other programs keep going when the reader of a program closes its pipe
+# early.  1000 PAT packets for SID#0001 are output with --pre-streaming.
+WORK_DIR=$(mktemp -d)
+trap "rm -rf $WORK_DIR" EXIT
+i=0
+while [ $i -lt 1000 ]
+do
+  printf '\107\100\000\020\000\000\260\015\000\001\301\000\000\000\001\341\001\354\070\103\312'
+  dd if=/dev/zero bs=167 count=1 2>/dev/null | tr '\000' '\377'
+  i=$((i + 1))
+done >"$WORK_DIR/pat.ts"
+{
+  $MIRAKC_ARIB filter-program --sid=1 --eid=1 --clock-pid=1 --clock-pcr=1 \
+    --clock-time=1 --pre-streaming --program=2:3 "$WORK_DIR/pat.ts" \
+    3>&1 >"$WORK_DIR/out.ts" </dev/null
+  echo $? >"$WORK_DIR/status"
+} | dd bs=188 count=1 >/dev/null 2>&1
+status=$(cat "$WORK_DIR/status")
+size=$(wc -c <"$WORK_DIR/out.ts")
+# 141 = 128 + SIGPIPE
+if [ $status -ne 141 ] && [ $size -eq 188000 ]; then
+  echo "PASS: filter-program --program with a closed pipe"
+else
+  echo "FAIL: filter-program --program with a closed pipe: status($status) size($size)"
+  exit 1
+fi
 
 assert 0 "$MIRAKC_ARIB filter-program-metadata"
 assert 0 "$MIRAKC_ARIB filter-program-metadata --sid=1"
@@ -61,6 +122,7 @@ assert 0 "$MIRAKC_ARIB filter-program-metadata --sid=0xFFFF"
 
 assert 0 "$MIRAKC_ARIB record-service --sid=1 --file=file --chunk-size=8192 --num-chunks=1"
 assert 0 "$MIRAKC_ARIB record-service --sid=1 --file=file --chunk-size=8192 --num-chunks=1 --start-pos=0"
+assert 0 "$MIRAKC_ARIB record-service --sid=1 --file=file --chunk-size=8192 --num-chunks=1 --threaded"
 assert 0 "$MIRAKC_ARIB record-service --sid=1 --file=file --chunk-size=8192 --num-chunks=2 --start-pos=8192"
 assert 0 "$MIRAKC_ARIB record-service --sid=0xFFFF --file=file --chunk-size=0x7FFE0000 --num-chunks=0x7FFFFFFF --start-pos=0x3FFEFFFF00040000"
 assert 134 "$MIRAKC_ARIB record-service --sid=1 --file=file --chunk-size=0 --num-chunks=1"
@@ -75,7 +137,22 @@ assert 0 "$MIRAKC_ARIB track-airtime --sid=1 --eid=1"
 assert 0 "$MIRAKC_ARIB track-airtime --sid=0xFFFF --eid=0xFFFF"
 
 assert 0 "$MIRAKC_ARIB seek-start --sid=1 --max-duration=1"
+assert 0 "$MIRAKC_ARIB seek-start --sid=1 --max-duration=1 --keyframe-start"
 assert 0 "$MIRAKC_ARIB seek-start --sid=0xFFFF --max-duration=0x7FFFFFFFFFFFFFFF --max-packets=0x7FFFFFFF"
 assert 134 "$MIRAKC_ARIB seek-start --sid=0xFFFF --max-duration=0xFFFFFFFFFFFFFFFF --max-packets=0x7FFFFFFF"
 
 assert 0 "$MIRAKC_ARIB print-pes"
+
+assert 1 "$MIRAKC_ARIB index no-such-file.ts"
+assert 1 "$MIRAKC_ARIB index --sid=1 --interval=188 --output=file.index no-such-file.ts"
+assert 134 "$MIRAKC_ARIB index --interval=0 no-such-file.ts"
+
+if [ -n "$STREAM_GENERATOR" ]; then
+  $STREAM_GENERATOR --duration=12000 --mux-bitrate=4000000 \
+    --video-bitrate=500000 >stream.ts
+  # scan-services decodes service names with tsduck in the ARIB mode.
+  assert_arib_strings "$MIRAKC_ARIB scan-services stream.ts"
+  # collect-eits decodes event names without the ARIB mode of tsduck.
+  assert_arib_strings "$MIRAKC_ARIB collect-eits stream.ts"
+  rm -f stream.ts
+fi
@@ -1,4 +1,9 @@
+#include <cstdio>
+#include <fstream>
 #include <memory>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
@@ -75,6 +80,227 @@ TEST(EitCollectorTest, Streaming) {
   EXPECT_TRUE(src.IsEmpty());
 }
 
+TEST(EitCollectorTest, TimedOutWithWorkers) {
+  EitCollectorOption option;
+  option.num_workers = 2;
+
+  TableSource src;
+  auto collector = std::make_unique<EitCollector>(option);
+  auto sink = std::make_unique<MockJsonlSink>();
+
+  src.LoadXml(R"(
+    <?xml version="1.0" encoding="utf-8"?>
+    <tsduck>
+      <TOT UTC_time="2020-02-05 00:00:00" test-pid="0x0014" test-cc="0" />
+      <TOT UTC_time="2020-02-05 00:00:30" test-pid="0x0014" test-cc="1" />
+    </tsduck>
+  )");
+
+  EXPECT_CALL(*sink, HandleDocument).Times(0);
+
+  collector->Connect(std::move(sink));
+  src.Connect(std::move(collector));
+  EXPECT_FALSE(src.FeedPackets());
+  EXPECT_TRUE(src.IsEmpty());
+}
+
+TEST(EitCollectorTest, TimedOutWithStateFile) {
+  const auto path = testing::TempDir() + "eit_collector_test_timed_out.json";
+  std::remove(path.c_str());
+
+  EitCollectorOption option;
+  option.time_limit = 5000;
+  option.state_file = path;
+
+  TableSource src;
+  auto collector = std::make_unique<EitCollector>(option);
+  auto sink = std::make_unique<MockJsonlSink>();
+
+  src.LoadXml(R"(
+    <?xml version="1.0" encoding="utf-8"?>
+    <tsduck>
+      <TOT UTC_time="2020-02-05 00:00:00" test-pid="0x0014" test-cc="0" />
+      <TOT UTC_time="2020-02-05 00:00:05" test-pid="0x0014" test-cc="1" />
+    </tsduck>
+  )");
+
+  EXPECT_CALL(*sink, HandleDocument).Times(0);
+
+  collector->Connect(std::move(sink));
+  src.Connect(std::move(collector));
+  EXPECT_FALSE(src.FeedPackets());
+
+  // A partial view must not be saved.
+  std::ifstream ifs(path);
+  EXPECT_FALSE(ifs.is_open());
+}
+
+namespace {
+
+// Collects EIT sections of multiple services and returns output documents.
+std::vector<std::string> CollectSchedules(size_t num_workers) {
+  EitCollectorOption option;
+  option.streaming = true;
+  option.num_workers = num_workers;
+
+  TableSource src;
+  auto collector = std::make_unique<EitCollector>(option);
+  auto sink = std::make_unique<MockJsonlSink>();
+
+  src.LoadXml(R"(
+    <?xml version="1.0" encoding="utf-8"?>
+    <tsduck>
+      <EIT type="0" version="1" current="true" actual="true"
+           service_id="0x0003" transport_stream_id="0x0002"
+           original_network_id="0x0001" last_table_id="0x50"
+           test-pid="0x0012" test-cc="0">
+        <event event_id="0x0001" start_time="2020-02-05 00:00:00"
+               duration="00:30:00" running_status="undefined" CA_mode="true" />
+        <event event_id="0x0002" start_time="2020-02-05 00:30:00"
+               duration="00:30:00" running_status="undefined" CA_mode="true" />
+      </EIT>
+      <EIT type="0" version="1" current="true" actual="true"
+           service_id="0x0004" transport_stream_id="0x0002"
+           original_network_id="0x0001" last_table_id="0x50"
+           test-pid="0x0012" test-cc="1">
+        <event event_id="0x0011" start_time="2020-02-05 00:00:00"
+               duration="01:00:00" running_status="undefined" CA_mode="true" />
+      </EIT>
+      <EIT type="8" version="2" current="true" actual="true"
+           service_id="0x0003" transport_stream_id="0x0002"
+           original_network_id="0x0001" last_table_id="0x58"
+           test-pid="0x0012" test-cc="2">
+        <event event_id="0x0001" start_time="2020-02-05 00:00:00"
+               duration="00:30:00" running_status="undefined" CA_mode="true" />
+      </EIT>
+      <EIT type="0" version="3" current="true" actual="true"
+           service_id="0x0005" transport_stream_id="0x0002"
+           original_network_id="0x0001" last_table_id="0x50"
+           test-pid="0x0012" test-cc="3">
+        <event event_id="0x0021" start_time="2020-02-05 00:00:00"
+               duration="00:15:00" running_status="undefined" CA_mode="true" />
+        <event event_id="0x0022" start_time="2020-02-05 00:15:00"
+               duration="00:45:00" running_status="undefined" CA_mode="true" />
+      </EIT>
+    </tsduck>
+  )");
+
+  std::vector<std::string> docs;
+  EXPECT_CALL(*sink, HandleDocument).WillRepeatedly(
+      [&docs](const rapidjson::Document& doc) {
+        docs.push_back(MockJsonlSink::Stringify(doc));
+        return true;
+      });
+
+  collector->Connect(std::move(sink));
+  src.Connect(std::move(collector));
+  src.FeedPackets();
+  EXPECT_TRUE(src.IsEmpty());
+  return docs;
+}
+
+}  // namespace
+
+TEST(EitCollectorTest, SchedulesWithWorkers) {
+  const auto expected = CollectSchedules(0);
+  ASSERT_EQ(4, expected.size());
+  EXPECT_THAT(expected[0], testing::HasSubstr(R"("serviceId":3)"));
+  EXPECT_THAT(expected[1], testing::HasSubstr(R"("serviceId":4)"));
+  EXPECT_THAT(expected[2], testing::HasSubstr(R"("tableId":88)"));
+  EXPECT_THAT(expected[3], testing::HasSubstr(R"("serviceId":5)"));
+
+  // The output must be the same as the single-threaded run regardless of the
+  // number of workers.
+  EXPECT_EQ(expected, CollectSchedules(2));
+  EXPECT_EQ(expected, CollectSchedules(4));
+}
+
+TEST(EitCollectorTest, SharedState) {
+  auto state = std::make_shared<EitCollectorSharedState>();
+
+  TableSource src1;
+  auto collector1 = std::make_unique<EitCollector>(kEmptyOption, state);
+  auto sink1 = std::make_unique<MockJsonlSink>();
+
+  TableSource src2;
+  auto collector2 = std::make_unique<EitCollector>(kEmptyOption, state);
+  auto sink2 = std::make_unique<MockJsonlSink>();
+
+  EXPECT_EQ(2, state->num_collectors);
+
+  const auto xml = R"(
+    <?xml version="1.0" encoding="utf-8"?>
+    <tsduck>
+      <TOT UTC_time="2020-02-05 00:00:00" test-pid="0x0014" test-cc="0" />
+      <TOT UTC_time="2020-02-05 00:00:30" test-pid="0x0014" test-cc="1" />
+    </tsduck>
+  )";
+  src1.LoadXml(xml);
+  src2.LoadXml(xml);
+
+  EXPECT_CALL(*sink1, HandleDocument).Times(0);
+  EXPECT_CALL(*sink2, HandleDocument).Times(0);
+
+  collector1->Connect(std::move(sink1));
+  src1.Connect(std::move(collector1));
+  collector2->Connect(std::move(sink2));
+  src2.Connect(std::move(collector2));
+
+  std::thread thread([&src2] {
+    EXPECT_FALSE(src2.FeedPackets());
+  });
+  EXPECT_FALSE(src1.FeedPackets());
+  thread.join();
+
+  EXPECT_TRUE(src1.IsEmpty());
+  EXPECT_TRUE(src2.IsEmpty());
+  EXPECT_EQ(0, state->num_collectors);
+}
+
+TEST(EitCollectorTest, SharedStateTimeDifference) {
+  auto state = std::make_shared<EitCollectorSharedState>();
+
+  TableSource src1;
+  auto collector1 = std::make_unique<EitCollector>(kEmptyOption, state);
+  auto sink1 = std::make_unique<MockJsonlSink>();
+
+  TableSource src2;
+  auto collector2 = std::make_unique<EitCollector>(kEmptyOption, state);
+  auto sink2 = std::make_unique<MockJsonlSink>();
+
+  src1.LoadXml(R"(
+    <?xml version="1.0" encoding="utf-8"?>
+    <tsduck>
+      <TOT UTC_time="2020-02-05 00:00:00" test-pid="0x0014" test-cc="0" />
+      <TOT UTC_time="2020-02-05 00:00:30" test-pid="0x0014" test-cc="1" />
+    </tsduck>
+  )");
+
+  // Recorded 6 hours later.
+  src2.LoadXml(R"(
+    <?xml version="1.0" encoding="utf-8"?>
+    <tsduck>
+      <TOT UTC_time="2020-02-05 06:00:00" test-pid="0x0014" test-cc="0" />
+      <TOT UTC_time="2020-02-05 06:00:30" test-pid="0x0014" test-cc="1" />
+    </tsduck>
+  )");
+
+  EXPECT_CALL(*sink1, HandleDocument).Times(0);
+  EXPECT_CALL(*sink2, HandleDocument).Times(0);
+
+  collector1->Connect(std::move(sink1));
+  src1.Connect(std::move(collector1));
+  collector2->Connect(std::move(sink2));
+  src2.Connect(std::move(collector2));
+
+  EXPECT_FALSE(src1.FeedPackets());
+  EXPECT_TRUE(src1.IsEmpty());
+
+  // Stopped at the first TOT.
+  EXPECT_FALSE(src2.FeedPackets());
+  EXPECT_EQ(1, src2.GetNumberOfRemainingPackets());
+}
+
 // TODO: Add more tests here.
 //
 // There are no classes and methods in TSDuck which can be used for generating
@@ -0,0 +1,140 @@
+#include <initializer_list>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "eit_event_differ.hh"
+
+namespace {
+
+constexpr uint64_t kTriple = 0x0001000200030000;
+
+// Makes an event loop without descriptors.
+std::vector<uint8_t> MakeEvents(
+    std::initializer_list<std::pair<uint16_t, uint8_t>> events) {
+  std::vector<uint8_t> data;
+  for (const auto& [eid, duration_min] : events) {
+    data.push_back(static_cast<uint8_t>(eid >> 8));
+    data.push_back(static_cast<uint8_t>(eid));
+    // start_time: 2020-01-01 00:00:00 (MJD 0xE4D6)
+    data.insert(data.end(), { 0xE4, 0xD6, 0x00, 0x00, 0x00 });
+    // duration (BCD)
+    data.push_back(0x00);
+    data.push_back(static_cast<uint8_t>(
+        (duration_min / 10) << 4 | (duration_min % 10)));
+    data.push_back(0x00);
+    // running_status, free_CA_mode, descriptors_loop_length
+    data.insert(data.end(), { 0x00, 0x00 });
+  }
+  return data;
+}
+
+using Type = EitEventChange::Type;
+
+std::vector<std::pair<Type, uint16_t>> Update(
+    EitEventDiffer& differ, uint8_t tid, uint8_t section_number,
+    const std::vector<uint8_t>& events) {
+  std::vector<std::pair<Type, uint16_t>> result;
+  for (const auto& change : differ.Update(
+           kTriple, tid, section_number, events.data(), events.size())) {
+    result.emplace_back(change.type, change.eid);
+  }
+  return result;
+}
+
+}  // namespace
+
+using testing::ElementsAre;
+using testing::IsEmpty;
+using testing::Pair;
+
+TEST(EitEventDifferTest, AddedChangedRemoved) {
+  EitEventDiffer differ;
+
+  EXPECT_THAT(Update(differ, 0x50, 0, MakeEvents({{1, 30}, {2, 30}})),
+              ElementsAre(Pair(Type::kAdded, 1), Pair(Type::kAdded, 2)));
+  EXPECT_EQ(2, differ.CountEvents());
+
+  // Same events.
+  EXPECT_THAT(Update(differ, 0x50, 0, MakeEvents({{1, 30}, {2, 30}})),
+              IsEmpty());
+
+  // Event#2 changed, event#3 added.
+  EXPECT_THAT(Update(differ, 0x50, 0, MakeEvents({{1, 30}, {2, 45}, {3, 15}})),
+              ElementsAre(Pair(Type::kChanged, 2), Pair(Type::kAdded, 3)));
+
+  // Event#1 removed.
+  EXPECT_THAT(Update(differ, 0x50, 0, MakeEvents({{2, 45}, {3, 15}})),
+              ElementsAre(Pair(Type::kRemoved, 1)));
+  EXPECT_EQ(2, differ.CountEvents());
+}
+
+TEST(EitEventDifferTest, MovedToAnotherSection) {
+  EitEventDiffer differ;
+
+  EXPECT_THAT(Update(differ, 0x50, 0, MakeEvents({{1, 30}, {2, 30}})),
+              ElementsAre(Pair(Type::kAdded, 1), Pair(Type::kAdded, 2)));
+
+  // Event#2 moved to the next section without any change.
+  EXPECT_THAT(Update(differ, 0x50, 1, MakeEvents({{2, 30}})),
+              IsEmpty());
+
+  // Event#2 is no longer included in the section#0, but it's not removed.
+  EXPECT_THAT(Update(differ, 0x50, 0, MakeEvents({{1, 30}})),
+              IsEmpty());
+  EXPECT_EQ(2, differ.CountEvents());
+
+  // Removed from the section#1.
+  EXPECT_THAT(Update(differ, 0x50, 1, MakeEvents({})),
+              ElementsAre(Pair(Type::kRemoved, 2)));
+  EXPECT_EQ(1, differ.CountEvents());
+}
+
+TEST(EitEventDifferTest, Services) {
+  EitEventDiffer differ;
+  auto events = MakeEvents({{1, 30}});
+
+  EXPECT_EQ(1, differ.Update(
+      kTriple, 0x50, 0, events.data(), events.size()).size());
+  EXPECT_EQ(1, differ.Update(
+      kTriple + 0x10000, 0x50, 0, events.data(), events.size()).size());
+  EXPECT_EQ(2, differ.CountEvents());
+}
+
+TEST(EitEventDifferTest, BasicAndExtended) {
+  EitEventDiffer differ;
+
+  // Extended tables carry the same event with different descriptors.  The
+  // duration stands in for the difference here.
+  EXPECT_THAT(Update(differ, 0x50, 0, MakeEvents({{1, 30}})),
+              ElementsAre(Pair(Type::kAdded, 1)));
+  EXPECT_THAT(Update(differ, 0x58, 0, MakeEvents({{1, 45}})),
+              ElementsAre(Pair(Type::kAdded, 1)));
+  EXPECT_EQ(2, differ.CountEvents());
+
+  // No spurious change in the next cycle.
+  EXPECT_THAT(Update(differ, 0x50, 0, MakeEvents({{1, 30}})), IsEmpty());
+  EXPECT_THAT(Update(differ, 0x58, 0, MakeEvents({{1, 45}})), IsEmpty());
+
+  // A change in the extended table doesn't affect the basic table.
+  EXPECT_THAT(Update(differ, 0x58, 0, MakeEvents({{1, 60}})),
+              ElementsAre(Pair(Type::kChanged, 1)));
+  EXPECT_THAT(Update(differ, 0x50, 0, MakeEvents({{1, 30}})), IsEmpty());
+
+  // The event table survives a state file.
+  rapidjson::Document doc;
+  auto json = differ.ToJson(doc.GetAllocator());
+  EitEventDiffer loaded;
+  EXPECT_TRUE(loaded.FromJson(json));
+  EXPECT_EQ(2, loaded.CountEvents());
+  EXPECT_THAT(Update(loaded, 0x50, 0, MakeEvents({{1, 30}})), IsEmpty());
+  EXPECT_THAT(Update(loaded, 0x58, 0, MakeEvents({{1, 60}})), IsEmpty());
+}
+
+TEST(EitEventDifferTest, BrokenEvent) {
+  EitEventDiffer differ;
+  auto events = MakeEvents({{1, 30}});
+  events.resize(events.size() - 1);
+  EXPECT_THAT(Update(differ, 0x50, 0, events), IsEmpty());
+}
@@ -0,0 +1,200 @@
+#include <cstdio>
+#include <fstream>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "eit_snapshot.hh"
+
+namespace {
+
+constexpr uint64_t kTriple = 0x0001000200030000;
+
+// Makes an event loop without descriptors.
+std::vector<uint8_t> MakeEvents(
+    std::initializer_list<std::pair<uint16_t, uint8_t>> events) {
+  std::vector<uint8_t> data;
+  for (const auto& [eid, duration_min] : events) {
+    data.push_back(static_cast<uint8_t>(eid >> 8));
+    data.push_back(static_cast<uint8_t>(eid));
+    // start_time: 2020-01-01 00:00:00 (MJD 0xE4D6)
+    data.insert(data.end(), { 0xE4, 0xD6, 0x00, 0x00, 0x00 });
+    // duration (BCD)
+    data.push_back(0x00);
+    data.push_back(static_cast<uint8_t>(
+        (duration_min / 10) << 4 | (duration_min % 10)));
+    data.push_back(0x00);
+    // running_status, free_CA_mode, descriptors_loop_length
+    data.insert(data.end(), { 0x00, 0x00 });
+  }
+  return data;
+}
+
+}  // namespace
+
+TEST(EitSnapshotTest, Contains) {
+  EitSnapshot snapshot;
+  EXPECT_FALSE(snapshot.Contains(kTriple, 0x50, 0, 1));
+
+  snapshot.Update(kTriple, 0x50, 0, 1);
+  EXPECT_TRUE(snapshot.Contains(kTriple, 0x50, 0, 1));
+  EXPECT_FALSE(snapshot.Contains(kTriple, 0x50, 0, 2));
+  EXPECT_FALSE(snapshot.Contains(kTriple, 0x50, 8, 1));
+  EXPECT_FALSE(snapshot.Contains(kTriple, 0x51, 0, 1));
+  EXPECT_FALSE(snapshot.Contains(kTriple + 0x10000, 0x50, 0, 1));
+
+  snapshot.Update(kTriple, 0x50, 0, 2);
+  EXPECT_FALSE(snapshot.Contains(kTriple, 0x50, 0, 1));
+  EXPECT_TRUE(snapshot.Contains(kTriple, 0x50, 0, 2));
+  EXPECT_EQ(1, snapshot.CountTables());
+}
+
+TEST(EitSnapshotTest, SaveAndLoad) {
+  const auto path = testing::TempDir() + "eit_snapshot_test.json";
+
+  EitSnapshot snapshot;
+  snapshot.Update(kTriple, 0x50, 0, 1);
+  snapshot.Update(kTriple, 0x50, 0xF8, 31);
+  snapshot.Update(kTriple, 0x58, 0x10, 0);
+  EXPECT_TRUE(snapshot.Save(path));
+
+  EitSnapshot loaded;
+  EXPECT_TRUE(loaded.Load(path));
+  EXPECT_EQ(2, loaded.CountTables());
+  EXPECT_TRUE(loaded.Contains(kTriple, 0x50, 0, 1));
+  EXPECT_TRUE(loaded.Contains(kTriple, 0x50, 0xF8, 31));
+  EXPECT_TRUE(loaded.Contains(kTriple, 0x58, 0x10, 0));
+  EXPECT_FALSE(loaded.Contains(kTriple, 0x50, 0x08, 1));
+
+  std::remove(path.c_str());
+}
+
+TEST(EitSnapshotTest, LoadNoFile) {
+  EitSnapshot snapshot;
+  EXPECT_FALSE(snapshot.Load(testing::TempDir() + "no-such-file.json"));
+  EXPECT_EQ(0, snapshot.CountTables());
+}
+
+TEST(EitSnapshotTest, LoadBrokenFile) {
+  const auto path = testing::TempDir() + "eit_snapshot_test_broken.json";
+
+  for (const auto* json : {
+      "",
+      "[]",
+      R"({"version": 0, "tables": []})",
+      R"({"version": 1})",
+      R"({"version": 1, "tables": [{"key": 1, "versions": "00"}]})",
+    }) {
+    {
+      std::ofstream ofs(path, std::ios::trunc);
+      ofs << json;
+    }
+    EitSnapshot snapshot;
+    snapshot.Update(kTriple, 0x50, 0, 1);
+    EXPECT_FALSE(snapshot.Load(path)) << json;
+    // The current state is kept.
+    EXPECT_TRUE(snapshot.Contains(kTriple, 0x50, 0, 1)) << json;
+  }
+
+  std::remove(path.c_str());
+}
+
+TEST(EitSnapshotTest, SaveAndLoadWithEvents) {
+  const auto path = testing::TempDir() + "eit_snapshot_test_events.json";
+
+  // The first run.
+  {
+    EitSnapshot snapshot;
+    EitEventDiffer differ;
+    auto events = MakeEvents({{1, 30}, {2, 30}});
+    auto changes = differ.Update(kTriple, 0x50, 0, events.data(), events.size());
+    EXPECT_EQ(2, changes.size());
+    snapshot.Update(kTriple, 0x50, 0, 1);
+    EXPECT_TRUE(snapshot.Save(path, &differ));
+  }
+
+  // The second run.  Changes are computed against the previous run.
+  {
+    EitSnapshot snapshot;
+    EitEventDiffer differ;
+    EXPECT_TRUE(snapshot.Load(path, &differ));
+    EXPECT_TRUE(snapshot.Contains(kTriple, 0x50, 0, 1));
+    EXPECT_EQ(2, differ.CountEvents());
+
+    auto events = MakeEvents({{1, 60}});
+    auto changes = differ.Update(kTriple, 0x50, 0, events.data(), events.size());
+    ASSERT_EQ(2, changes.size());
+    EXPECT_EQ(EitEventChange::Type::kChanged, changes[0].type);
+    EXPECT_EQ(1, changes[0].eid);
+    EXPECT_EQ(EitEventChange::Type::kRemoved, changes[1].type);
+    EXPECT_EQ(2, changes[1].eid);
+  }
+
+  std::remove(path.c_str());
+}
+
+TEST(EitSnapshotTest, LoadWithoutEvents) {
+  const auto path = testing::TempDir() + "eit_snapshot_test_no_events.json";
+
+  EitSnapshot snapshot;
+  snapshot.Update(kTriple, 0x50, 0, 1);
+  EXPECT_TRUE(snapshot.Save(path));
+
+  // Unchanged sections must not be skipped without the event table.
+  EitSnapshot loaded;
+  EitEventDiffer differ;
+  EXPECT_FALSE(loaded.Load(path, &differ));
+  EXPECT_EQ(0, loaded.CountTables());
+  EXPECT_EQ(0, differ.CountEvents());
+
+  std::remove(path.c_str());
+}
+
+TEST(EitSnapshotTest, Prune) {
+  const auto path = testing::TempDir() + "eit_snapshot_test_prune.json";
+  constexpr uint64_t kOtherTriple = kTriple + 0x10000;
+
+  {
+    EitSnapshot snapshot;
+    EitEventDiffer differ;
+    auto events = MakeEvents({{1, 30}});
+    differ.Update(kTriple, 0x50, 0, events.data(), events.size());
+    events = MakeEvents({{2, 30}});
+    differ.Update(kTriple, 0x50, 8, events.data(), events.size());
+    events = MakeEvents({{3, 30}});
+    differ.Update(kOtherTriple, 0x50, 0, events.data(), events.size());
+    snapshot.Update(kTriple, 0x50, 0, 1);
+    snapshot.Update(kTriple, 0x50, 8, 1);
+    snapshot.Update(kOtherTriple, 0x50, 0, 1);
+    EXPECT_TRUE(snapshot.Save(path, &differ));
+  }
+
+  EitSnapshot snapshot;
+  EitEventDiffer differ;
+  EXPECT_TRUE(snapshot.Load(path, &differ));
+  EXPECT_EQ(2, snapshot.CountTables());
+  EXPECT_EQ(3, differ.CountEvents());
+
+  // Only the section#00 of the first service is seen in this run.
+  snapshot.Update(kTriple, 0x50, 0, 1);
+  snapshot.Prune(&differ);
+
+  EXPECT_EQ(1, snapshot.CountTables());
+  EXPECT_TRUE(snapshot.Contains(kTriple, 0x50, 0, 1));
+  EXPECT_FALSE(snapshot.Contains(kTriple, 0x50, 8, 1));
+  EXPECT_FALSE(snapshot.Contains(kOtherTriple, 0x50, 0, 1));
+  EXPECT_EQ(1, differ.CountEvents());
+
+  // Pruned sections are not saved.
+  EXPECT_TRUE(snapshot.Save(path, &differ));
+  EitSnapshot loaded;
+  EitEventDiffer loaded_differ;
+  EXPECT_TRUE(loaded.Load(path, &loaded_differ));
+  EXPECT_EQ(1, loaded.CountTables());
+  EXPECT_EQ(1, loaded_differ.CountEvents());
+
+  std::remove(path.c_str());
+}
@@ -0,0 +1,70 @@
+#include <memory>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <tsduck/tsduck.h>
+
+#include "fanout_sink.hh"
+
+#include "test_helper.hh"
+
+TEST(FanoutSinkTest, NoSink) {
+  FanoutSink fanout;
+  EXPECT_FALSE(fanout.Start());
+}
+
+TEST(FanoutSinkTest, SamePacket) {
+  auto sink1 = std::make_unique<MockSink>();
+  auto sink2 = std::make_unique<MockSink>();
+  ts::TSPacket packet = ts::NullPacket;
+
+  EXPECT_CALL(*sink1, Start).WillOnce(testing::Return(true));
+  EXPECT_CALL(*sink1, HandlePacket).WillOnce(
+      [&packet](const ts::TSPacket& p) {
+        EXPECT_EQ(&packet, &p);
+        return true;
+      });
+  EXPECT_CALL(*sink1, End).WillOnce(testing::Return(true));
+
+  EXPECT_CALL(*sink2, Start).WillOnce(testing::Return(true));
+  EXPECT_CALL(*sink2, HandlePacket).WillOnce(
+      [&packet](const ts::TSPacket& p) {
+        EXPECT_EQ(&packet, &p);
+        return true;
+      });
+  EXPECT_CALL(*sink2, End).WillOnce(testing::Return(true));
+
+  FanoutSink fanout;
+  fanout.Connect(std::move(sink1));
+  fanout.Connect(std::move(sink2));
+  EXPECT_TRUE(fanout.Start());
+  EXPECT_TRUE(fanout.HandlePacket(packet));
+  EXPECT_TRUE(fanout.End());
+}
+
+TEST(FanoutSinkTest, Stop) {
+  auto sink1 = std::make_unique<MockSink>();
+  auto sink2 = std::make_unique<MockSink>();
+
+  {
+    // End() is called on each sink right after it stops.
+    testing::InSequence seq;
+    EXPECT_CALL(*sink1, Start).WillOnce(testing::Return(true));
+    EXPECT_CALL(*sink2, Start).WillOnce(testing::Return(true));
+    EXPECT_CALL(*sink1, HandlePacket).WillOnce(testing::Return(false));
+    EXPECT_CALL(*sink1, End).WillOnce(testing::Return(true));
+    EXPECT_CALL(*sink2, HandlePacket).WillOnce(testing::Return(true));
+    EXPECT_CALL(*sink2, HandlePacket).WillOnce(testing::Return(false));
+    EXPECT_CALL(*sink2, End).WillOnce(testing::Return(false));
+  }
+
+  FanoutSink fanout;
+  fanout.Connect(std::move(sink1));
+  fanout.Connect(std::move(sink2));
+  EXPECT_TRUE(fanout.Start());
+  // sink1 stops but sink2 still receives packets.
+  EXPECT_TRUE(fanout.HandlePacket(ts::NullPacket));
+  EXPECT_FALSE(fanout.HandlePacket(ts::NullPacket));
+  EXPECT_FALSE(fanout.HandlePacket(ts::NullPacket));
+  EXPECT_FALSE(fanout.End());
+}
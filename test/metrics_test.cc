@@ -0,0 +1,93 @@
+#include <cstdint>
+#include <string>
+
+#include <gtest/gtest.h>
+#include <rapidjson/document.h>
+
+#include "metrics.hh"
+
+TEST(MetricsTest, Counter) {
+  MetricsCounter counter;
+  EXPECT_EQ(0, counter.value());
+  counter.Add(1);
+  counter.Add(2);
+  EXPECT_EQ(3, counter.value());
+}
+
+TEST(MetricsTest, HistogramBuckets) {
+  for (uint64_t value = 0; value < 100000; ++value) {
+    auto index = MetricsHistogram::GetBucketIndex(value);
+    ASSERT_LT(index, MetricsHistogram::kNumBuckets);
+    ASSERT_LE(value, MetricsHistogram::GetBucketUpperBound(index));
+    if (index > 0) {
+      ASSERT_GT(value, MetricsHistogram::GetBucketUpperBound(index - 1));
+    }
+  }
+  const auto max_index = MetricsHistogram::GetBucketIndex(UINT64_MAX);
+  EXPECT_EQ(MetricsHistogram::kNumBuckets - 1, max_index);
+  EXPECT_EQ(UINT64_MAX, MetricsHistogram::GetBucketUpperBound(max_index));
+}
+
+TEST(MetricsTest, HistogramPercentiles) {
+  MetricsHistogram histogram;
+  EXPECT_EQ(0, histogram.GetPercentile(50.0));
+
+  for (uint64_t value = 1; value <= 1000; ++value) {
+    histogram.Record(value);
+  }
+  EXPECT_EQ(1000, histogram.count());
+  EXPECT_EQ(500500, histogram.sum());
+  EXPECT_EQ(1000, histogram.max());
+
+  auto p50 = histogram.GetPercentile(50.0);
+  EXPECT_GE(p50, 500);
+  EXPECT_LT(p50, 500 * 1.125);
+  auto p99 = histogram.GetPercentile(99.0);
+  EXPECT_GE(p99, 990);
+  EXPECT_LE(p99, 1000);
+  EXPECT_EQ(1000, histogram.GetPercentile(100.0));
+}
+
+TEST(MetricsTest, Registry) {
+  auto& registry = MetricsRegistry::GetInstance();
+  auto* counter = registry.GetCounter("test.registry.counter");
+  EXPECT_EQ(counter, registry.GetCounter("test.registry.counter"));
+  counter->Add(5);
+  auto* histogram = registry.GetHistogram("test.registry.histogram");
+  EXPECT_EQ(histogram, registry.GetHistogram("test.registry.histogram"));
+  histogram->Record(7);
+
+  rapidjson::Document doc;
+  doc.Parse(registry.ToJson().c_str());
+  ASSERT_FALSE(doc.HasParseError());
+  EXPECT_EQ(5, doc["counters"]["test.registry.counter"].GetUint64());
+  const auto& value = doc["histograms"]["test.registry.histogram"];
+  EXPECT_EQ(1, value["count"].GetUint64());
+  EXPECT_EQ(7, value["sum"].GetUint64());
+  EXPECT_EQ(7, value["max"].GetUint64());
+  EXPECT_EQ(7, value["p50"].GetUint64());
+}
+
+TEST(MetricsTest, Macros) {
+  auto& registry = MetricsRegistry::GetInstance();
+  auto run = [] {
+    MIRAKC_ARIB_METRICS_INC("test.macros.counter");
+    MIRAKC_ARIB_METRICS_ADD("test.macros.counter", 2);
+    MIRAKC_ARIB_METRICS_RECORD("test.macros.histogram", 10);
+    MIRAKC_ARIB_METRICS_TIMER("test.macros.timer");
+    MIRAKC_ARIB_METRICS_SAMPLED_TIMER("test.macros.sampled_timer", 2);
+  };
+
+  g_MetricsEnabled = false;
+  run();
+  EXPECT_EQ(std::string::npos, registry.ToJson().find("test.macros."));
+
+  g_MetricsEnabled = true;
+  run();
+  run();
+  g_MetricsEnabled = false;
+  EXPECT_EQ(6, registry.GetCounter("test.macros.counter")->value());
+  EXPECT_EQ(2, registry.GetHistogram("test.macros.histogram")->count());
+  EXPECT_EQ(2, registry.GetHistogram("test.macros.timer")->count());
+  EXPECT_EQ(1, registry.GetHistogram("test.macros.sampled_timer")->count());
+}
@@ -0,0 +1,113 @@
+#include <sstream>
+#include <string>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <rapidjson/document.h>
+
+#include "msgpack.hh"
+
+namespace {
+
+std::string Encode(const char* json) {
+  rapidjson::Document doc;
+  doc.Parse(json);
+  MsgpackWriter writer;
+  writer.Write(doc);
+  return writer.data();
+}
+
+bool RoundTrip(const char* json) {
+  rapidjson::Document expected;
+  expected.Parse(json);
+  MsgpackWriter writer;
+  writer.Write(expected);
+  const auto& data = writer.data();
+  rapidjson::Document doc;
+  MsgpackReader reader(reinterpret_cast<const uint8_t*>(data.data()), data.size());
+  return reader.Read(&doc) && doc == expected;
+}
+
+}  // namespace
+
+TEST(MsgpackTest, Encode) {
+  EXPECT_EQ(std::string("\xC0", 1), Encode("null"));
+  EXPECT_EQ(std::string("\xC2", 1), Encode("false"));
+  EXPECT_EQ(std::string("\xC3", 1), Encode("true"));
+  EXPECT_EQ(std::string("\x00", 1), Encode("0"));
+  EXPECT_EQ(std::string("\x7F", 1), Encode("127"));
+  EXPECT_EQ(std::string("\xCC\x80", 2), Encode("128"));
+  EXPECT_EQ(std::string("\xCD\x01\x00", 3), Encode("256"));
+  EXPECT_EQ(std::string("\xCE\x00\x01\x00\x00", 5), Encode("65536"));
+  EXPECT_EQ(std::string("\xFF", 1), Encode("-1"));
+  EXPECT_EQ(std::string("\xD0\xDF", 2), Encode("-33"));
+  EXPECT_EQ(std::string("\xCB\x3F\xF8\x00\x00\x00\x00\x00\x00", 9), Encode("1.5"));
+  EXPECT_EQ(std::string("\xA1" "a", 2), Encode("\"a\""));
+  EXPECT_EQ(std::string("\x92\x01\x02", 3), Encode("[1,2]"));
+  EXPECT_EQ(std::string("\x81\xA1" "a\x01", 4), Encode("{\"a\":1}"));
+}
+
+TEST(MsgpackTest, RoundTrip) {
+  EXPECT_TRUE(RoundTrip("null"));
+  EXPECT_TRUE(RoundTrip("[true,false]"));
+  EXPECT_TRUE(RoundTrip("[0,127,128,255,256,65535,65536,4294967295,4294967296]"));
+  EXPECT_TRUE(RoundTrip("[-1,-32,-33,-128,-129,-32768,-32769,-2147483648,-2147483649]"));
+  EXPECT_TRUE(RoundTrip("[18446744073709551615,-9223372036854775808]"));
+  EXPECT_TRUE(RoundTrip("[0.5,-1.25e10]"));
+  EXPECT_TRUE(RoundTrip("\"\""));
+  EXPECT_TRUE(RoundTrip(
+      "\"0123456789012345678901234567890123456789\""));  // str8
+  EXPECT_TRUE(RoundTrip("[0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16]"));  // array16
+  EXPECT_TRUE(RoundTrip(
+      R"({"type":"eit","data":{"originalNetworkId":1,"events":[)"
+      R"({"eventId":2,"startTime":1577836800000,"duration":3600000,)"
+      R"("scrambled":false,"descriptors":[{"$type":"ShortEvent",)"
+      R"("eventName":"番組","text":null}]}]}})"));
+}
+
+TEST(MsgpackTest, BrokenData) {
+  const uint8_t kTruncated[] = { 0x92, 0x01 };
+  rapidjson::Document doc;
+  EXPECT_FALSE(MsgpackReader(kTruncated, sizeof(kTruncated)).Read(&doc));
+
+  const uint8_t kTrailing[] = { 0x01, 0x02 };
+  EXPECT_FALSE(MsgpackReader(kTrailing, sizeof(kTrailing)).Read(&doc));
+
+  const uint8_t kUnsupported[] = { 0xC4, 0x00 };  // bin8
+  EXPECT_FALSE(MsgpackReader(kUnsupported, sizeof(kUnsupported)).Read(&doc));
+
+  const uint8_t kNonStringKey[] = { 0x81, 0x01, 0x02 };
+  EXPECT_FALSE(MsgpackReader(kNonStringKey, sizeof(kNonStringKey)).Read(&doc));
+
+  const uint8_t kTooLarge[] = { 0xDD, 0xFF, 0xFF, 0xFF, 0xFF };
+  EXPECT_FALSE(MsgpackReader(kTooLarge, sizeof(kTooLarge)).Read(&doc));
+}
+
+TEST(MsgpackTest, Stream) {
+  std::stringstream ss;
+
+  {
+    MsgpackJsonlSink sink(ss);
+    rapidjson::Document doc;
+    doc.Parse(R"({"type":"a"})");
+    EXPECT_TRUE(sink.HandleDocument(doc));
+    doc.Parse(R"({"type":"b"})");
+    EXPECT_TRUE(sink.HandleDocument(doc));
+  }
+
+  auto data = ss.str();
+  EXPECT_EQ(0, data.compare(0, 5, "MKAB\x01"));
+  EXPECT_EQ(0, data.compare(5, 4, std::string("\x00\x00\x00\x08", 4)));
+
+  MsgpackStreamReader reader(ss);
+  uint8_t version;
+  ASSERT_TRUE(reader.ReadHeader(&version));
+  EXPECT_EQ(kMsgpackSchemaVersion, version);
+
+  rapidjson::Document doc;
+  ASSERT_TRUE(reader.ReadFrame(&doc));
+  EXPECT_STREQ("a", doc["type"].GetString());
+  ASSERT_TRUE(reader.ReadFrame(&doc));
+  EXPECT_STREQ("b", doc["type"].GetString());
+  EXPECT_FALSE(reader.ReadFrame(&doc));
+}
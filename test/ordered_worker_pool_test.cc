@@ -0,0 +1,71 @@
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "ordered_worker_pool.hh"
+
+TEST(OrderedWorkerPoolTest, Empty) {
+  OrderedWorkerPool<int> pool(2, 4);
+  int result = 0;
+  EXPECT_TRUE(pool.IsEmpty());
+  EXPECT_FALSE(pool.IsFull());
+  EXPECT_FALSE(pool.Pop(&result, false));
+  EXPECT_FALSE(pool.Pop(&result, true));
+}
+
+TEST(OrderedWorkerPoolTest, Full) {
+  OrderedWorkerPool<int> pool(1, 2);
+  pool.Submit([] { return 1; });
+  EXPECT_FALSE(pool.IsFull());
+  pool.Submit([] { return 2; });
+  EXPECT_TRUE(pool.IsFull());
+
+  int result = 0;
+  EXPECT_TRUE(pool.Pop(&result, true));
+  EXPECT_EQ(1, result);
+  EXPECT_FALSE(pool.IsFull());
+}
+
+TEST(OrderedWorkerPoolTest, Order) {
+  constexpr int kNumJobs = 100;
+
+  OrderedWorkerPool<std::string> pool(4, 8);
+  std::string result;
+  int expected = 0;
+
+  for (int i = 0; i < kNumJobs; ++i) {
+    while (pool.IsFull()) {
+      EXPECT_TRUE(pool.Pop(&result, true));
+      EXPECT_EQ(std::to_string(expected++), result);
+    }
+    pool.Submit([i] {
+      // Later jobs tend to finish earlier.
+      std::this_thread::sleep_for(std::chrono::microseconds((i * 7919) % 300));
+      return std::to_string(i);
+    });
+    while (pool.Pop(&result, false)) {
+      EXPECT_EQ(std::to_string(expected++), result);
+    }
+  }
+
+  while (pool.Pop(&result, true)) {
+    EXPECT_EQ(std::to_string(expected++), result);
+  }
+
+  EXPECT_EQ(kNumJobs, expected);
+  EXPECT_TRUE(pool.IsEmpty());
+}
+
+TEST(OrderedWorkerPoolTest, DestroyWithPendingJobs) {
+  OrderedWorkerPool<int> pool(2, 4);
+  for (int i = 0; i < 4; ++i) {
+    pool.Submit([i] {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      return i;
+    });
+  }
+  // The destructor must join workers without deadlock.
+}
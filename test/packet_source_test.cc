@@ -1,4 +1,5 @@
 #include <memory>
+#include <vector>
 
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
@@ -99,6 +100,54 @@ TEST(PacketSourceTest, Resync) {
   src.FeedPackets();
 }
 
+TEST(PacketSourceTest, PacketPos) {
+  auto file = std::make_unique<MockFile>();
+  auto sink = std::make_unique<MockSink>();
+  auto* file_ptr = file.get();
+  auto* sink_ptr = sink.get();
+
+  FileSource src(std::move(file));
+  std::vector<uint64_t> positions;
+
+  {
+    testing::InSequence seq;
+    EXPECT_CALL(*file_ptr, Seek(1000, SeekMode::kSet)).WillOnce(testing::Return(1000));
+    EXPECT_CALL(*sink_ptr, Start).WillOnce(testing::Return(true));
+    EXPECT_CALL(*file_ptr, Read).WillOnce(
+        [](uint8_t* buf, size_t) {
+          buf[0] = 0;
+          buf[1] = ts::SYNC_BYTE;
+          buf[2] = 0;
+          return 3;
+        });
+    EXPECT_CALL(*file_ptr, Read).WillOnce(
+        [](uint8_t* buf, size_t) {
+          static constexpr size_t kNBytes = 5 * ts::PKT_SIZE;
+          for (auto* p = buf; p < buf + kNBytes; p += ts::PKT_SIZE) {
+            ts::NullPacket.copyTo(p);
+          }
+          return kNBytes;
+        });
+    EXPECT_CALL(*sink_ptr, HandlePacket).Times(5).WillRepeatedly(
+        [&src, &positions](const ts::TSPacket&) {
+          positions.push_back(src.packet_pos());
+          return true;
+        });
+    EXPECT_CALL(*file_ptr, Read).WillOnce(testing::Return(0));  // EOF
+    EXPECT_CALL(*sink_ptr, End).WillOnce(testing::Return(true));
+  }
+
+  src.Connect(std::move(sink));
+  EXPECT_TRUE(src.Seek(1000));
+  src.FeedPackets();
+
+  std::vector<uint64_t> expected;
+  for (uint64_t i = 0; i < 5; ++i) {
+    expected.push_back(1003 + i * ts::PKT_SIZE);
+  }
+  EXPECT_EQ(expected, positions);
+}
+
 TEST(PacketSourceTest, ResyncFailure) {
   auto file = std::make_unique<MockFile>();
   auto sink = std::make_unique<MockSink>();
@@ -0,0 +1,266 @@
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <tsduck/tsduck.h>
+
+#include "pcr_index.hh"
+#include "stream_generator.hh"
+
+#include "test_helper.hh"
+
+namespace {
+
+PcrIndexRecord MakeRecord(uint64_t pos, int64_t time, uint16_t eid, uint16_t next_eid) {
+  PcrIndexRecord record;
+  std::memset(&record, 0, sizeof(record));
+  record.pos = pos;
+  record.time = time;
+  record.eid = eid;
+  record.next_eid = next_eid;
+  record.flags = PcrIndexRecord::kHasTime |
+      PcrIndexRecord::kHasEid | PcrIndexRecord::kHasNextEid;
+  return record;
+}
+
+// Event#0001 .. Event#0002 .. (Event#0003 not started)
+void AddRecords(PcrIndex* index) {
+  index->AddRecord(MakeRecord(1000, 0, 1, 2));
+  index->AddRecord(MakeRecord(1100, 1000, 1, 2));
+  index->AddRecord(MakeRecord(1200, 2000, 1, 2));
+  index->AddRecord(MakeRecord(1300, 3000, 2, 3));
+  index->AddRecord(MakeRecord(1400, 4000, 2, 3));
+}
+
+}  // namespace
+
+TEST(PcrIndexTest, FindProgramStartPos) {
+  PcrIndex index;
+  AddRecords(&index);
+
+  EXPECT_EQ(1200, index.FindProgramStartPos(2, 0));
+  EXPECT_EQ(1100, index.FindProgramStartPos(2, 1000));
+  EXPECT_EQ(1000, index.FindProgramStartPos(2, 1500));
+  EXPECT_EQ(1000, index.FindProgramStartPos(2, 5000));
+  // Not started until the end of the file.
+  EXPECT_EQ(1300, index.FindProgramStartPos(3, 0));
+  // Started before the first record.
+  EXPECT_EQ(0, index.FindProgramStartPos(1, 0));
+  // Not found.
+  EXPECT_EQ(0, index.FindProgramStartPos(4, 0));
+}
+
+TEST(PcrIndexTest, FindProgramStartPosNotListed) {
+  PcrIndex index;
+  index.AddRecord(MakeRecord(1000, 0, 1, 2));
+  index.AddRecord(MakeRecord(1100, 1000, 1, 3));  // Event#0002 was canceled
+  index.AddRecord(MakeRecord(1200, 2000, 2, 3));
+
+  // ProgramFilter stops at 1100.
+  EXPECT_EQ(0, index.FindProgramStartPos(2, 0));
+}
+
+TEST(PcrIndexTest, FindProgramStartPosNoTime) {
+  PcrIndex index;
+  // Records made before the first TOT.
+  auto record = MakeRecord(1000, 0, 1, 2);
+  record.flags &= ~PcrIndexRecord::kHasTime;
+  index.AddRecord(record);
+  record.pos = 1100;
+  index.AddRecord(record);
+  index.AddRecord(MakeRecord(1200, 2000, 2, 3));
+
+  EXPECT_EQ(1000, index.FindProgramStartPos(2, 0));
+  EXPECT_EQ(1000, index.FindProgramStartPos(2, 1000));
+}
+
+TEST(PcrIndexTest, SaveAndLoad) {
+  PcrIndex index;
+  index.SetService(0x0400, 0x0100);
+  index.SetInterval(4096);
+  index.SetFileSize(12345);
+  AddRecords(&index);
+
+  std::vector<uint8_t> data;
+  auto file = std::make_unique<MockFile>();
+  EXPECT_CALL(*file, Write).WillRepeatedly([&data](uint8_t* buf, size_t len) {
+    data.insert(data.end(), buf, buf + len);
+    return static_cast<ssize_t>(len);
+  });
+  EXPECT_TRUE(index.Save(file.get()));
+  EXPECT_EQ(sizeof(PcrIndexHeader) + 5 * sizeof(PcrIndexRecord), data.size());
+
+  size_t pos = 0;
+  EXPECT_CALL(*file, Read).WillRepeatedly([&data, &pos](uint8_t* buf, size_t len) {
+    auto n = std::min(len, data.size() - pos);
+    std::memcpy(buf, data.data() + pos, n);
+    pos += n;
+    return static_cast<ssize_t>(n);
+  });
+  PcrIndex loaded;
+  EXPECT_TRUE(loaded.Load(file.get()));
+  EXPECT_EQ(0x0400, loaded.header().sid);
+  EXPECT_EQ(0x0100, loaded.header().pcr_pid);
+  EXPECT_EQ(4096, loaded.header().interval);
+  EXPECT_TRUE(loaded.IsValidFor(0x0400, 12345));
+  EXPECT_TRUE(loaded.IsValidFor(0, 12345));
+  EXPECT_FALSE(loaded.IsValidFor(0x0401, 12345));
+  EXPECT_FALSE(loaded.IsValidFor(0x0400, 12346));
+  ASSERT_EQ(5, loaded.records().size());
+  EXPECT_EQ(0, std::memcmp(index.records().data(), loaded.records().data(),
+                           5 * sizeof(PcrIndexRecord)));
+}
+
+TEST(PcrIndexTest, Map) {
+  PcrIndex index;
+  index.SetService(0x0400, 0x0100);
+  index.SetFileSize(12345);
+  AddRecords(&index);
+
+  // Use uint64_t for the alignment.
+  std::vector<uint64_t> data(
+      (sizeof(PcrIndexHeader) + 5 * sizeof(PcrIndexRecord)) / sizeof(uint64_t) + 1);
+  auto* bytes = reinterpret_cast<uint8_t*>(data.data());
+  std::memcpy(bytes, &index.header(), sizeof(PcrIndexHeader));
+  std::memcpy(bytes + sizeof(PcrIndexHeader), index.records().data(),
+              5 * sizeof(PcrIndexRecord));
+
+  PcrIndex mapped;
+  // The last 8 bytes are ignored.
+  EXPECT_TRUE(mapped.Map(bytes, data.size() * sizeof(uint64_t), "<memory>"));
+  EXPECT_TRUE(mapped.IsValidFor(0x0400, 12345));
+  ASSERT_EQ(5, mapped.records().size());
+  EXPECT_EQ(bytes + sizeof(PcrIndexHeader),
+            reinterpret_cast<const uint8_t*>(mapped.records().data()));
+  EXPECT_EQ(1200, mapped.FindProgramStartPos(2, 0));
+
+  EXPECT_FALSE(mapped.Map(bytes, sizeof(PcrIndexHeader) - 1, "<memory>"));
+  std::memset(bytes, 0, sizeof(PcrIndexHeader));
+  EXPECT_FALSE(mapped.Map(bytes, data.size() * sizeof(uint64_t), "<memory>"));
+}
+
+TEST(PcrIndexTest, FindPos) {
+  PcrIndex index;
+  EXPECT_EQ(0, index.FindPos(0));
+
+  AddRecords(&index);
+  EXPECT_EQ(0, index.FindPos(-1));
+  EXPECT_EQ(1000, index.FindPos(0));
+  EXPECT_EQ(1000, index.FindPos(999));
+  EXPECT_EQ(1100, index.FindPos(1000));
+  EXPECT_EQ(1400, index.FindPos(10000));
+}
+
+TEST(PcrIndexTest, LoadBrokenFile) {
+  auto file = std::make_unique<MockFile>();
+  EXPECT_CALL(*file, Read).WillRepeatedly([](uint8_t* buf, size_t len) {
+    std::memset(buf, 0, len);
+    return static_cast<ssize_t>(len);
+  });
+  PcrIndex index;
+  EXPECT_FALSE(index.Load(file.get()));
+}
+
+TEST(PcrIndexTest, Indexer) {
+  StreamGeneratorOption generator_option;
+  generator_option.duration = 5000;
+  StreamGenerator generator(generator_option);
+
+  PcrIndexerOption option;
+  option.interval = 1024 * 1024;
+  auto indexer = std::make_unique<PcrIndexer>(option);
+  auto* indexer_ptr = indexer.get();
+
+  MockSource src;
+  EXPECT_CALL(src, GetNextPacket).WillRepeatedly(
+      [&generator](ts::TSPacket* packet) {
+        return generator.Next(packet);
+      });
+  src.Connect(std::move(indexer));
+  EXPECT_TRUE(src.FeedPackets());
+
+  const auto& index = indexer_ptr->index();
+  EXPECT_EQ(StreamGenerator::kBaseSid, index.header().sid);
+  EXPECT_EQ(option.interval, index.header().interval);
+
+  // 32Mbps * 5s / 1MiB
+  const auto& records = index.records();
+  ASSERT_GE(records.size(), 18);
+  ASSERT_LE(records.size(), 20);
+  for (size_t i = 0; i < records.size(); ++i) {
+    EXPECT_EQ(0, records[i].pos % ts::PKT_SIZE);
+    EXPECT_TRUE(IsValidPcr(records[i].pcr));
+    if (i > 0) {
+      EXPECT_GE(records[i].pos / option.interval, i);
+      EXPECT_GT(records[i].pos, records[i - 1].pos);
+      if (records[i - 1].HasTime()) {
+        EXPECT_TRUE(records[i].HasTime());
+        EXPECT_GE(records[i].time, records[i - 1].time);
+      }
+    }
+  }
+  const auto& last = records.back();
+  EXPECT_TRUE(last.HasTime());
+  EXPECT_NE(0, last.flags & PcrIndexRecord::kHasEid);
+  EXPECT_NE(0, last.flags & PcrIndexRecord::kHasPatVersion);
+  EXPECT_NE(0, last.flags & PcrIndexRecord::kHasPmtVersion);
+}
+
+TEST(PcrIndexTest, IndexerPcrWrapAround) {
+  PcrIndexerOption option;
+  option.interval = ts::PKT_SIZE;
+  auto indexer = std::make_unique<PcrIndexer>(option);
+  auto* indexer_ptr = indexer.get();
+
+  // TDT tables are used for emulating PCR packets.
+  //
+  // The present section of the EIT p/f is empty.  The section #1 contains
+  // Event#0005 which starts at 2021-01-01 00:00:01.
+  TableSource src;
+  src.LoadXml(R"(
+    <?xml version="1.0" encoding="utf-8"?>
+    <tsduck>
+      <PAT version="1" current="true" transport_stream_id="0x0002"
+           test-pid="0x0000">
+        <service service_id="0x0003" program_map_PID="0x0101" />
+      </PAT>
+      <PMT version="1" current="true" service_id="0x0003" PCR_PID="0x901"
+           test-pid="0x0101">
+        <component elementary_PID="0x0301" stream_type="0x02" />
+      </PMT>
+      <TOT UTC_time="2021-01-01 00:00:00" test-pid="0x0014" />
+      <TDT UTC_time="1970-01-01 00:00:00" test-pid="0x0901"
+           test-pcr="2576953377600" />
+      <generic_long_table table_id="0x4E" table_id_ext="0x0003" version="1"
+                          test-pid="0x0012">
+        <section>00 02 00 01 01 4E</section>
+        <section>
+          00 02 00 01 01 4E
+          00 05 E7 4F 00 00 01 00 00 01 10 00
+        </section>
+      </generic_long_table>
+      <TDT UTC_time="1970-01-01 00:00:00" test-pid="0x0901" test-pcr="1000" />
+    </tsduck>
+  )");
+  src.Connect(std::move(indexer));
+  EXPECT_TRUE(src.FeedPackets());
+  EXPECT_TRUE(src.IsEmpty());
+
+  const auto& records = indexer_ptr->index().records();
+  ASSERT_EQ(2, records.size());
+
+  EXPECT_TRUE(records[0].HasTime());
+  EXPECT_EQ(1609426800000, records[0].time);
+  EXPECT_EQ(0, records[0].flags & PcrIndexRecord::kHasEid);
+  EXPECT_EQ(0, records[0].flags & PcrIndexRecord::kHasNextEid);
+
+  // The PCR has wrapped around 1s after the TOT.
+  EXPECT_TRUE(records[1].HasTime());
+  EXPECT_EQ(1609426801000, records[1].time);
+  EXPECT_EQ(0, records[1].flags & PcrIndexRecord::kHasEid);
+  EXPECT_NE(0, records[1].flags & PcrIndexRecord::kHasNextEid);
+  EXPECT_EQ(5, records[1].next_eid);
+}
@@ -1,3 +1,4 @@
+#include <cstring>
 #include <memory>
 
 #include <fmt/format.h>
@@ -6,6 +7,7 @@
 #include <tsduck/tsduck.h>
 
 #include "program_filter.hh"
+#include "service_filter.hh"
 
 #include "test_helper.hh"
 
@@ -152,6 +154,129 @@ TEST(ProgramFilterTest, WaitReady) {
   EXPECT_TRUE(src.IsEmpty());
 }
 
+TEST(ProgramFilterTest, SharedPsiState) {
+  TableSource src;
+  // Tables are parsed once in the PsiState fed by the ServiceFilter.
+  auto psi = std::make_shared<PsiState>(kOption.sid);
+  auto service_filter = std::make_unique<BasicServiceFilter<ProgramFilter>>(
+      ServiceFilterOption { kOption.sid }, psi);
+  auto filter = std::make_unique<ProgramFilter>(kOption, psi);
+  auto sink = std::make_unique<MockSink>();
+
+  // TDT tables are used for emulating PES and PCR packets.
+  src.LoadXml(R"(
+    <?xml version="1.0" encoding="utf-8"?>
+    <tsduck>
+      <PAT version="1" current="true" transport_stream_id="0x1234"
+           test-pid="0x0000">
+        <service service_id="0x0001" program_map_PID="0x0101" />
+        <service service_id="0x0002" program_map_PID="0x0102" />
+      </PAT>
+      <PMT version="1" current="true" service_id="0x0001" PCR_PID="0x0901"
+           test-pid="0x0101">
+        <component elementary_PID="0x0301" stream_type="0x02" />
+        <component elementary_PID="0x0302" stream_type="0x0F" />
+      </PMT>
+      <EIT type="pf" version="1" current="true" actual="true"
+           service_id="0x0001" transport_stream_id="0x1234"
+           original_network_id="0x0001" last_table_id="0x4E"
+           test-pid="0x0012">
+        <event event_id="0x1000" start_time="1970-01-01 00:00:00"
+               duration="00:00:01" running_status="undefined" CA_mode="true" />
+        <event event_id="0x1001" start_time="1970-01-01 00:00:01"
+               duration="01:00:00" running_status="undefined" CA_mode="true" />
+      </EIT>
+      <TDT UTC_time="1970-01-01 00:00:00" test-pid="0x0901"
+           test-pcr="0" />
+      <TDT UTC_time="1970-01-01 00:00:00" test-pid="0x0301" />
+      <TDT UTC_time="1970-01-01 00:00:00" test-pid="0x0302" />
+      <TDT UTC_time="1970-01-01 00:00:01" test-pid="0x0901" test-cc="1"
+           test-pcr="27000000"/>
+      <TDT UTC_time="1975-01-01 00:00:00" test-pid="0x0301" test-cc="1" />
+      <TDT UTC_time="1975-01-01 00:00:00" test-pid="0x0302" test-cc="1" />
+      <PAT version="1" current="true" transport_stream_id="0x1234"
+           test-pid="0x0000" test-cc="1">
+        <service service_id="0x0001" program_map_PID="0x0101" />
+        <service service_id="0x0002" program_map_PID="0x0102" />
+      </PAT>
+      <PMT version="1" current="true" service_id="0x0001" PCR_PID="0x0901"
+           test-pid="0x0101" test-cc="1">
+        <component elementary_PID="0x0301" stream_type="0x02" />
+        <component elementary_PID="0x0302" stream_type="0x0F" />
+      </PMT>
+      <TDT UTC_time="1975-01-01 00:00:00" test-pid="0x0301" test-cc="2" />
+      <TDT UTC_time="1975-01-01 00:00:00" test-pid="0x0302" test-cc="2" />
+   </tsduck>
+  )");
+
+  {
+    testing::InSequence seq;
+    EXPECT_CALL(*sink, Start).Times(1);
+    EXPECT_CALL(*sink, HandlePacket).WillOnce(
+        [](const ts::TSPacket& packet) {
+          EXPECT_EQ(ts::PID_PAT, packet.getPID());
+          EXPECT_EQ(0, packet.getCC());
+          return true;
+        });
+    EXPECT_CALL(*sink, HandlePacket).WillOnce(
+        [](const ts::TSPacket& packet) {
+          EXPECT_EQ(0x0101, packet.getPID());
+          EXPECT_EQ(0, packet.getCC());
+          return true;
+        });
+    EXPECT_CALL(*sink, HandlePacket).WillOnce(
+        [](const ts::TSPacket& packet) {
+          EXPECT_EQ(0x0901, packet.getPID());
+          EXPECT_EQ(27000000, packet.getPCR());
+          EXPECT_EQ(1, packet.getCC());
+          return true;
+        });
+    EXPECT_CALL(*sink, HandlePacket).WillOnce(
+        [](const ts::TSPacket& packet) {
+          EXPECT_EQ(0x0301, packet.getPID());
+          EXPECT_EQ(1, packet.getCC());
+          return true;
+        });
+    EXPECT_CALL(*sink, HandlePacket).WillOnce(
+        [](const ts::TSPacket& packet) {
+          EXPECT_EQ(0x0302, packet.getPID());
+          EXPECT_EQ(1, packet.getCC());
+          return true;
+        });
+    EXPECT_CALL(*sink, HandlePacket).WillOnce(
+        [](const ts::TSPacket& packet) {
+          EXPECT_EQ(ts::PID_PAT, packet.getPID());
+          EXPECT_EQ(1, packet.getCC());
+          return true;
+        });
+    EXPECT_CALL(*sink, HandlePacket).WillOnce(
+        [](const ts::TSPacket& packet) {
+          EXPECT_EQ(0x0101, packet.getPID());
+          EXPECT_EQ(1, packet.getCC());
+          return true;
+        });
+    EXPECT_CALL(*sink, HandlePacket).WillOnce(
+        [](const ts::TSPacket& packet) {
+          EXPECT_EQ(0x0301, packet.getPID());
+          EXPECT_EQ(2, packet.getCC());
+          return true;
+        });
+    EXPECT_CALL(*sink, HandlePacket).WillOnce(
+        [](const ts::TSPacket& packet) {
+          EXPECT_EQ(0x0302, packet.getPID());
+          EXPECT_EQ(2, packet.getCC());
+          return true;
+        });
+    EXPECT_CALL(*sink, End).WillOnce(testing::Return(true));
+  }
+
+  filter->Connect(std::move(sink));
+  service_filter->Connect(std::move(filter));
+  src.Connect(std::move(service_filter));
+  EXPECT_TRUE(src.FeedPackets());
+  EXPECT_TRUE(src.IsEmpty());
+}
+
 TEST(ProgramFilterTest, AlreadyStarted) {
   TableSource src;
   auto filter = std::make_unique<ProgramFilter>(kOption);
@@ -1607,6 +1732,7 @@ TEST(ProgramFilterTest, PesBlackList) {
    </tsduck>
   )");
 
+  ts::TSPacket pmt_packet;
   {
     testing::InSequence seq;
     EXPECT_CALL(*sink, Start).Times(1);
@@ -1617,11 +1743,12 @@ TEST(ProgramFilterTest, PesBlackList) {
           return true;
         });
     EXPECT_CALL(*sink, HandlePacket).WillOnce(
-        [](const ts::TSPacket& packet) {
+        [&pmt_packet](const ts::TSPacket& packet) {
           EXPECT_EQ(0x0101, packet.getPID());
           EXPECT_EQ(0, packet.getCC());
           // TODO: check if the packet contains only one entry for the video
           // stream.
+          pmt_packet = packet;
           return true;
         });
     EXPECT_CALL(*sink, HandlePacket).WillOnce(
@@ -1643,12 +1770,352 @@ TEST(ProgramFilterTest, PesBlackList) {
           EXPECT_EQ(1, packet.getCC());
           return true;
         });
+    EXPECT_CALL(*sink, HandlePacket).WillOnce(
+        [&pmt_packet](const ts::TSPacket& packet) {
+          EXPECT_EQ(0x0101, packet.getPID());
+          EXPECT_EQ(1, packet.getCC());
+          // The cached packet is sent again with the CC updated.
+          EXPECT_EQ(0, std::memcmp(packet.b + 4, pmt_packet.b + 4, ts::PKT_SIZE - 4));
+          return true;
+        });
+    EXPECT_CALL(*sink, HandlePacket).WillOnce(
+        [](const ts::TSPacket& packet) {
+          EXPECT_EQ(0x0301, packet.getPID());
+          EXPECT_EQ(2, packet.getCC());
+          return true;
+        });
+    EXPECT_CALL(*sink, End).WillOnce(testing::Return(true));
+  }
+
+  filter->Connect(std::move(sink));
+  src.Connect(std::move(filter));
+  EXPECT_TRUE(src.FeedPackets());
+  EXPECT_TRUE(src.IsEmpty());
+}
+
+TEST(ProgramFilterTest, PmtCache) {
+  TableSource src;
+  auto filter = std::make_unique<ProgramFilter>(kOption);
+  auto sink = std::make_unique<MockSink>();
+
+  // The PMT is split into 2 packets.  The same PMT is delivered again after
+  // the second PAT.
+  //
+  // TDT tables are used for emulating PCR packets.
+  src.LoadXml(R"(
+    <?xml version="1.0" encoding="utf-8"?>
+    <tsduck>
+      <PAT version="1" current="true" transport_stream_id="0x1234"
+           test-pid="0x0000">
+        <service service_id="0x0001" program_map_PID="0x0101" />
+      </PAT>
+      <PMT version="1" current="true" service_id="0x0001" PCR_PID="0x0901"
+           test-pid="0x0101">
+        <component elementary_PID="0x0301" stream_type="0x06">
+          <stream_identifier_descriptor component_tag="0" />
+        </component>
+        <component elementary_PID="0x0302" stream_type="0x06">
+          <stream_identifier_descriptor component_tag="1" />
+        </component>
+        <component elementary_PID="0x0303" stream_type="0x06">
+          <stream_identifier_descriptor component_tag="2" />
+        </component>
+        <component elementary_PID="0x0304" stream_type="0x06">
+          <stream_identifier_descriptor component_tag="3" />
+        </component>
+        <component elementary_PID="0x0305" stream_type="0x06">
+          <stream_identifier_descriptor component_tag="4" />
+        </component>
+        <component elementary_PID="0x0306" stream_type="0x06">
+          <stream_identifier_descriptor component_tag="5" />
+        </component>
+        <component elementary_PID="0x0307" stream_type="0x06">
+          <stream_identifier_descriptor component_tag="6" />
+        </component>
+        <component elementary_PID="0x0308" stream_type="0x06">
+          <stream_identifier_descriptor component_tag="7" />
+        </component>
+        <component elementary_PID="0x0309" stream_type="0x06">
+          <stream_identifier_descriptor component_tag="8" />
+        </component>
+        <component elementary_PID="0x030A" stream_type="0x06">
+          <stream_identifier_descriptor component_tag="9" />
+        </component>
+        <component elementary_PID="0x030B" stream_type="0x06">
+          <stream_identifier_descriptor component_tag="10" />
+        </component>
+        <component elementary_PID="0x030C" stream_type="0x06">
+          <stream_identifier_descriptor component_tag="11" />
+        </component>
+        <component elementary_PID="0x030D" stream_type="0x06">
+          <stream_identifier_descriptor component_tag="12" />
+        </component>
+        <component elementary_PID="0x030E" stream_type="0x06">
+          <stream_identifier_descriptor component_tag="13" />
+        </component>
+        <component elementary_PID="0x030F" stream_type="0x06">
+          <stream_identifier_descriptor component_tag="14" />
+        </component>
+        <component elementary_PID="0x0310" stream_type="0x06">
+          <stream_identifier_descriptor component_tag="15" />
+        </component>
+        <component elementary_PID="0x0311" stream_type="0x06">
+          <stream_identifier_descriptor component_tag="16" />
+        </component>
+        <component elementary_PID="0x0312" stream_type="0x06">
+          <stream_identifier_descriptor component_tag="17" />
+        </component>
+        <component elementary_PID="0x0313" stream_type="0x06">
+          <stream_identifier_descriptor component_tag="18" />
+        </component>
+        <component elementary_PID="0x0314" stream_type="0x06">
+          <stream_identifier_descriptor component_tag="19" />
+        </component>
+        <component elementary_PID="0x0315" stream_type="0x06">
+          <stream_identifier_descriptor component_tag="20" />
+        </component>
+        <component elementary_PID="0x0316" stream_type="0x06">
+          <stream_identifier_descriptor component_tag="21" />
+        </component>
+        <component elementary_PID="0x0317" stream_type="0x06">
+          <stream_identifier_descriptor component_tag="22" />
+        </component>
+        <component elementary_PID="0x0318" stream_type="0x06">
+          <stream_identifier_descriptor component_tag="23" />
+        </component>
+      </PMT>
+      <EIT type="pf" version="1" current="true" actual="true"
+           service_id="0x0001" transport_stream_id="0x1234"
+           original_network_id="0x0001" last_table_id="0x4E"
+           test-pid="0x0012">
+        <event event_id="0x1000" start_time="1970-01-01 00:00:00"
+               duration="00:00:01" running_status="undefined" CA_mode="true" />
+        <event event_id="0x1001" start_time="1970-01-01 00:00:01"
+               duration="01:00:00" running_status="undefined" CA_mode="true" />
+      </EIT>
+      <TDT UTC_time="1970-01-01 00:00:00" test-pid="0x0901"
+           test-pcr="0" />
+      <TDT UTC_time="1970-01-01 00:00:01" test-pid="0x0901" test-cc="1"
+           test-pcr="27000000"/>
+      <PAT version="1" current="true" transport_stream_id="0x1234"
+           test-pid="0x0000" test-cc="1">
+        <service service_id="0x0001" program_map_PID="0x0101" />
+      </PAT>
+      <PMT version="1" current="true" service_id="0x0001" PCR_PID="0x0901"
+           test-pid="0x0101" test-cc="2">
+        <component elementary_PID="0x0301" stream_type="0x06">
+          <stream_identifier_descriptor component_tag="0" />
+        </component>
+        <component elementary_PID="0x0302" stream_type="0x06">
+          <stream_identifier_descriptor component_tag="1" />
+        </component>
+        <component elementary_PID="0x0303" stream_type="0x06">
+          <stream_identifier_descriptor component_tag="2" />
+        </component>
+        <component elementary_PID="0x0304" stream_type="0x06">
+          <stream_identifier_descriptor component_tag="3" />
+        </component>
+        <component elementary_PID="0x0305" stream_type="0x06">
+          <stream_identifier_descriptor component_tag="4" />
+        </component>
+        <component elementary_PID="0x0306" stream_type="0x06">
+          <stream_identifier_descriptor component_tag="5" />
+        </component>
+        <component elementary_PID="0x0307" stream_type="0x06">
+          <stream_identifier_descriptor component_tag="6" />
+        </component>
+        <component elementary_PID="0x0308" stream_type="0x06">
+          <stream_identifier_descriptor component_tag="7" />
+        </component>
+        <component elementary_PID="0x0309" stream_type="0x06">
+          <stream_identifier_descriptor component_tag="8" />
+        </component>
+        <component elementary_PID="0x030A" stream_type="0x06">
+          <stream_identifier_descriptor component_tag="9" />
+        </component>
+        <component elementary_PID="0x030B" stream_type="0x06">
+          <stream_identifier_descriptor component_tag="10" />
+        </component>
+        <component elementary_PID="0x030C" stream_type="0x06">
+          <stream_identifier_descriptor component_tag="11" />
+        </component>
+        <component elementary_PID="0x030D" stream_type="0x06">
+          <stream_identifier_descriptor component_tag="12" />
+        </component>
+        <component elementary_PID="0x030E" stream_type="0x06">
+          <stream_identifier_descriptor component_tag="13" />
+        </component>
+        <component elementary_PID="0x030F" stream_type="0x06">
+          <stream_identifier_descriptor component_tag="14" />
+        </component>
+        <component elementary_PID="0x0310" stream_type="0x06">
+          <stream_identifier_descriptor component_tag="15" />
+        </component>
+        <component elementary_PID="0x0311" stream_type="0x06">
+          <stream_identifier_descriptor component_tag="16" />
+        </component>
+        <component elementary_PID="0x0312" stream_type="0x06">
+          <stream_identifier_descriptor component_tag="17" />
+        </component>
+        <component elementary_PID="0x0313" stream_type="0x06">
+          <stream_identifier_descriptor component_tag="18" />
+        </component>
+        <component elementary_PID="0x0314" stream_type="0x06">
+          <stream_identifier_descriptor component_tag="19" />
+        </component>
+        <component elementary_PID="0x0315" stream_type="0x06">
+          <stream_identifier_descriptor component_tag="20" />
+        </component>
+        <component elementary_PID="0x0316" stream_type="0x06">
+          <stream_identifier_descriptor component_tag="21" />
+        </component>
+        <component elementary_PID="0x0317" stream_type="0x06">
+          <stream_identifier_descriptor component_tag="22" />
+        </component>
+        <component elementary_PID="0x0318" stream_type="0x06">
+          <stream_identifier_descriptor component_tag="23" />
+        </component>
+      </PMT>
+    </tsduck>
+  )");
+
+  ts::TSPacket pmt_packets[2];
+  {
+    testing::InSequence seq;
+    EXPECT_CALL(*sink, Start).Times(1);
+    EXPECT_CALL(*sink, HandlePacket).WillOnce(
+        [](const ts::TSPacket& packet) {
+          EXPECT_EQ(ts::PID_PAT, packet.getPID());
+          EXPECT_EQ(0, packet.getCC());
+          return true;
+        });
+    EXPECT_CALL(*sink, HandlePacket).WillOnce(
+        [&pmt_packets](const ts::TSPacket& packet) {
+          EXPECT_EQ(0x0101, packet.getPID());
+          EXPECT_EQ(0, packet.getCC());
+          EXPECT_TRUE(packet.getPUSI());
+          pmt_packets[0] = packet;
+          return true;
+        });
+    EXPECT_CALL(*sink, HandlePacket).WillOnce(
+        [&pmt_packets](const ts::TSPacket& packet) {
+          EXPECT_EQ(0x0101, packet.getPID());
+          EXPECT_EQ(1, packet.getCC());
+          EXPECT_FALSE(packet.getPUSI());
+          pmt_packets[1] = packet;
+          return true;
+        });
+    EXPECT_CALL(*sink, HandlePacket).WillOnce(
+        [](const ts::TSPacket& packet) {
+          EXPECT_EQ(0x0901, packet.getPID());
+          EXPECT_EQ(27000000, packet.getPCR());
+          return true;
+        });
+    EXPECT_CALL(*sink, HandlePacket).WillOnce(
+        [](const ts::TSPacket& packet) {
+          EXPECT_EQ(ts::PID_PAT, packet.getPID());
+          EXPECT_EQ(1, packet.getCC());
+          return true;
+        });
+    EXPECT_CALL(*sink, HandlePacket).WillOnce(
+        [&pmt_packets](const ts::TSPacket& packet) {
+          EXPECT_EQ(0x0101, packet.getPID());
+          EXPECT_EQ(2, packet.getCC());
+          EXPECT_EQ(0, std::memcmp(packet.b + 4, pmt_packets[0].b + 4, ts::PKT_SIZE - 4));
+          return true;
+        });
+    // The PMT completed by the previous packet is unchanged.  So, the cached
+    // packets are not rebuilt and the second packet follows.
+    EXPECT_CALL(*sink, HandlePacket).WillOnce(
+        [&pmt_packets](const ts::TSPacket& packet) {
+          EXPECT_EQ(0x0101, packet.getPID());
+          EXPECT_EQ(3, packet.getCC());
+          EXPECT_FALSE(packet.getPUSI());
+          EXPECT_EQ(0, std::memcmp(packet.b + 4, pmt_packets[1].b + 4, ts::PKT_SIZE - 4));
+          return true;
+        });
+    EXPECT_CALL(*sink, End).WillOnce(testing::Return(true));
+  }
+
+  filter->Connect(std::move(sink));
+  src.Connect(std::move(filter));
+  EXPECT_TRUE(src.FeedPackets());
+  EXPECT_TRUE(src.IsEmpty());
+}
+
+TEST(ProgramFilterTest, KeyframeStart) {
+  auto option = kOption;
+  option.keyframe_start = true;
+  TableSource src;
+  auto filter = std::make_unique<ProgramFilter>(option);
+  auto sink = std::make_unique<MockSink>();
+
+  // TDT tables are used for emulating PES and PCR packets.
+  src.LoadXml(R"(
+    <?xml version="1.0" encoding="utf-8"?>
+    <tsduck>
+      <PAT version="1" current="true" transport_stream_id="0x1234"
+           test-pid="0x0000">
+        <service service_id="0x0001" program_map_PID="0x0101" />
+      </PAT>
+      <PMT version="1" current="true" service_id="0x0001" PCR_PID="0x0901"
+           test-pid="0x0101">
+        <component elementary_PID="0x0301" stream_type="0x02" />
+        <component elementary_PID="0x0302" stream_type="0x0F" />
+      </PMT>
+      <EIT type="pf" version="1" current="true" actual="true"
+           service_id="0x0001" transport_stream_id="0x1234"
+           original_network_id="0x0001" last_table_id="0x4E"
+           test-pid="0x0012">
+        <event event_id="0x1000" start_time="1970-01-01 00:00:00"
+               duration="00:00:01" running_status="undefined" CA_mode="true" />
+        <event event_id="0x1001" start_time="1970-01-01 00:00:01"
+               duration="01:00:00" running_status="undefined" CA_mode="true" />
+      </EIT>
+      <TDT UTC_time="1970-01-01 00:00:00" test-pid="0x0901"
+           test-pcr="0" />
+      <TDT UTC_time="1970-01-01 00:00:00" test-pid="0x0301" />
+      <TDT UTC_time="1970-01-01 00:00:00" test-pid="0x0301" test-cc="1"
+           test-rai="1" />
+      <TDT UTC_time="1970-01-01 00:00:00" test-pid="0x0302" />
+      <TDT UTC_time="1970-01-01 00:00:01" test-pid="0x0901" test-cc="1"
+           test-pcr="27000000"/>
+      <TDT UTC_time="1975-01-01 00:00:00" test-pid="0x0301" test-cc="2" />
+   </tsduck>
+  )");
+
+  {
+    testing::InSequence seq;
+    EXPECT_CALL(*sink, Start).Times(1);
+    EXPECT_CALL(*sink, HandlePacket).WillOnce(
+        [](const ts::TSPacket& packet) {
+          EXPECT_EQ(ts::PID_PAT, packet.getPID());
+          EXPECT_EQ(0, packet.getCC());
+          return true;
+        });
     EXPECT_CALL(*sink, HandlePacket).WillOnce(
         [](const ts::TSPacket& packet) {
           EXPECT_EQ(0x0101, packet.getPID());
+          EXPECT_EQ(0, packet.getCC());
+          return true;
+        });
+    EXPECT_CALL(*sink, HandlePacket).WillOnce(
+        [](const ts::TSPacket& packet) {
+          EXPECT_EQ(0x0301, packet.getPID());
+          EXPECT_EQ(1, packet.getCC());
+          return true;
+        });
+    EXPECT_CALL(*sink, HandlePacket).WillOnce(
+        [](const ts::TSPacket& packet) {
+          EXPECT_EQ(0x0302, packet.getPID());
+          EXPECT_EQ(0, packet.getCC());
+          return true;
+        });
+    EXPECT_CALL(*sink, HandlePacket).WillOnce(
+        [](const ts::TSPacket& packet) {
+          EXPECT_EQ(0x0901, packet.getPID());
+          EXPECT_EQ(27000000, packet.getPCR());
           EXPECT_EQ(1, packet.getCC());
-          // TODO: check if the packet contains only one entry for the video
-          // stream.
           return true;
         });
     EXPECT_CALL(*sink, HandlePacket).WillOnce(
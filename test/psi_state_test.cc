@@ -0,0 +1,153 @@
+#include <memory>
+
+#include <fmt/format.h>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <tsduck/tsduck.h>
+
+#include "psi_state.hh"
+
+#include "test_helper.hh"
+
+namespace {
+
+class PsiStateFeeder final : public PacketSink {
+ public:
+  explicit PsiStateFeeder(const std::shared_ptr<PsiState>& psi) : psi_(psi) {}
+  ~PsiStateFeeder() override {}
+
+  bool HandlePacket(const ts::TSPacket& packet) override {
+    psi_->FeedPacket(packet);
+    return true;
+  }
+
+ private:
+  std::shared_ptr<PsiState> psi_;
+};
+
+class MockPsiObserver final : public PsiObserver {
+ public:
+  MockPsiObserver() {}
+  ~MockPsiObserver() override {}
+
+  MOCK_METHOD(void, OnPat, (const ts::PAT&), (override));
+  MOCK_METHOD(void, OnCat, (const ts::CAT&), (override));
+  MOCK_METHOD(void, OnPmt, (const ts::PMT&, ts::PID), (override));
+  MOCK_METHOD(void, OnEit, (const std::shared_ptr<ts::EIT>&), (override));
+  MOCK_METHOD(void, OnTime, (const ts::Time&), (override));
+};
+
+}  // namespace
+
+TEST(PsiStateTest, Subscribe) {
+  TableSource src;
+  auto psi = std::make_shared<PsiState>(0x0001);
+  MockPsiObserver pmt_observer;
+  MockPsiObserver eit_observer;
+
+  src.LoadXml(R"(
+    <?xml version="1.0" encoding="utf-8"?>
+    <tsduck>
+      <PMT version="1" current="true" service_id="0x0001" PCR_PID="0x0901"
+           test-pid="0x0101">
+        <component elementary_PID="0x0301" stream_type="0x02" />
+      </PMT>
+      <PAT version="1" current="true" transport_stream_id="0x1234"
+           test-pid="0x0000">
+        <service service_id="0x0001" program_map_PID="0x0101" />
+        <service service_id="0x0002" program_map_PID="0x0102" />
+      </PAT>
+      <PMT version="1" current="true" service_id="0x0002" PCR_PID="0x0902"
+           test-pid="0x0102">
+        <component elementary_PID="0x0302" stream_type="0x02" />
+      </PMT>
+      <PMT version="1" current="true" service_id="0x0001" PCR_PID="0x0901"
+           test-pid="0x0101" test-cc="1">
+        <component elementary_PID="0x0301" stream_type="0x02" />
+      </PMT>
+      <EIT type="pf" version="1" current="true" actual="true"
+           service_id="0x0002" transport_stream_id="0x1234"
+           original_network_id="0x0001" last_table_id="0x4E"
+           test-pid="0x0012">
+        <event event_id="0x2000" start_time="1970-01-01 00:00:00"
+               duration="00:00:01" running_status="undefined" CA_mode="true" />
+      </EIT>
+      <EIT type="pf" version="1" current="true" actual="true"
+           service_id="0x0001" transport_stream_id="0x1234"
+           original_network_id="0x0001" last_table_id="0x4E"
+           test-pid="0x0012" test-cc="1">
+        <event event_id="0x1000" start_time="1970-01-01 00:00:00"
+               duration="00:00:01" running_status="undefined" CA_mode="true" />
+      </EIT>
+      <TDT UTC_time="1970-01-01 00:00:01" test-pid="0x0014" />
+    </tsduck>
+  )");
+
+  psi->Subscribe(&pmt_observer, kPsiPmt);
+  psi->Subscribe(&eit_observer, kPsiEit | kPsiTime);
+
+  EXPECT_CALL(pmt_observer, OnPat).Times(0);
+  EXPECT_CALL(pmt_observer, OnCat).Times(0);
+  EXPECT_CALL(pmt_observer, OnEit).Times(0);
+  EXPECT_CALL(pmt_observer, OnTime).Times(0);
+  // The PMT before the PAT is not demuxed.
+  EXPECT_CALL(pmt_observer, OnPmt).WillOnce(
+      [](const ts::PMT& pmt, ts::PID pid) {
+        EXPECT_EQ(0x0001, pmt.service_id);
+        EXPECT_EQ(0x0101, pid);
+      });
+
+  EXPECT_CALL(eit_observer, OnPat).Times(0);
+  EXPECT_CALL(eit_observer, OnCat).Times(0);
+  EXPECT_CALL(eit_observer, OnPmt).Times(0);
+  EXPECT_CALL(eit_observer, OnEit).WillOnce(
+      [](const std::shared_ptr<ts::EIT>& eit) {
+        EXPECT_EQ(0x0001, eit->service_id);
+        EXPECT_EQ(0x1000, eit->events[0].event_id);
+      });
+  EXPECT_CALL(eit_observer, OnTime).WillOnce(
+      [](const ts::Time& time) {
+        EXPECT_EQ(ts::Time(1970, 1, 1, 0, 0, 1), time);
+      });
+
+  src.Connect(std::make_unique<PsiStateFeeder>(psi));
+  EXPECT_TRUE(src.FeedPackets());
+  EXPECT_TRUE(src.IsEmpty());
+
+  EXPECT_EQ(0x0101, psi->pmt_pid());
+  ASSERT_TRUE(psi->pmt());
+  EXPECT_EQ(0x0901, psi->pmt()->pcr_pid);
+  ASSERT_TRUE(psi->eit());
+  EXPECT_EQ(0x1000, psi->eit()->events[0].event_id);
+  ASSERT_TRUE(psi->time().has_value());
+  EXPECT_EQ(ts::Time(1970, 1, 1, 0, 0, 1), psi->time().value());
+
+  psi->Unsubscribe(&pmt_observer);
+  psi->Unsubscribe(&eit_observer);
+}
+
+TEST(PsiStateTest, Unsubscribe) {
+  TableSource src;
+  auto psi = std::make_shared<PsiState>(0x0001);
+  MockPsiObserver observer;
+
+  src.LoadXml(R"(
+    <?xml version="1.0" encoding="utf-8"?>
+    <tsduck>
+      <PAT version="1" current="true" transport_stream_id="0x1234"
+           test-pid="0x0000">
+        <service service_id="0x0001" program_map_PID="0x0101" />
+      </PAT>
+    </tsduck>
+  )");
+
+  psi->Subscribe(&observer, kPsiPat);
+  psi->Unsubscribe(&observer);
+
+  EXPECT_CALL(observer, OnPat).Times(0);
+
+  src.Connect(std::make_unique<PsiStateFeeder>(psi));
+  EXPECT_TRUE(src.FeedPackets());
+  EXPECT_TRUE(src.IsEmpty());
+  EXPECT_EQ(0x0101, psi->pmt_pid());
+}
@@ -0,0 +1,117 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "session_server.hh"
+
+namespace {
+
+std::string MakeSocketPath() {
+  return testing::TempDir() + "mirakc-arib-session-server-test.sock";
+}
+
+std::string ReadAll(int fd) {
+  std::string str;
+  char buf[256];
+  ssize_t nread;
+  while ((nread = read(fd, buf, sizeof(buf))) > 0) {
+    str.append(buf, nread);
+  }
+  return str;
+}
+
+}  // namespace
+
+TEST(SessionServerTest, RunSession) {
+  const auto path = MakeSocketPath();
+  SessionServer server(path, [](const std::vector<std::string>& args) {
+    auto str = fmt::format("{}", fmt::join(args, " "));
+    auto nwritten = write(STDOUT_FILENO, str.data(), str.size());
+    return nwritten == static_cast<ssize_t>(str.size()) ? 3 : 0;
+  });
+  ASSERT_TRUE(server.Listen());
+
+  int out[2];
+  ASSERT_EQ(0, pipe(out));
+
+  int code = -1;
+  std::thread client([&path, &out, &code] {
+    const int fds[] = { STDIN_FILENO, out[1], STDERR_FILENO };
+    code = RunRemoteSession(path, { "track-airtime", "--sid=1" }, fds);
+  });
+  EXPECT_TRUE(server.ServeOne());
+  client.join();
+  close(out[1]);
+
+  EXPECT_EQ(3, code);
+  EXPECT_EQ("track-airtime --sid=1", ReadAll(out[0]));
+  close(out[0]);
+}
+
+TEST(SessionServerTest, KilledSession) {
+  const auto path = MakeSocketPath();
+  SessionServer server(path, [](const std::vector<std::string>&) -> int {
+    std::abort();
+  });
+  ASSERT_TRUE(server.Listen());
+
+  int code = -1;
+  std::thread client([&path, &code] {
+    const int fds[] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+    code = RunRemoteSession(path, { "print-pes" }, fds);
+  });
+  EXPECT_TRUE(server.ServeOne());
+  client.join();
+
+  EXPECT_EQ(128 + SIGABRT, code);
+}
+
+TEST(SessionServerTest, NoFds) {
+  const auto path = MakeSocketPath();
+  SessionServer server(path, [](const std::vector<std::string>&) {
+    return 0;
+  });
+  ASSERT_TRUE(server.Listen());
+
+  std::thread client([&path] {
+    auto sock = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    struct sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    std::strcpy(addr.sun_path, path.c_str());
+    ASSERT_EQ(0, connect(
+        sock, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)));
+    const char kArgs[] = "print-pes";
+    ASSERT_EQ(sizeof(kArgs), send(sock, kArgs, sizeof(kArgs), 0));
+    uint32_t code;
+    EXPECT_EQ(0, recv(sock, &code, sizeof(code), 0));  // closed
+    close(sock);
+  });
+  EXPECT_TRUE(server.ServeOne());
+  client.join();
+}
+
+TEST(SessionServerTest, NotSocket) {
+  const auto path = MakeSocketPath();
+  auto fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  ASSERT_LE(0, fd);
+  close(fd);
+
+  {
+    SessionServer server(path, [](const std::vector<std::string>&) {
+      return 0;
+    });
+    EXPECT_FALSE(server.Listen());
+  }
+
+  // The regular file must not be removed.
+  EXPECT_EQ(0, access(path.c_str(), F_OK));
+  unlink(path.c_str());
+}
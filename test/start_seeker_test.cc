@@ -1,3 +1,4 @@
+#include <cstring>
 #include <memory>
 
 #include <fmt/format.h>
@@ -529,3 +530,280 @@ TEST(StartSeekerTest, PmtSidUnmatched) {
   EXPECT_TRUE(src.FeedPackets());
   EXPECT_TRUE(src.IsEmpty());
 }
+
+TEST(StartSeekerTest, ManyPackets) {
+  // More than the number of packets in a block.
+  constexpr uint32_t kNumPackets = 10000;
+
+  MockSource src;
+  StartSeekerOption option = kOption;
+  option.max_packets = kNumPackets;
+  auto filter = std::make_unique<StartSeeker>(option);
+  auto sink = std::make_unique<MockSink>();
+
+  uint32_t num_fed = 0;
+  EXPECT_CALL(src, GetNextPacket).WillRepeatedly(
+      [&num_fed](ts::TSPacket* packet) {
+        if (num_fed == kNumPackets) {
+          return false;  // EOF
+        }
+        *packet = ts::NullPacket;
+        std::memcpy(packet->b + 4, &num_fed, sizeof(num_fed));
+        num_fed++;
+        return true;
+      });
+
+  uint32_t num_handled = 0;
+  EXPECT_CALL(*sink, Start).WillOnce(testing::Return(true));
+  EXPECT_CALL(*sink, HandlePacket).Times(kNumPackets).WillRepeatedly(
+      [&num_handled](const ts::TSPacket& packet) {
+        uint32_t index;
+        std::memcpy(&index, packet.b + 4, sizeof(index));
+        EXPECT_EQ(num_handled, index);
+        num_handled++;
+        return true;
+      });
+  EXPECT_CALL(*sink, End).WillOnce(testing::Return(true));
+
+  filter->Connect(std::move(sink));
+  src.Connect(std::move(filter));
+  EXPECT_TRUE(src.FeedPackets());
+}
+
+TEST(StartSeekerTest, KeyframeStart) {
+  TableSource src;
+  StartSeekerOption option = kOption;
+  option.keyframe_start = true;
+  auto filter = std::make_unique<StartSeeker>(option);
+  auto sink = std::make_unique<MockSink>();
+
+  // TDT tables are used for emulating PCR packets.
+  src.LoadXml(R"(
+    <?xml version="1.0" encoding="utf-8"?>
+    <tsduck>
+      <PAT version="1" current="true" transport_stream_id="0x1234"
+           test-pid="0x0000">
+        <service service_id="0x0001" program_map_PID="0x0101" />
+      </PAT>
+      <PMT version="1" current="true" service_id="0x0001" PCR_PID="0x0901"
+           test-pid="0x0101">
+        <component elementary_PID="0x0301" stream_type="0x02" />
+        <component elementary_PID="0x0302" stream_type="0x0F" />
+      </PMT>
+      <TDT UTC_time="1970-01-01 00:00:00" test-pid="0x0901"
+           test-pcr="0" />
+      <TDT UTC_time="1970-01-01 00:00:00" test-pid="0x0301" />
+      <TDT UTC_time="1970-01-01 00:00:00" test-pid="0x0302" />
+      <PAT version="2" current="true" transport_stream_id="0x1234"
+           test-pid="0x0000" test-cc="1">
+        <service service_id="0x0001" program_map_PID="0x0101" />
+      </PAT>
+      <PMT version="2" current="true" service_id="0x0001" PCR_PID="0x0901"
+           test-pid="0x0101" test-cc="1">
+        <component elementary_PID="0x0301" stream_type="0x02" />
+        <component elementary_PID="0x0302" stream_type="0x0F" />
+        <component elementary_PID="0x0303" stream_type="0x0F" />
+      </PMT>
+      <TDT UTC_time="1970-01-01 00:00:00" test-pid="0x0901" test-cc="1"
+           test-pcr="13500000"/>
+      <TDT UTC_time="1975-01-01 00:00:00" test-pid="0x0301" test-cc="1" />
+      <TDT UTC_time="1975-01-01 00:00:00" test-pid="0x0302" test-cc="1" />
+      <TDT UTC_time="1975-01-01 00:00:00" test-pid="0x0301" test-cc="2"
+           test-rai="1" />
+      <TDT UTC_time="1975-01-01 00:00:00" test-pid="0x0303" test-cc="0" />
+   </tsduck>
+  )");
+
+  {
+    testing::InSequence seq;
+    EXPECT_CALL(*sink, Start).Times(1);
+    EXPECT_CALL(*sink, HandlePacket).WillOnce(
+        [](const ts::TSPacket& packet) {
+          EXPECT_EQ(ts::PID_PAT, packet.getPID());
+          EXPECT_EQ(1, packet.getCC());
+          return true;
+        });
+    EXPECT_CALL(*sink, HandlePacket).WillOnce(
+        [](const ts::TSPacket& packet) {
+          EXPECT_EQ(0x0101, packet.getPID());
+          EXPECT_EQ(1, packet.getCC());
+          return true;
+        });
+    EXPECT_CALL(*sink, HandlePacket).WillOnce(
+        [](const ts::TSPacket& packet) {
+          EXPECT_EQ(0x0901, packet.getPID());
+          EXPECT_EQ(1, packet.getCC());
+          return true;
+        });
+    // PES packets before the keyframe are dropped.
+    EXPECT_CALL(*sink, HandlePacket).WillOnce(
+        [](const ts::TSPacket& packet) {
+          EXPECT_EQ(0x0301, packet.getPID());
+          EXPECT_EQ(2, packet.getCC());
+          return true;
+        });
+    EXPECT_CALL(*sink, HandlePacket).WillOnce(
+        [](const ts::TSPacket& packet) {
+          EXPECT_EQ(0x0303, packet.getPID());
+          EXPECT_EQ(0, packet.getCC());
+          return true;
+        });
+    EXPECT_CALL(*sink, End).WillOnce(testing::Return(true));
+  }
+
+  filter->Connect(std::move(sink));
+  src.Connect(std::move(filter));
+  EXPECT_TRUE(src.FeedPackets());
+  EXPECT_TRUE(src.IsEmpty());
+}
+
+TEST(StartSeekerTest, DetectDiscontinuity) {
+  TableSource src;
+  auto filter = std::make_unique<StartSeeker>(kOption);
+  auto sink = std::make_unique<MockSink>();
+
+  // TDT tables are used for emulating PCR packets.
+  src.LoadXml(R"(
+    <?xml version="1.0" encoding="utf-8"?>
+    <tsduck>
+      <PAT version="1" current="true" transport_stream_id="0x1234"
+           test-pid="0x0000">
+        <service service_id="0x0001" program_map_PID="0x0101" />
+      </PAT>
+      <PMT version="1" current="true" service_id="0x0001" PCR_PID="0x0901"
+           test-pid="0x0101">
+        <component elementary_PID="0x0301" stream_type="0x02" />
+        <component elementary_PID="0x0302" stream_type="0x0F" />
+      </PMT>
+      <TDT UTC_time="1970-01-01 00:00:00" test-pid="0x0901"
+           test-pcr="0" />
+      <TDT UTC_time="1970-01-01 00:00:00" test-pid="0x0301" />
+      <TDT UTC_time="1970-01-01 00:00:00" test-pid="0x0302" />
+      <PAT version="1" current="true" transport_stream_id="0x1234"
+           test-pid="0x0000" test-cc="1">
+        <service service_id="0x0001" program_map_PID="0x0101" />
+      </PAT>
+      <TDT UTC_time="1970-01-01 00:00:00" test-pid="0x0901" test-cc="1"
+           test-pcr="13500000"/>
+      <TDT UTC_time="1975-01-01 00:00:00" test-pid="0x0301" test-cc="5"
+           test-discontinuity="1" />
+      <TDT UTC_time="1975-01-01 00:00:00" test-pid="0x0302" test-cc="1" />
+   </tsduck>
+  )");
+
+  {
+    testing::InSequence seq;
+    EXPECT_CALL(*sink, Start).Times(1);
+    EXPECT_CALL(*sink, HandlePacket).WillOnce(
+        [](const ts::TSPacket& packet) {
+          EXPECT_EQ(ts::PID_PAT, packet.getPID());
+          EXPECT_EQ(1, packet.getCC());
+          return true;
+        });
+    EXPECT_CALL(*sink, HandlePacket).WillOnce(
+        [](const ts::TSPacket& packet) {
+          EXPECT_EQ(0x0901, packet.getPID());
+          EXPECT_EQ(1, packet.getCC());
+          return true;
+        });
+    EXPECT_CALL(*sink, HandlePacket).WillOnce(
+        [](const ts::TSPacket& packet) {
+          EXPECT_EQ(0x0301, packet.getPID());
+          EXPECT_EQ(5, packet.getCC());
+          return true;
+        });
+    EXPECT_CALL(*sink, HandlePacket).WillOnce(
+        [](const ts::TSPacket& packet) {
+          EXPECT_EQ(0x0302, packet.getPID());
+          EXPECT_EQ(1, packet.getCC());
+          return true;
+        });
+    EXPECT_CALL(*sink, End).WillOnce(testing::Return(true));
+  }
+
+  filter->Connect(std::move(sink));
+  src.Connect(std::move(filter));
+  EXPECT_TRUE(src.FeedPackets());
+  EXPECT_TRUE(src.IsEmpty());
+}
+
+TEST(StartSeekerTest, DetectComponentTagsChange) {
+  TableSource src;
+  auto filter = std::make_unique<StartSeeker>(kOption);
+  auto sink = std::make_unique<MockSink>();
+
+  // TDT tables are used for emulating PCR packets.
+  src.LoadXml(R"(
+    <?xml version="1.0" encoding="utf-8"?>
+    <tsduck>
+      <PAT version="1" current="true" transport_stream_id="0x1234"
+           test-pid="0x0000">
+        <service service_id="0x0001" program_map_PID="0x0101" />
+      </PAT>
+      <PMT version="1" current="true" service_id="0x0001" PCR_PID="0x0901"
+           test-pid="0x0101">
+        <component elementary_PID="0x0301" stream_type="0x02">
+          <stream_identifier_descriptor component_tag="0x00" />
+        </component>
+        <component elementary_PID="0x0302" stream_type="0x0F">
+          <stream_identifier_descriptor component_tag="0x10" />
+        </component>
+      </PMT>
+      <TDT UTC_time="1970-01-01 00:00:00" test-pid="0x0901"
+           test-pcr="0" />
+      <TDT UTC_time="1970-01-01 00:00:00" test-pid="0x0301" />
+      <TDT UTC_time="1970-01-01 00:00:00" test-pid="0x0302" />
+      <PAT version="2" current="true" transport_stream_id="0x1234"
+           test-pid="0x0000" test-cc="1">
+        <service service_id="0x0001" program_map_PID="0x0101" />
+      </PAT>
+      <PMT version="2" current="true" service_id="0x0001" PCR_PID="0x0901"
+           test-pid="0x0101" test-cc="1">
+        <component elementary_PID="0x0301" stream_type="0x02">
+          <stream_identifier_descriptor component_tag="0x01" />
+        </component>
+        <component elementary_PID="0x0302" stream_type="0x0F">
+          <stream_identifier_descriptor component_tag="0x10" />
+        </component>
+      </PMT>
+      <TDT UTC_time="1970-01-01 00:00:00" test-pid="0x0901" test-cc="1"
+           test-pcr="13500000"/>
+      <TDT UTC_time="1975-01-01 00:00:00" test-pid="0x0301" test-cc="1" />
+   </tsduck>
+  )");
+
+  {
+    testing::InSequence seq;
+    EXPECT_CALL(*sink, Start).Times(1);
+    EXPECT_CALL(*sink, HandlePacket).WillOnce(
+        [](const ts::TSPacket& packet) {
+          EXPECT_EQ(ts::PID_PAT, packet.getPID());
+          EXPECT_EQ(1, packet.getCC());
+          return true;
+        });
+    EXPECT_CALL(*sink, HandlePacket).WillOnce(
+        [](const ts::TSPacket& packet) {
+          EXPECT_EQ(0x0101, packet.getPID());
+          EXPECT_EQ(1, packet.getCC());
+          return true;
+        });
+    EXPECT_CALL(*sink, HandlePacket).WillOnce(
+        [](const ts::TSPacket& packet) {
+          EXPECT_EQ(0x0901, packet.getPID());
+          EXPECT_EQ(1, packet.getCC());
+          return true;
+        });
+    EXPECT_CALL(*sink, HandlePacket).WillOnce(
+        [](const ts::TSPacket& packet) {
+          EXPECT_EQ(0x0301, packet.getPID());
+          EXPECT_EQ(1, packet.getCC());
+          return true;
+        });
+    EXPECT_CALL(*sink, End).WillOnce(testing::Return(true));
+  }
+
+  filter->Connect(std::move(sink));
+  src.Connect(std::move(filter));
+  EXPECT_TRUE(src.FeedPackets());
+  EXPECT_TRUE(src.IsEmpty());
+}
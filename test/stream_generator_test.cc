@@ -0,0 +1,142 @@
+#include <cstring>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <tsduck/tsduck.h>
+
+#include "service_scanner.hh"
+#include "stream_generator.hh"
+
+#include "test_helper.hh"
+
+namespace {
+
+std::vector<ts::TSPacket> Generate(const StreamGeneratorOption& option) {
+  StreamGenerator generator(option);
+  std::vector<ts::TSPacket> packets;
+  ts::TSPacket packet;
+  while (generator.Next(&packet)) {
+    packets.push_back(packet);
+  }
+  EXPECT_EQ(packets.size(), generator.num_packets());
+  return packets;
+}
+
+StreamGeneratorOption MakeShortOption() {
+  StreamGeneratorOption option;
+  option.duration = 1000;
+  return option;
+}
+
+}  // namespace
+
+TEST(StreamGeneratorTest, Deterministic) {
+  auto option = MakeShortOption();
+  option.seed = 1;
+  const auto packets1 = Generate(option);
+  const auto packets2 = Generate(option);
+  option.seed = 2;
+  const auto packets3 = Generate(option);
+
+  ASSERT_EQ(packets1.size(), packets2.size());
+  ASSERT_EQ(packets1.size(), packets3.size());
+  bool differs = false;
+  for (size_t i = 0; i < packets1.size(); ++i) {
+    EXPECT_EQ(0, std::memcmp(packets1[i].b, packets2[i].b, ts::PKT_SIZE));
+    differs |= std::memcmp(packets1[i].b, packets3[i].b, ts::PKT_SIZE) != 0;
+  }
+  EXPECT_TRUE(differs);
+}
+
+TEST(StreamGeneratorTest, Bitrate) {
+  auto option = MakeShortOption();
+  option.mux_bitrate = 60000000;
+  const auto packets = Generate(option);
+  // ceil(60Mbps * 1s / (188 * 8))
+  EXPECT_EQ(39894, packets.size());
+}
+
+TEST(StreamGeneratorTest, ContinuityCounters) {
+  const auto packets = Generate(MakeShortOption());
+  std::map<ts::PID, uint8_t> counters;
+  size_t num_pcrs = 0;
+  for (const auto& packet : packets) {
+    ASSERT_EQ(ts::SYNC_BYTE, packet.b[0]);
+    const auto pid = packet.getPID();
+    if (pid == ts::PID_NULL) {
+      continue;
+    }
+    if (counters.count(pid) != 0) {
+      EXPECT_EQ((counters[pid] + 1) & 0x0F, packet.getCC());
+    }
+    counters[pid] = packet.getCC();
+    if (packet.hasPCR()) {
+      ++num_pcrs;
+    }
+  }
+  // 3 services * 25 PCRs/s
+  EXPECT_EQ(75, num_pcrs);
+}
+
+TEST(StreamGeneratorTest, Discontinuities) {
+  auto option = MakeShortOption();
+  option.discontinuity_rate = 1.0;
+  const auto packets = Generate(option);
+  std::map<ts::PID, uint8_t> counters;
+  for (const auto& packet : packets) {
+    const auto pid = packet.getPID();
+    if (pid < 0x0100 || pid >= 0x1000) {
+      continue;  // PSI/SI or null packets
+    }
+    if (counters.count(pid) != 0) {
+      EXPECT_EQ((counters[pid] + 2) & 0x0F, packet.getCC());
+    }
+    counters[pid] = packet.getCC();
+  }
+}
+
+TEST(StreamGeneratorTest, SyncLoss) {
+  auto option = MakeShortOption();
+  option.sync_loss_interval = 100;
+  const auto packets = Generate(option);
+  size_t num_broken_packets = 0;
+  for (const auto& packet : packets) {
+    if (packet.b[0] != ts::SYNC_BYTE) {
+      ++num_broken_packets;
+    }
+  }
+  // at 100ms, 200ms, ..., 900ms
+  EXPECT_EQ(9, num_broken_packets);
+}
+
+TEST(StreamGeneratorTest, ScanServices) {
+  StreamGenerator generator(MakeShortOption());
+  MockSource src;
+  auto scanner = std::make_unique<ServiceScanner>(ServiceScannerOption {});
+  auto sink = std::make_unique<MockJsonlSink>();
+
+  EXPECT_CALL(src, GetNextPacket).WillRepeatedly(
+      [&generator](ts::TSPacket* packet) {
+        return generator.Next(packet);
+      });
+  EXPECT_CALL(*sink, HandleDocument).WillOnce(
+      [](const rapidjson::Document& doc) {
+        EXPECT_TRUE(doc.IsArray());
+        EXPECT_EQ(3, doc.Size());
+        for (rapidjson::SizeType i = 0; i < doc.Size(); ++i) {
+          EXPECT_EQ(StreamGenerator::kNid, doc[i]["nid"].GetInt());
+          EXPECT_EQ(StreamGenerator::kTsid, doc[i]["tsid"].GetInt());
+          EXPECT_EQ(StreamGenerator::kBaseSid + i, doc[i]["sid"].GetUint());
+          EXPECT_EQ(1, doc[i]["type"].GetInt());
+          EXPECT_EQ(i, doc[i]["logoId"].GetUint());
+        }
+        return true;
+      });
+
+  scanner->Connect(std::move(sink));
+  src.Connect(std::move(scanner));
+  src.FeedPackets();
+}
@@ -131,7 +131,13 @@ class TableSource final : public PacketSource {
       table.fromXML(context_, node);
       table.setSourcePID(pid);
 
-      auto packetizer = std::make_unique<ts::CyclingPacketizer>(pid);
+      // A table larger than a packet is split into multiple packets.
+      auto num_packets =
+          (table.totalSize() + 1 + ts::PKT_SIZE - 5) / (ts::PKT_SIZE - 4);
+      auto packetizer = num_packets > 1 ?
+          std::make_unique<ts::CyclingPacketizer>(
+              pid, ts::CyclingPacketizer::ALWAYS) :
+          std::make_unique<ts::CyclingPacketizer>(pid);
       packetizer->addTable(table);
 
       ts::TSPacket packet;
@@ -158,6 +164,16 @@ class TableSource final : public PacketSource {
         }
       }
 
+      if (node->hasAttribute(u"test-rai")) {
+        packet.setPayloadSize(0);
+        packet.b[5] |= 0x40;  // random_access_indicator
+      }
+
+      if (node->hasAttribute(u"test-discontinuity")) {
+        packet.setPayloadSize(0);
+        packet.b[5] |= 0x80;  // discontinuity_indicator
+      }
+
       if (node->hasAttribute(u"test-sleep")) {
         uint8_t sleep_ms;
         node->getIntAttribute<uint8_t>(sleep_ms, u"test-sleep", false);
@@ -166,6 +182,18 @@ class TableSource final : public PacketSource {
       }
 
       packets_.push(std::move(packet));
+
+      // The CC is incremented for subsequent packets of a large table.
+      for (size_t i = 1; i < num_packets; ++i) {
+        ts::TSPacket next_packet;
+        packetizer->getNextPacket(next_packet);
+        if (node->hasAttribute(u"test-cc")) {
+          uint8_t cc;
+          node->getIntAttribute<uint8_t>(cc, u"test-cc", false, 0, 0x00, 0x0F);
+          next_packet.setCC(static_cast<uint8_t>((cc + i) & 0x0F));
+        }
+        packets_.push(std::move(next_packet));
+      }
     }
   }
 
@@ -0,0 +1,100 @@
+#include <memory>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <tsduck/tsduck.h>
+
+#include "threaded_sink.hh"
+
+#include "test_helper.hh"
+
+namespace {
+
+ts::TSPacket MakePacket(size_t i) {
+  ts::TSPacket packet = ts::NullPacket;
+  packet.setPID(static_cast<ts::PID>(i % ts::PID_NULL));
+  return packet;
+}
+
+}  // namespace
+
+TEST(ThreadedSinkTest, Order) {
+  constexpr size_t kNumPackets =
+      ThreadedSink::kBatchSize * ThreadedSink::kMaxBatches * 2 + 1;
+
+  auto sink = std::make_unique<MockSink>();
+  std::vector<ts::PID> pids;
+
+  {
+    testing::InSequence seq;
+    EXPECT_CALL(*sink, Start).WillOnce(testing::Return(true));
+    EXPECT_CALL(*sink, HandlePacket).Times(kNumPackets).WillRepeatedly(
+        [&pids](const ts::TSPacket& packet) {
+          pids.push_back(packet.getPID());
+          return true;
+        });
+    EXPECT_CALL(*sink, End).WillOnce(testing::Return(true));
+  }
+
+  ThreadedSink threaded(std::move(sink));
+  EXPECT_TRUE(threaded.Start());
+  for (size_t i = 0; i < kNumPackets; ++i) {
+    EXPECT_TRUE(threaded.HandlePacket(MakePacket(i)));
+  }
+  EXPECT_TRUE(threaded.End());
+
+  ASSERT_EQ(kNumPackets, pids.size());
+  for (size_t i = 0; i < kNumPackets; ++i) {
+    EXPECT_EQ(MakePacket(i).getPID(), pids[i]);
+  }
+}
+
+TEST(ThreadedSinkTest, Cancel) {
+  auto sink = std::make_unique<MockSink>();
+
+  {
+    testing::InSequence seq;
+    EXPECT_CALL(*sink, Start).WillOnce(testing::Return(true));
+    EXPECT_CALL(*sink, HandlePacket).Times(9).WillRepeatedly(
+        testing::Return(true));
+    EXPECT_CALL(*sink, HandlePacket).WillOnce(testing::Return(false));
+    EXPECT_CALL(*sink, End).WillOnce(testing::Return(false));
+  }
+
+  ThreadedSink threaded(std::move(sink));
+  EXPECT_TRUE(threaded.Start());
+  // The cancellation is noticed after the first batch has been processed.
+  size_t i = 0;
+  while (threaded.HandlePacket(MakePacket(i))) {
+    ++i;
+  }
+  EXPECT_LE(ThreadedSink::kBatchSize, i);
+  EXPECT_FALSE(threaded.End());
+}
+
+TEST(ThreadedSinkTest, StartFailure) {
+  auto sink = std::make_unique<MockSink>();
+
+  EXPECT_CALL(*sink, Start).WillOnce(testing::Return(false));
+  EXPECT_CALL(*sink, HandlePacket).Times(0);
+  EXPECT_CALL(*sink, End).Times(0);
+
+  ThreadedSink threaded(std::move(sink));
+  EXPECT_FALSE(threaded.Start());
+  EXPECT_FALSE(threaded.HandlePacket(MakePacket(0)));
+  EXPECT_FALSE(threaded.End());
+}
+
+TEST(ThreadedSinkTest, DestroyWithoutEnd) {
+  auto sink = std::make_unique<MockSink>();
+
+  {
+    testing::InSequence seq;
+    EXPECT_CALL(*sink, Start).WillOnce(testing::Return(true));
+    EXPECT_CALL(*sink, End).WillOnce(testing::Return(true));
+  }
+
+  ThreadedSink threaded(std::move(sink));
+  EXPECT_TRUE(threaded.Start());
+}
@@ -0,0 +1,149 @@
+#include <cstring>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <tsduck/tsduck.h>
+
+#include "tsduck_helper.hh"
+
+namespace {
+
+// Makes a packet starting a PES packet which contains `es`.
+ts::TSPacket MakePesPacket(const std::vector<uint8_t>& es) {
+  static const uint8_t kPesHeader[] = {
+    0x00, 0x00, 0x01, 0xE0, 0x00, 0x00, 0x80, 0x00, 0x00,
+  };
+  ts::TSPacket packet = ts::NullPacket;
+  packet.setPID(0x0100);
+  packet.setPUSI(true);
+  std::memcpy(packet.b + 4, kPesHeader, sizeof(kPesHeader));
+  std::memcpy(packet.b + 4 + sizeof(kPesHeader), es.data(), es.size());
+  return packet;
+}
+
+}  // namespace
+
+TEST(TsduckHelperTest, IsRandomAccessPointRai) {
+  ts::TSPacket packet = ts::NullPacket;
+  packet.setPID(0x0100);
+  packet.b[3] = 0x30;  // adaptation field and payload
+  packet.b[4] = 1;
+  packet.b[5] = 0x40;  // random_access_indicator
+  EXPECT_TRUE(IsRandomAccessPoint(packet, ts::ST_MPEG2_VIDEO));
+  packet.b[5] = 0x00;
+  EXPECT_FALSE(IsRandomAccessPoint(packet, ts::ST_MPEG2_VIDEO));
+}
+
+TEST(TsduckHelperTest, IsRandomAccessPointMpeg2) {
+  // sequence_header_code
+  auto packet = MakePesPacket({ 0x00, 0x00, 0x01, 0xB3 });
+  EXPECT_TRUE(IsRandomAccessPoint(packet, ts::ST_MPEG2_VIDEO));
+
+  // Not the first packet of the PES packet.
+  packet.setPUSI(false);
+  EXPECT_FALSE(IsRandomAccessPoint(packet, ts::ST_MPEG2_VIDEO));
+
+  // picture_start_code without sequence_header_code
+  packet = MakePesPacket({ 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0xB3 });
+  EXPECT_FALSE(IsRandomAccessPoint(packet, ts::ST_MPEG2_VIDEO));
+}
+
+TEST(TsduckHelperTest, IsRandomAccessPointAvc) {
+  // AUD, SPS
+  auto packet = MakePesPacket({
+    0x00, 0x00, 0x00, 0x01, 0x09, 0xF0, 0x00, 0x00, 0x00, 0x01, 0x67,
+  });
+  EXPECT_TRUE(IsRandomAccessPoint(packet, ts::ST_AVC_VIDEO));
+
+  // AUD, non-IDR slice
+  packet = MakePesPacket({
+    0x00, 0x00, 0x00, 0x01, 0x09, 0xF0, 0x00, 0x00, 0x00, 0x01, 0x41,
+  });
+  EXPECT_FALSE(IsRandomAccessPoint(packet, ts::ST_AVC_VIDEO));
+}
+
+TEST(TsduckHelperTest, IsRandomAccessPointHevc) {
+  // AUD, VPS
+  auto packet = MakePesPacket({
+    0x00, 0x00, 0x01, 0x46, 0x01, 0x10, 0x00, 0x00, 0x01, 0x40, 0x01,
+  });
+  EXPECT_TRUE(IsRandomAccessPoint(packet, ts::ST_HEVC_VIDEO));
+
+  // AUD, TRAIL_R
+  packet = MakePesPacket({
+    0x00, 0x00, 0x01, 0x46, 0x01, 0x10, 0x00, 0x00, 0x01, 0x02, 0x01,
+  });
+  EXPECT_FALSE(IsRandomAccessPoint(packet, ts::ST_HEVC_VIDEO));
+}
+
+TEST(TsduckHelperTest, IsRandomAccessPointUnsupportedStreamType) {
+  auto packet = MakePesPacket({ 0x00, 0x00, 0x01, 0xB3 });
+  EXPECT_FALSE(IsRandomAccessPoint(packet, 0x0F));
+}
+
+TEST(TsduckHelperTest, HasDiscontinuityIndicator) {
+  ts::TSPacket packet = ts::NullPacket;
+  packet.b[3] = 0x30;  // adaptation field and payload
+  packet.b[4] = 1;
+  packet.b[5] = 0x80;  // discontinuity_indicator
+  EXPECT_TRUE(HasDiscontinuityIndicator(packet));
+  EXPECT_FALSE(HasRandomAccessIndicator(packet));
+  packet.b[4] = 0;
+  EXPECT_FALSE(HasDiscontinuityIndicator(packet));
+}
+
+TEST(TsduckHelperTest, GetVideoFormatMpeg2) {
+  uint32_t format = 0;
+
+  // 1920x1080, 16:9, 29.97fps
+  auto packet = MakePesPacket({
+    0x00, 0x00, 0x01, 0xB3, 0x78, 0x04, 0x38, 0x34,
+  });
+  EXPECT_TRUE(GetVideoFormat(packet, ts::ST_MPEG2_VIDEO, &format));
+  EXPECT_EQ(0x78043834, format);
+
+  // 1440x1080, 16:9, 29.97fps
+  packet = MakePesPacket({
+    0x00, 0x00, 0x01, 0xB3, 0x5A, 0x04, 0x38, 0x34,
+  });
+  EXPECT_TRUE(GetVideoFormat(packet, ts::ST_MPEG2_VIDEO, &format));
+  EXPECT_EQ(0x5A043834, format);
+
+  // No sequence header.
+  packet = MakePesPacket({ 0x00, 0x00, 0x01, 0x00 });
+  EXPECT_FALSE(GetVideoFormat(packet, ts::ST_MPEG2_VIDEO, &format));
+}
+
+TEST(TsduckHelperTest, GetVideoFormatAvc) {
+  uint32_t format = 0;
+
+  // AUD, SPS (High profile, level 4.0)
+  auto packet = MakePesPacket({
+    0x00, 0x00, 0x00, 0x01, 0x09, 0xF0, 0x00, 0x00, 0x00, 0x01, 0x67, 0x64,
+    0x00, 0x28,
+  });
+  EXPECT_TRUE(GetVideoFormat(packet, ts::ST_AVC_VIDEO, &format));
+  EXPECT_EQ(0x6428, format);
+
+  // Non-IDR slice
+  packet = MakePesPacket({ 0x00, 0x00, 0x00, 0x01, 0x41 });
+  EXPECT_FALSE(GetVideoFormat(packet, ts::ST_AVC_VIDEO, &format));
+}
+
+TEST(TsduckHelperTest, GetAdtsFormat) {
+  uint32_t format = 0;
+
+  // AAC LC, 48kHz, stereo
+  auto packet = MakePesPacket({ 0xFF, 0xF1, 0x4C, 0x80 });
+  EXPECT_TRUE(GetAdtsFormat(packet, &format));
+  EXPECT_EQ(0x132, format);
+
+  // AAC LC, 48kHz, 5.1ch
+  packet = MakePesPacket({ 0xFF, 0xF1, 0x4D, 0x80 });
+  EXPECT_TRUE(GetAdtsFormat(packet, &format));
+  EXPECT_EQ(0x136, format);
+
+  // No syncword
+  packet = MakePesPacket({ 0x00, 0x00, 0x01, 0xB3 });
+  EXPECT_FALSE(GetAdtsFormat(packet, &format));
+}